@@ -0,0 +1,458 @@
+#include <cstring>
+#include <bitset>
+#include "AttackBatch.h"
+
+using namespace std;
+
+#if defined(__GNUC__)
+#define BATCH_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define BATCH_INLINE __forceinline
+#else
+#define BATCH_INLINE inline
+#endif
+
+// AVX2 and AVX-512 through the vector extensions of GCC and Clang, compiled per function for the target
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ATTACK_BATCH_X86
+typedef uint64_t U64x4 __attribute__((vector_size(32)));
+typedef uint64_t U64x8 __attribute__((vector_size(64)));
+#endif
+
+namespace {
+
+const uint64_t FILE_A = 0x0101010101010101ULL;
+const uint64_t FILE_B = FILE_A << 1;
+const uint64_t FILE_G = FILE_A << 6;
+const uint64_t FILE_H = FILE_A << 7;
+const uint64_t RANK_3 = 0xFFULL << 16;
+const uint64_t RANK_8 = 0xFFULL << 56;
+
+/* Positions are stored from the side to move point of view: boards with black to move are mirrored (ranks swapped,
+colors swapped), so the side to move always plays up the board as white. Bitboards of the side to move come first. */
+enum BitsIndex { bi_pawns = 0, bi_knights = 1, bi_diagonal = 2, bi_straight = 3, bi_king = 4, bi_them = 5, bi_count = 10 };
+
+BATCH_INLINE int popcount(const uint64_t x) {
+#if defined(__GNUC__)
+	return __builtin_popcountll(x);
+#else
+	return (int)bitset<64>(x).count();
+#endif
+}
+
+BATCH_INLINE uint64_t byte_swap(const uint64_t x) {
+#if defined(__GNUC__)
+	return __builtin_bswap64(x);
+#else
+	uint64_t r = 0;
+	for (int i = 0; i < 8; i++) {
+		r |= ((x >> (8 * i)) & 0xFF) << (8 * (7 - i));
+	}
+	return r;
+#endif
+}
+
+// Squares a shift by s can land on without wrapping around the a or h file
+constexpr uint64_t edge_mask(const int s) {
+	return ((s + 68) % 8) - 4 == 1 ? ~FILE_A
+		: ((s + 68) % 8) - 4 == 2 ? ~(FILE_A | FILE_B)
+		: ((s + 68) % 8) - 4 == -1 ? ~FILE_H
+		: ((s + 68) % 8) - 4 == -2 ? ~(FILE_G | FILE_H)
+		: ~0ULL;
+}
+
+/* The helpers work on uint64_t (one position) and on vectors of them (one position per lane). Results are returned
+through references, since vector values cannot be passed by value between functions compiled for different targets. */
+
+template <int S, class V>
+BATCH_INLINE void shift_raw(V& r, const V& a) {
+	if (S >= 0)
+		r = a << (S >= 0 ? S : -S);
+	else
+		r = a >> (S >= 0 ? S : -S);
+}
+
+// a moved s squares (up for positive s), dropping squares that would wrap around the board
+template <int S, class V>
+BATCH_INLINE void shift(V& r, const V& a) {
+	shift_raw<S>(r, a);
+	r &= edge_mask(S);
+}
+
+// Kogge-Stone: squares attacked by sliders moving in steps of s over empty, up to and including the first blocker
+template <int S, class V>
+BATCH_INLINE void slide(V& r, const V& sliders, const V& empty) {
+	V gen = sliders, pro = empty & edge_mask(S), t;
+	shift_raw<S>(t, gen);
+	gen |= pro & t;
+	shift_raw<S>(t, pro);
+	pro &= t;
+	shift_raw<2 * S>(t, gen);
+	gen |= pro & t;
+	shift_raw<2 * S>(t, pro);
+	pro &= t;
+	shift_raw<4 * S>(t, gen);
+	gen |= pro & t;
+	shift<S>(r, gen);
+}
+
+// All ones where a is not zero
+template <class V>
+BATCH_INLINE void nonzero(V& r, const V& a) {
+	r = (V)(a != 0);
+}
+
+template <>
+BATCH_INLINE void nonzero(uint64_t& r, const uint64_t& a) {
+	r = a ? ~0ULL : 0;
+}
+
+template <class V>
+BATCH_INLINE void knight_attacks(V& r, const V& knights) {
+	V t;
+	shift<17>(r, knights);
+	shift<15>(t, knights); r |= t;
+	shift<10>(t, knights); r |= t;
+	shift<6>(t, knights); r |= t;
+	shift<-6>(t, knights); r |= t;
+	shift<-10>(t, knights); r |= t;
+	shift<-15>(t, knights); r |= t;
+	shift<-17>(t, knights); r |= t;
+}
+
+template <class V>
+BATCH_INLINE void king_attacks(V& r, const V& king) {
+	V t;
+	shift<8>(r, king);
+	shift<-8>(t, king); r |= t;
+	shift<1>(t, king); r |= t;
+	shift<-1>(t, king); r |= t;
+	shift<9>(t, king); r |= t;
+	shift<7>(t, king); r |= t;
+	shift<-7>(t, king); r |= t;
+	shift<-9>(t, king); r |= t;
+}
+
+template <class V>
+BATCH_INLINE void slider_attacks(V& r, const V& diagonal, const V& straight, const V& empty) {
+	V t;
+	slide<8>(r, straight, empty);
+	slide<-8>(t, straight, empty); r |= t;
+	slide<1>(t, straight, empty); r |= t;
+	slide<-1>(t, straight, empty); r |= t;
+	slide<9>(t, diagonal, empty); r |= t;
+	slide<7>(t, diagonal, empty); r |= t;
+	slide<-7>(t, diagonal, empty); r |= t;
+	slide<-9>(t, diagonal, empty); r |= t;
+}
+
+template <class V>
+BATCH_INLINE void add_count(int* counts, const V& targets, const int weight = 1) {
+	uint64_t lanes[sizeof(V) / sizeof(uint64_t)];
+	memcpy(lanes, &targets, sizeof(V));
+	for (size_t i = 0; i < sizeof(V) / sizeof(uint64_t); i++) {
+		counts[i] += weight * popcount(lanes[i]);
+	}
+}
+
+/* Checks and pins along direction S from the king: a slider of the opponent as first blocker gives check (the ray up
+to it must be blocked), one of ours followed by such a slider is pinned to this line (axis). */
+template <int S, class V>
+BATCH_INLINE void king_ray(const V& king, const V& sliders, const V& us, const V& empty, V& checkers, V& check_line, V& pinned) {
+	V ray, back, hit, t;
+	slide<S>(ray, king, empty);
+	hit = ray & sliders;
+	checkers |= hit;
+	nonzero(t, hit);
+	check_line |= ray & t;
+	slide<-S>(back, sliders, empty);
+	pinned |= ray & back & us;
+}
+
+// Moves along direction S of the sliders that are not pinned, or pinned to this axis
+template <int S, class V>
+BATCH_INLINE void slider_moves(int* counts, const V& sliders, const V& pinned_other, const V& empty, const V& targets) {
+	V movers = sliders & ~pinned_other, t;
+	slide<S>(t, movers, empty);
+	add_count(counts, t & targets);
+}
+
+// Whether the king of the side to move is attacked, in a single position given by bits (see BitsIndex) and empty
+bool king_attacked(const uint64_t* bits, const uint64_t empty) {
+	const uint64_t* them = bits + bi_them;
+	uint64_t t, pawns;
+	knight_attacks(t, bits[bi_king]);
+	if (t & them[bi_knights])
+		return true;
+	shift<9>(pawns, bits[bi_king]);
+	shift<7>(t, bits[bi_king]);
+	if ((pawns | t) & them[bi_pawns])
+		return true;
+	slider_attacks(t, them[bi_diagonal], them[bi_straight], empty);
+	return (t & bits[bi_king]) != 0;
+}
+
+// En passant captures to ep that do not leave the king in check
+int en_passant_moves(const uint64_t* bits, const int ep) {
+	if (ep < 40 || ep >= 48)
+		return 0;
+	uint64_t target = 1ULL << ep, victim = target >> 8, left, right;
+	shift<-9>(left, target);
+	shift<-7>(right, target);
+	uint64_t capturers = (left | right) & bits[bi_pawns];
+	if (!(bits[bi_them + bi_pawns] & victim) || !capturers)
+		return 0;
+
+	uint64_t occupied = 0;
+	for (int i = 0; i < bi_count; i++) {
+		occupied |= bits[i];
+	}
+
+	int moves = 0;
+	uint64_t after[bi_count];
+	memcpy(after, bits, sizeof(after));
+	after[bi_them + bi_pawns] &= ~victim;
+	while (capturers) {
+		uint64_t from = capturers & (0 - capturers);
+		capturers ^= from;
+		if (!king_attacked(after, ~(occupied ^ from ^ victim ^ target)))
+			moves++;
+	}
+	return moves;
+}
+
+// Bitboards from the side to move point of view, into lane of bits
+void to_bits(const Board& b, uint64_t (*bits)[bi_count], const size_t lane) {
+	const bool black = b.side_to_move == EPieceColor::clr_black;
+	for (int sq = 0; sq < 64; sq++) {
+		int code = (int)b.square_list[sq];
+		if (code == (int)EPieceCode::epc_empty)
+			continue;
+		uint64_t bit = 1ULL << (black ? sq ^ 56 : sq);
+		uint64_t* side = bits[lane] + (((code & 8) != 0) != black ? bi_them : 0);
+		switch ((EPieceType)(code & 7)) {
+		case EPieceType::ept_wpawn:
+		case EPieceType::ept_bpawn:		side[bi_pawns] |= bit; break;
+		case EPieceType::ept_knight:	side[bi_knights] |= bit; break;
+		case EPieceType::ept_bishop:	side[bi_diagonal] |= bit; break;
+		case EPieceType::ept_rook:		side[bi_straight] |= bit; break;
+		case EPieceType::ept_queen:		side[bi_diagonal] |= bit; side[bi_straight] |= bit; break;
+		case EPieceType::ept_king:		side[bi_king] |= bit; break;
+		default:						break;
+		}
+	}
+}
+
+template <class V>
+BATCH_INLINE void load(V& r, const uint64_t (*bits)[bi_count], const int index) {
+	uint64_t lanes[sizeof(V) / sizeof(uint64_t)];
+	for (size_t i = 0; i < sizeof(V) / sizeof(uint64_t); i++) {
+		lanes[i] = bits[i][index];
+	}
+	memcpy(&r, lanes, sizeof(V));
+}
+
+// Up to one vector of positions: boards[0..n) into out, with V holding the lanes
+template <class V>
+BATCH_INLINE void attack_group(const Board* boards, const size_t n, BoardAttacks* out) {
+	const size_t LANES = sizeof(V) / sizeof(uint64_t);
+	uint64_t bits[LANES][bi_count];
+	memset(bits, 0, sizeof(bits));
+	for (size_t i = 0; i < n; i++) {
+		to_bits(boards[i], bits, i);
+	}
+
+	V pawns[2], knights[2], diagonal[2], straight[2], king[2], side[2];
+	for (int c = 0; c < 2; c++) {
+		load(pawns[c], bits, c * bi_them + bi_pawns);
+		load(knights[c], bits, c * bi_them + bi_knights);
+		load(diagonal[c], bits, c * bi_them + bi_diagonal);
+		load(straight[c], bits, c * bi_them + bi_straight);
+		load(king[c], bits, c * bi_them + bi_king);
+		side[c] = pawns[c] | knights[c] | diagonal[c] | straight[c] | king[c];
+	}
+	const V empty = ~(side[0] | side[1]);
+	V t, u;
+
+	// Attack sets; danger is where the king cannot go: the attacks of the opponent seen through the king
+	V attacks[2], danger;
+	for (int c = 0; c < 2; c++) {
+		if (c == 0) {
+			shift<9>(attacks[c], pawns[c]);
+			shift<7>(t, pawns[c]);
+		}
+		else {
+			shift<-7>(attacks[c], pawns[c]);
+			shift<-9>(t, pawns[c]);
+		}
+		attacks[c] |= t;
+		knight_attacks(t, knights[c]);
+		attacks[c] |= t;
+		king_attacks(t, king[c]);
+		attacks[c] |= t;
+		slider_attacks(t, diagonal[c], straight[c], empty);
+		attacks[c] |= t;
+	}
+	slider_attacks(t, diagonal[1], straight[1], empty | king[0]);
+	danger = attacks[1] | t;
+
+	// Checkers and pins, per axis: vertical, horizontal, diagonal (a1-h8), anti-diagonal (h1-a8)
+	V checkers, check_line = {}, pinned[4] = {};
+	knight_attacks(checkers, king[0]);
+	checkers &= knights[1];
+	shift<9>(t, king[0]);
+	shift<7>(u, king[0]);
+	checkers |= (t | u) & pawns[1];
+	king_ray<8>(king[0], straight[1], side[0], empty, checkers, check_line, pinned[0]);
+	king_ray<-8>(king[0], straight[1], side[0], empty, checkers, check_line, pinned[0]);
+	king_ray<1>(king[0], straight[1], side[0], empty, checkers, check_line, pinned[1]);
+	king_ray<-1>(king[0], straight[1], side[0], empty, checkers, check_line, pinned[1]);
+	king_ray<9>(king[0], diagonal[1], side[0], empty, checkers, check_line, pinned[2]);
+	king_ray<-9>(king[0], diagonal[1], side[0], empty, checkers, check_line, pinned[2]);
+	king_ray<7>(king[0], diagonal[1], side[0], empty, checkers, check_line, pinned[3]);
+	king_ray<-7>(king[0], diagonal[1], side[0], empty, checkers, check_line, pinned[3]);
+	const V pinned_any = pinned[0] | pinned[1] | pinned[2] | pinned[3];
+
+	// Without check every square will do, in check only capturing the checker or blocking
+	V check_mask;
+	nonzero(t, checkers);
+	check_mask = (t & (check_line | checkers)) | ~t;
+	const V targets = ~side[0] & check_mask;
+
+	int king_moves[LANES] = {}, moves[LANES] = {};
+	king_attacks(t, king[0]);
+	add_count(king_moves, t & ~side[0] & ~danger);
+
+	// Every target of a jump or slide in one direction is reached by one piece only, so counting squares counts moves
+	const V free_knights = knights[0] & ~pinned_any;
+	shift<17>(t, free_knights); add_count(moves, t & targets);
+	shift<15>(t, free_knights); add_count(moves, t & targets);
+	shift<10>(t, free_knights); add_count(moves, t & targets);
+	shift<6>(t, free_knights); add_count(moves, t & targets);
+	shift<-6>(t, free_knights); add_count(moves, t & targets);
+	shift<-10>(t, free_knights); add_count(moves, t & targets);
+	shift<-15>(t, free_knights); add_count(moves, t & targets);
+	shift<-17>(t, free_knights); add_count(moves, t & targets);
+
+	slider_moves<8>(moves, straight[0], pinned_any & ~pinned[0], empty, targets);
+	slider_moves<-8>(moves, straight[0], pinned_any & ~pinned[0], empty, targets);
+	slider_moves<1>(moves, straight[0], pinned_any & ~pinned[1], empty, targets);
+	slider_moves<-1>(moves, straight[0], pinned_any & ~pinned[1], empty, targets);
+	slider_moves<9>(moves, diagonal[0], pinned_any & ~pinned[2], empty, targets);
+	slider_moves<-9>(moves, diagonal[0], pinned_any & ~pinned[2], empty, targets);
+	slider_moves<7>(moves, diagonal[0], pinned_any & ~pinned[3], empty, targets);
+	slider_moves<-7>(moves, diagonal[0], pinned_any & ~pinned[3], empty, targets);
+
+	// Pawns: pushes and captures, promotions count four times
+	shift<8>(t, pawns[0] & ~(pinned_any & ~pinned[0]));
+	t &= empty;
+	shift<8>(u, t & RANK_3);
+	u &= empty & check_mask;
+	t &= check_mask;
+	add_count(moves, t);
+	add_count(moves, t & RANK_8, 3);
+	add_count(moves, u);
+	shift<9>(t, pawns[0] & ~(pinned_any & ~pinned[2]));
+	t &= side[1] & check_mask;
+	add_count(moves, t);
+	add_count(moves, t & RANK_8, 3);
+	shift<7>(t, pawns[0] & ~(pinned_any & ~pinned[3]));
+	t &= side[1] & check_mask;
+	add_count(moves, t);
+	add_count(moves, t & RANK_8, 3);
+
+	uint64_t lanes[4][LANES];
+	memcpy(lanes[0], &attacks[0], sizeof(V));
+	memcpy(lanes[1], &attacks[1], sizeof(V));
+	memcpy(lanes[2], &checkers, sizeof(V));
+	memcpy(lanes[3], &danger, sizeof(V));
+	for (size_t i = 0; i < n; i++) {
+		const Board& b = boards[i];
+		const bool black = b.side_to_move == EPieceColor::clr_black;
+		const uint64_t check = lanes[2][i];
+		int legal = king_moves[i];
+		if (popcount(check) < 2) {
+			legal += moves[i];
+			legal += en_passant_moves(bits[i], b.en_passant_square < 0 ? -1 : (black ? b.en_passant_square ^ 56 : b.en_passant_square));
+		}
+		if (!check) {
+			uint64_t occupied = 0;
+			for (int f = 0; f < bi_count; f++) {
+				occupied |= bits[i][f];
+			}
+			int rights = black ? b.castling_rights >> 2 : b.castling_rights;
+			if ((rights & cr_white_short) && !(occupied & 0x60) && !(lanes[3][i] & 0x60))
+				legal++;
+			if ((rights & cr_white_long) && !(occupied & 0x0E) && !(lanes[3][i] & 0x0C))
+				legal++;
+		}
+
+		out[i].attacks[black ? 1 : 0] = black ? byte_swap(lanes[0][i]) : lanes[0][i];
+		out[i].attacks[black ? 0 : 1] = black ? byte_swap(lanes[1][i]) : lanes[1][i];
+		out[i].checkers = black ? byte_swap(check) : check;
+		out[i].legal_moves = legal;
+	}
+}
+
+void batch_scalar(const Board* boards, const size_t count, BoardAttacks* out) {
+	for (size_t i = 0; i < count; i++) {
+		attack_group<uint64_t>(boards + i, 1, out + i);
+	}
+}
+
+#ifdef ATTACK_BATCH_X86
+
+__attribute__((target("avx2,popcnt")))
+void batch_avx2(const Board* boards, const size_t count, BoardAttacks* out) {
+	for (size_t i = 0; i < count; i += 4) {
+		attack_group<U64x4>(boards + i, min<size_t>(4, count - i), out + i);
+	}
+}
+
+__attribute__((target("avx512f,popcnt")))
+void batch_avx512(const Board* boards, const size_t count, BoardAttacks* out) {
+	for (size_t i = 0; i < count; i += 8) {
+		attack_group<U64x8>(boards + i, min<size_t>(8, count - i), out + i);
+	}
+}
+
+#endif
+
+}  // namespace
+
+SimdLevel simd_supported() {
+#ifdef ATTACK_BATCH_X86
+	static const SimdLevel level = __builtin_cpu_supports("avx512f") ? SimdLevel::sl_avx512
+		: __builtin_cpu_supports("avx2") ? SimdLevel::sl_avx2 : SimdLevel::sl_scalar;
+	return level;
+#else
+	return SimdLevel::sl_scalar;
+#endif
+}
+
+const char* simd_name(const SimdLevel level) {
+	switch (level) {
+	case SimdLevel::sl_avx2:	return "avx2";
+	case SimdLevel::sl_avx512:	return "avx512";
+	default:					return "scalar";
+	}
+}
+
+void attack_batch(const Board* boards, const size_t count, BoardAttacks* out, SimdLevel level) {
+	level = min(level, simd_supported());
+#ifdef ATTACK_BATCH_X86
+	if (level == SimdLevel::sl_avx512) {
+		batch_avx512(boards, count, out);
+		return;
+	}
+	if (level == SimdLevel::sl_avx2) {
+		batch_avx2(boards, count, out);
+		return;
+	}
+#endif
+	batch_scalar(boards, count, out);
+}
+
+void attack_batch(const Board* boards, const size_t count, BoardAttacks* out) {
+	attack_batch(boards, count, out, simd_supported());
+}
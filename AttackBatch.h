@@ -0,0 +1,38 @@
+/*
+ * AttackBatch.h
+ *
+ *  Attack sets, check status and legal move counts of many independent positions at once, for bulk work (labelling,
+ *  legality filtering, features) where setting up a Chess per position costs more than the answer. Positions are
+ *  converted to bitboards and processed in groups of 4 (AVX2) or 8 (AVX-512) with Kogge-Stone fills, one position per
+ *  64 bit lane; the same code runs on plain 64 bit integers as the fallback. The level is chosen from the CPU at run
+ *  time, so the engine binary needs no special compiler flags. Bitboards have bit n for square n (a1 = bit 0).
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "EnumList.h"
+
+enum class SimdLevel : uint8_t {
+	sl_scalar = 0,
+	sl_avx2 = 1,				// 4 positions per instruction
+	sl_avx512 = 2,				// 8 positions per instruction
+};
+
+struct BoardAttacks {
+	uint64_t attacks[2];		// Squares attacked by white [0] and by black [1]
+	uint64_t checkers;			// Pieces giving check to the side to move
+	int legal_moves;
+
+	bool in_check() const { return checkers != 0; }
+};
+
+// Best level supported by this CPU (and compiler)
+SimdLevel simd_supported();
+const char* simd_name(const SimdLevel level);
+
+/* Fill out[i] for boards[i], i < count. Levels above simd_supported() are lowered to it. The boards must be legal
+positions: one king each and the side not to move not in check. */
+void attack_batch(const Board* boards, const size_t count, BoardAttacks* out, SimdLevel level);
+void attack_batch(const Board* boards, const size_t count, BoardAttacks* out);
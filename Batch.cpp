@@ -0,0 +1,235 @@
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cctype>
+#include <algorithm>
+#include "Batch.h"
+#include "Chess.h"
+#include "Evaluate.h"
+#include "Numa.h"
+
+using namespace std;
+
+namespace {
+
+string json_string(const string& s) {
+	string r = "\"";
+	for (char ch : s) {
+		if (ch == '"' || ch == '\\')
+			r += '\\';
+		if ((unsigned char)ch < 0x20)
+			r += ' ';
+		else
+			r += ch;
+	}
+	return r + "\"";
+}
+
+bool is_number(const string& s) {
+	return !s.empty() && all_of(s.begin(), s.end(), [](char ch) { return isdigit((unsigned char)ch); });
+}
+
+// Only positions the move generator can handle: 8 ranks of 8 squares and Chess::is_legal_position
+bool valid_position(const string fields[4]) {
+	int ranks = 1, files = 0, kings[2] = {};
+	for (char ch : fields[0]) {
+		if (ch == '/') {
+			if (files != 8)
+				return false;
+			ranks++;
+			files = 0;
+		}
+		else if (ch >= '1' && ch <= '8')
+			files += ch - '0';
+		else if (string("pnbrqkPNBRQK").find(ch) != string::npos) {
+			files++;
+			if (ch == 'k' || ch == 'K')
+				kings[ch == 'k']++;
+		}
+		else
+			return false;
+		if (files > 8)
+			return false;
+	}
+	if (ranks != 8 || files != 8 || kings[0] != 1 || kings[1] != 1)
+		return false;
+	if (fields[1] != "w" && fields[1] != "b")
+		return false;
+	if (fields[2] != "-" && fields[2].find_first_not_of("KQkq") != string::npos)
+		return false;
+	if (fields[3] != "-" && !(fields[3].size() == 2 && fields[3][0] >= 'a' && fields[3][0] <= 'h'
+		&& (fields[3][1] == '3' || fields[3][1] == '6')))
+		return false;
+
+	Board b;
+	istringstream(fields[0] + " " + fields[1] + " " + fields[2] + " " + fields[3] + " 0 1") >> b;
+	return Chess::is_legal_position(b);
+}
+
+/* FEN (six fields) or EPD (four fields followed by operations, of which id is kept). Returns false if line is not
+a position. */
+bool parse_position(const string& line, string& fen, string& id) {
+	istringstream in(line);
+	string fields[6];
+	for (string& f : fields) {
+		in >> f;
+	}
+	if (fields[3].empty() || !valid_position(fields))
+		return false;
+
+	if (is_number(fields[4]) && is_number(fields[5]))
+		fen = fields[0] + " " + fields[1] + " " + fields[2] + " " + fields[3] + " " + fields[4] + " " + fields[5];
+	else {
+		fen = fields[0] + " " + fields[1] + " " + fields[2] + " " + fields[3] + " 0 1";
+		size_t pos = line.find(" id \"");
+		if (pos != string::npos) {
+			size_t end = line.find('"', pos + 5);
+			id = line.substr(pos + 5, end == string::npos ? string::npos : end - pos - 5);
+		}
+	}
+	return true;
+}
+
+string analyse(const BatchSettings& settings, Search& search, const uint64_t index, const string& line) {
+	string fen, id;
+	ostringstream r;
+	r << "{\"index\":" << index;
+	if (!parse_position(line, fen, id)) {
+		r << ",\"input\":" << json_string(line) << ",\"error\":\"invalid position\"}";
+		return r.str();
+	}
+	r << ",\"fen\":" << json_string(fen);
+	if (!id.empty())
+		r << ",\"id\":" << json_string(id);
+
+	auto start = chrono::steady_clock::now();
+	Chess c(fen);
+	switch (settings.mode) {
+	case BatchMode::bm_perft: {
+		// Root moves one by one: Chess::perft counts in an int
+		uint64_t nodes = 1;
+		if (settings.perft_depth > 0) {
+			nodes = 0;
+			vector<Move> moves = c.legal_moves();
+			for (const Move& mv : moves) {
+				c.do_move(mv);
+				nodes += (uint64_t)c.perft(settings.perft_depth - 1);
+				c.undo_last_moves(1, false);
+			}
+		}
+		r << ",\"depth\":" << settings.perft_depth << ",\"nodes\":" << nodes;
+		break;
+	}
+	case BatchMode::bm_eval:
+		r << ",\"eval\":" << evaluate(c.get_board());
+		break;
+	case BatchMode::bm_search: {
+		// Every position starts with an empty table, so results do not depend on the order of the work
+		search.clear();
+		SearchInfo info = search.go(c, settings.limits);
+		r << ",\"depth\":" << info.depth << ",\"seldepth\":" << info.seldepth;
+		if (Search::is_mate_score(info.score))
+			r << ",\"mate\":" << Search::mate_in(info.score);
+		else
+			r << ",\"cp\":" << info.score;
+		r << ",\"nodes\":" << info.nodes << ",\"bestmove\":";
+		if (info.pv.empty())
+			r << "null";
+		else
+			r << json_string(uci_move(info.pv.front()));
+		r << ",\"pv\":[";
+		for (size_t i = 0; i < info.pv.size(); i++) {
+			r << (i ? "," : "") << json_string(uci_move(info.pv[i]));
+		}
+		r << "]";
+		break;
+	}
+	}
+	r << ",\"time\":" << chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count() << "}";
+	return r.str();
+}
+
+}  // namespace
+
+/* The calling thread reads lines into a ring of window slots; workers take the oldest unstarted line and put their
+result in its slot, and whoever completes the oldest unwritten slot writes it and every completed slot after it.
+The reader waits while the window is full, which bounds memory to window lines however slow the head of the queue. */
+uint64_t run_batch(const BatchSettings& settings, std::istream& in, std::ostream& out) {
+	struct Slot {
+		string input;
+		string result;
+		bool done = false;
+	};
+
+	const int threads = max(1, settings.threads);
+	const size_t window = settings.window ? settings.window : 4 * (size_t)threads;
+	vector<Slot> slots(window);
+	uint64_t read = 0, started = 0, written = 0;
+	bool end_of_input = false;
+	mutex slots_mutex;
+	condition_variable work_ready, slot_free;
+
+	auto worker = [&](const int index) {
+		bind_thread(index);
+		Search search(settings.hash_mb);
+		unique_lock<mutex> lock(slots_mutex);
+		while (true) {
+			work_ready.wait(lock, [&]() { return started < read || end_of_input; });
+			if (started == read)
+				return;
+			uint64_t n = started++;
+			string input = slots[n % window].input;
+			lock.unlock();
+
+			string result = analyse(settings, search, n + 1, input);
+
+			lock.lock();
+			slots[n % window].result = move(result);
+			slots[n % window].done = true;
+			bool wrote = false;
+			while (written < started && slots[written % window].done) {
+				Slot& s = slots[written++ % window];
+				out << s.result << '\n';
+				s.done = false;
+				wrote = true;
+			}
+			if (wrote) {
+				out.flush();
+				slot_free.notify_one();
+			}
+		}
+	};
+
+	vector<thread> pool;
+	for (int t = 0; t < threads; t++) {
+		pool.emplace_back(worker, t);
+	}
+
+	string line;
+	while (getline(in, line)) {
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		size_t first = line.find_first_not_of(" \t");
+		if (first == string::npos || line[first] == '#')
+			continue;
+
+		unique_lock<mutex> lock(slots_mutex);
+		slot_free.wait(lock, [&]() { return read - written < window; });
+		slots[read % window].input = line.substr(first);
+		read++;
+		work_ready.notify_one();
+	}
+
+	{
+		lock_guard<mutex> lock(slots_mutex);
+		end_of_input = true;
+	}
+	work_ready.notify_all();
+	for (thread& t : pool) {
+		t.join();
+	}
+	return read;
+}
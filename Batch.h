@@ -0,0 +1,28 @@
+/*
+ * Batch.h
+ *
+ *  Non-interactive analysis of many positions: FEN or EPD lines are read from a stream, analysed by a pool of
+ *  threads (perft, static evaluation or a fixed depth/node search) and written as one JSON object per line, in the
+ *  order of the input. At most a small window of positions is in flight, so memory does not grow with the input.
+ */
+
+#pragma once
+
+#include <string>
+#include <iostream>
+#include "Search.h"
+
+enum class BatchMode { bm_perft, bm_eval, bm_search };
+
+struct BatchSettings {
+	BatchMode mode = BatchMode::bm_search;
+	int perft_depth = 1;
+	SearchLimits limits;			// Per position (bm_search)
+	int threads = 1;
+	size_t hash_mb = 16;			// Per thread
+	size_t window = 0;				// Positions in flight (0 for 4 per thread)
+};
+
+/* Analyse every position of in and write the results to out. Blank lines and lines starting with # are skipped;
+a line that is not a position gives an error object. Returns the number of positions read. */
+uint64_t run_batch(const BatchSettings& settings, std::istream& in, std::ostream& out);
@@ -6,10 +6,84 @@
 #include <algorithm>
 #include "EnumList.h"
 #include "Chess.h"
+#include "Stats.h"
+#include "Profile.h"
 #include <map>
+#include <stdexcept>
+#include <cstring>
 
 using namespace std;
 
+namespace {
+
+// Lookup tables for the incremental mode. Directions are ordered so that d ^ 1 is the opposite of direction d.
+//	RayStep -- Rank and file step of every direction
+//	RayMask -- Bitboard of the squares along each direction from every square (even directions run to higher squares)
+//	RayDirection -- Direction from one square to another (-1 if they are not on a common line)
+//	KnightMask -- Bitboard of the knight targets of every square
+//	SliderKind -- Per piece code the directions it slides in (bit 0 straight, bit 1 diagonal, bit 2 king)
+const int RayStep[8][2] = { {0, 1}, {0, -1}, {1, 0}, {-1, 0}, {1, 1}, {-1, -1}, {1, -1}, {-1, 1} };
+uint64_t RayMask[64][8];
+int8_t RayDirection[64][64];
+uint64_t KnightMask[64];
+uint8_t SliderKind[16];
+
+struct RayInit {
+	RayInit() {
+		const int jumps[8][2] = { {-2, -1}, {-2, 1}, {-1, -2}, {-1, 2}, {1, -2}, {1, 2}, {2, -1}, {2, 1} };
+		memset(RayDirection, -1, sizeof(RayDirection));
+		for (int sq = 0; sq < 64; sq++) {
+			int r = sq / 8, f = sq % 8;
+			for (int d = 0; d < 8; d++) {
+				RayMask[sq][d] = 0;
+				for (int rr = r + RayStep[d][0], ff = f + RayStep[d][1]; rr >= 0 && rr < 8 && ff >= 0 && ff < 8; rr += RayStep[d][0], ff += RayStep[d][1]) {
+					RayMask[sq][d] |= 1ULL << (rr * 8 + ff);
+					RayDirection[sq][rr * 8 + ff] = d;
+				}
+			}
+			KnightMask[sq] = 0;
+			for (const auto& j : jumps) {
+				if (r + j[0] >= 0 && r + j[0] < 8 && f + j[1] >= 0 && f + j[1] < 8)
+					KnightMask[sq] |= 1ULL << ((r + j[0]) * 8 + f + j[1]);
+			}
+		}
+		for (EPieceColor clr : {EPieceColor::clr_white, EPieceColor::clr_black}) {
+			SliderKind[(int)ept2epc(EPieceType::ept_rook, clr)] = 1;
+			SliderKind[(int)ept2epc(EPieceType::ept_bishop, clr)] = 2;
+			SliderKind[(int)ept2epc(EPieceType::ept_queen, clr)] = 3;
+			SliderKind[(int)ept2epc(EPieceType::ept_king, clr)] = 4;
+		}
+	}
+} ray_init;
+
+// Index of the lowest set bit of x (x != 0)
+inline int lowest_bit(const uint64_t x) {
+#if defined(__GNUC__)
+	return __builtin_ctzll(x);
+#else
+	int i = 0;
+	while (!((x >> i) & 1)) {
+		i++;
+	}
+	return i;
+#endif
+}
+
+// Index of the highest set bit of x (x != 0)
+inline int highest_bit(const uint64_t x) {
+#if defined(__GNUC__)
+	return 63 - __builtin_clzll(x);
+#else
+	int i = 63;
+	while (!((x >> i) & 1)) {
+		i--;
+	}
+	return i;
+#endif
+}
+
+}
+
 // Constructors
 Chess::Chess(const std::string& fen) {
 	istringstream(fen) >> pos;
@@ -23,6 +97,26 @@ Chess::Chess(const std::string& fen) {
 	// Initialize pseudolegal_moves
 	pseudolegal_moves.reserve(100);
 	generate_pseudolegal_moves(pseudolegal_moves);
+
+	// Preallocate stack for copy-make mode
+	pos_stack.reserve(256);
+
+	if (incremental_moves)
+		init_move_lists();
+}
+
+void Chess::set_copy_make(const bool enable) {
+	// Only switch on an empty history, otherwise pos_stack and move_history get out of sync
+	if (!move_history.empty()) {
+		throw std::logic_error("Cannot switch make/unmake strategy with moves in history");
+	}
+	copy_make = enable;
+}
+
+void Chess::set_incremental_moves(const bool enable) {
+	incremental_moves = enable;
+	if (incremental_moves)
+		init_move_lists();
 }
 
 
@@ -30,36 +124,40 @@ Chess::Chess(const std::string& fen) {
 void Chess::generate_pseudolegal_moves(vector<Move>& res) {
 	for (int i = 0; i < 64; i++) {
 		if (get_clr(pos.square_list[i]) != pos.side_to_move) continue;
+		gen_square(res, i);
+	}
+}
 
-		int r = i / 8;
-		int f = i % 8;
-
-		switch (get_ept(pos.square_list[i])) {
-		case EPieceType::ept_queen:
-			gen_rooklike(res, i, r, f);
-			gen_bishoplike(res, i, r, f);
-			break;
-		case EPieceType::ept_rook:
-			gen_rooklike(res, i, r, f);
-			break;
-		case EPieceType::ept_bishop:
-			gen_bishoplike(res, i, r, f);
-			break;
-		case EPieceType::ept_king:
-			gen_king(res, i, r, f);
-			break;
-		case EPieceType::ept_knight:
-			gen_knight(res, i, r, f);
-			break;
-		case EPieceType::ept_wpawn:
-			gen_wpawn(res, i, r, f);
-			break;
-		case EPieceType::ept_bpawn:
-			gen_bpawn(res, i, r, f);
-			break;
-		default:
-			break;
-		}
+// Generate the pseudolegal moves of the piece on square i (assumes it belongs to the side to move)
+void Chess::gen_square(vector<Move>& res, const int i) {
+	int r = i / 8;
+	int f = i % 8;
+
+	switch (get_ept(pos.square_list[i])) {
+	case EPieceType::ept_queen:
+		gen_rooklike(res, i, r, f);
+		gen_bishoplike(res, i, r, f);
+		break;
+	case EPieceType::ept_rook:
+		gen_rooklike(res, i, r, f);
+		break;
+	case EPieceType::ept_bishop:
+		gen_bishoplike(res, i, r, f);
+		break;
+	case EPieceType::ept_king:
+		gen_king(res, i, r, f);
+		break;
+	case EPieceType::ept_knight:
+		gen_knight(res, i, r, f);
+		break;
+	case EPieceType::ept_wpawn:
+		gen_wpawn(res, i, r, f);
+		break;
+	case EPieceType::ept_bpawn:
+		gen_bpawn(res, i, r, f);
+		break;
+	default:
+		break;
 	}
 }
 
@@ -85,44 +183,49 @@ void Chess::add_move(vector<Move>& move_list, int from, int to, bool capture, EP
 
 	mv.capture = capt;
 
+	mv.lost_castle_rights = lost_castling_rights(from, to, moving_piece, capt);
+
+	move_list.push_back(mv);
+}
+
+// Castling rights that are lost (given the current castling rights) when moving_piece moves from -> to capturing capt
+CastlingRights Chess::lost_castling_rights(const int from, const int to, const EPieceCode moving_piece, const EPieceCode capt) {
+	return pos.castling_rights & castling_mask(from, to, moving_piece, capt);
+}
+
+// All castling rights that can be affected when moving_piece moves from -> to capturing capt (regardless of current rights)
+CastlingRights Chess::castling_mask(const int from, const int to, const EPieceCode moving_piece, const EPieceCode capt) {
+	CastlingRights mask = CastlingRights::cr_none;
+
 	// Lose castling rights after king or rook move
 	if (moving_piece == EPieceCode::epc_wking)
-		mv.lost_castle_rights = pos.castling_rights & CastlingRights::cr_white_both;
+		mask = CastlingRights::cr_white_both;
 	else if (moving_piece == EPieceCode::epc_bking)
-		mv.lost_castle_rights = pos.castling_rights & CastlingRights::cr_black_both;
+		mask = CastlingRights::cr_black_both;
 	else if (moving_piece == EPieceCode::epc_wrook) {
 		if (from == 0)
-			mv.lost_castle_rights = pos.castling_rights & CastlingRights::cr_white_long;
+			mask = CastlingRights::cr_white_long;
 		else if (from == 7)
-			mv.lost_castle_rights = pos.castling_rights & CastlingRights::cr_white_short;
+			mask = CastlingRights::cr_white_short;
 	}
 	else if (moving_piece == EPieceCode::epc_brook) {
 		if (from == 56)
-			mv.lost_castle_rights = pos.castling_rights & CastlingRights::cr_black_long;
+			mask = CastlingRights::cr_black_long;
 		else if (from == 63)
-			mv.lost_castle_rights = pos.castling_rights & CastlingRights::cr_black_short;
+			mask = CastlingRights::cr_black_short;
 	}
-	else
-		mv.lost_castle_rights = CastlingRights::cr_none;
 
 	// Additionally, lose castling rights after rook is captured
-	if (capture) {
-		if (to == 63 && capt == EPieceCode::epc_brook) {
-			mv.lost_castle_rights = mv.lost_castle_rights ^ (pos.castling_rights & CastlingRights::cr_black_short);
-		}
-		else if (to == 56 && capt == EPieceCode::epc_brook) {
-			mv.lost_castle_rights = mv.lost_castle_rights ^ (pos.castling_rights & CastlingRights::cr_black_long);
-		}
-		else if (to == 7 && capt == EPieceCode::epc_wrook) {
-			mv.lost_castle_rights = mv.lost_castle_rights ^ (pos.castling_rights & CastlingRights::cr_white_short);
-		}
-		else if (to == 0 && capt == EPieceCode::epc_wrook) {
-			mv.lost_castle_rights = mv.lost_castle_rights ^ (pos.castling_rights & CastlingRights::cr_white_long);
-		}
-
-	}
-
-	move_list.push_back(mv);
+	if (to == 63 && capt == EPieceCode::epc_brook)
+		mask = mask ^ CastlingRights::cr_black_short;
+	else if (to == 56 && capt == EPieceCode::epc_brook)
+		mask = mask ^ CastlingRights::cr_black_long;
+	else if (to == 7 && capt == EPieceCode::epc_wrook)
+		mask = mask ^ CastlingRights::cr_white_short;
+	else if (to == 0 && capt == EPieceCode::epc_wrook)
+		mask = mask ^ CastlingRights::cr_white_long;
+
+	return mask;
 }
 
 bool Chess::is_on_board(const int r, const int f, const int dr, const int df) {
@@ -279,7 +382,8 @@ void Chess::print_pseudolegal_moves() {
 }
 
 void Chess::print_board() {
-	cout << "FEN: " << pos << std::endl << std::endl;
+	cout << "FEN: " << pos << std::endl;
+	cout << "Status: " << game_status() << (in_check() ? " (in check)" : "") << std::endl << std::endl;
 
 	for (int r = 7; r >= 0; r--) {
 		cout << "+---+---+---+---+---+---+---+---+" << std::endl;
@@ -296,56 +400,33 @@ void Chess::print_board() {
 // Attempt to do move m. Responsible for checking if (pseudo)legal, and if so, update pseudolegal moves and in_check. Returns succes flag.
 bool Chess::do_move(const Move& mv) {
 	EPieceCode moving_piece = pos.square_list[mv.from];
-	update_board(mv);
-	vector<Move> new_moves{};
-	new_moves.reserve(100);
-	generate_pseudolegal_moves(new_moves);
-
-	// Check if move was legal
-
-	// First, check if any move can simply capture the king (i.e. was left or put in check)
-	for (Move &new_mv : new_moves) {
-		if (get_ept(new_mv.capture) == EPieceType::ept_king) {
-			revert_board(mv);
-			return false;
-		}
+	{
+		ProfileScope scope(ph_make);
+		if (copy_make)
+			pos_stack.push_back(pos);
+		update_board(mv);
 	}
-
-	// If move was castle, check if castle was not FROM or THROUGH check
-	if (get_ept(moving_piece) == EPieceType::ept_king && abs(mv.to - mv.from)==2) {
-		int through_sq = (mv.to + mv.from)/2;
-
-		// Check Non-pawn pieces -- they can pseudolegally move to the FROM or THROUGH square when they attack them.
-		for (Move &new_mv : new_moves) {
-			if (pos.square_list[new_mv.from] != EPieceCode::epc_wpawn &&
-				pos.square_list[new_mv.from] != EPieceCode::epc_bpawn &&
-				(new_mv.to == mv.from || new_mv.to == through_sq))
-			{
-				revert_board(mv);
-				return false;
-			}
-		}
-
-		// Check if white pawn pieces attack blacks FROM or THROUGH squares
-		if (through_sq/8 == 7) {
-			for(int i : {through_sq - 7, through_sq - 9, mv.from - 7, mv.from - 9}) {
-				if (pos.square_list[i] == EPieceCode::epc_wpawn) {
-					revert_board(mv);
-					return false;
-				}
-			}
-		}
-		// Check if black pawn pieces attack whites FROM or THROUGH squares
+	vector<Move> new_moves{};
+	{
+		ProfileScope scope(ph_generate);
+		if (incremental_moves)
+			update_move_lists(mv);
 		else {
-			for(int i : {through_sq + 7, through_sq + 9, mv.from + 7, mv.from + 9}) {
-				if (pos.square_list[i] == EPieceCode::epc_bpawn) {
-					revert_board(mv);
-					return false;
-				}
-			}
+			new_moves.reserve(100);
+			generate_pseudolegal_moves(new_moves);
 		}
 	}
+	// Moves of the opponent after mv (the new side to move)
+	const vector<Move>& opponent_moves = incremental_moves ? move_lists[list_ply + 2] : new_moves;
+	Stats::add(st_move_generations);
+	Stats::add(st_moves_generated, opponent_moves.size());
 
+	// Check if move was legal
+	if (leaves_king_attacked(mv, moving_piece, opponent_moves)) {
+		restore_board(mv);
+		Stats::add(st_illegal_moves);
+		return false;
+	}
 
 	// Move was legal!
 
@@ -356,7 +437,7 @@ bool Chess::do_move(const Move& mv) {
 	}
 
 	if (mv.promotion != EPieceCode::epc_empty) {
-		if(mv.to == 7) {
+		if(mv.to / 8 == 7) {
 			piece_count[(int)mv.promotion]++;
 			piece_count[(int)EPieceCode::epc_wpawn]--;
 		}
@@ -370,19 +451,79 @@ bool Chess::do_move(const Move& mv) {
 	// Update move history
 	move_history.push_back(mv);
 
-	// Update pseudolegal moves (already calculated)
-	pseudolegal_moves = std::move(new_moves);
+	// Update pseudolegal moves (already calculated). In incremental mode the mover's list is parked in its slot and
+	// the opponent's new list is taken out of the next one.
+	if (incremental_moves) {
+		std::swap(pseudolegal_moves, move_lists[list_ply + 1]);
+		list_ply++;
+		std::swap(pseudolegal_moves, move_lists[list_ply + 1]);
+	}
+	else
+		pseudolegal_moves = std::move(new_moves);
 
 	return true;
 }
 
-// Undo last n moves in move_history
+// True if pseudolegal Move mv (already made, new_moves generated for the opponent) left or put the own king in check,
+// or castled from or through check
+bool Chess::leaves_king_attacked(const Move& mv, const EPieceCode moving_piece, const vector<Move>& new_moves) const {
+	ProfileScope scope(ph_legality);
+
+	// First, check if any move can simply capture the king (i.e. was left or put in check)
+	for (const Move &new_mv : new_moves) {
+		if (get_ept(new_mv.capture) == EPieceType::ept_king)
+			return true;
+	}
+
+	// If move was castle, check if castle was not FROM or THROUGH check
+	if (get_ept(moving_piece) == EPieceType::ept_king && abs(mv.to - mv.from)==2) {
+		int through_sq = (mv.to + mv.from)/2;
+
+		// Check Non-pawn pieces -- they can pseudolegally move to the FROM or THROUGH square when they attack them.
+		for (const Move &new_mv : new_moves) {
+			if (pos.square_list[new_mv.from] != EPieceCode::epc_wpawn &&
+				pos.square_list[new_mv.from] != EPieceCode::epc_bpawn &&
+				(new_mv.to == mv.from || new_mv.to == through_sq))
+				return true;
+		}
+
+		// Check if white pawn pieces attack blacks FROM or THROUGH squares
+		if (through_sq/8 == 7) {
+			for(int i : {through_sq - 7, through_sq - 9, mv.from - 7, mv.from - 9}) {
+				if (pos.square_list[i] == EPieceCode::epc_wpawn)
+					return true;
+			}
+		}
+		// Check if black pawn pieces attack whites FROM or THROUGH squares
+		else {
+			for(int i : {through_sq + 7, through_sq + 9, mv.from + 7, mv.from + 9}) {
+				if (pos.square_list[i] == EPieceCode::epc_bpawn)
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Undo last n moves in move_history. In incremental mode the lists of the previous ply are always restored, since
+// that only swaps vectors.
 void Chess::undo_last_moves(const int n, const bool recalc_pseudolegal_moves) {
+	bool reinit_lists = false;
 	for (int i = n; i > 0 && !move_history.empty(); i--) {
 		Move mv = move_history.back();
 		move_history.pop_back();
 
-		revert_board(mv);
+		restore_board(mv);
+
+		if (incremental_moves) {
+			if (list_ply > 0) {
+				std::swap(pseudolegal_moves, move_lists[list_ply + 1]);
+				list_ply--;
+				std::swap(pseudolegal_moves, move_lists[list_ply + 1]);
+			}
+			else
+				reinit_lists = true;  // Move was done before incremental mode was switched on
+		}
 
 		// revert piece_count
 		if (mv.capture != EPieceCode::epc_empty) {
@@ -391,7 +532,7 @@ void Chess::undo_last_moves(const int n, const bool recalc_pseudolegal_moves) {
 		}
 
 		if (mv.promotion != EPieceCode::epc_empty) {
-			if(mv.to == 7) {
+			if(mv.to / 8 == 7) {
 				piece_count[(int)mv.promotion]--;
 				piece_count[(int)EPieceCode::epc_wpawn]++;
 			}
@@ -402,8 +543,18 @@ void Chess::undo_last_moves(const int n, const bool recalc_pseudolegal_moves) {
 			}
 		}
 	}
-	if (recalc_pseudolegal_moves)
+	if (move_notation.size() > move_history.size())
+		move_notation.resize(move_history.size());
+
+	if (reinit_lists) {
+		ProfileScope scope(ph_generate);
+		init_move_lists();
+	}
+	else if (recalc_pseudolegal_moves && !incremental_moves) {
+		ProfileScope scope(ph_generate);
+		pseudolegal_moves.clear();
 		generate_pseudolegal_moves(pseudolegal_moves);
+	}
 }
 
 // No checking nothing, just modify Board struct pos by performing Move mv
@@ -460,6 +611,17 @@ void Chess::update_board(const Move& mv) {
 		pos.full_move_count++;
 }
 
+// Undo Move mv on pos, either by popping the saved copy (copy-make) or by reverting the move (make/unmake)
+void Chess::restore_board(const Move& mv) {
+	ProfileScope scope(ph_unmake);
+	if (copy_make) {
+		pos = pos_stack.back();
+		pos_stack.pop_back();
+	}
+	else
+		revert_board(mv);
+}
+
 void Chess::revert_board(const Move& mv) {
 	EPieceCode moved_piece = pos.square_list[mv.to];
 
@@ -511,22 +673,53 @@ bool Chess::do_move(unsigned int n) {
 	return do_move(pseudolegal_moves[n-1]);
 }
 
+bool Chess::do_move(const std::string& uci) {
+	for (const Move& mv : pseudolegal_moves) {
+		if (uci_move(mv) == uci) {
+			Move m = mv;  // do_move replaces pseudolegal_moves
+			return do_move(m);
+		}
+	}
+	return false;
+}
+
+std::vector<Move> Chess::legal_moves() {
+	vector<Move> res;
+
+	// Make copy since moving changes pseudolegal_moves
+	vector<Move> current_pseudo = pseudolegal_moves;
+	for (const Move& mv : current_pseudo) {
+		if (do_move(mv)) {
+			res.push_back(mv);
+			undo_last_moves(1, false);
+		}
+	}
+	pseudolegal_moves = std::move(current_pseudo);
+
+	return res;
+}
+
 
 int Chess::perft(const unsigned int n, const bool split, const bool progress) {
 	if (n == 0) {
+		Stats::add(st_perft_leaves);
 		return 1;
 	}
 
 	int nodes = 0;
 
 
-	// Make copy since moving changes pseudolegal_moves
-	vector<Move> current_pseudo = pseudolegal_moves;
+	// Make copy since moving changes pseudolegal_moves. In incremental mode undo restores the same list, so it is
+	// iterated in place.
+	vector<Move> current_pseudo;
+	if (!incremental_moves)
+		current_pseudo = pseudolegal_moves;
+	const vector<Move>& moves = incremental_moves ? pseudolegal_moves : current_pseudo;
 
 	map<string, int> splits;
 
-	float sz = (float)current_pseudo.size();
-	for (size_t i = 0; i != current_pseudo.size(); i++) {
+	float sz = (float)moves.size();
+	for (size_t i = 0; i != moves.size(); i++) {
 		if (progress) {
 			std::cout << "[";
 			int pos = 70 * (i/sz);
@@ -539,7 +732,7 @@ int Chess::perft(const unsigned int n, const bool split, const bool progress) {
 			std::cout.flush();
 		}
 
-		Move mv = current_pseudo[i];
+		Move mv = moves[i];
 		if (do_move(mv)){
 			int add = perft(n-1);
 			nodes += add;
@@ -560,8 +753,711 @@ int Chess::perft(const unsigned int n, const bool split, const bool progress) {
 		cout << x.first << ": " << x.second << endl;
 	}
 
-	pseudolegal_moves = std::move(current_pseudo);
+	if (!incremental_moves)
+		pseudolegal_moves = std::move(current_pseudo);
 
 	return nodes;
 
 }
+
+
+// Incremental move generation ------------------------------------------------------------------
+
+// Start the move lists from scratch at ply 0: pseudolegal_moves for the side to move and the opponent's moves in
+// move_lists[0]
+void Chess::init_move_lists() {
+	list_ply = 0;
+	if (move_lists.size() < 2) {
+		move_lists.resize(2);
+		list_affected.resize(2);
+	}
+	list_affected[0] = AffectedSquares();
+
+	AffectedSquares all;
+	all.squares = ~0ULL;
+	pseudolegal_moves.clear();
+	generate_pseudolegal_moves(pseudolegal_moves);
+	splice_moves(vector<Move>(), move_lists[0], !pos.side_to_move, all);
+}
+
+/* Pieces whose moves can be changed by (un)doing Move mv. Works the same after update_board and after revert_board,
+since the set of changed squares is identical. All moves of a piece have to be regenerated if:
+	1) it stands on a changed square (from, to, castling rook squares, en passant victim)
+	2) it is a king next to or on a clear line with a changed square (castling depends on the squares between king and
+	   rook, and castling rights only change when a changed square is on such a line)
+	3) it is a knight, or a pawn pushing or capturing onto a changed square
+A slider whose ray reaches a changed square without passing another piece only gets that ray regenerated. */
+void Chess::affected_squares(const Move& mv, AffectedSquares& res) {
+	int changed[4] = { mv.from, mv.to, -1, -1 };
+	int n_changed = 2;
+
+	// The moved piece is on the to square after update_board and on the from square after revert_board
+	EPieceCode moved_piece = pos.square_list[mv.from] != EPieceCode::epc_empty ? pos.square_list[mv.from] : pos.square_list[mv.to];
+	if (get_ept(moved_piece) == EPieceType::ept_king && abs(mv.to - mv.from) == 2) {
+		if (mv.to > mv.from) {   // Short castle
+			changed[n_changed++] = mv.from + 3;
+			changed[n_changed++] = mv.to - 1;
+		}
+		else {   // Long castle
+			changed[n_changed++] = mv.from - 4;
+			changed[n_changed++] = mv.to + 1;
+		}
+	}
+	else if (mv.en_passant) {
+		changed[n_changed++] = (mv.to > mv.from) ? mv.to - 8 : mv.to + 8;
+	}
+
+	uint64_t occupied = 0;
+	for (int i = 0; i < 64; i++) {
+		occupied |= (uint64_t)(pos.square_list[i] != EPieceCode::epc_empty) << i;
+	}
+
+	res.squares = 0;
+	res.partial = 0;
+	for (int c = 0; c < n_changed; c++) {
+		int sq = changed[c];
+		res.squares |= 1ULL << sq;
+
+		// Sliders and kings: the first piece along each ray from the changed square
+		for (int d = 0; d < 8; d++) {
+			uint64_t blockers = RayMask[sq][d] & occupied;
+			if (!blockers) continue;
+			int target = (d % 2 == 0) ? lowest_bit(blockers) : highest_bit(blockers);
+			uint8_t kind = SliderKind[(int)pos.square_list[target]];
+			if (kind & 4)
+				res.squares |= 1ULL << target;
+			else if (kind & (d >= 4 ? 2 : 1)) {
+				if (!(res.partial & (1ULL << target)))
+					res.rays[target] = 0;
+				res.partial |= 1ULL << target;
+				res.rays[target] |= 1 << (d ^ 1);  // The ray from the slider back to sq
+			}
+		}
+
+		// Knights
+		for (uint64_t bits = KnightMask[sq] & occupied; bits; bits &= bits - 1) {
+			int target = lowest_bit(bits);
+			if (pos.square_list[target] == EPieceCode::epc_wknight || pos.square_list[target] == EPieceCode::epc_bknight)
+				res.squares |= 1ULL << target;
+		}
+
+		// Pawns that push or capture onto the changed square
+		for (int offset : {8, 16, 7, 9}) {
+			if (sq - offset >= 0 && pos.square_list[sq - offset] == EPieceCode::epc_wpawn)
+				res.squares |= 1ULL << (sq - offset);
+			if (sq + offset < 64 && pos.square_list[sq + offset] == EPieceCode::epc_bpawn)
+				res.squares |= 1ULL << (sq + offset);
+		}
+	}
+}
+
+/* Build the move list of ply list_ply + 1 after Move mv was made (pos is already updated). The new side to move last
+had a list one ply earlier, so only the pieces affected by mv or by the move before it are regenerated. The affected
+squares of both moves can be combined: a piece that moved since stands on a changed square of mv, which is regenerated
+entirely. The existing lists stay untouched, so undo and an illegal mv only have to step back. */
+void Chess::update_move_lists(const Move& mv) {
+	size_t next = list_ply + 1;
+	if (move_lists.size() < next + 2) {
+		move_lists.resize(std::max(next + 2, 2 * move_lists.size()));
+		list_affected.resize(move_lists.size());
+	}
+	AffectedSquares& affected = list_affected[next];
+	affected_squares(mv, affected);
+
+	// Combine with the move before
+	const AffectedSquares& before = list_affected[list_ply];
+	AffectedSquares both;
+	both.squares = affected.squares | before.squares;
+	both.partial = (affected.partial | before.partial) & ~both.squares;
+	for (uint64_t bits = both.partial; bits; bits &= bits - 1) {
+		int i = lowest_bit(bits);
+		both.rays[i] = ((affected.partial >> i) & 1 ? affected.rays[i] : 0) | ((before.partial >> i) & 1 ? before.rays[i] : 0);
+	}
+
+	splice_moves(move_lists[list_ply], move_lists[next + 1], pos.side_to_move, both);
+}
+
+/* Copy the moves of color clr from old_moves to output, replacing the moves of the affected pieces (or their affected
+rays) by freshly generated ones. The copied moves are patched with the state dependent fields of the current position
+(castling rights only ever shrink along a line, so the lost rights can be masked). En passant captures are dropped and
+added again for the side to move only. */
+void Chess::splice_moves(const vector<Move>& old_moves, vector<Move>& res, const EPieceColor clr, const AffectedSquares& affected) {
+	res.resize(old_moves.size());
+	Move* out = res.data();
+	for (const Move& mv : old_moves) {
+		if ((affected.squares & (1ULL << mv.from)) || mv.en_passant) continue;
+		if ((affected.partial & (1ULL << mv.from)) && (affected.rays[mv.from] & (1 << RayDirection[mv.from][mv.to]))) continue;
+		*out = mv;
+		out->old_en_passant_square = pos.en_passant_square;
+		out->old_halfmove_count = pos.half_move_count;
+		out->lost_castle_rights = mv.lost_castle_rights & pos.castling_rights;
+		out++;
+	}
+	res.resize(out - res.data());
+
+	// Regenerate the affected pieces and rays as if clr is to move and without en passant
+	EPieceColor old_side_to_move = pos.side_to_move;
+	int8_t old_en_passant_square = pos.en_passant_square;
+	pos.side_to_move = clr;
+	pos.en_passant_square = -1;
+
+	size_t first = res.size();
+	for (uint64_t bits = affected.squares | affected.partial; bits; bits &= bits - 1) {
+		int i = lowest_bit(bits);
+		if (get_clr(pos.square_list[i]) != clr) continue;
+
+		if (affected.squares & (1ULL << i))
+			gen_square(res, i);
+		else {
+			for (int d = 0; d < 8; d++) {
+				if (affected.rays[i] & (1 << d))
+					gen_raymoves(res, i, i / 8, i % 8, RayStep[d][0], RayStep[d][1]);
+			}
+		}
+	}
+
+	pos.side_to_move = old_side_to_move;
+	pos.en_passant_square = old_en_passant_square;
+	for (size_t j = first; j < res.size(); j++) {
+		res[j].old_en_passant_square = pos.en_passant_square;
+	}
+
+	// En passant captures
+	int ep = pos.en_passant_square;
+	if (ep != -1 && clr == pos.side_to_move) {
+		int f = ep % 8;
+		if (pos.side_to_move == EPieceColor::clr_white) {
+			if (f != 0 && pos.square_list[ep - 9] == EPieceCode::epc_wpawn)
+				add_move(res, ep - 9, ep, true, EPieceCode::epc_empty, true);
+			if (f != 7 && pos.square_list[ep - 7] == EPieceCode::epc_wpawn)
+				add_move(res, ep - 7, ep, true, EPieceCode::epc_empty, true);
+		}
+		else {
+			if (f != 0 && pos.square_list[ep + 7] == EPieceCode::epc_bpawn)
+				add_move(res, ep + 7, ep, true, EPieceCode::epc_empty, true);
+			if (f != 7 && pos.square_list[ep + 9] == EPieceCode::epc_bpawn)
+				add_move(res, ep + 9, ep, true, EPieceCode::epc_empty, true);
+		}
+	}
+}
+
+
+// Game termination ---------------------------------------------------------------------------
+
+// Returns true if square sq is attacked by a piece of color clr
+bool Chess::is_attacked(const int sq, const EPieceColor clr) {
+	int r = sq / 8;
+	int f = sq % 8;
+
+	// Pawns
+	if (clr == EPieceColor::clr_white) {
+		if (r > 0 && f > 0 && pos.square_list[sq - 9] == EPieceCode::epc_wpawn) return true;
+		if (r > 0 && f < 7 && pos.square_list[sq - 7] == EPieceCode::epc_wpawn) return true;
+	}
+	else {
+		if (r < 7 && f > 0 && pos.square_list[sq + 7] == EPieceCode::epc_bpawn) return true;
+		if (r < 7 && f < 7 && pos.square_list[sq + 9] == EPieceCode::epc_bpawn) return true;
+	}
+
+	// Knights
+	EPieceCode knight = ept2epc(EPieceType::ept_knight, clr);
+	for (int dr : {-2, -1, 1, 2}) {
+		for (int df = -3 + abs(dr); df <= 3 - abs(dr); df += 2 * (3 - abs(dr))) {
+			if (is_on_board(r, f, dr, df) && pos.square_list[(r + dr) * 8 + f + df] == knight)
+				return true;
+		}
+	}
+
+	// Sliders and king: first piece along each ray
+	for (int dr = -1; dr <= 1; dr++) {
+		for (int df = -1; df <= 1; df++) {
+			if (dr == 0 && df == 0) continue;
+			bool diagonal = (dr != 0 && df != 0);
+
+			int dist = 1;
+			while (is_on_board(r, f, dr * dist, df * dist)) {
+				EPieceCode piece = pos.square_list[sq + dist * (dr * 8 + df)];
+				if (piece != EPieceCode::epc_empty) {
+					if (get_clr(piece) == clr) {
+						EPieceType ept = get_ept(piece);
+						if (ept == EPieceType::ept_queen ||
+							(ept == EPieceType::ept_rook && !diagonal) ||
+							(ept == EPieceType::ept_bishop && diagonal) ||
+							(ept == EPieceType::ept_king && dist == 1))
+							return true;
+					}
+					break;
+				}
+				dist++;
+			}
+		}
+	}
+
+	return false;
+}
+
+// Square of the king of color clr (-1 if there is none)
+int Chess::king_square(const EPieceColor clr) {
+	EPieceCode king = ept2epc(EPieceType::ept_king, clr);
+	for (int i = 0; i < 64; i++) {
+		if (pos.square_list[i] == king)
+			return i;
+	}
+	return -1;
+}
+
+// True if the side to move is in check
+bool Chess::in_check() {
+	int ksq = king_square(pos.side_to_move);
+	return ksq != -1 && is_attacked(ksq, !pos.side_to_move);
+}
+
+// Returns true if the side to move has at least one legal move. Stops at the first legal move found, trying king
+// moves first and then the cheap pieces. Moves are tested with update_board/revert_board and is_attacked, so
+// pseudolegal_moves, move_history and the copy-make/incremental state are left untouched.
+bool Chess::has_legal_move() {
+	EPieceColor us = pos.side_to_move;
+	EPieceColor them = !us;
+	int ksq = king_square(us);
+
+	// Group squares by piece type, in the order in which they are tried: king, pawns, knights, bishops, rooks, queens
+	int squares[6][16];
+	int n_squares[6] = {};
+	for (int i = 0; i < 64; i++) {
+		if (get_clr(pos.square_list[i]) != us) continue;
+
+		int group;
+		switch (get_ept(pos.square_list[i])) {
+		case EPieceType::ept_king:		group = 0; break;
+		case EPieceType::ept_wpawn:
+		case EPieceType::ept_bpawn:		group = 1; break;
+		case EPieceType::ept_knight:	group = 2; break;
+		case EPieceType::ept_bishop:	group = 3; break;
+		case EPieceType::ept_rook:		group = 4; break;
+		default:						group = 5; break;
+		}
+		if (n_squares[group] < 16)
+			squares[group][n_squares[group]++] = i;
+	}
+
+	vector<Move> moves;
+	moves.reserve(32);
+
+	for (int group = 0; group < 6; group++) {
+		for (int j = 0; j < n_squares[group]; j++) {
+			int i = squares[group][j];
+			moves.clear();
+			gen_square(moves, i);
+
+			for (const Move& mv : moves) {
+				bool is_king = (i == ksq);
+
+				// Castling may not start from or pass through check
+				if (is_king && abs(mv.to - mv.from) == 2) {
+					if (is_attacked(mv.from, them) || is_attacked((mv.from + mv.to) / 2, them))
+						continue;
+				}
+
+				update_board(mv);
+				bool legal = ksq == -1 || !is_attacked(is_king ? mv.to : ksq, them);
+				revert_board(mv);
+
+				if (legal)
+					return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+// True if neither side can possibly checkmate: K vs K, K+minor vs K, and K+B(s) vs K+B(s) with all bishops on the same color
+bool Chess::insufficient_material() {
+	for (EPieceCode epc : {EPieceCode::epc_wpawn, EPieceCode::epc_bpawn, EPieceCode::epc_wrook, EPieceCode::epc_brook,
+						   EPieceCode::epc_wqueen, EPieceCode::epc_bqueen}) {
+		if (piece_count[(int)epc])
+			return false;
+	}
+
+	int knights = piece_count[(int)EPieceCode::epc_wknight] + piece_count[(int)EPieceCode::epc_bknight];
+	int bishops = piece_count[(int)EPieceCode::epc_wbishop] + piece_count[(int)EPieceCode::epc_bbishop];
+
+	if (knights + bishops <= 1)
+		return true;
+	if (knights > 0)
+		return false;
+
+	// Only bishops left: draw if they all live on the same square color
+	int square_colors[2] = { 0, 0 };
+	for (int i = 0; i < 64; i++) {
+		if (get_ept(pos.square_list[i]) == EPieceType::ept_bishop)
+			square_colors[(i / 8 + i % 8) % 2]++;
+	}
+	return square_colors[0] == 0 || square_colors[1] == 0;
+}
+
+// Determine if the game has ended in the current position (checkmate and stalemate take precedence over the draw rules)
+EGameStatus Chess::game_status() {
+	if (!has_legal_move())
+		return in_check() ? EGameStatus::gs_checkmate : EGameStatus::gs_stalemate;
+	if (insufficient_material())
+		return EGameStatus::gs_insufficient_material;
+	if (pos.half_move_count >= 100)
+		return EGameStatus::gs_fifty_moves;
+	return EGameStatus::gs_ongoing;
+}
+
+
+// Retrograde analysis --------------------------------------------------------------------------
+
+// Replace the position by b and forget the history
+void Chess::set_position(const Board& b) {
+	pos = b;
+	init_pos = b;
+	move_history.clear();
+	move_notation.clear();
+	pos_stack.clear();
+
+	fill(begin(piece_count), end(piece_count), 0);
+	for (const EPieceCode piece : pos.square_list) {
+		piece_count[(int)piece]++;
+	}
+
+	pseudolegal_moves.clear();
+	generate_pseudolegal_moves(pseudolegal_moves);
+
+	if (incremental_moves)
+		init_move_lists();
+}
+
+// True if both sides have one king, no pawn is on the first or last rank, the castling rights and en passant square
+// match the pieces and the side not to move is not in check
+bool Chess::is_legal_position() {
+	return is_valid_board(pos) && !is_attacked(king_square(!pos.side_to_move), pos.side_to_move);
+}
+
+bool Chess::is_legal_position(const Board& b) {
+	if (!is_valid_board(b))
+		return false;
+	Chess c;
+	c.set_position(b);
+	return c.is_legal_position();
+}
+
+bool Chess::is_valid_board(const Board& b) {
+	const EPieceCode* sq = b.square_list;
+	int kings[2] = {};
+	for (int i = 0; i < 64; i++) {
+		if (sq[i] == EPieceCode::epc_wking)
+			kings[0]++;
+		else if (sq[i] == EPieceCode::epc_bking)
+			kings[1]++;
+		else if ((sq[i] == EPieceCode::epc_wpawn || sq[i] == EPieceCode::epc_bpawn) && (i < 8 || i >= 56))
+			return false;
+	}
+	if (kings[0] != 1 || kings[1] != 1)
+		return false;
+
+	// Every castling right needs its king and rook on their home squares
+	const struct { CastlingRights right; int king, rook; EPieceCode king_code, rook_code; } castles[4] = {
+		{ cr_white_short, 4, 7, EPieceCode::epc_wking, EPieceCode::epc_wrook },
+		{ cr_white_long, 4, 0, EPieceCode::epc_wking, EPieceCode::epc_wrook },
+		{ cr_black_short, 60, 63, EPieceCode::epc_bking, EPieceCode::epc_brook },
+		{ cr_black_long, 60, 56, EPieceCode::epc_bking, EPieceCode::epc_brook },
+	};
+	for (const auto& c : castles) {
+		if ((b.castling_rights & c.right) && (sq[c.king] != c.king_code || sq[c.rook] != c.rook_code))
+			return false;
+	}
+
+	// The en passant square is behind a pawn of the side not to move that just moved two squares
+	if (b.en_passant_square != -1) {
+		const int ep = b.en_passant_square;
+		const bool white_to_move = b.side_to_move == EPieceColor::clr_white;
+		if (ep < 0 || ep > 63 || ep / 8 != (white_to_move ? 5 : 2))
+			return false;
+		const int pawn = white_to_move ? ep - 8 : ep + 8;
+		const int origin = white_to_move ? ep + 8 : ep - 8;
+		if (sq[pawn] != (white_to_move ? EPieceCode::epc_bpawn : EPieceCode::epc_wpawn) ||
+			sq[ep] != EPieceCode::epc_empty || sq[origin] != EPieceCode::epc_empty)
+			return false;
+	}
+	return true;
+}
+
+// Legal moves of the side to move, tested with update_board/revert_board and is_attacked like has_legal_move
+void Chess::generate_legal_moves(vector<Move>& res) {
+	int ksq = king_square(pos.side_to_move);
+
+	for (const Move& mv : pseudolegal_moves) {
+		if (is_legal(mv, ksq))
+			res.push_back(mv);
+	}
+}
+
+bool Chess::is_legal(const Move& mv, const int ksq) {
+	EPieceColor them = !pos.side_to_move;
+	bool is_king = (mv.from == ksq);
+
+	// Castling may not start from or pass through check
+	if (is_king && abs(mv.to - mv.from) == 2) {
+		if (is_attacked(mv.from, them) || is_attacked((mv.from + mv.to) / 2, them))
+			return false;
+	}
+
+	update_board(mv);
+	bool legal = ksq == -1 || !is_attacked(is_king ? mv.to : ksq, them);
+	revert_board(mv);
+	return legal;
+}
+
+/* Moves by which the side not to move could have reached the current position without capturing or promoting.
+Pieces move back along their own move pattern (which is symmetric, except for pawns, which step back one or two
+ranks). Castling and en passant rights are ignored: the predecessor has neither. Unmoves after which the side to
+move now would be in check while the other side is to move are skipped. */
+void Chess::generate_unmoves(vector<Move>& res) {
+	EPieceColor us = pos.side_to_move;
+	EPieceColor them = !us;
+
+	Board saved = pos;
+	pos.side_to_move = them;
+	pos.castling_rights = cr_none;
+	pos.en_passant_square = -1;
+
+	vector<Move> piece_moves;
+	piece_moves.reserve(32);
+
+	for (int i = 0; i < 64; i++) {
+		EPieceCode piece = pos.square_list[i];
+		if (get_clr(piece) != them)
+			continue;
+
+		piece_moves.clear();
+		EPieceType ept = get_ept(piece);
+
+		if (ept == EPieceType::ept_wpawn || ept == EPieceType::ept_bpawn) {
+			int dir = (ept == EPieceType::ept_wpawn) ? -8 : 8;
+			int start_rank = (ept == EPieceType::ept_wpawn) ? 1 : 6;
+
+			int sq = i + dir;
+			if (sq / 8 != 0 && sq / 8 != 7 && pos.square_list[sq] == EPieceCode::epc_empty) {
+				piece_moves.push_back(Move{ sq, i });
+				sq += dir;
+				if (sq / 8 == start_rank && pos.square_list[sq] == EPieceCode::epc_empty)
+					piece_moves.push_back(Move{ sq, i });
+			}
+		}
+		else {
+			// Generate forward moves from i and reverse the quiet ones
+			gen_square(piece_moves, i);
+			piece_moves.erase(remove_if(piece_moves.begin(), piece_moves.end(), [](const Move& mv) {
+				return mv.capture != EPieceCode::epc_empty || mv.promotion != EPieceCode::epc_empty; }), piece_moves.end());
+			for (Move& mv : piece_moves) {
+				mv = Move{ mv.to, mv.from };
+			}
+		}
+
+		for (Move& mv : piece_moves) {
+			mv.old_en_passant_square = -1;
+			mv.old_halfmove_count = 0;
+			mv.capture = EPieceCode::epc_empty;
+			mv.promotion = EPieceCode::epc_empty;
+			mv.en_passant = false;
+			mv.lost_castle_rights = cr_none;
+
+			// In the predecessor it is the other side's turn, so our king may not be attacked there
+			EPieceCode moved = pos.square_list[mv.to];
+			pos.square_list[mv.from] = moved;
+			pos.square_list[mv.to] = EPieceCode::epc_empty;
+			bool legal = !is_attacked(king_square(us), them);
+			pos.square_list[mv.to] = moved;
+			pos.square_list[mv.from] = EPieceCode::epc_empty;
+
+			if (legal)
+				res.push_back(mv);
+		}
+	}
+
+	pos = saved;
+}
+
+// Position after Move mv (the current position is left untouched)
+Board Chess::board_after(const Move& mv) {
+	Board saved = pos;
+	update_board(mv);
+	Board res = pos;
+	pos = saved;
+	return res;
+}
+
+// Position before an unmove from generate_unmoves (the current position is left untouched)
+Board Chess::board_before(const Move& unmove) {
+	Board saved = pos;
+	revert_board(unmove);
+	Board res = pos;
+	pos = saved;
+	return res;
+}
+
+
+// Notation -------------------------------------------------------------------------------------
+
+std::string Chess::san(const Move& mv) {
+	EPieceCode moving_piece = pos.square_list[mv.from];
+	EPieceType ept = get_ept(moving_piece);
+	bool is_pawn = (ept == EPieceType::ept_wpawn || ept == EPieceType::ept_bpawn);
+	string res;
+
+	if (ept == EPieceType::ept_king && abs(mv.to - mv.from) == 2) {
+		res = (mv.to > mv.from) ? "O-O" : "O-O-O";
+	}
+	else {
+		const char piece_letters[] = " PPNBRQK";
+		if (!is_pawn) {
+			res += piece_letters[(int)ept];
+
+			// Disambiguate between pieces of the same type that can reach the same square
+			vector<Move> legal;
+			generate_legal_moves(legal);
+			bool ambiguous = false, same_file = false, same_rank = false;
+			for (const Move& other : legal) {
+				if (other.to != mv.to || other.from == mv.from || pos.square_list[other.from] != moving_piece)
+					continue;
+				ambiguous = true;
+				same_file |= (other.from % 8 == mv.from % 8);
+				same_rank |= (other.from / 8 == mv.from / 8);
+			}
+			if (ambiguous) {
+				string from = square_name(mv.from);
+				if (!same_file)
+					res += from[0];
+				else if (!same_rank)
+					res += from[1];
+				else
+					res += from;
+			}
+		}
+
+		if (mv.capture != EPieceCode::epc_empty) {
+			if (is_pawn)
+				res += square_name(mv.from)[0];
+			res += 'x';
+		}
+		res += square_name(mv.to);
+
+		if (mv.promotion != EPieceCode::epc_empty) {
+			res += '=';
+			res += piece_letters[(int)get_ept(mv.promotion)];
+		}
+	}
+
+	// Check and mate suffix
+	Move m = mv;
+	if (do_move(m)) {
+		if (in_check())
+			res += has_legal_move() ? '+' : '#';
+		undo_last_moves(1);
+	}
+	return res;
+}
+
+/* Parse SAN like e4, exd5, Nbd7, R1e2, Qh4xe1, e8=Q, e8Q, O-O-O or 0-0 (with optional +, #, !, ? suffixes). The
+piece, target square, promotion and given from file/rank are matched against the pseudolegal moves, and only the
+candidates are tested for legality. */
+bool Chess::parse_san(const std::string& text, Move& res) {
+	size_t len = text.size();
+	while (len > 0 && (text[len - 1] == '+' || text[len - 1] == '#' || text[len - 1] == '!' || text[len - 1] == '?')) {
+		len--;
+	}
+	string s = text.substr(0, len);
+	int ksq = king_square(pos.side_to_move);
+
+	// Castling
+	if (s == "O-O" || s == "0-0" || s == "O-O-O" || s == "0-0-0") {
+		int to = ksq + (s.size() == 3 ? 2 : -2);
+		for (const Move& mv : pseudolegal_moves) {
+			if (mv.from == ksq && mv.to == to && is_legal(mv, ksq)) {
+				res = mv;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Promotion piece (e8=Q or e8Q)
+	EPieceType promotion = EPieceType::ept_pnil;
+	if (len >= 3 && string("NBRQ").find(s[len - 1]) != string::npos) {
+		const char* letters = " PPNBRQK";
+		promotion = (EPieceType)(strchr(letters + 3, s[len - 1]) - letters);
+		len -= (s[len - 2] == '=') ? 2 : 1;
+	}
+	if (len < 2)
+		return false;
+
+	// Target square is the last two characters, the piece letter and disambiguation precede it
+	int to_file = s[len - 2] - 'a', to_rank = s[len - 1] - '1';
+	if (to_file < 0 || to_file > 7 || to_rank < 0 || to_rank > 7)
+		return false;
+	int to = to_rank * 8 + to_file;
+
+	size_t i = 0;
+	EPieceType piece = EPieceType::ept_pnil;  // Pawn
+	switch (s[0]) {
+	case 'N': piece = EPieceType::ept_knight; i++; break;
+	case 'B': piece = EPieceType::ept_bishop; i++; break;
+	case 'R': piece = EPieceType::ept_rook; i++; break;
+	case 'Q': piece = EPieceType::ept_queen; i++; break;
+	case 'K': piece = EPieceType::ept_king; i++; break;
+	default: break;
+	}
+
+	int from_file = -1, from_rank = -1;
+	for (; i < len - 2; i++) {
+		if (s[i] >= 'a' && s[i] <= 'h')
+			from_file = s[i] - 'a';
+		else if (s[i] >= '1' && s[i] <= '8')
+			from_rank = s[i] - '1';
+		else if (s[i] != 'x' && s[i] != '-' && s[i] != ':')
+			return false;
+	}
+
+	bool found = false;
+	for (const Move& mv : pseudolegal_moves) {
+		EPieceType ept = get_ept(pos.square_list[mv.from]);
+		bool is_pawn = (ept == EPieceType::ept_wpawn || ept == EPieceType::ept_bpawn);
+		if (mv.to != to || (piece == EPieceType::ept_pnil ? !is_pawn : ept != piece))
+			continue;
+		if ((from_file != -1 && mv.from % 8 != from_file) || (from_rank != -1 && mv.from / 8 != from_rank))
+			continue;
+		if ((promotion == EPieceType::ept_pnil) != (mv.promotion == EPieceCode::epc_empty) ||
+			(promotion != EPieceType::ept_pnil && get_ept(mv.promotion) != promotion))
+			continue;
+		if (!is_legal(mv, ksq))
+			continue;
+
+		// Ambiguous
+		if (found)
+			return false;
+		res = mv;
+		found = true;
+	}
+	return found;
+}
+
+bool Chess::do_san_move(const std::string& text) {
+	Move mv;
+	return parse_san(text, mv) && do_move(mv);
+}
+
+const std::vector<std::string>& Chess::get_move_notation() {
+	if (move_notation.size() < move_history.size()) {
+		// Replay the moves without notation yet from the position before the first of them
+		Chess replay = *this;
+		replay.undo_last_moves((int)(move_history.size() - move_notation.size()));
+		for (size_t i = move_notation.size(); i < move_history.size(); i++) {
+			move_notation.push_back(replay.san(move_history[i]));
+			replay.do_move(move_history[i]);
+		}
+	}
+	return move_notation;
+}
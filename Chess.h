@@ -7,6 +7,18 @@
 #include <stack>
 #include "EnumList.h"
 
+// Default make/unmake strategy for new Chess objects. Build with -DCHESS_COPY_MAKE=1 to make copy-make the default
+// on platforms where it is faster (compare with "myperft compare").
+#ifndef CHESS_COPY_MAKE
+#define CHESS_COPY_MAKE 0
+#endif
+
+// Default move list maintenance for new Chess objects. Build with -DCHESS_INCREMENTAL_MOVES=1 to only regenerate
+// the moves of pieces affected by a move instead of all pseudolegal moves.
+#ifndef CHESS_INCREMENTAL_MOVES
+#define CHESS_INCREMENTAL_MOVES 0
+#endif
+
 class Chess {
 	/* Main Chess class.
 	Keeps the state of board and is responsible for:
@@ -31,9 +43,57 @@ public:
 
 	bool do_move(unsigned int n);
 
+	// Attempt to do move given in UCI notation (e.g. e2e4, e7e8q). Returns succes flag.
+	bool do_move(const std::string& uci);
+
+	// All legal moves in the current position
+	std::vector<Move> legal_moves();
+
+	const Board& get_board() const { return pos; }
+	const Board& get_init_board() const { return init_pos; }
+	const std::vector<Move>& get_move_history() const { return move_history; }
+	const std::vector<Move>& get_pseudolegal_moves() const { return pseudolegal_moves; }
+
+	// Standard algebraic notation of legal move mv in the current position (e.g. Nbd7, exd6, e8=Q+, O-O-O#)
+	std::string san(const Move& mv);
+	// Find the legal move written in standard algebraic notation (check marks and annotations are ignored). Returns succes flag.
+	bool parse_san(const std::string& san, Move& mv);
+	// Attempt to do move given in standard algebraic notation. Returns succes flag.
+	bool do_san_move(const std::string& san);
+	// Played moves in standard algebraic notation (computed when asked for)
+	const std::vector<std::string>& get_move_notation();
+
 	// Undo last n moves in move_history
 	void undo_last_moves(const int n=1, const bool recalc_pseudolegal_moves=true);
 
+	// Game termination. has_legal_move stops at the first legal move found; game_status reports checkmate,
+	// stalemate, insufficient material and the fifty move rule.
+	bool in_check();
+	bool has_legal_move();
+	bool insufficient_material();
+	EGameStatus game_status();
+
+	// Retrograde analysis (tablebase generation). set_position replaces the position and clears the history,
+	// generate_unmoves lists the non-capturing, non-promoting moves by which the side not to move could have
+	// reached the current position (from/to as in the forward move, so the predecessor is board_before(unmove)).
+	void set_position(const Board& b);
+	bool is_legal_position();
+	// Same for a Board that may not be safe to search (e.g. parsed from a FEN): checked before any move is generated
+	static bool is_legal_position(const Board& b);
+	void generate_legal_moves(std::vector<Move>& output);
+	void generate_unmoves(std::vector<Move>& output);
+	Board board_after(const Move& mv);
+	Board board_before(const Move& unmove);
+
+	// Switch between copy-make (save a copy of the Board on pos_stack for every move) and make/unmake (revert_board)
+	void set_copy_make(const bool enable);
+	bool get_copy_make() const { return copy_make; }
+
+	// Switch between incremental updates of the pseudolegal moves (only affected pieces are regenerated) and full
+	// regeneration after every move
+	void set_incremental_moves(const bool enable);
+	bool get_incremental_moves() const { return incremental_moves; }
+
 private:
 	/* Members ---------------------------------------------
 	pos -- Current Board representation of the board
@@ -46,6 +106,16 @@ private:
 	init_pos -- Save initial position
 	move_history -- Sequence of played moves (Move objects stored)
 	move_notation -- Sequence of played moves (String, written in algebraic chess notation)
+
+	copy_make -- If true, moves are undone by restoring a saved copy of pos instead of calling revert_board
+	pos_stack -- Preallocated stack of Board copies, one per move in move_history (only used in copy-make mode)
+
+	incremental_moves -- If true, the move list of every ply is kept and a move only splices the moves of affected pieces
+		into the list the new side to move had two plies earlier, undo steps back to the list of the previous ply
+	move_lists -- Pseudolegal moves of the side to move at ply p in move_lists[p + 1] (the current one is swapped out into
+		pseudolegal_moves). move_lists[0] holds the opponent's moves at ply 0, without en passant
+	list_affected -- Pieces affected by the move that led to ply p (none for ply 0)
+	list_ply -- Current ply in move_lists (0 is the position in which incremental mode was switched on)
 	 */
 
 	// Current state tracking members
@@ -58,15 +128,38 @@ private:
 	// History tracking members
 	Board init_pos;
 	std::vector<Move> move_history{};
-	std::vector<std::string> move_notation{};  // TODO: Implement
+	std::vector<std::string> move_notation{};  // Filled by get_move_notation, truncated on undo
+
+	// Copy-make members
+	bool copy_make = CHESS_COPY_MAKE;
+	std::vector<Board> pos_stack{};
+
+	// Incremental move generation members
+	bool incremental_moves = CHESS_INCREMENTAL_MOVES;
+	// Pieces whose moves can be changed by a move: all moves of the pieces on squares, and for the sliders on partial
+	// only the rays in the directions rays[square] (bit d for direction d, see RayStep in Chess.cpp)
+	struct AffectedSquares {
+		uint64_t squares = 0;
+		uint64_t partial = 0;
+		uint8_t rays[64];
+	};
+	std::vector<std::vector<Move>> move_lists{};
+	std::vector<AffectedSquares> list_affected{};
+	int list_ply = 0;
 
 
 	// Methods -----------------------------------------------
 	void generate_pseudolegal_moves(std::vector<Move>& output);
+	void gen_square(std::vector<Move>& output, const int i);
 	void update_board(const Move& mv);	// No checking nothing, just modify Board struct pos by performing Move mv
 	void revert_board(const Move& mv);   	// No checking nothing, just modify Board struct pos by undoing Move mv
+	void restore_board(const Move& mv);		// Undo Move mv using the active strategy (copy-make or revert_board)
+	static bool is_valid_board(const Board& b);	// Kings, pawns, castling rights and en passant square agree
+	bool leaves_king_attacked(const Move& mv, const EPieceCode moving_piece, const std::vector<Move>& new_moves) const;
 
 	void add_move(std::vector<Move>& move_list, int from, int to, bool capture = false, EPieceCode prom = EPieceCode::epc_empty, bool is_ep = false);
+	CastlingRights lost_castling_rights(const int from, const int to, const EPieceCode moving_piece, const EPieceCode capt);
+	static CastlingRights castling_mask(const int from, const int to, const EPieceCode moving_piece, const EPieceCode capt);
 	inline bool is_on_board(const int r, const int f, const int dr, const int df);
 
 	void gen_rooklike(std::vector<Move>& moves, const int i, const int r, const int f);
@@ -77,4 +170,14 @@ private:
 	void gen_wpawn(std::vector<Move>& moves, const int i, const int r, const int f);
 	void gen_bpawn(std::vector<Move>& moves, const int i, const int r, const int f);
 
+	bool is_attacked(const int sq, const EPieceColor clr);	// Is square sq attacked by a piece of color clr
+	bool is_legal(const Move& mv, const int ksq);			// Is pseudolegal move mv legal (ksq: king square of side to move)
+	int king_square(const EPieceColor clr);
+
+	// Incremental move generation
+	void init_move_lists();
+	void affected_squares(const Move& mv, AffectedSquares& output);	// Pieces whose moves can be changed by (un)doing Move mv
+	void update_move_lists(const Move& mv);		// Build the move list of ply list_ply + 1 after Move mv was made
+	void splice_moves(const std::vector<Move>& old_moves, std::vector<Move>& output, const EPieceColor clr, const AffectedSquares& affected);
+
 };
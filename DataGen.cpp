@@ -0,0 +1,239 @@
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include <numeric>
+#include <algorithm>
+#include <unordered_map>
+#include <filesystem>
+#include "DataGen.h"
+#include "Chess.h"
+#include "Numa.h"
+
+using namespace std;
+
+// Packed position ----------------------------------------------------------------------------------------------------
+
+PackedPosition PackedPosition::pack(const Board& b, const int score, const int result) {
+	PackedPosition p{};
+	int n = 0;
+	for (int sq = 0; sq < 64; sq++) {
+		if (b.square_list[sq] == EPieceCode::epc_empty)
+			continue;
+		p.occupancy |= 1ULL << sq;
+		if (n < 32)
+			p.pieces[n / 2] |= (uint8_t)((int)b.square_list[sq] << (4 * (n % 2)));
+		n++;
+	}
+
+	p.flags = (uint8_t)((b.side_to_move == EPieceColor::clr_black) | ((b.castling_rights & cr_all) << 1));
+	p.en_passant = b.en_passant_square == -1 ? 64 : (uint8_t)b.en_passant_square;
+	p.score = (int16_t)max(-32000, min(32000, score));
+	p.result = (uint8_t)result;
+	p.half_move_count = (uint8_t)min<int>(b.half_move_count, 255);
+	p.full_move_count = b.full_move_count;
+	return p;
+}
+
+Board PackedPosition::unpack() const {
+	Board b;
+	int n = 0;
+	for (int sq = 0; sq < 64; sq++) {
+		if (occupancy & (1ULL << sq)) {
+			b.square_list[sq] = (EPieceCode)((pieces[n / 2] >> (4 * (n % 2))) & 0xF);
+			n++;
+		}
+	}
+
+	b.side_to_move = (flags & 1) ? EPieceColor::clr_black : EPieceColor::clr_white;
+	b.castling_rights = (CastlingRights)((flags >> 1) & cr_all);
+	b.en_passant_square = en_passant == 64 ? -1 : (int8_t)en_passant;
+	b.half_move_count = half_move_count;
+	b.full_move_count = full_move_count;
+	return b;
+}
+
+double PackedPosition::stm_result() const {
+	return (flags & 1) ? (2 - result) / 2.0 : result / 2.0;
+}
+
+bool PositionFile::open(const std::string& path) {
+	return file.open(path) && file.get_size() % sizeof(PackedPosition) == 0;
+}
+
+
+// Generation ---------------------------------------------------------------------------------------------------------
+
+namespace {
+
+struct DataGenState {
+	const DataGenSettings& settings;
+	ofstream file;
+	mutex file_mutex;
+	atomic<uint64_t> positions{ 0 };
+	atomic<uint64_t> games{ 0 };
+
+	explicit DataGenState(const DataGenSettings& s) : settings(s) {}
+};
+
+// Play one game, returning the sampled positions with the result filled in
+void play_game(Search& search, mt19937_64& rng, const DataGenSettings& settings, vector<PackedPosition>& output) {
+	output.clear();
+	Chess game;
+
+	// Random opening, restarted if it ends the game
+	for (int ply = 0; ply < settings.random_plies; ply++) {
+		vector<Move> legal = game.legal_moves();
+		if (legal.empty()) {
+			game = Chess();
+			ply = -1;
+			continue;
+		}
+		game.do_move(legal[rng() % legal.size()]);
+	}
+
+	unordered_map<uint64_t, int> seen;
+	seen[position_key(game.get_board())]++;
+	int result = -1;		// White's point of view: 0 loss, 1 draw, 2 win
+	int winning_plies = 0;
+
+	for (int ply = settings.random_plies; result < 0; ply++) {
+		bool white_to_move = game.get_board().side_to_move == EPieceColor::clr_white;
+		switch (game.game_status()) {
+		case EGameStatus::gs_checkmate:	result = white_to_move ? 0 : 2; continue;
+		case EGameStatus::gs_ongoing:	break;
+		default:						result = 1; continue;
+		}
+		if (seen[position_key(game.get_board())] >= 3 || ply >= settings.max_plies) {
+			result = 1;
+			continue;
+		}
+
+		SearchInfo info = search.go(game, settings.limits);
+		const Move& best = info.pv.front();
+		int white_score = white_to_move ? info.score : -info.score;
+
+		// Only quiet positions: their static evaluation should match the search score
+		bool quiet = !game.in_check() && best.capture == EPieceCode::epc_empty && best.promotion == EPieceCode::epc_empty;
+		if (ply >= settings.min_ply && quiet && !Search::is_mate_score(info.score))
+			output.push_back(PackedPosition::pack(game.get_board(), info.score, 1));
+
+		// Both sides agree the game is decided
+		winning_plies = abs(white_score) >= settings.resign_score ? winning_plies + 1 : 0;
+		if (winning_plies >= 4) {
+			result = white_score > 0 ? 2 : 0;
+			continue;
+		}
+
+		game.do_move(best);
+		seen[position_key(game.get_board())]++;
+	}
+
+	for (PackedPosition& p : output) {
+		p.result = (uint8_t)result;
+	}
+}
+
+void worker(DataGenState& state, const int thread_id) {
+	const DataGenSettings& settings = state.settings;
+	bind_thread(thread_id);
+	Search search(settings.hash_mb);
+	mt19937_64 rng(settings.seed * 0x9E3779B97F4A7C15ULL + thread_id);
+	vector<PackedPosition> game_positions;
+
+	while (state.positions < settings.positions) {
+		search.clear();
+		play_game(search, rng, settings, game_positions);
+
+		lock_guard<mutex> lock(state.file_mutex);
+		uint64_t room = settings.positions - min(settings.positions, state.positions.load());
+		size_t n = (size_t)min<uint64_t>(room, game_positions.size());
+		state.file.write(reinterpret_cast<const char*>(game_positions.data()), n * sizeof(PackedPosition));
+		state.positions += n;
+		state.games++;
+	}
+}
+
+}  // namespace
+
+bool generate_data(const DataGenSettings& settings, std::ostream& out) {
+	DataGenState state(settings);
+	state.file.open(settings.output, ios::binary | ios::app);
+	if (!state.file) {
+		out << "info string Could not open " << settings.output << endl;
+		return false;
+	}
+
+	auto start = chrono::steady_clock::now();
+	vector<thread> threads;
+	for (int i = 0; i < max(1, settings.threads); i++) {
+		threads.emplace_back(worker, ref(state), i);
+	}
+
+	// Progress every few seconds
+	auto last = start;
+	while (state.positions < settings.positions) {
+		this_thread::sleep_for(chrono::milliseconds(100));
+		auto now = chrono::steady_clock::now();
+		if (now - last >= chrono::seconds(10) && state.positions < settings.positions) {
+			double seconds = chrono::duration<double>(now - start).count();
+			out << "info string " << state.positions << " positions, " << state.games << " games, "
+				<< (uint64_t)(state.positions / seconds) << " positions/s" << endl;
+			last = now;
+		}
+	}
+	for (thread& t : threads) {
+		t.join();
+	}
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	out << "Wrote " << state.positions << " positions from " << state.games << " games to " << settings.output << " in "
+		<< seconds << "s: " << (uint64_t)(state.positions / seconds) << " positions/s, "
+		<< (uint64_t)(state.positions / seconds / max(1, settings.threads)) << " per thread, "
+		<< sizeof(PackedPosition) << " bytes per position" << endl;
+	return (bool)state.file;
+}
+
+
+// Shuffling ----------------------------------------------------------------------------------------------------------
+
+bool shuffle_data(const std::string& input, const std::string& output, const uint64_t seed, std::ostream& out) {
+	// The input is memory mapped while the output is truncated and written, so they must be different files
+	error_code ec;
+	if (filesystem::equivalent(input, output, ec)) {
+		out << "info string Input and output are the same file " << output << endl;
+		return false;
+	}
+
+	PositionFile in;
+	if (!in.open(input)) {
+		out << "info string Could not open " << input << " (or size is not a multiple of " << sizeof(PackedPosition)
+			<< " bytes)" << endl;
+		return false;
+	}
+
+	vector<uint64_t> order(in.size());
+	iota(order.begin(), order.end(), 0);
+	shuffle(order.begin(), order.end(), mt19937_64(seed));
+
+	ofstream file(output, ios::binary | ios::trunc);
+	vector<PackedPosition> buffer;
+	buffer.reserve(1 << 16);
+	for (uint64_t i : order) {
+		buffer.push_back(in[i]);
+		if (buffer.size() == buffer.capacity()) {
+			file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(PackedPosition));
+			buffer.clear();
+		}
+	}
+	file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(PackedPosition));
+
+	if (!file) {
+		out << "info string Could not write " << output << endl;
+		return false;
+	}
+	out << "Shuffled " << in.size() << " positions into " << output << endl;
+	return true;
+}
@@ -0,0 +1,73 @@
+/*
+ * DataGen.h
+ *
+ *  Training data from self-play: many games are played in parallel by the internal search, quiet positions are
+ *  sampled with their search score and the game result, and stored as fixed size 32 byte records. Data files are
+ *  plain arrays of records (native byte order), so they can be concatenated, memory mapped and shuffled in place of
+ *  any text format.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include "EnumList.h"
+#include "MappedFile.h"
+#include "Search.h"
+
+/* Packed position: occupancy bitboard plus one 4 bit piece code per occupied square (in square order), which
+takes at most 16 bytes for 32 pieces. */
+struct PackedPosition {
+	uint64_t occupancy;
+	uint8_t pieces[16];			// EPieceCode of the n-th occupied square, low nibble first
+	uint8_t flags;				// Bit 0: black to move, bits 1-4: castling rights
+	uint8_t en_passant;			// En passant square or 64 for none
+	int16_t score;				// Search score in centipawns from the side to move point of view
+	uint8_t result;				// Game result from white's point of view: 0 loss, 1 draw, 2 win
+	uint8_t half_move_count;
+	uint16_t full_move_count;
+
+	static PackedPosition pack(const Board& b, const int score, const int result);
+	Board unpack() const;
+	// Result from the side to move point of view (0, 0.5 or 1)
+	double stm_result() const;
+};
+
+static_assert(sizeof(PackedPosition) == 32, "PackedPosition should be 32 bytes");
+
+// Read-only view of a data file
+class PositionFile {
+public:
+	bool open(const std::string& path);
+	void close() { file.close(); }
+
+	size_t size() const { return file.get_size() / sizeof(PackedPosition); }
+	const PackedPosition& operator[](const size_t i) const { return records()[i]; }
+	const PackedPosition* begin() const { return records(); }
+	const PackedPosition* end() const { return records() + size(); }
+
+private:
+	MappedFile file;
+	const PackedPosition* records() const { return reinterpret_cast<const PackedPosition*>(file.get_data()); }
+};
+
+struct DataGenSettings {
+	uint64_t positions = 1000000;	// Stop after this many positions
+	int threads = 1;
+	SearchLimits limits;			// Per move
+	size_t hash_mb = 16;			// Per thread
+	int random_plies = 8;			// Random moves from the start position, for variety
+	int min_ply = 16;				// Positions before this ply are not sampled
+	int max_plies = 400;			// Games longer than this are drawn
+	int resign_score = 2500;		// Adjudicate a win once |score| exceeds this for both sides (4 plies)
+	uint64_t seed = 1;
+	std::string output;
+};
+
+// Play self-play games and append their positions to settings.output. Progress is reported to out.
+bool generate_data(const DataGenSettings& settings, std::ostream& out);
+
+// Write the records of input in random order to output (a different file)
+bool shuffle_data(const std::string& input, const std::string& output, const uint64_t seed, std::ostream& out);
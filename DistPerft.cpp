@@ -0,0 +1,484 @@
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <sstream>
+#include <cstring>
+#include <cstdint>
+#include "DistPerft.h"
+#include "Chess.h"
+#include "Numa.h"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+
+bool perft_coordinator(const DistPerftSettings&, std::ostream& out) {
+	out << "Distributed perft is not available on this platform" << endl;
+	return false;
+}
+
+bool perft_worker(const std::string&, const int, std::ostream& out) {
+	out << "Distributed perft is not available on this platform" << endl;
+	return false;
+}
+
+#else
+
+namespace {
+
+struct Connection {
+	int fd = -1;
+	std::string buffer;			// Received data after the last complete line
+	long job = -1;				// Job handed to this worker
+	chrono::steady_clock::time_point job_start;
+	bool timed_out = false;		// The job was handed out again, whichever result comes first counts
+	bool idle = false;			// Waiting for a job
+};
+
+struct Job {
+	size_t root_move;			// Index of the root move this position is below
+	std::string fen;
+	int attempts = 0;
+	bool done = false;
+	uint64_t nodes = 0;
+};
+
+// Listening or connected stream socket for "host:port" or "unix:<path>". Returns -1 on failure.
+int open_socket(const string& address, const bool listening) {
+	if (address.compare(0, 5, "unix:") == 0) {
+		string path = address.substr(5);
+		sockaddr_un addr{};
+		addr.sun_family = AF_UNIX;
+		if (path.empty() || path.size() >= sizeof(addr.sun_path))
+			return -1;
+		strcpy(addr.sun_path, path.c_str());
+
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0)
+			return -1;
+		if (listening)
+			unlink(path.c_str());
+		bool ok = listening ? (::bind(fd, (sockaddr*)&addr, sizeof(addr)) == 0 && listen(fd, 64) == 0)
+			: connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+		if (!ok) {
+			::close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	size_t colon = address.rfind(':');
+	if (colon == string::npos)
+		return -1;
+	string host = address.substr(0, colon), port = address.substr(colon + 1);
+
+	addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = listening ? AI_PASSIVE : 0;
+	addrinfo* result = nullptr;
+	if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result) != 0)
+		return -1;
+
+	int fd = -1;
+	for (addrinfo* ai = result; ai && fd < 0; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+		bool ok;
+		if (listening) {
+			int reuse = 1;
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+			ok = ::bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 64) == 0;
+		}
+		else
+			ok = connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+		if (!ok) {
+			::close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(result);
+	return fd;
+}
+
+bool send_line(const int fd, const string& line) {
+	string data = line + '\n';
+	size_t sent = 0;
+	while (sent < data.size()) {
+		ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		sent += (size_t)n;
+	}
+	return true;
+}
+
+// Read what is available (blocks if nothing is). Returns false when the connection is closed or broken.
+bool receive(Connection& c) {
+	char chunk[4096];
+	ssize_t n;
+	do {
+		n = recv(c.fd, chunk, sizeof(chunk), 0);
+	} while (n < 0 && errno == EINTR);
+	if (n <= 0)
+		return false;
+	c.buffer.append(chunk, (size_t)n);
+	return true;
+}
+
+bool next_line(Connection& c, string& line) {
+	size_t eol = c.buffer.find('\n');
+	if (eol == string::npos)
+		return false;
+	line = c.buffer.substr(0, eol);
+	c.buffer.erase(0, eol + 1);
+	if (!line.empty() && line.back() == '\r')
+		line.pop_back();
+	return true;
+}
+
+// Chess::perft counts in an int, so it only counts the subtrees of the moves of the job
+uint64_t count_nodes(const string& fen, const int depth) {
+	if (depth == 0)
+		return 1;
+	Chess c(fen);
+	uint64_t nodes = 0;
+	vector<Move> moves = c.legal_moves();
+	for (const Move& mv : moves) {
+		c.do_move(mv);
+		nodes += (uint64_t)c.perft(depth - 1);
+		c.undo_last_moves(1, false);
+	}
+	return nodes;
+}
+
+// A job for every position plies below c
+void expand(Chess& c, const int plies, const size_t root_move, vector<Job>& jobs) {
+	if (plies == 0) {
+		Board b = c.get_board();
+		ostringstream fen;
+		fen << b;
+		jobs.push_back({ root_move, fen.str() });
+		return;
+	}
+	// Own copy: after undo_last_moves(1, false) the pseudolegal moves of c are stale
+	vector<Move> moves = c.legal_moves();
+	for (const Move& mv : moves) {
+		c.do_move(mv);
+		expand(c, plies - 1, root_move, jobs);
+		c.undo_last_moves(1, false);
+	}
+}
+
+// One worker connection: count jobs until quit. Returns false if the coordinator could not be reached.
+bool work(const string& address, atomic<uint64_t>& jobs_done) {
+	// The coordinator may still be starting
+	int fd = -1;
+	for (int attempt = 0; attempt < 50 && fd < 0; attempt++) {
+		fd = open_socket(address, false);
+		if (fd < 0)
+			this_thread::sleep_for(chrono::milliseconds(200));
+	}
+	if (fd < 0)
+		return false;
+
+	Connection c;
+	c.fd = fd;
+	string line;
+	bool alive = send_line(fd, "ready");
+	while (alive) {
+		if (!next_line(c, line)) {
+			alive = receive(c);
+			continue;
+		}
+
+		istringstream in(line);
+		string command, fen;
+		long job;
+		int depth;
+		in >> command;
+		if (command == "quit")
+			break;
+		if (command != "job")
+			continue;
+		if (in >> job >> depth && getline(in >> ws, fen) && !fen.empty()) {
+			alive = send_line(fd, "result " + to_string(job) + " " + to_string(count_nodes(fen, depth)));
+			jobs_done++;
+		}
+		else
+			alive = send_line(fd, "error " + to_string(job));
+	}
+	::close(fd);
+	return true;
+}
+
+}  // namespace
+
+
+bool perft_worker(const std::string& address, const int threads, std::ostream& out) {
+	atomic<uint64_t> jobs_done{ 0 };
+	atomic<int> connected{ 0 };
+	vector<thread> workers;
+	for (int t = 0; t < max(1, threads); t++) {
+		workers.emplace_back([&, t]() {
+			bind_thread(t);
+			if (work(address, jobs_done))
+				connected++;
+		});
+	}
+	for (thread& w : workers) {
+		w.join();
+	}
+
+	if (!connected) {
+		out << "Could not connect to " << address << endl;
+		return false;
+	}
+	out << "Worker finished: " << jobs_done << " jobs counted" << endl;
+	return true;
+}
+
+bool perft_coordinator(const DistPerftSettings& settings, std::ostream& out) {
+	Chess root = settings.fen.empty() ? Chess() : Chess(settings.fen);
+	const int depth = max(1, settings.depth);
+	const int split = min(max(1, settings.split_depth), depth);
+	const int job_depth = depth - split;
+
+	vector<Move> root_moves = root.legal_moves();
+	vector<Job> jobs;
+	for (size_t i = 0; i < root_moves.size(); i++) {
+		root.do_move(root_moves[i]);
+		expand(root, split - 1, i, jobs);
+		root.undo_last_moves(1, false);
+	}
+
+	int listen_fd = open_socket(settings.address, true);
+	if (listen_fd < 0) {
+		out << "Could not listen on " << settings.address << endl;
+		return false;
+	}
+	out << "perft(" << depth << "): " << jobs.size() << " jobs of depth " << job_depth << ", waiting for workers on "
+		<< settings.address << endl;
+
+	// Local workers connect to the loopback address of the port
+	string local_address = settings.address;
+	if (local_address.compare(0, 5, "unix:") != 0)
+		local_address = "127.0.0.1" + local_address.substr(local_address.rfind(':'));
+	vector<pid_t> children;
+	out.flush();
+	for (int i = 0; i < settings.local_workers; i++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			::close(listen_fd);
+			ostream quiet(nullptr);
+			_exit(perft_worker(local_address, settings.worker_threads, quiet) ? 0 : 1);
+		}
+		if (pid > 0)
+			children.push_back(pid);
+	}
+
+	deque<size_t> queue;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		queue.push_back(i);
+	}
+	vector<Connection> connections;
+	size_t done = 0;
+	long failed_job = -1;
+	bool no_workers = false;
+	auto start = chrono::steady_clock::now();
+	auto last_report = start;
+	auto last_worker = start;	// Last time a worker was connected or a local worker was running
+
+	// Hand the next job to c, or mark it idle. Returns false if the connection broke.
+	auto assign = [&](Connection& c) {
+		// Jobs that were handed out again can be counted by their first worker in the meantime
+		while (!queue.empty() && jobs[queue.front()].done) {
+			queue.pop_front();
+		}
+		c.idle = queue.empty();
+		if (c.idle)
+			return true;
+		c.job = (long)queue.front();
+		queue.pop_front();
+		jobs[c.job].attempts++;
+		c.job_start = chrono::steady_clock::now();
+		c.timed_out = false;
+		return send_line(c.fd, "job " + to_string(c.job) + " " + to_string(job_depth) + " " + jobs[c.job].fen);
+	};
+	// A job that was not counted goes to the front of the queue for the next worker
+	auto requeue = [&](Connection& c) {
+		if (c.job >= 0 && !jobs[c.job].done && !c.timed_out) {
+			if (jobs[c.job].attempts >= settings.max_attempts)
+				failed_job = c.job;
+			queue.push_front((size_t)c.job);
+		}
+		c.job = -1;
+	};
+
+	while (done < jobs.size() && failed_job < 0 && !no_workers) {
+		vector<pollfd> fds(1, pollfd{ listen_fd, POLLIN, 0 });
+		for (const Connection& c : connections) {
+			fds.push_back(pollfd{ c.fd, POLLIN, 0 });
+		}
+		if (poll(fds.data(), fds.size(), 1000) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (size_t i = 0; i < connections.size(); i++) {
+			Connection& c = connections[i];
+			if (!(fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+
+			bool alive = receive(c);
+			string line;
+			while (alive && next_line(c, line)) {
+				istringstream in(line);
+				string command;
+				long job = -1;
+				uint64_t nodes = 0;
+				in >> command;
+				if (command == "result" && in >> job >> nodes && job == c.job) {
+					if (!jobs[job].done) {
+						jobs[job].done = true;
+						jobs[job].nodes = nodes;
+						done++;
+					}
+					c.job = -1;
+					alive = assign(c);
+				}
+				else if (command == "error") {
+					requeue(c);
+					alive = assign(c);
+				}
+				else if (command == "ready" && c.job < 0)
+					alive = assign(c);
+				else
+					alive = false;	// Protocol error
+			}
+			if (!alive) {
+				requeue(c);
+				::close(c.fd);
+				c.fd = -1;
+			}
+		}
+
+		// A worker that takes too long may hang: its job also goes to the next free worker
+		auto now = chrono::steady_clock::now();
+		if (settings.job_timeout > 0) {
+			for (Connection& c : connections) {
+				if (c.fd >= 0 && c.job >= 0 && !c.timed_out && now - c.job_start > chrono::seconds(settings.job_timeout)) {
+					out << "Job " << c.job << " timed out after " << settings.job_timeout << " s" << endl;
+					if (jobs[c.job].attempts >= settings.max_attempts)
+						failed_job = c.job;
+					queue.push_front((size_t)c.job);
+					c.timed_out = true;
+				}
+			}
+		}
+		connections.erase(remove_if(connections.begin(), connections.end(), [](const Connection& c) {
+			return c.fd < 0; }), connections.end());
+
+		// Requeued jobs go to idle workers
+		for (Connection& c : connections) {
+			if (c.idle && !queue.empty() && !assign(c)) {
+				requeue(c);
+				::close(c.fd);
+				c.fd = -1;
+			}
+		}
+
+		if (fds[0].revents & POLLIN) {
+			int fd = accept(listen_fd, nullptr, nullptr);
+			if (fd >= 0) {
+				connections.emplace_back();
+				connections.back().fd = fd;
+			}
+		}
+
+		if (now - last_report > chrono::seconds(5)) {
+			out << "Jobs done: " << done << "/" << jobs.size() << ", workers: " << connections.size() << endl;
+			last_report = now;
+		}
+
+		// Local workers that exited are not coming back, those that are running may still connect. Without any
+		// worker (or only ones whose job timed out) the run fails after worker_wait.
+		children.erase(remove_if(children.begin(), children.end(), [](pid_t pid) {
+			return waitpid(pid, nullptr, WNOHANG) == pid; }), children.end());
+		bool working = any_of(connections.begin(), connections.end(), [](const Connection& c) { return !c.timed_out; });
+		if (working || (connections.empty() && !children.empty()))
+			last_worker = now;
+		else if (settings.worker_wait > 0 && now - last_worker > chrono::seconds(settings.worker_wait))
+			no_workers = true;
+	}
+
+	for (Connection& c : connections) {
+		if (c.fd >= 0) {
+			send_line(c.fd, "quit");
+			::close(c.fd);
+		}
+	}
+	::close(listen_fd);
+	if (settings.address.compare(0, 5, "unix:") == 0)
+		unlink(settings.address.substr(5).c_str());
+	// Local workers still busy with a timed out job do not read quit
+	auto deadline = chrono::steady_clock::now() + chrono::seconds(1);
+	for (pid_t pid : children) {
+		pid_t res;
+		while ((res = waitpid(pid, nullptr, WNOHANG)) == 0 && chrono::steady_clock::now() < deadline) {
+			this_thread::sleep_for(chrono::milliseconds(10));
+		}
+		if (res == 0) {
+			kill(pid, SIGKILL);
+			waitpid(pid, nullptr, 0);
+		}
+	}
+
+	if (done < jobs.size()) {
+		if (failed_job >= 0)
+			out << "Perft failed: job " << failed_job << " (" << jobs[failed_job].fen << ") failed " << settings.max_attempts
+				<< " times" << endl;
+		else if (no_workers)
+			out << "Perft failed: no workers for " << settings.worker_wait << " s" << endl;
+		else
+			out << "Perft failed: connection error" << endl;
+		return false;
+	}
+
+	// Divide: nodes per root move
+	vector<uint64_t> divide(root_moves.size());
+	uint64_t total = 0;
+	for (const Job& j : jobs) {
+		divide[j.root_move] += j.nodes;
+		total += j.nodes;
+	}
+	for (size_t i = 0; i < root_moves.size(); i++) {
+		out << uci_move(root_moves[i]) << ": " << divide[i] << endl;
+	}
+	auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+	out << "===========================" << endl;
+	out << "Total time (ms) : " << elapsed << endl;
+	out << "Nodes searched  : " << total << endl;
+	out << "Nodes/second    : " << total * 1000 / max<int64_t>(elapsed, 1) << endl;
+	return true;
+}
+
+#endif
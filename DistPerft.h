@@ -0,0 +1,39 @@
+/*
+ * DistPerft.h
+ *
+ *  Perft over several processes or machines. The coordinator expands the first plies of the tree into jobs (FEN and
+ *  remaining depth) and serves them over a socket; workers connect, count the nodes of one job at a time and send
+ *  the result back. Jobs of a worker that disconnects, reports an error or exceeds the job timeout are handed out
+ *  again; the run fails when a job fails too often or when no worker is left. The protocol is one text line per
+ *  message:
+ *
+ *    worker -> coordinator: "ready", "result <job> <nodes>", "error <job>"
+ *    coordinator -> worker: "job <job> <depth> <fen>", "quit"
+ *
+ *  Addresses are "host:port" (TCP) or "unix:<path>" (Unix domain socket). Only available on POSIX systems.
+ */
+
+#pragma once
+
+#include <string>
+#include <iostream>
+
+struct DistPerftSettings {
+	std::string fen;				// Root position
+	int depth = 6;
+	int split_depth = 2;			// Plies expanded by the coordinator; jobs search depth - split_depth
+	std::string address = "0.0.0.0:7600";
+	int local_workers = 0;			// Worker processes forked on this machine
+	int worker_threads = 1;			// Connections per local worker
+	int max_attempts = 3;			// Hand outs per job before the run fails
+	int job_timeout = 0;			// Seconds before a job is taken from its worker and handed out again (0 for none)
+	int worker_wait = 60;			// Seconds without a working worker before the run fails (0: forever)
+};
+
+// Serve the jobs of one perft until all are counted, then print the node count per root move and the total.
+// Returns false if a job failed max_attempts times, no worker was left or the address could not be used.
+bool perft_coordinator(const DistPerftSettings& settings, std::ostream& out);
+
+// Count jobs from the coordinator at address with threads connections, until it sends quit or disconnects.
+// Returns false if no connection could be made.
+bool perft_worker(const std::string& address, const int threads, std::ostream& out);
@@ -0,0 +1,746 @@
+/*
+ * EndgameTable.cpp
+ *
+ *  Retrograde analysis: all positions are first scored by their moves out of the table (mate, stalemate,
+ *  captures and promotions into smaller tables) and the number of distinct positions reached by quiet moves.
+ *  Then, ply by ply, the positions resolved at ply d are unmoved: predecessors of a loss are wins at d+1,
+ *  predecessors of a win lose one escape and are lost once they have none left. Every ply is processed by
+ *  all threads, each with its own Chess object.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include "EndgameTable.h"
+#include "Chess.h"
+#include "Numa.h"
+
+using namespace std;
+
+namespace {
+
+const char PIECE_ORDER[] = "KQRBNP";
+const char EGTB_MAGIC[4] = { 'E', 'G', 'T', 'B' };
+const uint32_t EGTB_VERSION = 2;
+const size_t EGTB_HEADER_SIZE = 64;
+const int MAX_PLIES = 253;  // Values are stored as plies + 1 below EGT_UNUSED
+
+// White king squares in the a1-d1-d4 triangle, and their index
+const int TRIANGLE[10] = { 0, 1, 2, 3, 9, 10, 11, 18, 19, 27 };
+int TriangleIdx[64];
+
+// King pairs (white king, black king) of pawnless tables and tables with pawns, and the index of a pair (-1 if
+// the pair is not indexed)
+const int KING_PAIRS_PAWNLESS = 462;
+const int KING_PAIRS_PAWNS = 1806;
+int KingPairSquares[2][KING_PAIRS_PAWNS][2];
+int KingPairIdx[2][64][64];
+
+// Binomial[n][k] = n over k, for combinations of like pieces
+uint64_t Binomial[65][EndgameTable::MAX_PIECES + 1];
+
+struct IndexInit {
+	IndexInit() {
+		fill(begin(TriangleIdx), end(TriangleIdx), -1);
+		for (int i = 0; i < 10; i++) {
+			TriangleIdx[TRIANGLE[i]] = i;
+		}
+
+		for (int pawns = 0; pawns < 2; pawns++) {
+			int n = 0;
+			for (int wk = 0; wk < 64; wk++) {
+				for (int bk = 0; bk < 64; bk++) {
+					KingPairIdx[pawns][wk][bk] = -1;
+					bool adjacent = abs(wk % 8 - bk % 8) <= 1 && abs(wk / 8 - bk / 8) <= 1;
+					bool in_region = pawns ? wk % 8 < 4
+						: TriangleIdx[wk] != -1 && (wk % 8 != wk / 8 || bk % 8 >= bk / 8);
+					if (adjacent || !in_region)
+						continue;
+					KingPairSquares[pawns][n][0] = wk;
+					KingPairSquares[pawns][n][1] = bk;
+					KingPairIdx[pawns][wk][bk] = n++;
+				}
+			}
+		}
+
+		for (int n = 0; n <= 64; n++) {
+			for (int k = 0; k <= EndgameTable::MAX_PIECES; k++) {
+				Binomial[n][k] = k == 0 ? 1 : n == 0 ? 0 : Binomial[n - 1][k - 1] + Binomial[n - 1][k];
+			}
+		}
+	}
+} index_init;
+
+// Symmetry t (0-7) of square sq: optional transpose in the a1-h8 diagonal, then file and rank mirrors
+int transform_square(const int sq, const int t) {
+	int s = (t & 4) ? ((sq >> 3) | (sq << 3)) & 63 : sq;
+	return s ^ ((t & 1) ? 7 : 0) ^ ((t & 2) ? 56 : 0);
+}
+
+EPieceCode piece_code(const char c, const EPieceColor clr) {
+	switch (c) {
+	case 'K': return ept2epc(EPieceType::ept_king, clr);
+	case 'Q': return ept2epc(EPieceType::ept_queen, clr);
+	case 'R': return ept2epc(EPieceType::ept_rook, clr);
+	case 'B': return ept2epc(EPieceType::ept_bishop, clr);
+	case 'N': return ept2epc(EPieceType::ept_knight, clr);
+	case 'P': return clr == EPieceColor::clr_white ? EPieceCode::epc_wpawn : EPieceCode::epc_bpawn;
+	default:  return EPieceCode::epc_empty;
+	}
+}
+
+bool is_pawn(const EPieceCode epc) {
+	return epc == EPieceCode::epc_wpawn || epc == EPieceCode::epc_bpawn;
+}
+
+char piece_char(const EPieceCode epc) {
+	switch (get_ept(epc)) {
+	case EPieceType::ept_king:		return 'K';
+	case EPieceType::ept_queen:		return 'Q';
+	case EPieceType::ept_rook:		return 'R';
+	case EPieceType::ept_bishop:	return 'B';
+	case EPieceType::ept_knight:	return 'N';
+	case EPieceType::ept_wpawn:
+	case EPieceType::ept_bpawn:		return 'P';
+	default:						return ' ';
+	}
+}
+
+// Pieces of one side sorted strongest first (e.g. "RKP" -> "KRP")
+string sort_side(string side) {
+	sort(side.begin(), side.end(), [](char a, char b) {
+		return strchr(PIECE_ORDER, a) < strchr(PIECE_ORDER, b); });
+	return side;
+}
+
+int side_value(const string& side) {
+	int value = 0;
+	for (char c : side) {
+		value += c == 'Q' ? 9 : c == 'R' ? 5 : (c == 'B' || c == 'N') ? 3 : c == 'P' ? 1 : 0;
+	}
+	return value;
+}
+
+// Material of the board as "<white>v<black>"
+string board_material(const Board& b) {
+	string side[2];
+	for (EPieceCode epc : b.square_list) {
+		if (epc != EPieceCode::epc_empty)
+			side[get_clr(epc) == EPieceColor::clr_white ? 0 : 1] += piece_char(epc);
+	}
+	return sort_side(side[0]) + "v" + sort_side(side[1]);
+}
+
+// K vs K and a single minor piece can never mate
+bool trivial_draw(const string& normalized) {
+	return normalized == "KvK" || normalized == "KNvK" || normalized == "KBvK";
+}
+
+// Board with colors swapped and ranks mirrored
+Board flip_colors(const Board& b) {
+	Board res = b;
+	for (int sq = 0; sq < 64; sq++) {
+		EPieceCode epc = b.square_list[sq ^ 56];
+		if (epc == EPieceCode::epc_empty)
+			res.square_list[sq] = epc;
+		else if (epc == EPieceCode::epc_wpawn || epc == EPieceCode::epc_bpawn)
+			res.square_list[sq] = epc == EPieceCode::epc_wpawn ? EPieceCode::epc_bpawn : EPieceCode::epc_wpawn;
+		else
+			res.square_list[sq] = ept2epc(get_ept(epc), !get_clr(epc));
+	}
+	res.side_to_move = !b.side_to_move;
+	res.en_passant_square = b.en_passant_square == -1 ? -1 : (int8_t)(b.en_passant_square ^ 56);
+	return res;
+}
+
+// Result of table value v for the side to move
+EGTResult value_result(const uint8_t v, int& plies) {
+	if (v == EndgameTable::EGT_UNUSED)
+		return egt_fail;
+	if (v == EndgameTable::EGT_DRAW) {
+		plies = 0;
+		return egt_draw;
+	}
+	plies = v - 1;
+	return (plies % 2) ? egt_win : egt_loss;
+}
+
+// Run work(thread, begin, end) over [0, n) in chunks on threads threads
+void parallel_for(const uint64_t n, const int threads, const function<void(int, uint64_t, uint64_t)>& work) {
+	const uint64_t chunk = 1024;
+	atomic<uint64_t> next(0);
+
+	vector<thread> pool;
+	for (int t = 0; t < threads; t++) {
+		pool.emplace_back([&, t]() {
+			bind_thread(t);
+			while (true) {
+				uint64_t begin = next.fetch_add(chunk);
+				if (begin >= n)
+					break;
+				work(t, begin, min(n, begin + chunk));
+			}
+		});
+	}
+	for (thread& th : pool) {
+		th.join();
+	}
+}
+
+}  // namespace
+
+
+// EndgameTable ---------------------------------------------------------------------------------
+
+bool EndgameTable::set_material(const std::string& material) {
+	size_t v = material.find('v');
+	if (v == string::npos || material.find('v', v + 1) != string::npos)
+		return false;
+
+	string white = material.substr(0, v);
+	string black = material.substr(v + 1);
+	int n = (int)(white.size() + black.size());
+	if (n < 3 || n > MAX_PIECES)
+		return false;
+
+	pieces.clear();
+	for (int s = 0; s < 2; s++) {
+		const string& side = s ? black : white;
+		if (side.empty() || side[0] != 'K' || side != sort_side(side) || count(side.begin(), side.end(), 'K') != 1)
+			return false;
+		for (char c : side) {
+			if (!strchr(PIECE_ORDER, c))
+				return false;
+			pieces.push_back(piece_code(c, s ? EPieceColor::clr_black : EPieceColor::clr_white));
+		}
+	}
+
+	name = material;
+	has_pawns = material.find('P') != string::npos;
+	king_pairs = has_pawns ? KING_PAIRS_PAWNS : KING_PAIRS_PAWNLESS;
+
+	groups.clear();
+	group_size = 1;
+	for (EPieceCode epc : pieces) {
+		if (get_ept(epc) == EPieceType::ept_king)
+			continue;
+		if (!groups.empty() && groups.back().code == epc)
+			groups.back().count++;
+		else
+			groups.push_back({ epc, 1, 0 });
+	}
+	for (PieceGroup& g : groups) {
+		g.size = Binomial[is_pawn(g.code) ? 48 : 62][g.count];
+		group_size *= g.size;
+	}
+	size = 2 * (uint64_t)king_pairs * group_size;
+	return true;
+}
+
+// Index of b after symmetry transform t, or UINT64_MAX if the kings do not end up as an indexed pair
+uint64_t EndgameTable::encode_raw(const Board& b, const int transform) const {
+	// Transformed squares per piece code, ascending for the combination index of like pieces
+	int squares[16][MAX_PIECES];
+	int n_squares[16] = {};
+	for (int sq = 0; sq < 64; sq++) {
+		int code = (int)b.square_list[sq];
+		if (code && n_squares[code] < MAX_PIECES)
+			squares[code][n_squares[code]++] = transform_square(sq, transform);
+	}
+
+	int wk = squares[(int)EPieceCode::epc_wking][0];
+	int bk = squares[(int)EPieceCode::epc_bking][0];
+	int pair = KingPairIdx[has_pawns][wk][bk];
+	if (pair < 0)
+		return UINT64_MAX;
+	uint64_t idx = (b.side_to_move == EPieceColor::clr_black ? 1 : 0) * (uint64_t)king_pairs + pair;
+
+	for (const PieceGroup& g : groups) {
+		int* sq = squares[(int)g.code];
+		sort(sq, sq + g.count);
+
+		// Squares numbered without the king squares (or from a2 for pawns), then combinatorial number system
+		uint64_t comb = 0;
+		for (int i = 0; i < g.count; i++) {
+			int r = is_pawn(g.code) ? sq[i] - 8 : sq[i] - (sq[i] > wk) - (sq[i] > bk);
+			comb += Binomial[r][i + 1];
+		}
+		idx = idx * g.size + comb;
+	}
+	return idx;
+}
+
+uint64_t EndgameTable::encode(const Board& b) const {
+	int wk = 0;
+	for (int sq = 0; sq < 64; sq++) {
+		if (b.square_list[sq] == EPieceCode::epc_wking)
+			wk = sq;
+	}
+
+	// Lowest index among the symmetries that bring the white king in the indexed region
+	uint64_t best = UINT64_MAX;
+	for (int t = 0; t < (has_pawns ? 2 : 8); t++) {
+		int s = transform_square(wk, t);
+		bool in_region = has_pawns ? s % 8 < 4 : TriangleIdx[s] != -1;
+		if (in_region)
+			best = min(best, encode_raw(b, t));
+	}
+	return best;
+}
+
+bool EndgameTable::decode(const uint64_t idx, Board& b) const {
+	b = Board();
+	b.castling_rights = cr_none;
+	b.en_passant_square = -1;
+	b.full_move_count = 1;
+
+	uint64_t rest = idx / group_size;
+	const int* kings = KingPairSquares[has_pawns][rest % king_pairs];
+	const int wk = kings[0], bk = kings[1];
+	const int lo = min(wk, bk), hi = max(wk, bk);
+	b.square_list[wk] = EPieceCode::epc_wking;
+	b.square_list[bk] = EPieceCode::epc_bking;
+	b.side_to_move = (rest / king_pairs) ? EPieceColor::clr_black : EPieceColor::clr_white;
+
+	rest = idx % group_size;
+	for (size_t i = groups.size(); i-- > 0;) {
+		const PieceGroup& g = groups[i];
+		uint64_t comb = rest % g.size;
+		rest /= g.size;
+
+		// Highest square first: the largest r with r over k not above the remaining index
+		int r = is_pawn(g.code) ? 48 : 62;
+		for (int k = g.count; k > 0; k--) {
+			do {
+				r--;
+			} while (Binomial[r][k] > comb);
+			comb -= Binomial[r][k];
+
+			int sq = r;
+			if (is_pawn(g.code))
+				sq += 8;
+			else {
+				if (sq >= lo) sq++;
+				if (sq >= hi) sq++;
+			}
+			if (b.square_list[sq] != EPieceCode::epc_empty)
+				return false;
+			b.square_list[sq] = g.code;
+		}
+	}
+	return true;
+}
+
+// File layout: 64 byte header (magic, version, size, max plies, name), then one byte per index
+bool EndgameTable::open(const std::string& path) {
+	values.clear();
+	data = nullptr;
+	if (!file.open(path))
+		return false;
+
+	const uint8_t* base = file.get_data();
+	uint32_t version, plies;
+	uint64_t file_size;
+	char file_name[16] = {};
+	if (file.get_size() < EGTB_HEADER_SIZE || memcmp(base, EGTB_MAGIC, 4)) {
+		file.close();
+		return false;
+	}
+	memcpy(&version, base + 4, 4);
+	memcpy(&file_size, base + 8, 8);
+	memcpy(&plies, base + 16, 4);
+	memcpy(file_name, base + 20, 15);
+
+	if (version != EGTB_VERSION || file_size != size || name != file_name || file.get_size() < EGTB_HEADER_SIZE + size) {
+		file.close();
+		return false;
+	}
+
+	max_plies = (int)plies;
+	data = base + EGTB_HEADER_SIZE;
+	return true;
+}
+
+void EndgameTable::set_values(std::vector<uint8_t>&& generated, const int plies) {
+	file.close();
+	values = std::move(generated);
+	data = values.data();
+	max_plies = plies;
+}
+
+bool EndgameTable::save(const std::string& path) const {
+	if (!data)
+		return false;
+
+	char header[EGTB_HEADER_SIZE] = {};
+	uint32_t version = EGTB_VERSION, plies = (uint32_t)max_plies;
+	memcpy(header, EGTB_MAGIC, 4);
+	memcpy(header + 4, &version, 4);
+	memcpy(header + 8, &size, 8);
+	memcpy(header + 16, &plies, 4);
+	memcpy(header + 20, name.c_str(), min<size_t>(name.size(), 15));
+
+	ofstream out(path, ios::binary);
+	out.write(header, EGTB_HEADER_SIZE);
+	out.write((const char*)data, (streamsize)size);
+	return (bool)out;
+}
+
+
+// EndgameTablebase -----------------------------------------------------------------------------
+
+void EndgameTablebase::init(const std::string& dir) {
+	lock_guard<mutex> lock(tables_mutex);
+	path = dir;
+	tables.clear();
+}
+
+std::string EndgameTablebase::normalize(const std::string& material) {
+	size_t v = material.find('v');
+	if (v == string::npos)
+		return material;
+
+	string white = sort_side(material.substr(0, v));
+	string black = sort_side(material.substr(v + 1));
+
+	// Stronger side first, on equal value the side with the stronger pieces
+	auto rank = [](const string& side) {
+		string res;
+		for (char c : side) {
+			res += (char)('0' + (strchr(PIECE_ORDER, c) - PIECE_ORDER));
+		}
+		return res;
+	};
+	if (side_value(black) > side_value(white) || (side_value(black) == side_value(white) && rank(black) < rank(white)))
+		swap(white, black);
+	return white + "v" + black;
+}
+
+// Table for normalized material name, mapped from the table directory on first use (nullptr if not available)
+EndgameTable* EndgameTablebase::get_table(const std::string& name) {
+	lock_guard<mutex> lock(tables_mutex);
+
+	auto it = tables.find(name);
+	if (it != tables.end())
+		return it->second.get();
+
+	unique_ptr<EndgameTable> t(new EndgameTable());
+	if (path.empty() || !t->set_material(name) || !t->open(path + "/" + name + ".egtb"))
+		t.reset();
+
+	EndgameTable* res = t.get();
+	tables[name] = std::move(t);
+	return res;
+}
+
+EGTResult EndgameTablebase::probe(const Board& b, int& plies) {
+	if (b.castling_rights != cr_none)
+		return egt_fail;
+
+	// Tables have no en passant rights, only probe if no pawn can take en passant
+	if (b.en_passant_square != -1) {
+		int victim = b.en_passant_square + (b.side_to_move == EPieceColor::clr_white ? -8 : 8);
+		EPieceCode our_pawn = b.side_to_move == EPieceColor::clr_white ? EPieceCode::epc_wpawn : EPieceCode::epc_bpawn;
+		if ((victim % 8 > 0 && b.square_list[victim - 1] == our_pawn) || (victim % 8 < 7 && b.square_list[victim + 1] == our_pawn))
+			return egt_fail;
+	}
+
+	string material = board_material(b);
+	string name = normalize(material);
+	if (trivial_draw(name)) {
+		plies = 0;
+		return egt_draw;
+	}
+	if ((int)material.size() - 1 > EndgameTable::MAX_PIECES)
+		return egt_fail;
+
+	EndgameTable* t = get_table(name);
+	if (!t)
+		return egt_fail;
+
+	if (name == material)
+		return value_result(t->get_value(t->encode(b)), plies);
+	return value_result(t->get_value(t->encode(flip_colors(b))), plies);
+}
+
+bool EndgameTablebase::root_probe(Chess& chess, std::vector<Move>& moves) {
+	int plies;
+	if (moves.empty() || probe(chess.get_board(), plies) == egt_fail)
+		return false;
+
+	// Rank from the point of view of the side to move: fast wins high, long losses above fast ones
+	vector<int> rank(moves.size());
+	for (size_t i = 0; i < moves.size(); i++) {
+		switch (probe(chess.board_after(moves[i]), plies)) {
+		case egt_loss:	rank[i] = 1000 - (plies + 1); break;
+		case egt_draw:	rank[i] = 0; break;
+		case egt_win:	rank[i] = -1000 + (plies + 1); break;
+		default:		return false;
+		}
+	}
+
+	int best = *max_element(rank.begin(), rank.end());
+	vector<Move> res;
+	for (size_t i = 0; i < moves.size(); i++) {
+		if (rank[i] == best)
+			res.push_back(moves[i]);
+	}
+	moves = std::move(res);
+	return true;
+}
+
+bool EndgameTablebase::generate(const std::string& material, const int threads, std::ostream& out) {
+	string name = normalize(material);
+	unique_ptr<EndgameTable> t(new EndgameTable());
+	if (!t->set_material(name)) {
+		out << "Unsupported material " << material << " (3 to " << EndgameTable::MAX_PIECES << " pieces, e.g. KQvKR)" << endl;
+		return false;
+	}
+
+	// Tables reached by captures and promotions
+	size_t v = name.find('v');
+	string sides[2] = { name.substr(0, v), name.substr(v + 1) };
+	vector<string> deps;
+	for (int s = 0; s < 2; s++) {
+		const string& own = sides[s];
+		const string& other = sides[1 - s];
+
+		for (size_t i = 1; i < own.size(); i++) {
+			// Own piece i captured
+			string captured = own.substr(0, i) + own.substr(i + 1);
+			deps.push_back(s ? other + "v" + captured : captured + "v" + other);
+
+			// Own pawn i promoted, with or without capturing a piece of the other side
+			if (own[i] != 'P')
+				continue;
+			for (char prom : string("QRBN")) {
+				string promoted = own;
+				promoted[i] = prom;
+				deps.push_back(s ? other + "v" + promoted : promoted + "v" + other);
+				for (size_t j = 1; j < other.size(); j++) {
+					string other_captured = other.substr(0, j) + other.substr(j + 1);
+					deps.push_back(s ? other_captured + "v" + promoted : promoted + "v" + other_captured);
+				}
+			}
+		}
+	}
+	for (string& dep : deps) {
+		dep = normalize(dep);
+	}
+	sort(deps.begin(), deps.end());
+	deps.erase(unique(deps.begin(), deps.end()), deps.end());
+
+	for (const string& dep : deps) {
+		if (!trivial_draw(dep) && !get_table(dep) && !generate(dep, threads, out))
+			return false;
+	}
+
+	auto start = chrono::steady_clock::now();
+	if (!build(*t, threads, out))
+		return false;
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	string file_name = (path.empty() ? string(".") : path) + "/" + name + ".egtb";
+	if (!t->save(file_name)) {
+		out << "Could not write " << file_name << endl;
+		return false;
+	}
+
+	out << "Generated " << name << " in " << seconds << " s: " << t->get_size() << " positions, "
+		<< EGTB_HEADER_SIZE + t->get_size() << " bytes, longest mate " << t->get_max_plies() << " plies" << endl;
+
+	lock_guard<mutex> lock(tables_mutex);
+	tables[name] = std::move(t);
+	return true;
+}
+
+bool EndgameTablebase::build(EndgameTable& t, const int threads, std::ostream& out) {
+	const uint64_t size = t.get_size();
+	const uint8_t NEVER_LOST = 255;  // count of positions that can not be lost (win or draw by leaving the table)
+
+	unique_ptr<atomic<uint8_t>[]> value(new atomic<uint8_t>[size]);	// EGT_DRAW until resolved
+	unique_ptr<atomic<uint8_t>[]> count(new atomic<uint8_t>[size]);	// Distinct quiet successors not yet won
+	vector<uint8_t> loss_floor(size);								// Longest loss by leaving the table
+	interleave_memory(value.get(), size);
+	interleave_memory(count.get(), size);
+	interleave_memory(loss_floor.data(), size);
+
+	// Positions to resolve per ply, collected per thread and merged after every ply
+	vector<vector<uint64_t>> buckets(MAX_PLIES + 2);
+	vector<vector<vector<uint64_t>>> local_buckets(threads, vector<vector<uint64_t>>(MAX_PLIES + 2));
+	vector<Chess> chess(threads);
+	atomic<bool> failed(false);
+
+	// Smaller tables by material as on the board, with the color flip needed for probing them
+	map<string, pair<EndgameTable*, bool>> deps;
+	{
+		lock_guard<mutex> lock(tables_mutex);
+		for (auto& entry : tables) {
+			if (!entry.second || entry.first == t.get_name())
+				continue;
+			size_t v = entry.first.find('v');
+			deps[entry.first] = { entry.second.get(), false };
+			deps[entry.first.substr(v + 1) + "v" + entry.first.substr(0, v)] = { entry.second.get(), true };
+		}
+	}
+
+	auto probe_dep = [&](const Board& b, int& plies) {
+		string material = board_material(b);
+		if (trivial_draw(normalize(material))) {
+			plies = 0;
+			return egt_draw;
+		}
+		auto it = deps.find(material);
+		if (it == deps.end())
+			return egt_fail;
+		EndgameTable* dep = it->second.first;
+		return value_result(dep->get_value(dep->encode(it->second.second ? flip_colors(b) : b)), plies);
+	};
+
+	// Initial pass: mates, stalemates, moves out of the table and the number of quiet successors
+	parallel_for(size, threads, [&](int th, uint64_t begin, uint64_t end) {
+		Chess& c = chess[th];
+		vector<Move> moves;
+		vector<uint64_t> children;
+		Board b;
+
+		for (uint64_t idx = begin; idx < end; idx++) {
+			value[idx].store(EndgameTable::EGT_DRAW, memory_order_relaxed);
+			count[idx].store(NEVER_LOST, memory_order_relaxed);
+
+			if (!t.decode(idx, b) || t.encode(b) != idx) {
+				value[idx].store(EndgameTable::EGT_UNUSED, memory_order_relaxed);
+				continue;
+			}
+			c.set_position(b);
+			if (!c.is_legal_position()) {
+				value[idx].store(EndgameTable::EGT_UNUSED, memory_order_relaxed);
+				continue;
+			}
+
+			moves.clear();
+			c.generate_legal_moves(moves);
+			if (moves.empty()) {
+				if (c.in_check())
+					local_buckets[th][0].push_back(idx);
+				continue;
+			}
+
+			int win_exit = INT_MAX, floor = 0;
+			bool escape = false;
+			children.clear();
+			for (const Move& mv : moves) {
+				Board child = c.board_after(mv);
+				if (mv.capture == EPieceCode::epc_empty && mv.promotion == EPieceCode::epc_empty) {
+					children.push_back(t.encode(child));
+					continue;
+				}
+
+				int plies;
+				switch (probe_dep(child, plies)) {
+				case egt_loss:	win_exit = min(win_exit, plies + 1); break;
+				case egt_draw:	escape = true; break;
+				case egt_win:	floor = max(floor, plies + 1); break;
+				default:		failed = true; break;
+				}
+			}
+			sort(children.begin(), children.end());
+			children.erase(unique(children.begin(), children.end()), children.end());
+
+			if (win_exit != INT_MAX)
+				local_buckets[th][min(win_exit, MAX_PLIES + 1)].push_back(idx);
+			else if (!escape && children.empty())
+				local_buckets[th][min(floor, MAX_PLIES + 1)].push_back(idx);
+			else if (!escape) {
+				count[idx].store((uint8_t)children.size(), memory_order_relaxed);
+				loss_floor[idx] = (uint8_t)min(floor, MAX_PLIES + 1);
+			}
+		}
+	});
+
+	if (failed) {
+		out << "Missing tables for captures or promotions in " << t.get_name() << endl;
+		return false;
+	}
+
+	auto merge_buckets = [&]() {
+		for (auto& thread_buckets : local_buckets) {
+			for (int d = 0; d <= MAX_PLIES + 1; d++) {
+				buckets[d].insert(buckets[d].end(), thread_buckets[d].begin(), thread_buckets[d].end());
+				thread_buckets[d].clear();
+			}
+		}
+	};
+	merge_buckets();
+
+	// Retrograde iterations: resolve the positions of ply d and unmove them
+	int max_plies = 0;
+	atomic<int> resolved(0);
+	for (int d = 0; d <= MAX_PLIES; d++) {
+		const vector<uint64_t>& frontier = buckets[d];
+
+		parallel_for(frontier.size(), threads, [&](int th, uint64_t begin, uint64_t end) {
+			Chess& c = chess[th];
+			vector<Move> unmoves;
+			vector<uint64_t> parents;
+			Board b;
+
+			for (uint64_t i = begin; i < end; i++) {
+				uint64_t idx = frontier[i];
+				uint8_t unresolved = EndgameTable::EGT_DRAW;
+				if (!value[idx].compare_exchange_strong(unresolved, (uint8_t)(d + 1)))
+					continue;  // Already resolved at a lower ply
+				resolved.store(d, memory_order_relaxed);
+
+				t.decode(idx, b);
+				c.set_position(b);
+				unmoves.clear();
+				c.generate_unmoves(unmoves);
+
+				parents.clear();
+				for (const Move& mv : unmoves) {
+					parents.push_back(t.encode(c.board_before(mv)));
+				}
+				sort(parents.begin(), parents.end());
+				parents.erase(unique(parents.begin(), parents.end()), parents.end());
+
+				for (uint64_t parent : parents) {
+					if (value[parent].load(memory_order_relaxed) != EndgameTable::EGT_DRAW)
+						continue;
+
+					if (d % 2 == 0)  // Lost here, so the parent wins
+						local_buckets[th][d + 1].push_back(parent);
+					else if (count[parent].fetch_sub(1) == 1)  // Last escape of the parent is won by us
+						local_buckets[th][max(d + 1, (int)loss_floor[parent])].push_back(parent);
+				}
+			}
+		});
+
+		max_plies = resolved.load();
+		buckets[d].clear();
+		buckets[d].shrink_to_fit();
+		merge_buckets();
+	}
+
+	if (!buckets[MAX_PLIES + 1].empty()) {
+		out << "Mates in " << t.get_name() << " are longer than " << MAX_PLIES << " plies" << endl;
+		return false;
+	}
+
+	vector<uint8_t> values(size);
+	parallel_for(size, threads, [&](int, uint64_t begin, uint64_t end) {
+		for (uint64_t idx = begin; idx < end; idx++) {
+			values[idx] = value[idx].load(memory_order_relaxed);
+		}
+	});
+	t.set_values(std::move(values), max_plies);
+	return true;
+}
@@ -0,0 +1,115 @@
+/*
+ * EndgameTable.h
+ *
+ *  Own endgame tablebases built by retrograde analysis (e.g. KPvK, KRvK, KQvKR): one byte per position with the
+ *  distance to mate in plies, generated in parallel with the Chess move and unmove generators. Tables are stored
+ *  as <material>.egtb files (strongest side as white) that are memory mapped when probed.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include "EnumList.h"
+#include "MappedFile.h"
+
+class Chess;
+
+enum EGTResult {
+	egt_fail = 0,	// No table for this material (or castling rights)
+	egt_draw = 1,
+	egt_win = 2,	// Side to move mates
+	egt_loss = 3,	// Side to move gets mated
+};
+
+/* Table for one material combination. Positions are indexed as
+	index = (stm * king pairs + king pair) * product of group sizes + group indices (mixed radix, in order of groups)
+Both kings are indexed together over the legal pairs (not adjacent): the white king in the a1-d1-d4 triangle with the
+black king on or below the a1-h8 diagonal if the white king is on it (pawnless, 8 symmetries, 462 pairs), or the white
+king on files a-d (with pawns, left-right mirror, 1806 pairs). The other pieces form groups of like pieces in the
+order of the material. A group of k pieces is indexed as a combination of k squares out of the 62 squares not taken
+by the kings, or out of the 48 pawn squares, so permutations of like pieces share one index. Of symmetric positions
+only the lowest index is used, the others hold EGT_UNUSED like illegal positions. Values are EGT_DRAW or 1 + distance
+to mate in plies (odd: side to move wins). */
+class EndgameTable {
+public:
+	static const uint8_t EGT_DRAW = 0;
+	static const uint8_t EGT_UNUSED = 255;
+	static const int MAX_PIECES = 5;
+
+	// Parse material like "KQvKR". Returns false for unsupported material.
+	bool set_material(const std::string& name);
+
+	const std::string& get_name() const { return name; }
+	int get_piece_count() const { return (int)pieces.size(); }
+	uint64_t get_size() const { return size; }
+	int get_max_plies() const { return max_plies; }
+
+	// Index of position b, which must have the material of the table with white as the first side
+	uint64_t encode(const Board& b) const;
+	// Position at index idx. Returns false if pieces overlap.
+	bool decode(const uint64_t idx, Board& b) const;
+
+	uint8_t get_value(const uint64_t idx) const { return data[idx]; }
+
+	// Memory map a table file, or take over generated values
+	bool open(const std::string& path);
+	void set_values(std::vector<uint8_t>&& values, const int max_plies);
+	bool save(const std::string& path) const;
+	bool is_ready() const { return data != nullptr; }
+
+private:
+	struct PieceGroup {
+		EPieceCode code;
+		int count;
+		uint64_t size;					// Combinations of count squares
+	};
+
+	std::string name;
+	std::vector<EPieceCode> pieces;		// White king, white pieces, black king, black pieces (strongest first)
+	std::vector<PieceGroup> groups;		// Like pieces other than the kings, in the order of pieces
+	bool has_pawns = false;
+	int king_pairs = 0;					// 462 or 1806
+	uint64_t group_size = 0;			// Product of the group sizes
+	uint64_t size = 0;
+	int max_plies = 0;
+
+	MappedFile file;
+	std::vector<uint8_t> values;		// Generated table, when not mapped from file
+	const uint8_t* data = nullptr;
+
+	uint64_t encode_raw(const Board& b, const int transform) const;
+};
+
+class EndgameTablebase {
+public:
+	// Directory holding the .egtb files (and where generated tables are written)
+	void init(const std::string& path);
+	const std::string& get_path() const { return path; }
+
+	// Result and distance to mate in plies of position b (no castling rights, material with a table)
+	EGTResult probe(const Board& b, int& plies);
+
+	// Keep only the best moves: fastest mate, else a draw, else the longest resistance. Returns false if
+	// the position can not be probed, moves is then left untouched.
+	bool root_probe(Chess& chess, std::vector<Move>& moves);
+
+	// Generate table for material (e.g. "KQvKR") and the tables it depends on, using threads threads.
+	// Progress and statistics are written to out. Returns false for unsupported material or write errors.
+	bool generate(const std::string& material, const int threads, std::ostream& out);
+
+	// Material name in table orientation (strongest side first), e.g. "KvKR" -> "KRvK"
+	static std::string normalize(const std::string& material);
+
+private:
+	std::string path;
+	std::map<std::string, std::unique_ptr<EndgameTable>> tables;	// Opened tables (nullptr if no file)
+	std::mutex tables_mutex;
+
+	EndgameTable* get_table(const std::string& name);
+	bool build(EndgameTable& t, const int threads, std::ostream& out);
+};
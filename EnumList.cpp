@@ -74,6 +74,17 @@ std::ostream& operator<<(std::ostream& res, const CastlingRights cr) {
 	return res;
 }
 
+std::ostream& operator<<(std::ostream& res, const EGameStatus gs) {
+	switch(gs) {
+	case EGameStatus::gs_ongoing : res << "ongoing"; break;
+	case EGameStatus::gs_checkmate : res << "checkmate"; break;
+	case EGameStatus::gs_stalemate : res << "stalemate"; break;
+	case EGameStatus::gs_insufficient_material : res << "draw by insufficient material"; break;
+	case EGameStatus::gs_fifty_moves : res << "draw by fifty move rule"; break;
+	}
+	return res;
+}
+
 CastlingRights operator&(CastlingRights lhs, CastlingRights rhs) {
 	return (CastlingRights) ((int)lhs & (int)rhs);
 }
@@ -159,7 +170,7 @@ std::istream& operator>>(std::istream& fen,  Board& b){
 	for (int r = 7; r >= 0; r--) {
 		std::string line = lines[7-r];
 		int f = 0;
-		for (size_t j = 0; j < line.length(); j++) {
+		for (size_t j = 0; j < line.length() && f < 8; j++) {
 			switch (line[j]) {
 			case 'p': b.square_list[r * 8 + f] = EPieceCode::epc_bpawn; break;
 			case 'r': b.square_list[r * 8 + f] = EPieceCode::epc_brook;  break;
@@ -224,5 +235,15 @@ std::string square_name(int i) {
 	return res.str();
 }
 
-
-
+// Move in long algebraic notation as used by UCI (e.g. e2e4, e7e8q)
+std::string uci_move(const Move& mv) {
+	std::string res = square_name(mv.from) + square_name(mv.to);
+	switch (get_ept(mv.promotion)) {
+	case EPieceType::ept_knight:	res += 'n'; break;
+	case EPieceType::ept_bishop:	res += 'b'; break;
+	case EPieceType::ept_rook:		res += 'r'; break;
+	case EPieceType::ept_queen:		res += 'q'; break;
+	default: break;
+	}
+	return res;
+}
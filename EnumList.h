@@ -8,8 +8,9 @@
 #pragma once
 
 #include<iostream>
+#include<cstdint>
 
-enum class EPieceType {
+enum class EPieceType : uint8_t {
 	ept_pnil = 0,
 
 	ept_wpawn = 1,
@@ -22,7 +23,7 @@ enum class EPieceType {
 };
 
 
-enum class EPieceCode {
+enum class EPieceCode : uint8_t {
 	epc_empty = 0,
 
 	epc_wpawn = (int)EPieceType::ept_wpawn,
@@ -40,14 +41,14 @@ enum class EPieceCode {
 	epc_bking = (int)EPieceType::ept_king + 8,
 };
 
-enum class EPieceColor {
+enum class EPieceColor : uint8_t {
 	clr_none = 0,
 	clr_white = 1,
 	clr_black = 2,
 };
 
 
-enum CastlingRights {
+enum CastlingRights : uint8_t {
 	cr_none = 0,
 	cr_white_short = 1,
 	cr_white_long = 2,
@@ -60,6 +61,15 @@ enum CastlingRights {
 };
 
 
+enum class EGameStatus : uint8_t {
+	gs_ongoing = 0,
+	gs_checkmate = 1,
+	gs_stalemate = 2,
+	gs_insufficient_material = 3,
+	gs_fifty_moves = 4,
+};
+
+
 struct Move {
 	int from;								// From square (0-63)
 	int to;									// To square (0-63)
@@ -72,7 +82,7 @@ struct Move {
 };
 
 
-struct Board {
+struct alignas(64) Board {
 	/* Represents a chess board state. Does no checking or keeping track at all. That is delegated to the Chess class.
 	Minimal info to uniquely define a board:
 
@@ -82,23 +92,30 @@ struct Board {
 	en_passant_square -- Target square for en passant capture (0-63 or -1 for none)
 	half_move_count -- Counts half moves since last capture or pawn push
 	full_move_count -- Counts full moves after black moves
+
+	All members are byte sized (or 16 bit for the counters) and the struct is cache line aligned, so a Board
+	takes exactly two cache lines and is cheap to copy (see copy-make mode in Chess).
 	*/
 	EPieceCode square_list[64]{};
 	EPieceColor side_to_move{};
 	CastlingRights castling_rights{};
-	int en_passant_square{};
-	unsigned int half_move_count{};
-	unsigned int full_move_count{};
+	int8_t en_passant_square{};
+	uint16_t half_move_count{};
+	uint16_t full_move_count{};
 
 };
 
+static_assert(sizeof(Board) <= 128, "Board should fit in two cache lines");
+
 std::ostream& operator<<(std::ostream& res, Board& b);
 std::istream& operator>>(std::istream& in,  Board& b);
 std::ostream& operator<<(std::ostream& out, const Move& m);
 std::ostream& operator<<(std::ostream& res, const EPieceCode epc);
 std::ostream& operator<<(std::ostream& res, const EPieceColor clr);
 std::ostream& operator<<(std::ostream& res, const CastlingRights cr);
+std::ostream& operator<<(std::ostream& res, const EGameStatus gs);
 std::string square_name(int i);
+std::string uci_move(const Move& mv);
 
 
 
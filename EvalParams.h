@@ -0,0 +1,142 @@
+/*
+ * EvalParams.h
+ *
+ *  Evaluation weights: material and piece-square tables for the middlegame (mg) and endgame (eg), blended by game
+ *  phase. Tables are from white's point of view with a1 first; black uses the square mirrored vertically.
+ *  This file can be regenerated by the tuner.
+ */
+
+#pragma once
+
+// Piece order: pawn, knight, bishop, rook, queen, king
+const int PIECE_VALUE_MG[6] = { 82, 337, 365, 477, 1025, 0 };
+const int PIECE_VALUE_EG[6] = { 94, 281, 297, 512, 936, 0 };
+
+// Game phase contribution per piece (24 = all pieces on the board)
+const int PHASE_WEIGHT[6] = { 0, 1, 1, 2, 4, 0 };
+
+const int PST_MG[6][64] = {
+	{	// Pawn
+		   0,    0,    0,    0,    0,    0,    0,    0,
+		   0,    0,    0,   -8,   -8,    0,    0,    0,
+		   4,    4,    4,    4,    4,    4,    4,    4,
+		   8,    8,    8,   18,   18,    8,    8,    8,
+		  12,   12,   12,   22,   22,   12,   12,   12,
+		  16,   16,   16,   16,   16,   16,   16,   16,
+		  20,   20,   20,   20,   20,   20,   20,   20,
+		   0,    0,    0,    0,    0,    0,    0,    0,
+	},
+	{	// Knight
+		 -10,  -10,  -10,  -10,  -10,  -10,  -10,  -10,
+		 -10,    0,    0,    0,    0,    0,    0,  -10,
+		 -10,    0,   10,   10,   10,   10,    0,  -10,
+		 -10,    0,   10,   20,   20,   10,    0,  -10,
+		 -10,    0,   10,   20,   20,   10,    0,  -10,
+		 -10,    0,   10,   10,   10,   10,    0,  -10,
+		 -10,    0,    0,    0,    0,    0,    0,  -10,
+		 -10,  -10,  -10,  -10,  -10,  -10,  -10,  -10,
+	},
+	{	// Bishop
+		  -5,   -5,   -5,   -5,   -5,   -5,   -5,   -5,
+		  -5,    0,    0,    0,    0,    0,    0,   -5,
+		  -5,    0,    5,    5,    5,    5,    0,   -5,
+		  -5,    0,    5,   10,   10,    5,    0,   -5,
+		  -5,    0,    5,   10,   10,    5,    0,   -5,
+		  -5,    0,    5,    5,    5,    5,    0,   -5,
+		  -5,    0,    0,    0,    0,    0,    0,   -5,
+		  -5,   -5,   -5,   -5,   -5,   -5,   -5,   -5,
+	},
+	{	// Rook
+		   0,    0,    0,    5,    5,    0,    0,    0,
+		   0,    0,    0,    5,    5,    0,    0,    0,
+		   0,    0,    0,    5,    5,    0,    0,    0,
+		   0,    0,    0,    5,    5,    0,    0,    0,
+		   0,    0,    0,    5,    5,    0,    0,    0,
+		   0,    0,    0,    5,    5,    0,    0,    0,
+		  15,   15,   15,   20,   20,   15,   15,   15,
+		   0,    0,    0,    5,    5,    0,    0,    0,
+	},
+	{	// Queen
+		  -3,   -3,   -3,   -3,   -3,   -3,   -3,   -3,
+		  -3,    0,    0,    0,    0,    0,    0,   -3,
+		  -3,    0,    3,    3,    3,    3,    0,   -3,
+		  -3,    0,    3,    6,    6,    3,    0,   -3,
+		  -3,    0,    3,    6,    6,    3,    0,   -3,
+		  -3,    0,    3,    3,    3,    3,    0,   -3,
+		  -3,    0,    0,    0,    0,    0,    0,   -3,
+		  -3,   -3,   -3,   -3,   -3,   -3,   -3,   -3,
+	},
+	{	// King
+		   0,   20,   20,  -10,  -10,    0,   20,    0,
+		 -12,  -12,  -12,  -22,  -22,  -12,  -12,  -12,
+		 -24,  -24,  -24,  -34,  -34,  -24,  -24,  -24,
+		 -36,  -36,  -36,  -46,  -46,  -36,  -36,  -36,
+		 -48,  -48,  -48,  -58,  -58,  -48,  -48,  -48,
+		 -60,  -60,  -60,  -70,  -70,  -60,  -60,  -60,
+		 -72,  -72,  -72,  -82,  -82,  -72,  -72,  -72,
+		 -84,  -84,  -84,  -94,  -94,  -84,  -84,  -84,
+	},
+};
+
+const int PST_EG[6][64] = {
+	{	// Pawn
+		   0,    0,    0,    0,    0,    0,    0,    0,
+		   0,    0,    0,    0,    0,    0,    0,    0,
+		  12,   12,   12,   12,   12,   12,   12,   12,
+		  24,   24,   24,   24,   24,   24,   24,   24,
+		  36,   36,   36,   36,   36,   36,   36,   36,
+		  48,   48,   48,   48,   48,   48,   48,   48,
+		  60,   60,   60,   60,   60,   60,   60,   60,
+		   0,    0,    0,    0,    0,    0,    0,    0,
+	},
+	{	// Knight
+		 -12,  -12,  -12,  -12,  -12,  -12,  -12,  -12,
+		 -12,   -4,   -4,   -4,   -4,   -4,   -4,  -12,
+		 -12,   -4,    4,    4,    4,    4,   -4,  -12,
+		 -12,   -4,    4,   12,   12,    4,   -4,  -12,
+		 -12,   -4,    4,   12,   12,    4,   -4,  -12,
+		 -12,   -4,    4,    4,    4,    4,   -4,  -12,
+		 -12,   -4,   -4,   -4,   -4,   -4,   -4,  -12,
+		 -12,  -12,  -12,  -12,  -12,  -12,  -12,  -12,
+	},
+	{	// Bishop
+		  -6,   -6,   -6,   -6,   -6,   -6,   -6,   -6,
+		  -6,   -2,   -2,   -2,   -2,   -2,   -2,   -6,
+		  -6,   -2,    2,    2,    2,    2,   -2,   -6,
+		  -6,   -2,    2,    6,    6,    2,   -2,   -6,
+		  -6,   -2,    2,    6,    6,    2,   -2,   -6,
+		  -6,   -2,    2,    2,    2,    2,   -2,   -6,
+		  -6,   -2,   -2,   -2,   -2,   -2,   -2,   -6,
+		  -6,   -6,   -6,   -6,   -6,   -6,   -6,   -6,
+	},
+	{	// Rook
+		   0,    0,    0,    0,    0,    0,    0,    0,
+		   0,    0,    0,    0,    0,    0,    0,    0,
+		   0,    0,    0,    0,    0,    0,    0,    0,
+		   0,    0,    0,    0,    0,    0,    0,    0,
+		   0,    0,    0,    0,    0,    0,    0,    0,
+		   0,    0,    0,    0,    0,    0,    0,    0,
+		  10,   10,   10,   10,   10,   10,   10,   10,
+		   0,    0,    0,    0,    0,    0,    0,    0,
+	},
+	{	// Queen
+		  -9,   -9,   -9,   -9,   -9,   -9,   -9,   -9,
+		  -9,   -3,   -3,   -3,   -3,   -3,   -3,   -9,
+		  -9,   -3,    3,    3,    3,    3,   -3,   -9,
+		  -9,   -3,    3,    9,    9,    3,   -3,   -9,
+		  -9,   -3,    3,    9,    9,    3,   -3,   -9,
+		  -9,   -3,    3,    3,    3,    3,   -3,   -9,
+		  -9,   -3,   -3,   -3,   -3,   -3,   -3,   -9,
+		  -9,   -9,   -9,   -9,   -9,   -9,   -9,   -9,
+	},
+	{	// King
+		 -18,  -18,  -18,  -18,  -18,  -18,  -18,  -18,
+		 -18,   -6,   -6,   -6,   -6,   -6,   -6,  -18,
+		 -18,   -6,    6,    6,    6,    6,   -6,  -18,
+		 -18,   -6,    6,   18,   18,    6,   -6,  -18,
+		 -18,   -6,    6,   18,   18,    6,   -6,  -18,
+		 -18,   -6,    6,    6,    6,    6,   -6,  -18,
+		 -18,   -6,   -6,   -6,   -6,   -6,   -6,  -18,
+		 -18,  -18,  -18,  -18,  -18,  -18,  -18,  -18,
+	},
+};
@@ -0,0 +1,39 @@
+#include "Evaluate.h"
+#include "EvalParams.h"
+
+int eval_piece_index(const EPieceCode epc) {
+	switch (get_ept(epc)) {
+	case EPieceType::ept_wpawn:
+	case EPieceType::ept_bpawn:		return 0;
+	case EPieceType::ept_knight:	return 1;
+	case EPieceType::ept_bishop:	return 2;
+	case EPieceType::ept_rook:		return 3;
+	case EPieceType::ept_queen:		return 4;
+	case EPieceType::ept_king:		return 5;
+	default:						return -1;
+	}
+}
+
+int evaluate(const Board& b) {
+	int mg = 0, eg = 0, phase = 0;
+
+	for (int sq = 0; sq < 64; sq++) {
+		int p = eval_piece_index(b.square_list[sq]);
+		if (p < 0)
+			continue;
+
+		// Tables are from white's point of view
+		bool white = get_clr(b.square_list[sq]) == EPieceColor::clr_white;
+		int i = white ? sq : sq ^ 56;
+		int sign = white ? 1 : -1;
+
+		mg += sign * (PIECE_VALUE_MG[p] + PST_MG[p][i]);
+		eg += sign * (PIECE_VALUE_EG[p] + PST_EG[p][i]);
+		phase += PHASE_WEIGHT[p];
+	}
+
+	if (phase > 24)
+		phase = 24;
+	int score = (mg * phase + eg * (24 - phase)) / 24;
+	return b.side_to_move == EPieceColor::clr_white ? score : -score;
+}
@@ -0,0 +1,15 @@
+/*
+ * Evaluate.h
+ *
+ *  Static evaluation: material and piece-square tables (EvalParams.h), tapered between middlegame and endgame.
+ */
+
+#pragma once
+
+#include "EnumList.h"
+
+// Index of piece type in the evaluation tables: pawn 0, knight 1, bishop 2, rook 3, queen 4, king 5 (-1 for empty)
+int eval_piece_index(const EPieceCode epc);
+
+// Evaluation of b in centipawns from the point of view of the side to move
+int evaluate(const Board& b);
@@ -0,0 +1,143 @@
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <new>
+#include <map>
+#include <mutex>
+#include <cstdint>
+#include "LargePages.h"
+#include "Numa.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+const size_t HUGE_PAGE = 2 * 1024 * 1024;
+
+enum PageKind { pk_normal = 0, pk_transparent = 1, pk_explicit = 2 };
+
+atomic<bool> explicit_pages{ true };
+atomic<size_t> allocated[3];		// Bytes per PageKind
+
+size_t round_up(const size_t bytes) {
+	return (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+}
+
+#ifndef _WIN32
+
+// Transparent huge pages are only used for advised memory when the kernel setting is "always" or "madvise"
+bool transparent_pages_enabled() {
+	static const bool enabled = []() {
+		ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+		string setting;
+		getline(file, setting);
+		return file && setting.find("[never]") == string::npos;
+	}();
+	return enabled;
+}
+
+// Page kind of every mapping, for the statistics (function statics: tables are allocated during static initialization)
+mutex kinds_mutex;
+
+map<void*, PageKind>& kinds() {
+	static map<void*, PageKind> mapping_kinds;
+	return mapping_kinds;
+}
+
+void add_mapping(void* p, const size_t size, const PageKind kind) {
+	lock_guard<mutex> lock(kinds_mutex);
+	kinds()[p] = kind;
+	allocated[kind] += size;
+}
+
+#endif
+
+}  // namespace
+
+#ifdef _WIN32
+
+void* large_alloc(const size_t bytes) {
+	return ::operator new(bytes);
+}
+
+void large_free(void* p, const size_t) {
+	::operator delete(p);
+}
+
+#else
+
+void* large_alloc(const size_t bytes) {
+	if (bytes < HUGE_PAGE)
+		return ::operator new(bytes);
+	const size_t size = round_up(bytes);
+
+#ifdef MAP_HUGETLB
+	if (explicit_pages) {
+		void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED) {
+			place_memory(p, size);
+			add_mapping(p, size, pk_explicit);
+			return p;
+		}
+	}
+#endif
+
+	// Map one huge page more and unmap around the aligned part
+	void* mapping = mmap(nullptr, size + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED)
+		throw bad_alloc();
+	char* start = static_cast<char*>(mapping);
+	char* aligned = reinterpret_cast<char*>(round_up(reinterpret_cast<uintptr_t>(start)));
+	if (aligned > start)
+		munmap(start, aligned - start);
+	if (start + HUGE_PAGE > aligned)
+		munmap(aligned + size, start + HUGE_PAGE - aligned);
+
+	PageKind kind = pk_normal;
+#ifdef MADV_HUGEPAGE
+	if (transparent_pages_enabled() && madvise(aligned, size, MADV_HUGEPAGE) == 0)
+		kind = pk_transparent;
+#endif
+	place_memory(aligned, size);
+	add_mapping(aligned, size, kind);
+	return aligned;
+}
+
+void large_free(void* p, const size_t bytes) {
+	if (!p)
+		return;
+	if (bytes < HUGE_PAGE) {
+		::operator delete(p);
+		return;
+	}
+	{
+		lock_guard<mutex> lock(kinds_mutex);
+		auto it = kinds().find(p);
+		if (it != kinds().end()) {
+			allocated[it->second] -= round_up(bytes);
+			kinds().erase(it);
+		}
+	}
+	munmap(p, round_up(bytes));
+}
+
+#endif
+
+void set_large_pages(const bool on) {
+	explicit_pages = on;
+}
+
+std::string large_pages_info() {
+	const char* names[3] = { "normal pages", "transparent huge pages", "explicit huge pages" };
+	ostringstream out;
+	for (int kind = pk_explicit; kind >= pk_normal; kind--) {
+		if (allocated[kind] == 0)
+			continue;
+		out << (out.tellp() > 0 ? ", " : "") << allocated[kind] / (1024 * 1024) << " MB on " << names[kind];
+	}
+	return out.tellp() > 0 ? out.str() : "no large tables";
+}
@@ -0,0 +1,41 @@
+/*
+ * LargePages.h
+ *
+ *  Memory for the large tables (transposition tables of the search and of the mate solver). A table of gigabytes
+ *  on 4 KB pages misses the TLB on nearly every probe, so on Linux tables of 2 MB and more are mapped on explicit
+ *  huge pages (MAP_HUGETLB, when the administrator reserved them), or else 2 MB aligned and advised for transparent
+ *  huge pages, or else on normal pages. Smaller tables, and other systems, use the normal allocator. The pages are
+ *  placed on NUMA nodes by place_memory (Numa.h).
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Allocate and free bytes bytes (free needs the same size), aligned to at least 64 bytes
+void* large_alloc(const size_t bytes);
+void large_free(void* p, const size_t bytes);
+
+// Try explicit huge pages for new tables (default on)
+void set_large_pages(const bool on);
+// Memory of the current tables per page kind, e.g. "16 MB on transparent huge pages"
+std::string large_pages_info();
+
+// Allocator for std::vector of table entries
+template <class T>
+struct LargePageAllocator {
+	typedef T value_type;
+
+	LargePageAllocator() = default;
+	template <class U>
+	LargePageAllocator(const LargePageAllocator<U>&) {}
+
+	T* allocate(const size_t n) { return static_cast<T*>(large_alloc(n * sizeof(T))); }
+	void deallocate(T* p, const size_t n) { large_free(p, n * sizeof(T)); }
+
+	template <class U>
+	bool operator==(const LargePageAllocator<U>&) const { return true; }
+	template <class U>
+	bool operator!=(const LargePageAllocator<U>&) const { return false; }
+};
@@ -0,0 +1,37 @@
+/*
+ * MappedFile.h
+ *
+ *  Read-only memory mapping of a file (mmap on POSIX, file mapping objects on Windows).
+ *  Used for opening books and tablebases, so only the touched pages are ever read from disk.
+ */
+
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Map file at path (closes previously mapped file). Returns succes flag.
+	bool open(const std::string& path);
+	void close();
+
+	bool is_open() const { return data != nullptr; }
+	const unsigned char* get_data() const { return data; }
+	size_t get_size() const { return size; }
+
+private:
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+
+#ifdef _WIN32
+	void* file_handle = nullptr;
+	void* map_handle = nullptr;
+#endif
+};
@@ -0,0 +1,424 @@
+#include <sstream>
+#include <thread>
+#include <memory>
+#include <cmath>
+#include <ctime>
+#include <map>
+#include <algorithm>
+#include "Match.h"
+#include "Chess.h"
+#include "UCIProcess.h"
+
+using namespace std;
+
+const string START_FEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+// Players ------------------------------------------------------------------------------------------------------------
+
+class Match::Player {
+public:
+	virtual ~Player() = default;
+	virtual bool start() = 0;
+	virtual void new_game() = 0;
+	// Best move (UCI notation) in the current position of game and its score for the side to move. Returns false
+	// if the engine failed to answer in time.
+	virtual bool think(const Chess& game, string& move, int& score) = 0;
+};
+
+class Match::InternalPlayer : public Match::Player {
+public:
+	InternalPlayer(const size_t hash_mb, const SearchLimits& limits) : search(new Search(hash_mb)), limits(limits) {}
+
+	bool start() override { return true; }
+	void new_game() override { search->clear(); }
+
+	bool think(const Chess& game, string& move, int& score) override {
+		SearchInfo info = search->go(game, limits);
+		if (info.pv.empty())
+			return false;
+		move = uci_move(info.pv.front());
+		score = info.score;
+		return true;
+	}
+
+private:
+	unique_ptr<Search> search;		// Heap allocated, the pv table is large
+	SearchLimits limits;
+};
+
+class Match::ExternalPlayer : public Match::Player {
+public:
+	ExternalPlayer(const string& command, const SearchLimits& limits) : command(command) {
+		ostringstream go;
+		go << "go";
+		if (limits.depth)
+			go << " depth " << limits.depth;
+		if (limits.nodes)
+			go << " nodes " << limits.nodes;
+		if (limits.movetime)
+			go << " movetime " << limits.movetime;
+		go_command = go.str();
+
+		// Generous margin: a forfeit should mean a hanging engine, not a slow machine
+		timeout_ms = limits.movetime ? (int)limits.movetime * 2 + 5000 : 60000;
+	}
+
+	bool start() override { return process.start(command); }
+
+	void new_game() override {
+		string line;
+		process.write_line("ucinewgame");
+		process.write_line("isready");
+		process.wait_for("readyok", line, 10000);
+	}
+
+	bool think(const Chess& game, string& move, int& score) override {
+		Board init = game.get_init_board();
+		ostringstream position;
+		position << "position fen " << init;
+		if (!game.get_move_history().empty()) {
+			position << " moves";
+			for (const Move& mv : game.get_move_history()) {
+				position << ' ' << uci_move(mv);
+			}
+		}
+		if (!process.write_line(position.str()) || !process.write_line(go_command))
+			return false;
+
+		// Keep the score of the last info line before bestmove
+		auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+		string line;
+		score = 0;
+		while (true) {
+			auto remaining = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+			if (remaining <= 0 || !process.read_line(line, (int)remaining))
+				return false;
+
+			istringstream in(line);
+			string token;
+			in >> token;
+			if (token == "bestmove") {
+				in >> move;
+				return true;
+			}
+			while (token == "info" && in >> token) {
+				if (token == "score") {
+					string type;
+					int value;
+					in >> type >> value;
+					if (type == "cp")
+						score = value;
+					else if (type == "mate")
+						score = value > 0 ? Search::MATE_SCORE - 2 * value + 1 : -Search::MATE_SCORE - 2 * value;
+					break;
+				}
+			}
+		}
+	}
+
+private:
+	string command;
+	string go_command;
+	int timeout_ms;
+	UCIProcess process;
+};
+
+
+// Match --------------------------------------------------------------------------------------------------------------
+
+Match::Match(const MatchSettings& match_settings) : settings(match_settings) {
+	for (int i = 0; i < 2; i++) {
+		MatchEngine& e = settings.engines[i];
+		if (e.name.empty())
+			e.name = e.command.empty() ? "BasEngine" : e.command;
+	}
+	if (settings.engines[0].name == settings.engines[1].name) {
+		settings.engines[0].name += " 1";
+		settings.engines[1].name += " 2";
+	}
+}
+
+bool Match::run(std::ostream& output) {
+	out = &output;
+	result = MatchResult();
+	next_game = 0;
+	stop_flag = false;
+
+	load_openings();
+	if (!settings.pgn_file.empty()) {
+		pgn.open(settings.pgn_file, ios::app);
+		if (!pgn)
+			*out << "info string Could not open " << settings.pgn_file << endl;
+	}
+
+	// Check the engines can be started before spawning workers
+	for (const MatchEngine& e : settings.engines) {
+		if (!e.command.empty() && !UCIProcess().start(e.command)) {
+			*out << "info string Could not start engine: " << e.command << endl;
+			return false;
+		}
+	}
+
+	*out << "Match " << settings.engines[0].name << " vs " << settings.engines[1].name << ": " << settings.games
+		<< " games, " << openings.size() << " openings, concurrency " << settings.concurrency << endl;
+
+	vector<thread> workers;
+	int n_workers = max(1, min(settings.concurrency, settings.games));
+	for (int i = 0; i < n_workers; i++) {
+		workers.emplace_back(&Match::worker, this);
+	}
+	for (thread& t : workers) {
+		t.join();
+	}
+
+	*out << "Finished: " << result.wins << " - " << result.losses << " - " << result.draws << " (W - L - D)";
+	*out << ", Elo " << elo(result.score()) << " +/- " << elo_error(result) << endl;
+	pgn.close();
+	return true;
+}
+
+// One opening per line: EPD (four FEN fields followed by operations) or a full FEN. Illegal positions are skipped.
+void Match::load_openings() {
+	openings.clear();
+	ifstream file(settings.openings_file);
+	string line;
+	while (getline(file, line)) {
+		istringstream in(line);
+		string fields[6];
+		int n = 0;
+		while (n < 6 && in >> fields[n]) {
+			n++;
+		}
+		if (n < 4)
+			continue;
+
+		string fen = fields[0] + " " + fields[1] + " " + fields[2] + " " + fields[3];
+		bool counters = n == 6 && all_of(fields[4].begin(), fields[4].end(), ::isdigit) &&
+			all_of(fields[5].begin(), fields[5].end(), ::isdigit);
+		fen = counters ? fen + " " + fields[4] + " " + fields[5] : fen + " 0 1";
+		Board b;
+		istringstream(fen) >> b;
+		if (Chess::is_legal_position(b))
+			openings.push_back(fen);
+	}
+
+	if (!settings.openings_file.empty() && openings.empty())
+		*out << "info string No openings read from " << settings.openings_file << ", using the start position" << endl;
+	if (openings.empty())
+		openings.push_back(START_FEN);
+}
+
+void Match::worker() {
+	unique_ptr<Player> players[2];
+	for (int i = 0; i < 2; i++) {
+		const string& command = settings.engines[i].command;
+		if (command.empty())
+			players[i].reset(new InternalPlayer(settings.hash_mb, settings.limits));
+		else
+			players[i].reset(new ExternalPlayer(command, settings.limits));
+		if (!players[i]->start()) {
+			lock_guard<mutex> lock(report_mutex);
+			*out << "info string Could not start engine: " << command << endl;
+			return;
+		}
+	}
+
+	// Game g plays opening g/2, the first engine has white in even games
+	int g;
+	while (!stop_flag && (g = next_game++) < settings.games) {
+		const string& fen = openings[(g / 2) % openings.size()];
+		bool first_is_white = g % 2 == 0;
+		Player& white = *players[first_is_white ? 0 : 1];
+		Player& black = *players[first_is_white ? 1 : 0];
+
+		white.new_game();
+		black.new_game();
+		GameRecord record = play_game(fen, white, black);
+		record.white = settings.engines[first_is_white ? 0 : 1].name;
+		record.black = settings.engines[first_is_white ? 1 : 0].name;
+		report(g, record, first_is_white);
+	}
+}
+
+Match::GameRecord Match::play_game(const std::string& fen, Player& white, Player& black) {
+	GameRecord record;
+	record.fen = fen;
+
+	Chess game(fen);
+	map<uint64_t, int> seen;
+	seen[position_key(game.get_board())]++;
+	int resign_count = 0, resign_side = 0, draw_count = 0;
+
+	auto finish = [&record](const string& result, const string& termination) {
+		record.result = result;
+		record.termination = termination;
+		return record;
+	};
+
+	for (int ply = 0; ; ply++) {
+		switch (game.game_status()) {
+		case EGameStatus::gs_checkmate:
+			return finish(game.get_board().side_to_move == EPieceColor::clr_white ? "0-1" : "1-0", "checkmate");
+		case EGameStatus::gs_stalemate:				return finish("1/2-1/2", "stalemate");
+		case EGameStatus::gs_insufficient_material:	return finish("1/2-1/2", "insufficient material");
+		case EGameStatus::gs_fifty_moves:			return finish("1/2-1/2", "fifty move rule");
+		default: break;
+		}
+		if (seen[position_key(game.get_board())] >= 3)
+			return finish("1/2-1/2", "threefold repetition");
+		if (ply >= settings.max_plies)
+			return finish("1/2-1/2", "adjudication: maximum game length");
+
+		bool white_to_move = game.get_board().side_to_move == EPieceColor::clr_white;
+		const char* loss = white_to_move ? "0-1" : "1-0";
+		Player& player = white_to_move ? white : black;
+
+		string uci;
+		int score;
+		if (!player.think(game, uci, score))
+			return finish(loss, "time forfeit");
+
+		// Illegal moves lose
+		bool legal = false;
+		for (const Move& mv : game.legal_moves()) {
+			if (uci_move(mv) == uci) {
+				record.san.push_back(game.san(mv));
+				game.do_move(mv);
+				legal = true;
+				break;
+			}
+		}
+		if (!legal)
+			return finish(loss, "illegal move " + uci);
+		seen[position_key(game.get_board())]++;
+
+		// Adjudication on the scores (white's point of view) of consecutive moves of both engines
+		int white_score = white_to_move ? score : -score;
+		int side = white_score >= settings.resign_score ? 1 : white_score <= -settings.resign_score ? -1 : 0;
+		resign_count = (side != 0 && side == resign_side) ? resign_count + 1 : (side != 0);
+		resign_side = side;
+		if (settings.resign_moves > 0 && resign_count >= 2 * settings.resign_moves)
+			return finish(side > 0 ? "1-0" : "0-1", "adjudication: resign");
+
+		draw_count = abs(white_score) <= settings.draw_score ? draw_count + 1 : 0;
+		if (settings.draw_moves > 0 && ply + 1 >= 2 * settings.draw_after_move && draw_count >= 2 * settings.draw_moves)
+			return finish("1/2-1/2", "adjudication: draw");
+	}
+}
+
+void Match::report(const int game, const GameRecord& record, const bool first_is_white) {
+	lock_guard<mutex> lock(report_mutex);
+	if (record.result == "1/2-1/2")
+		result.draws++;
+	else if ((record.result == "1-0") == first_is_white)
+		result.wins++;
+	else
+		result.losses++;
+
+	*out << "Game " << game + 1 << " (" << record.white << " vs " << record.black << "): " << record.result << " {"
+		<< record.termination << "}" << endl;
+	*out << "Score of " << settings.engines[0].name << " vs " << settings.engines[1].name << ": " << result.wins
+		<< " - " << result.losses << " - " << result.draws << " [" << result.score() << "] " << result.games() << endl;
+	*out << "Elo difference: " << elo(result.score()) << " +/- " << elo_error(result) << endl;
+
+	if (settings.sprt) {
+		double llr = sprt_llr(result, settings.elo0, settings.elo1);
+		double lower = log(settings.beta / (1 - settings.alpha));
+		double upper = log((1 - settings.beta) / settings.alpha);
+		*out << "SPRT: llr " << llr << " [" << lower << ", " << upper << "]";
+		if (llr >= upper || llr <= lower) {
+			*out << ", H" << (llr >= upper ? 1 : 0) << " accepted";
+			stop_flag = true;
+		}
+		*out << endl;
+	}
+
+	write_pgn(game, record);
+}
+
+void Match::write_pgn(const int game, const GameRecord& record) {
+	if (!pgn.is_open())
+		return;
+
+	time_t now = time(nullptr);
+	char date[16];
+	strftime(date, sizeof(date), "%Y.%m.%d", localtime(&now));
+
+	pgn << "[Event \"Self-play match\"]\n";
+	pgn << "[Site \"?\"]\n";
+	pgn << "[Date \"" << date << "\"]\n";
+	pgn << "[Round \"" << game + 1 << "\"]\n";
+	pgn << "[White \"" << record.white << "\"]\n";
+	pgn << "[Black \"" << record.black << "\"]\n";
+	pgn << "[Result \"" << record.result << "\"]\n";
+	if (record.fen != START_FEN) {
+		pgn << "[FEN \"" << record.fen << "\"]\n";
+		pgn << "[SetUp \"1\"]\n";
+	}
+	pgn << "[PlyCount \"" << record.san.size() << "\"]\n";
+	pgn << "[Termination \"" << record.termination << "\"]\n\n";
+
+	// Movetext, wrapped at 80 characters
+	Board b;
+	istringstream(record.fen) >> b;
+	int move_number = b.full_move_count;
+	bool white_to_move = b.side_to_move == EPieceColor::clr_white;
+	string line, token;
+
+	auto add = [this, &line](const string& t) {
+		if (!line.empty() && line.size() + 1 + t.size() > 80) {
+			pgn << line << '\n';
+			line.clear();
+		}
+		line += (line.empty() ? "" : " ") + t;
+	};
+
+	for (size_t i = 0; i < record.san.size(); i++) {
+		if (white_to_move)
+			add(to_string(move_number) + ". " + record.san[i]);
+		else if (i == 0)
+			add(to_string(move_number) + "... " + record.san[i]);
+		else
+			add(record.san[i]);
+		if (!white_to_move)
+			move_number++;
+		white_to_move = !white_to_move;
+	}
+	add(record.result);
+	pgn << line << "\n\n";
+	pgn.flush();
+}
+
+
+// Statistics ---------------------------------------------------------------------------------------------------------
+
+double Match::elo(const double score) {
+	double s = min(max(score, 1e-6), 1 - 1e-6);
+	return 400.0 * log10(s / (1.0 - s));
+}
+
+double Match::elo_error(const MatchResult& r) {
+	int n = r.games();
+	if (n == 0)
+		return 0.0;
+
+	double s = r.score();
+	double variance = (r.wins * pow(1 - s, 2) + r.draws * pow(0.5 - s, 2) + r.losses * pow(s, 2)) / n;
+	double margin = 1.959964 * sqrt(variance / n);
+	return (elo(s + margin) - elo(s - margin)) / 2;
+}
+
+double Match::sprt_llr(const MatchResult& r, const double elo0, const double elo1) {
+	int n = r.games();
+	if (n == 0)
+		return 0.0;
+
+	double s = r.score();
+	double variance = (r.wins * pow(1 - s, 2) + r.draws * pow(0.5 - s, 2) + r.losses * pow(s, 2)) / n;
+	if (variance <= 0)
+		return 0.0;
+
+	double s0 = 1 / (1 + pow(10, -elo0 / 400));
+	double s1 = 1 / (1 + pow(10, -elo1 / 400));
+	return n * (s1 - s0) * (2 * s - s0 - s1) / (2 * variance);
+}
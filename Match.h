@@ -0,0 +1,103 @@
+/*
+ * Match.h
+ *
+ *  Engine-vs-engine match runner for regression testing. Games are played concurrently (one thread per game) by
+ *  the internal search or by UCI engines started as child processes, from openings in an EPD file (every opening
+ *  is played twice with colors reversed). Results are adjudicated, written as PGN and reported as an Elo
+ *  difference, optionally with a sequential probability ratio test (SPRT) that stops the match once the result
+ *  is clear.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <fstream>
+#include <iostream>
+#include "Search.h"
+
+struct MatchEngine {
+	std::string command;		// Command line of a UCI engine, or empty for the internal engine
+	std::string name;			// Name in the PGN (default: "id name" of the engine)
+};
+
+struct MatchSettings {
+	int games = 2;
+	int concurrency = 1;
+	std::string openings_file;	// EPD or FEN per line (start position if empty)
+	std::string pgn_file;		// Games are appended to this file (none if empty)
+	SearchLimits limits;		// Per move, for both engines
+	size_t hash_mb = 16;		// Hash of the internal engine
+	MatchEngine engines[2];
+
+	// Adjudication. Resign: both engines agree a side is down resign_score for resign_moves moves.
+	// Draw: scores within draw_score for draw_moves moves, from move draw_after_move on.
+	int resign_score = 1000;
+	int resign_moves = 4;
+	int draw_score = 10;
+	int draw_moves = 8;
+	int draw_after_move = 40;
+	int max_plies = 400;
+
+	// SPRT of H0: elo = elo0 against H1: elo = elo1 (logistic Elo of the first engine)
+	bool sprt = false;
+	double elo0 = 0.0;
+	double elo1 = 5.0;
+	double alpha = 0.05;
+	double beta = 0.05;
+};
+
+// Wins, draws and losses of the first engine
+struct MatchResult {
+	int wins = 0;
+	int draws = 0;
+	int losses = 0;
+
+	int games() const { return wins + draws + losses; }
+	double score() const { return games() ? (wins + 0.5 * draws) / games() : 0.5; }
+};
+
+class Match {
+public:
+	explicit Match(const MatchSettings& settings);
+
+	// Play the match, reporting every game to out. Returns false if engines could not be started.
+	bool run(std::ostream& out);
+	const MatchResult& get_result() const { return result; }
+
+	// Elo difference for a score fraction, and its 95% confidence half width for a result
+	static double elo(const double score);
+	static double elo_error(const MatchResult& r);
+	// Log likelihood ratio of H1 against H0 (normal approximation of the game results)
+	static double sprt_llr(const MatchResult& r, const double elo0, const double elo1);
+
+private:
+	class Player;
+	class InternalPlayer;
+	class ExternalPlayer;
+
+	struct GameRecord {
+		std::string fen;					// Opening position
+		std::string white, black;
+		std::vector<std::string> san;		// Moves in standard algebraic notation
+		std::string result;					// "1-0", "0-1" or "1/2-1/2"
+		std::string termination;
+	};
+
+	MatchSettings settings;
+	std::vector<std::string> openings;
+	MatchResult result;
+	std::atomic<int> next_game{ 0 };
+	std::atomic<bool> stop_flag{ false };
+	std::mutex report_mutex;
+	std::ofstream pgn;
+	std::ostream* out = nullptr;
+
+	void load_openings();
+	void worker();
+	GameRecord play_game(const std::string& fen, Player& white, Player& black);
+	void report(const int game, const GameRecord& record, const bool first_is_white);
+	void write_pgn(const int game, const GameRecord& record);
+};
@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <cstdint>
+#include "MateSolver.h"
+#include "Chess.h"
+#include "Search.h"
+
+using namespace std;
+
+MateSolver::MateSolver(const size_t hash_mb) {
+	set_hash(hash_mb);
+}
+
+void MateSolver::set_hash(const size_t hash_mb) {
+	// Largest power of two number of entries that fits
+	size_t entries = 1;
+	while (entries * 2 * sizeof(TTEntry) <= max<size_t>(hash_mb, 1) * 1024 * 1024) {
+		entries *= 2;
+	}
+	tt.clear();
+	tt.shrink_to_fit();
+	tt.assign(entries, TTEntry());
+}
+
+void MateSolver::clear() {
+	fill(tt.begin(), tt.end(), TTEntry());
+}
+
+MateResult MateSolver::solve(const Chess& root, const int moves, const SearchLimits& limits, const bool shortest) {
+	start_time = chrono::steady_clock::now();
+	max_nodes = limits.nodes;
+	root_moves = limits.root_moves;
+	time_limit = 0;
+	if (!limits.infinite && limits.movetime > 0)
+		time_limit = max<int64_t>(1, limits.movetime - limits.move_overhead);
+	else if (!limits.infinite && limits.time_left > 0) {
+		TimeManager time_manager;
+		time_manager.init(limits.time_left, limits.increment, limits.moves_to_go, limits.move_overhead);
+		time_limit = time_manager.get_hard_limit();
+	}
+	stop_flag = false;
+	aborted = false;
+	nodes = 0;
+
+	MateResult result;
+	const uint64_t root_key = position_key(root.get_board());
+	for (int n = moves; n >= 1 && !aborted; n--) {
+		// Every search starts from a fresh copy: after undo_last_moves(1, false) the pseudolegal moves are stale
+		Chess c = root;
+		chess = &c;
+		path.assign(1, root_key);
+		Child node{ Move{ -1, -1 }, root_key, 1, 1, 0 };
+		mid(root_key, 2 * n - 1, INF, INF, node);
+		if (aborted || node.phi != 0) {
+			// No mate in n moves: the previous (longer) mate is the shortest
+			result.disproven = !aborted && node.delta == 0 && result.moves == 0;
+			break;
+		}
+
+		result.moves = (node.plies + 1) / 2;
+		result.pv.clear();
+		Chess line = root;
+		chess = &line;
+		extract_pv(2 * n - 1, result.pv);
+		if (!shortest)
+			break;
+		n = result.moves;
+	}
+
+	result.nodes = nodes;
+	result.time = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_time).count();
+	return result;
+}
+
+/* Multiple iterative deepening: search below node until its phi or delta reaches its threshold. The child with the
+smallest delta is searched with thresholds that return as soon as another child becomes better. */
+void MateSolver::mid(const uint64_t key, const int remaining, const uint32_t th_phi, const uint32_t th_delta, Child& node) {
+	nodes++;
+	if (stop_flag.load(memory_order_relaxed) || (max_nodes && nodes >= max_nodes)
+		|| (time_limit && (nodes & 1023) == 0
+			&& chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_time).count() >= time_limit)) {
+		aborted = true;
+		return;
+	}
+
+	const bool attacker = remaining & 1;
+	vector<Child> children;
+	expand(remaining, children);
+	if (children.empty()) {
+		// Mate or stalemate of the defender (a stalemate is a successful defence), or an attacker without moves
+		bool escaped = !attacker && !chess->in_check();
+		node.phi = escaped ? 0 : INF;
+		node.delta = escaped ? INF : 0;
+		node.plies = 0;
+		tt_store(key, remaining, node);
+		return;
+	}
+
+	while (true) {
+		uint64_t phi = INF, delta = 0;
+		Child* best = nullptr;
+		uint32_t second_delta = INF;
+		for (Child& ch : children) {
+			delta = min<uint64_t>(delta + ch.phi, INF);
+			if (!best || ch.delta < best->delta) {
+				if (best)
+					second_delta = best->delta;
+				best = &ch;
+			}
+			else
+				second_delta = min(second_delta, ch.delta);
+		}
+		if (best)
+			phi = best->delta;
+		node.phi = (uint32_t)phi;
+		node.delta = (uint32_t)delta;
+
+		if (phi >= th_phi || delta >= th_delta || aborted)
+			break;
+
+		uint64_t child_th_phi = min<uint64_t>((uint64_t)th_delta + best->phi - delta, INF);
+		uint32_t child_th_delta = min<uint32_t>(th_phi, second_delta + 1);
+		chess->do_move(best->move);
+		path.push_back(best->key);
+		mid(best->key, remaining - 1, (uint32_t)child_th_phi, child_th_delta, *best);
+		path.pop_back();
+		chess->undo_last_moves(1, false);
+	}
+
+	// Length of a proven mate: the attacker takes the fastest mating move, the defender the slowest reply
+	node.plies = 0;
+	if (attacker && node.phi == 0) {
+		node.plies = UINT16_MAX;
+		for (const Child& ch : children) {
+			if (ch.delta == 0)
+				node.plies = min<uint16_t>(node.plies, ch.plies + 1);
+		}
+	}
+	else if (!attacker && node.delta == 0) {
+		for (const Child& ch : children) {
+			node.plies = max<uint16_t>(node.plies, ch.plies + 1);
+		}
+	}
+	// With a root move filter the root is not solved for all its moves
+	if (!aborted && (path.size() > 1 || root_moves.empty()))
+		tt_store(key, remaining, node);
+}
+
+// Children of the current position with their numbers from the table, or solved when they are terminal
+void MateSolver::expand(const int remaining, vector<Child>& children) {
+	const bool attacker = remaining & 1;
+
+	// Own copy: after undo_last_moves(1, false) the pseudolegal moves of chess are stale
+	vector<Move> moves = chess->get_pseudolegal_moves();
+	for (const Move& mv : moves) {
+		if ((path.size() == 1 && !is_root_move(mv)) || !chess->do_move(mv))
+			continue;
+		uint64_t key = position_key(chess->get_board());
+		Child ch{ mv, key, 1, 1, 0 };
+
+		if (find(path.begin(), path.end(), key) != path.end()) {
+			// A repetition makes no progress towards the mate
+			ch.phi = attacker ? 0 : INF;
+			ch.delta = attacker ? INF : 0;
+		}
+		else if (remaining == 1) {
+			// Last attacker move: the defender is mated or the attack failed
+			bool mate = is_checkmate();
+			ch.phi = mate ? INF : 0;
+			ch.delta = mate ? 0 : INF;
+		}
+		else if (const TTEntry* e = tt_probe(key, remaining - 1)) {
+			ch.phi = e->phi;
+			ch.delta = e->delta;
+			ch.plies = e->plies;
+		}
+		else if (attacker && !chess->in_check()) {
+			ch.delta = 2;		// Quiet attacker moves are less likely to mate than checks
+		}
+		chess->undo_last_moves(1, false);
+		children.push_back(ch);
+	}
+}
+
+// Follow the proof: fastest mating moves, slowest defences
+void MateSolver::extract_pv(const int remaining, vector<Move>& pv) {
+	if (remaining <= 0)
+		return;
+	const bool attacker = remaining & 1;
+
+	vector<Move> moves = chess->legal_moves();
+	const Move* best = nullptr;
+	int best_plies = attacker ? INT32_MAX : -1;
+	for (const Move& mv : moves) {
+		if (pv.empty() && !is_root_move(mv))
+			continue;
+		chess->do_move(mv);
+		int plies = -1;
+		if (remaining == 1)
+			plies = is_checkmate() ? 0 : -1;
+		else if (const TTEntry* e = tt_probe(position_key(chess->get_board()), remaining - 1)) {
+			bool proven = attacker ? e->delta == 0 : e->phi == 0;
+			if (proven)
+				plies = e->plies;
+		}
+		chess->undo_last_moves(1, false);
+
+		if (plies >= 0 && (attacker ? plies < best_plies : plies > best_plies)) {
+			best = &mv;
+			best_plies = plies;
+		}
+	}
+	if (!best)
+		return;
+
+	pv.push_back(*best);
+	chess->do_move(*best);
+	if (best_plies > 0)
+		extract_pv(remaining - 1, pv);
+	chess->undo_last_moves(1, false);
+}
+
+bool MateSolver::is_checkmate() {
+	return chess->in_check() && chess->legal_moves().empty();
+}
+
+bool MateSolver::is_root_move(const Move& mv) const {
+	if (root_moves.empty())
+		return true;
+	for (const Move& m : root_moves) {
+		if (m.from == mv.from && m.to == mv.to && m.promotion == mv.promotion)
+			return true;
+	}
+	return false;
+}
+
+uint64_t MateSolver::tt_key(const uint64_t key, const int remaining) {
+	return key ^ ((uint64_t)remaining * 0x9E3779B97F4A7C15ULL);
+}
+
+const MateSolver::TTEntry* MateSolver::tt_probe(const uint64_t key, const int remaining) const {
+	uint64_t k = tt_key(key, remaining);
+	size_t index = k & (tt.size() - 1);
+	for (size_t i : { index, index ^ 1 }) {
+		if (tt[i].key == k && (tt[i].phi || tt[i].delta))
+			return &tt[i];
+	}
+	return nullptr;
+}
+
+// Two slots per key; solved entries are kept over unsolved ones
+void MateSolver::tt_store(const uint64_t key, const int remaining, const Child& node) {
+	uint64_t k = tt_key(key, remaining);
+	size_t index = k & (tt.size() - 1);
+	TTEntry* slot = &tt[index];
+	TTEntry* other = &tt[index ^ 1];
+	auto solved = [](const TTEntry* e) { return e->phi == 0 || e->delta == 0; };
+	if (other->key == k || (slot->key != k && solved(slot) && !solved(other)))
+		slot = other;
+
+	slot->key = k;
+	slot->phi = node.phi;
+	slot->delta = node.delta;
+	slot->plies = node.plies;
+}
@@ -0,0 +1,84 @@
+/*
+ * MateSolver.h
+ *
+ *  Mate search with depth-first proof-number search (df-pn). The attacker (side to move) needs one move that mates,
+ *  the defender must be mated after all replies, so the tree is searched where it is closest to a proof or a
+ *  disproof instead of to a fixed depth. Proof and disproof numbers are kept in a fixed size transposition table
+ *  keyed by position and remaining plies. Checks get a smaller initial proof number than quiet moves.
+ */
+
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "EnumList.h"
+#include "LargePages.h"
+#include "Search.h"
+
+class Chess;
+
+struct MateResult {
+	int moves = 0;				// Mate in this number of moves, 0 if no mate was found
+	bool disproven = false;		// There is no mate within the number of moves searched
+	std::vector<Move> pv;		// Mating line (defender replies that last longest within the proof)
+	uint64_t nodes = 0;
+	int64_t time = 0;			// Milliseconds
+};
+
+class MateSolver {
+public:
+	explicit MateSolver(const size_t hash_mb = 16);
+
+	void set_hash(const size_t hash_mb);
+	void clear();
+
+	/* Look for a mate in at most moves moves for the side to move of chess, starting with one of limits.root_moves
+	(all legal moves if empty). With shortest, a mate that is found is shortened until a shorter one is disproven.
+	The node limit, the time limit (movetime, else the hard limit of the clock, unless infinite) and stop() end the
+	search early; a mate found before that is kept. */
+	MateResult solve(const Chess& chess, const int moves, const SearchLimits& limits, const bool shortest = true);
+	void stop() { stop_flag = true; }
+
+private:
+	static const uint32_t INF = 100000000;
+
+	// phi and delta are the proof numbers of the side to move and of its opponent: phi 0 means the side to move
+	// reached its goal (mate, or escaping the mate), delta 0 that it failed
+	struct TTEntry {
+		uint64_t key;
+		uint32_t phi;
+		uint32_t delta;
+		uint16_t plies;			// Plies to mate of a proven node
+	};
+
+	struct Child {
+		Move move;
+		uint64_t key;			// Position key
+		uint32_t phi;
+		uint32_t delta;
+		uint16_t plies;
+	};
+
+	std::vector<TTEntry, LargePageAllocator<TTEntry>> tt;
+	Chess* chess = nullptr;
+	std::vector<uint64_t> path;			// Position keys from the root, for repetitions
+	std::vector<Move> root_moves;		// Allowed first moves (all if empty)
+	uint64_t nodes = 0;
+	uint64_t max_nodes = 0;
+	std::chrono::steady_clock::time_point start_time;
+	int64_t time_limit = 0;				// Milliseconds (0 for no limit)
+	std::atomic<bool> stop_flag{ false };
+	bool aborted = false;
+
+	void mid(const uint64_t key, const int remaining, const uint32_t th_phi, const uint32_t th_delta, Child& node);
+	void expand(const int remaining, std::vector<Child>& children);
+	void extract_pv(const int remaining, std::vector<Move>& pv);
+	bool is_checkmate();
+	bool is_root_move(const Move& mv) const;
+
+	static uint64_t tt_key(const uint64_t key, const int remaining);
+	const TTEntry* tt_probe(const uint64_t key, const int remaining) const;
+	void tt_store(const uint64_t key, const int remaining, const Child& node);
+};
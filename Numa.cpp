@@ -0,0 +1,207 @@
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <cstdint>
+#include "Numa.h"
+
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+atomic<int> binding{ (int)ThreadBinding::tb_auto };
+atomic<bool> interleave{ true };
+thread_local int bound_node = -1;
+
+// "0-3,8,10-11"
+vector<int> parse_cpu_list(const string& list) {
+	vector<int> cpus;
+	istringstream in(list);
+	string range;
+	while (getline(in, range, ',')) {
+		size_t dash = range.find('-');
+		int first = atoi(range.c_str());
+		int last = dash == string::npos ? first : atoi(range.c_str() + dash + 1);
+		for (int cpu = first; cpu <= last && !range.empty(); cpu++) {
+			cpus.push_back(cpu);
+		}
+	}
+	return cpus;
+}
+
+string format_cpu_list(const vector<int>& cpus) {
+	ostringstream out;
+	for (size_t i = 0; i < cpus.size(); i++) {
+		size_t j = i;
+		while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+			j++;
+		}
+		out << (i ? "," : "") << cpus[i];
+		if (j > i)
+			out << "-" << cpus[j];
+		i = j;
+	}
+	return out.str();
+}
+
+ThreadBinding effective_binding() {
+	ThreadBinding b = (ThreadBinding)binding.load();
+	if (b == ThreadBinding::tb_auto)
+		return cpu_topology().node_cpus.size() > 1 ? ThreadBinding::tb_node : ThreadBinding::tb_off;
+	return b;
+}
+
+#ifdef __linux__
+
+// Memory policies of mbind(2), without depending on libnuma
+const int MPOL_PREFERRED_MODE = 1;
+const int MPOL_INTERLEAVE_MODE = 3;
+const unsigned MPOL_MF_MOVE_FLAG = 1 << 1;
+
+void set_policy(void* p, const size_t bytes, const int mode, const vector<int>& nodes) {
+	const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t begin = ((uintptr_t)p + page - 1) / page * page;
+	uintptr_t end = ((uintptr_t)p + bytes) / page * page;
+	if (end <= begin)
+		return;
+
+	unsigned long mask[1024 / (8 * sizeof(unsigned long))] = {};
+	for (int node : nodes) {
+		if (node >= 0 && node < 1024)
+			mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+	}
+	syscall(SYS_mbind, begin, end - begin, mode, mask, (unsigned long)1024, MPOL_MF_MOVE_FLAG);
+}
+
+#endif
+
+// Read on the main thread during static initialization, before any thread is pinned
+const CpuTopology& topology_at_start = cpu_topology();
+
+}  // namespace
+
+const CpuTopology& cpu_topology() {
+	static const CpuTopology topology = []() {
+		CpuTopology t;
+#ifdef __linux__
+		cpu_set_t allowed;
+		bool have_mask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+		ifstream online("/sys/devices/system/node/online");
+		string nodes;
+		getline(online, nodes);
+		for (int node : parse_cpu_list(nodes)) {
+			ifstream file("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+			string list;
+			getline(file, list);
+			vector<int> cpus;
+			for (int cpu : parse_cpu_list(list)) {
+				if (!have_mask || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)))
+					cpus.push_back(cpu);
+			}
+			if (!cpus.empty()) {
+				t.node_ids.push_back(node);
+				t.node_cpus.push_back(cpus);
+			}
+		}
+		if (t.node_cpus.empty() && have_mask) {
+			t.node_ids.push_back(0);
+			t.node_cpus.emplace_back();
+			for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+				if (CPU_ISSET(cpu, &allowed))
+					t.node_cpus[0].push_back(cpu);
+			}
+		}
+#endif
+		if (t.node_cpus.empty()) {
+			t.node_ids.push_back(0);
+			t.node_cpus.emplace_back();
+			for (int cpu = 0; cpu < (int)max(1u, thread::hardware_concurrency()); cpu++) {
+				t.node_cpus[0].push_back(cpu);
+			}
+		}
+		return t;
+	}();
+	return topology;
+}
+
+void set_thread_binding(const ThreadBinding b) {
+	binding = (int)b;
+}
+
+void set_numa_interleave(const bool on) {
+	interleave = on;
+}
+
+int bind_thread(const int index) {
+	ThreadBinding b = effective_binding();
+	if (b == ThreadBinding::tb_off)
+		return -1;
+#ifdef __linux__
+	const CpuTopology& t = cpu_topology();
+	const int nodes = (int)t.node_cpus.size();
+	const int node = max(index, 0) % nodes;
+	const vector<int>& cpus = t.node_cpus[node];
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (b == ThreadBinding::tb_core)
+		CPU_SET(cpus[(max(index, 0) / nodes) % cpus.size()], &set);
+	else {
+		for (int cpu : cpus) {
+			CPU_SET(cpu, &set);
+		}
+	}
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+		return -1;
+	bound_node = node;
+	return node;
+#else
+	return -1;
+#endif
+}
+
+void place_memory(void* p, const size_t bytes) {
+#ifdef __linux__
+	const CpuTopology& t = cpu_topology();
+	if (t.node_cpus.size() < 2)
+		return;
+	if (bound_node >= 0)
+		set_policy(p, bytes, MPOL_PREFERRED_MODE, { t.node_ids[bound_node] });
+	else if (interleave)
+		set_policy(p, bytes, MPOL_INTERLEAVE_MODE, t.node_ids);
+#else
+	(void)p;
+	(void)bytes;
+#endif
+}
+
+void interleave_memory(void* p, const size_t bytes) {
+#ifdef __linux__
+	const CpuTopology& t = cpu_topology();
+	if (t.node_cpus.size() >= 2 && interleave)
+		set_policy(p, bytes, MPOL_INTERLEAVE_MODE, t.node_ids);
+#else
+	(void)p;
+	(void)bytes;
+#endif
+}
+
+std::string topology_info() {
+	const CpuTopology& t = cpu_topology();
+	const char* names[4] = { "auto", "off", "node", "core" };
+	ostringstream out;
+	out << t.node_cpus.size() << " NUMA node" << (t.node_cpus.size() > 1 ? "s" : "") << ":";
+	for (size_t i = 0; i < t.node_cpus.size(); i++) {
+		out << (i ? "; " : " ") << t.node_ids[i] << " (cpus " << format_cpu_list(t.node_cpus[i]) << ")";
+	}
+	out << ", binding " << names[(int)effective_binding()] << ", interleave " << (interleave ? "on" : "off");
+	return out.str();
+}
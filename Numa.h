@@ -0,0 +1,46 @@
+/*
+ * Numa.h
+ *
+ *  Thread and memory placement on multi-socket machines. The CPUs of every NUMA node are read from /sys on Linux
+ *  (limited to the CPUs this process may run on). Worker threads of the thread pools (perft, bench, datagen, batch,
+ *  tablebase generation, tuning, the search thread) are pinned to a node or a core, spread evenly over the nodes, so
+ *  they do not migrate away from their memory. Tables allocated by a pinned thread are placed on its node; shared
+ *  tables are interleaved over all nodes. Elsewhere, and on single node machines by default, nothing is pinned.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+enum class ThreadBinding {
+	tb_auto = 0,				// tb_node on machines with more than one node, else tb_off
+	tb_off = 1,
+	tb_node = 2,				// Any CPU of the worker's node
+	tb_core = 3,				// One CPU per worker
+};
+
+struct CpuTopology {
+	std::vector<int> node_ids;					// Node numbers as in /sys/devices/system/node
+	std::vector<std::vector<int>> node_cpus;	// CPUs of every node
+};
+
+const CpuTopology& cpu_topology();
+
+void set_thread_binding(const ThreadBinding binding);
+// Interleave tables allocated by threads that are not pinned (default on)
+void set_numa_interleave(const bool on);
+
+/* Pin the calling thread as worker index of a pool: worker i goes to node i % nodes, so every pool is spread evenly.
+Returns the node index, or -1 if the thread is not pinned. */
+int bind_thread(const int index);
+
+/* Place the memory of a new table (whole pages in [p, p + bytes)): on the node of the calling thread if it is pinned,
+else interleaved over all nodes. Pages already touched are moved. */
+void place_memory(void* p, const size_t bytes);
+// Interleave the memory of a table shared by all threads of a pool
+void interleave_memory(void* p, const size_t bytes);
+
+// E.g. "2 NUMA nodes: 0 (cpus 0-15); 1 (cpus 16-31), binding node, interleave on"
+std::string topology_info();
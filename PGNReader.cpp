@@ -0,0 +1,205 @@
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cctype>
+#include "PGNReader.h"
+
+using namespace std;
+
+std::string PGNGame::tag(const std::string& name) const {
+	for (const auto& t : tags) {
+		if (t.first == name)
+			return t.second;
+	}
+	return "";
+}
+
+bool PGNReader::open(const std::string& path) {
+	file.close();
+	file.clear();
+	pending.clear();
+	file.open(path);
+	return (bool)file;
+}
+
+// A game ends where the tags of the next one start (a line beginning with '[' after movetext)
+bool PGNReader::next_game_text(std::string& text) {
+	text = pending;
+	pending.clear();
+	bool movetext = false;
+
+	string line;
+	while (getline(file, line)) {
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+
+		bool tag_line = !line.empty() && line[0] == '[' && line.compare(0, 2, "[%") != 0;
+		if (tag_line && movetext) {
+			pending = line + '\n';
+			return true;
+		}
+		if (!tag_line && line.find_first_not_of(" \t") != string::npos)
+			movetext = true;
+		text += line;
+		text += '\n';
+	}
+	return text.find_first_not_of(" \t\n") != string::npos;
+}
+
+bool PGNReader::parse_game(const std::string& text, PGNGame& pgn) {
+	pgn.tags.clear();
+	pgn.result = "*";
+	pgn.error.clear();
+
+	// Tags
+	size_t i = 0, n = text.size();
+	while (i < n) {
+		size_t eol = text.find('\n', i);
+		if (eol == string::npos)
+			eol = n;
+		if (text[i] == '[') {
+			size_t name_end = text.find(' ', i);
+			size_t open_quote = text.find('"', i);
+			size_t close_quote = text.rfind('"', eol);
+			if (name_end < eol && open_quote < close_quote && close_quote < eol)
+				pgn.tags.emplace_back(text.substr(i + 1, name_end - i - 1), text.substr(open_quote + 1, close_quote - open_quote - 1));
+		}
+		else if (text.find_first_not_of(" \t\r", i) < eol)
+			break;
+		i = eol + 1;
+	}
+
+	string fen = pgn.tag("FEN");
+	pgn.game = fen.empty() ? Chess() : Chess(fen);
+
+	// Movetext
+	string token;
+	while (i < n) {
+		char c = text[i];
+		if (isspace((unsigned char)c) || c == '.') {
+			i++;
+		}
+		else if (c == '{') {
+			i = text.find('}', i);
+			i = (i == string::npos) ? n : i + 1;
+		}
+		else if (c == ';' || c == '%') {
+			i = text.find('\n', i);
+			i = (i == string::npos) ? n : i + 1;
+		}
+		else if (c == '(') {
+			// Variations nest and may contain comments
+			int depth = 0;
+			for (; i < n; i++) {
+				if (text[i] == '{') {
+					i = text.find('}', i);
+					if (i == string::npos)
+						i = n - 1;
+				}
+				else if (text[i] == '(')
+					depth++;
+				else if (text[i] == ')' && --depth == 0)
+					break;
+			}
+			i++;
+		}
+		else if (c == '$') {
+			for (i++; i < n && isdigit((unsigned char)text[i]); i++) {}
+		}
+		else {
+			size_t start = i;
+			while (i < n && !isspace((unsigned char)text[i]) && text[i] != '{' && text[i] != '(' && text[i] != ';' && text[i] != '$')
+				i++;
+			token.assign(text, start, i - start);
+
+			// Move numbers ("12." or "12..."), possibly without space before the move ("12.e4")
+			size_t digits = token.find_first_not_of("0123456789");
+			if (digits != 0 && (digits == string::npos || token[digits] == '.')) {
+				size_t move_start = token.find_first_not_of(".", digits);
+				if (digits == string::npos || move_start == string::npos)
+					continue;
+				token.erase(0, move_start);
+			}
+
+			if (token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*") {
+				pgn.result = token;
+				break;
+			}
+			if (!pgn.game.do_san_move(token)) {
+				pgn.error = "illegal or unreadable move " + token;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+uint64_t PGNReader::process(const std::string& path, const int threads,
+	const std::function<void(const int, const PGNGame&)>& callback) {
+	PGNReader reader;
+	if (!reader.open(path))
+		return 0;
+
+	// The calling thread reads batches of game texts, workers parse them
+	const size_t batch_size = 64;
+	const size_t max_batches = 4 * max(1, threads);
+	deque<vector<string>> queue;
+	mutex queue_mutex;
+	condition_variable queue_changed;
+	bool done = false;
+
+	vector<thread> workers;
+	for (int t = 0; t < max(1, threads); t++) {
+		workers.emplace_back([&, t]() {
+			PGNGame pgn;
+			while (true) {
+				vector<string> batch;
+				{
+					unique_lock<mutex> lock(queue_mutex);
+					queue_changed.wait(lock, [&]() { return done || !queue.empty(); });
+					if (queue.empty())
+						return;
+					batch = move(queue.front());
+					queue.pop_front();
+				}
+				queue_changed.notify_all();
+
+				for (const string& text : batch) {
+					parse_game(text, pgn);
+					callback(t, pgn);
+				}
+			}
+		});
+	}
+
+	uint64_t games = 0;
+	vector<string> batch;
+	string text;
+	while (true) {
+		bool more = reader.next_game_text(text);
+		if (more) {
+			batch.push_back(move(text));
+			games++;
+		}
+		if (batch.size() == batch_size || (!more && !batch.empty())) {
+			unique_lock<mutex> lock(queue_mutex);
+			queue_changed.wait(lock, [&]() { return queue.size() < max_batches; });
+			queue.push_back(move(batch));
+			batch.clear();
+			queue_changed.notify_all();
+		}
+		if (!more)
+			break;
+	}
+
+	{
+		lock_guard<mutex> lock(queue_mutex);
+		done = true;
+	}
+	queue_changed.notify_all();
+	for (thread& w : workers) {
+		w.join();
+	}
+	return games;
+}
@@ -0,0 +1,49 @@
+/*
+ * PGNReader.h
+ *
+ *  Streaming PGN reader. The file is read sequentially and split into games, which are parsed in batches by worker
+ *  threads: tags are collected and the SAN movetext (comments, variations and NAGs are skipped) is replayed through
+ *  Chess::do_san_move. Games are handed to a callback, so databases of any size are processed in constant memory.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <fstream>
+#include <cstdint>
+#include "Chess.h"
+
+struct PGNGame {
+	std::vector<std::pair<std::string, std::string>> tags;
+	Chess game;					// Start position (FEN tag or the initial position) with all moves played
+	std::string result;			// "1-0", "0-1", "1/2-1/2" or "*"
+	std::string error;			// Set if the movetext could not be replayed (moves up to the error are in game)
+
+	// Value of tag name, or empty if not present
+	std::string tag(const std::string& name) const;
+};
+
+class PGNReader {
+public:
+	bool open(const std::string& path);
+	void close() { file.close(); }
+
+	// Text of the next game (tags and movetext). Returns false at the end of the file.
+	bool next_game_text(std::string& text);
+
+	// Parse the text of one game. Returns false (with game.error set) if it contains an illegal or unreadable move.
+	static bool parse_game(const std::string& text, PGNGame& game);
+
+	// Read all games of the file at path with threads worker threads, calling callback (thread index, game) for
+	// every game, also the ones with errors. The callback is called concurrently from different threads.
+	// Returns the number of games read.
+	static uint64_t process(const std::string& path, const int threads,
+		const std::function<void(const int, const PGNGame&)>& callback);
+
+private:
+	std::ifstream file;
+	std::string pending;		// First line of the next game, read while looking for the end of the previous one
+};
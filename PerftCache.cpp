@@ -0,0 +1,229 @@
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <cstring>
+#include "PerftCache.h"
+#include "Chess.h"
+#include "Search.h"
+#include "Numa.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+struct CacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t entries;
+};
+
+const char CACHE_MAGIC[4] = { 'C', 'P', 'F', 'C' };
+const uint32_t CACHE_VERSION = 1;
+
+}  // namespace
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Cache entries are shared between processes");
+
+PerftCache::~PerftCache() {
+	close();
+}
+
+#ifdef _WIN32
+
+bool PerftCache::open(const std::string&, const size_t, const bool) { return false; }
+void PerftCache::close() {}
+void PerftCache::flush() {}
+
+#else
+
+bool PerftCache::open(const std::string& path, const size_t size_mb, const bool open_read_only) {
+	close();
+
+	int fd = ::open(path.c_str(), open_read_only ? O_RDONLY : O_RDWR | O_CREAT, 0644);
+	if (fd == -1)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		::close(fd);
+		return false;
+	}
+
+	// New file: largest power of two number of entries that fits
+	bool created = st.st_size == 0;
+	if (created) {
+		if (open_read_only) {
+			::close(fd);
+			return false;
+		}
+		uint64_t entries = 1;
+		while ((entries * 2) * sizeof(Entry) <= max<size_t>(size_mb, 1) * 1024 * 1024) {
+			entries *= 2;
+		}
+		st.st_size = (off_t)(sizeof(CacheHeader) + entries * sizeof(Entry));
+		if (ftruncate(fd, st.st_size) == -1) {
+			::close(fd);
+			return false;
+		}
+	}
+
+	void* view = mmap(nullptr, (size_t)st.st_size, open_read_only ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (view == MAP_FAILED)
+		return false;
+
+	base = static_cast<unsigned char*>(view);
+	map_size = (size_t)st.st_size;
+	CacheHeader* header = reinterpret_cast<CacheHeader*>(base);
+	if (created) {
+		memcpy(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+		header->version = CACHE_VERSION;
+		header->entries = (map_size - sizeof(CacheHeader)) / sizeof(Entry);
+	}
+
+	uint64_t entries = header->entries;
+	if (memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header->version != CACHE_VERSION
+		|| entries == 0 || (entries & (entries - 1)) != 0 || sizeof(CacheHeader) + entries * sizeof(Entry) != map_size) {
+		close();
+		return false;
+	}
+
+	table = reinterpret_cast<Entry*>(base + sizeof(CacheHeader));
+	mask = entries - 1;
+	read_only = open_read_only;
+	hits = 0;
+	return true;
+}
+
+void PerftCache::close() {
+	if (base) {
+		flush();
+		munmap(base, map_size);
+	}
+	base = nullptr;
+	table = nullptr;
+	map_size = 0;
+	mask = 0;
+}
+
+void PerftCache::flush() {
+	if (base && !read_only)
+		msync(base, map_size, MS_SYNC);
+}
+
+#endif
+
+// Two slots per key: key & mask and its neighbour
+bool PerftCache::probe(const uint64_t key, const int depth, uint64_t& nodes) const {
+	if (!table)
+		return false;
+	uint64_t index = key & mask;
+	for (uint64_t i : { index, index ^ 1 }) {
+		uint64_t data = table[i].data.load(memory_order_relaxed);
+		uint64_t check = table[i].check.load(memory_order_relaxed);
+		if ((check ^ data) == key && (int)(data & 0xFF) == depth && data != 0) {
+			nodes = data >> 8;
+			hits.fetch_add(1, memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+// Replaces the entry of the same position, or else the shallower one (deep results save the most work)
+void PerftCache::store(const uint64_t key, const int depth, const uint64_t nodes) {
+	if (!table || read_only)
+		return;
+	uint64_t index = key & mask;
+	Entry* slot = &table[index];
+	Entry* other = &table[index ^ 1];
+	uint64_t slot_data = slot->data.load(memory_order_relaxed);
+	uint64_t other_data = other->data.load(memory_order_relaxed);
+	bool slot_same = (slot->check.load(memory_order_relaxed) ^ slot_data) == key;
+	bool other_same = (other->check.load(memory_order_relaxed) ^ other_data) == key;
+	if (other_same || (!slot_same && (other_data & 0xFF) < (slot_data & 0xFF)))
+		slot = other;
+
+	uint64_t data = (nodes << 8) | (uint64_t)depth;
+	slot->data.store(data, memory_order_relaxed);
+	slot->check.store(key ^ data, memory_order_relaxed);
+}
+
+
+uint64_t perft_cached(Chess& c, const int depth, PerftCache& cache) {
+	if (depth < PerftCache::MIN_DEPTH)
+		return (uint64_t)c.perft(depth);
+
+	uint64_t key = position_key(c.get_board());
+	uint64_t nodes = 0;
+	if (cache.probe(key, depth, nodes))
+		return nodes;
+
+	// Own copy: after undo_last_moves(1, false) the pseudolegal moves of c are stale
+	vector<Move> moves = c.get_pseudolegal_moves();
+	for (const Move& mv : moves) {
+		if (c.do_move(mv)) {
+			nodes += perft_cached(c, depth - 1, cache);
+			c.undo_last_moves(1, false);
+		}
+	}
+	cache.store(key, depth, nodes);
+	return nodes;
+}
+
+uint64_t perft_divide(const std::string& fen, const int depth, const int threads, PerftCache* cache, std::ostream& out) {
+	Chess root(fen);
+	vector<Move> moves = root.legal_moves();
+	if (depth <= 0)
+		return 1;
+
+	vector<uint64_t> nodes(moves.size());
+	atomic<size_t> next{ 0 };
+	mutex out_mutex;
+	auto start = chrono::steady_clock::now();
+
+	vector<thread> workers;
+	for (int t = 0; t < max(1, threads); t++) {
+		workers.emplace_back([&, t]() {
+			bind_thread(t);
+			Chess c = root;
+			for (size_t i = next++; i < moves.size(); i = next++) {
+				c.do_move(moves[i]);
+				bool resumed = cache && cache->probe(position_key(c.get_board()), depth - 1, nodes[i]);
+				if (!resumed)
+					nodes[i] = cache ? perft_cached(c, depth - 1, *cache) : (uint64_t)c.perft(depth - 1);
+				c.undo_last_moves(1, false);
+
+				// Checkpoint: an interrupted run continues after the finished root moves
+				if (cache && !resumed)
+					cache->flush();
+				lock_guard<mutex> lock(out_mutex);
+				out << uci_move(moves[i]) << ": " << nodes[i] << (resumed ? " (cached)" : "") << endl;
+			}
+		});
+	}
+	for (thread& w : workers) {
+		w.join();
+	}
+
+	uint64_t total = 0;
+	for (uint64_t n : nodes) {
+		total += n;
+	}
+	auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+	out << "===========================" << endl;
+	out << "Total time (ms) : " << elapsed << endl;
+	out << "Nodes searched  : " << total << endl;
+	out << "Nodes/second    : " << total * 1000 / max<int64_t>(elapsed, 1) << endl;
+	if (cache)
+		out << "Cache hits      : " << cache->get_hits() << endl;
+	return total;
+}
@@ -0,0 +1,64 @@
+/*
+ * PerftCache.h
+ *
+ *  Persistent perft results. A file backed hash table of (position key, depth) -> node count is mapped into memory,
+ *  so results survive between runs: an interrupted divide resumes with every finished subtree counted already, and
+ *  repeated runs only count what is not in the file. Every entry stores its key xor its data, so entries torn by
+ *  concurrent writers are detected on probe; several processes can share one file, writing or read-only.
+ *  Only available on POSIX systems.
+ */
+
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+
+class Chess;
+
+class PerftCache {
+public:
+	// Subtrees of lower depth are counted, not cached
+	static const int MIN_DEPTH = 3;
+
+	PerftCache() = default;
+	~PerftCache();
+
+	PerftCache(const PerftCache&) = delete;
+	PerftCache& operator=(const PerftCache&) = delete;
+
+	/* Map the cache file at path. A new file is created with size_mb megabytes; an existing file keeps its size.
+	Read-only caches are only probed. Returns succes flag. */
+	bool open(const std::string& path, const size_t size_mb, const bool read_only);
+	void close();
+	bool is_open() const { return table != nullptr; }
+
+	bool probe(const uint64_t key, const int depth, uint64_t& nodes) const;
+	void store(const uint64_t key, const int depth, const uint64_t nodes);
+	// Write changed pages to the file (checkpoint)
+	void flush();
+
+	uint64_t get_hits() const { return hits; }
+	uint64_t get_capacity() const { return mask + 1; }
+
+private:
+	struct Entry {
+		std::atomic<uint64_t> check;	// key ^ data
+		std::atomic<uint64_t> data;		// nodes << 8 | depth
+	};
+
+	Entry* table = nullptr;
+	uint64_t mask = 0;
+	unsigned char* base = nullptr;		// Mapping: header followed by the table
+	size_t map_size = 0;
+	bool read_only = true;
+	mutable std::atomic<uint64_t> hits{ 0 };
+};
+
+// Perft of c with the subtrees of at least PerftCache::MIN_DEPTH plies looked up in and added to cache
+uint64_t perft_cached(Chess& c, const int depth, PerftCache& cache);
+
+/* Divide of fen at depth with threads threads working on different root moves: the node count of every root move
+and the total. With a cache, finished root moves are checkpointed to the file. Returns the total. */
+uint64_t perft_divide(const std::string& fen, const int depth, const int threads, PerftCache* cache, std::ostream& out);
@@ -0,0 +1,55 @@
+/*
+ * PolyglotBook.h
+ *
+ *  Reader for opening books in the Polyglot .bin format. The book is memory mapped and binary searched,
+ *  so it is never loaded into memory as a whole.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdint>
+#include "EnumList.h"
+#include "MappedFile.h"
+
+struct BookEntry {
+	std::string move;		// Move in UCI notation (castling converted from king-takes-rook to e1g1 style)
+	uint16_t weight;		// Relative weight of the move
+};
+
+class PolyglotBook {
+	/* Polyglot book entries are 16 bytes, big endian: key (64 bit), move (16 bit), weight (16 bit), learn (32 bit).
+	Entries are sorted by key. The key is the Polyglot Zobrist hash of the position, which is built from the fixed
+	table of 781 random numbers (Random64) of the Polyglot book format specification.
+	*/
+
+public:
+	// Map book file at path. Returns succes flag.
+	bool open(const std::string& path);
+	void close();
+
+	bool is_ready() const { return book.is_open(); }
+
+	// Polyglot key of a board
+	uint64_t key(const Board& b) const;
+
+	// All book moves for board b (empty if not in book)
+	std::vector<BookEntry> probe(const Board& b) const;
+
+	// Pick a book move for board b: highest weight if best is set, otherwise random proportional to weight.
+	// Returns empty string if not in book.
+	std::string pick_move(const Board& b, const bool best);
+
+private:
+	MappedFile book;
+	size_t n_entries = 0;
+	std::mt19937 rng{ std::random_device{}() };
+
+	static const size_t ENTRY_SIZE = 16;
+
+	uint64_t entry_key(const size_t i) const;
+	static uint64_t read_be(const unsigned char* p, const int n);
+	static std::string decode_move(const uint16_t mv, const Board& b);
+};
@@ -0,0 +1,224 @@
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <iomanip>
+#include <cstring>
+#include "Profile.h"
+
+#if CHESS_PROFILE && defined(__linux__)
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#define PROFILE_PERF 1
+#else
+#define PROFILE_PERF 0
+#endif
+
+using namespace std;
+
+std::atomic<int> Profile::clock{ PROFILE_TSC ? (int)ProfileClock::pc_tsc : (int)ProfileClock::pc_steady };
+
+namespace {
+
+// Counters of running threads, and the sums of finished threads
+mutex registry_mutex;
+vector<Profile::Counters*> registry;
+uint64_t retired_cycles[ph_count];
+uint64_t retired_calls[ph_count];
+
+// Registers the thread's counters on first use and folds them into the retired sums when the thread ends
+struct ThreadCounters {
+	Profile::Counters counters{};
+
+	ThreadCounters() {
+		lock_guard<mutex> lock(registry_mutex);
+		registry.push_back(&counters);
+	}
+
+	~ThreadCounters() {
+		lock_guard<mutex> lock(registry_mutex);
+		for (int p = 0; p < ph_count; p++) {
+			retired_cycles[p] += counters.cycles[p].load(memory_order_relaxed);
+			retired_calls[p] += counters.calls[p].load(memory_order_relaxed);
+		}
+		registry.erase(find(registry.begin(), registry.end(), &counters));
+	}
+};
+
+const char* const PHASE_NAMES[ph_count] = { "generate", "make", "unmake", "legality" };
+
+#if PROFILE_PERF
+
+/* Cycle counter of the calling thread (user mode only, so it works with perf_event_paranoid 2). It is read with
+rdpmc from the mapped control page when the kernel allows it, else with read(). */
+struct PerfCounter {
+	int fd = -1;
+	perf_event_mmap_page* page = nullptr;
+
+	PerfCounter() {
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = PERF_COUNT_HW_CPU_CYCLES;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		if (fd < 0)
+			return;
+		void* p = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+		if (p != MAP_FAILED)
+			page = static_cast<perf_event_mmap_page*>(p);
+	}
+
+	~PerfCounter() {
+		if (page)
+			munmap(page, sysconf(_SC_PAGESIZE));
+		if (fd >= 0)
+			close(fd);
+	}
+
+	uint64_t read_cycles() const {
+#if PROFILE_TSC && !defined(_MSC_VER)
+		if (page && page->cap_user_rdpmc) {
+			uint32_t seq;
+			uint64_t count;
+			do {
+				seq = page->lock;
+				atomic_signal_fence(memory_order_seq_cst);
+				count = page->offset;
+				const uint32_t index = page->index;
+				if (index) {
+					const int width = page->pmc_width;
+					int64_t pmc = (int64_t)__rdpmc(index - 1);
+					pmc = (int64_t)((uint64_t)pmc << (64 - width)) >> (64 - width);
+					count += pmc;
+				}
+				atomic_signal_fence(memory_order_seq_cst);
+			} while (page->lock != seq);
+			return count;
+		}
+#endif
+		uint64_t count = 0;
+		if (fd < 0 || read(fd, &count, sizeof(count)) != (ssize_t)sizeof(count))
+			return 0;
+		return count;
+	}
+};
+
+PerfCounter& thread_perf_counter() {
+	thread_local PerfCounter counter;
+	return counter;
+}
+
+#endif
+
+uint64_t steady_now() {
+	return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+Profile::Counters& Profile::local() {
+	thread_local ThreadCounters thread_counters;
+	return thread_counters.counters;
+}
+
+uint64_t Profile::read_clock() {
+	switch ((ProfileClock)clock.load(memory_order_relaxed)) {
+#if PROFILE_TSC
+	case ProfileClock::pc_tsc:
+		return __rdtsc();
+#endif
+#if PROFILE_PERF
+	case ProfileClock::pc_perf:
+		return thread_perf_counter().read_cycles();
+#endif
+	default:
+		return steady_now();
+	}
+}
+
+bool Profile::set_clock(const ProfileClock c) {
+	switch (c) {
+	case ProfileClock::pc_tsc:
+		if (!PROFILE_TSC)
+			return false;
+		break;
+	case ProfileClock::pc_perf:
+#if PROFILE_PERF
+		// Other threads open their counter on first use
+		if (thread_perf_counter().fd < 0)
+			return false;
+		break;
+#else
+		return false;
+#endif
+	case ProfileClock::pc_steady:
+		break;
+	}
+	clock = (int)c;
+	return true;
+}
+
+const char* Profile::clock_unit() {
+	switch (get_clock()) {
+	case ProfileClock::pc_tsc:
+		return "tsc cycles";
+	case ProfileClock::pc_perf:
+		return "core cycles";
+	default:
+		return "ns";
+	}
+}
+
+void Profile::reset() {
+	lock_guard<mutex> lock(registry_mutex);
+	fill(begin(retired_cycles), end(retired_cycles), 0);
+	fill(begin(retired_calls), end(retired_calls), 0);
+	for (Counters* c : registry) {
+		for (int p = 0; p < ph_count; p++) {
+			c->cycles[p].store(0, memory_order_relaxed);
+			c->calls[p].store(0, memory_order_relaxed);
+		}
+	}
+}
+
+void Profile::print(std::ostream& out, const uint64_t run_cycles) {
+	if (!enabled()) {
+		out << "info string Phase profiling is compiled out (build with -DCHESS_PROFILE=1)" << endl;
+		return;
+	}
+
+	uint64_t cycles[ph_count];
+	uint64_t calls[ph_count];
+	uint64_t phases = 0;
+	{
+		lock_guard<mutex> lock(registry_mutex);
+		for (int p = 0; p < ph_count; p++) {
+			cycles[p] = retired_cycles[p];
+			calls[p] = retired_calls[p];
+			for (Counters* c : registry) {
+				cycles[p] += c->cycles[p].load(memory_order_relaxed);
+				calls[p] += c->calls[p].load(memory_order_relaxed);
+			}
+			phases += cycles[p];
+		}
+	}
+	const uint64_t total = max(run_cycles, phases);
+
+	auto line = [&](const char* name, const uint64_t n, const uint64_t c, const bool per_call) {
+		out << "info string " << left << setw(10) << name << right << setw(14) << c << " " << clock_unit();
+		if (per_call)
+			out << setw(12) << n << " calls" << setw(10) << fixed << setprecision(1) << (n ? (double)c / n : 0.0) << " per call";
+		out << setw(8) << fixed << setprecision(1) << (total ? 100.0 * c / total : 0.0) << "%" << endl;
+	};
+	for (int p = 0; p < ph_count; p++) {
+		line(PHASE_NAMES[p], calls[p], cycles[p], true);
+	}
+	if (run_cycles)
+		line("other", 0, run_cycles > phases ? run_cycles - phases : 0, false);
+	out.unsetf(ios::floatfield);
+}
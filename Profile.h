@@ -0,0 +1,100 @@
+/*
+ * Profile.h
+ *
+ *  Cycle counts of the phases of a move: generating the pseudolegal moves, update_board, restore_board (revert_board
+ *  or the copy-make pop) and the king capture / castling scan of do_move. A ProfileScope adds the cycles of its
+ *  lifetime to the counters of the calling thread, which are kept like those of Stats. Cycles come from the time
+ *  stamp counter, from a perf_event cycle counter of the thread (Linux), or from steady_clock (nanoseconds) where
+ *  neither exists. The timers are compiled out unless CHESS_PROFILE is set.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+
+// Build with -DCHESS_PROFILE=1 to time the phases (this costs two clock reads per scope)
+#ifndef CHESS_PROFILE
+#define CHESS_PROFILE 0
+#endif
+
+#if CHESS_PROFILE && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64))
+#define PROFILE_TSC 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#else
+#define PROFILE_TSC 0
+#endif
+
+enum EPhase : int {
+	ph_generate = 0,			// Pseudolegal move generation (full or incremental)
+	ph_make,					// update_board
+	ph_unmake,					// restore_board
+	ph_legality,				// King capture and castling scans of do_move
+	ph_count
+};
+
+enum class ProfileClock : int {
+	pc_tsc = 0,					// Time stamp counter (reference cycles)
+	pc_perf = 1,				// perf_event hardware cycle counter of the thread (core cycles)
+	pc_steady = 2,				// steady_clock (nanoseconds)
+};
+
+class Profile {
+public:
+	struct alignas(64) Counters {
+		std::atomic<uint64_t> cycles[ph_count];
+		std::atomic<uint64_t> calls[ph_count];
+	};
+
+	static constexpr bool enabled() { return CHESS_PROFILE != 0; }
+
+	// Current count of the clock
+	static inline uint64_t now() {
+#if PROFILE_TSC
+		if (clock.load(std::memory_order_relaxed) == (int)ProfileClock::pc_tsc)
+			return __rdtsc();
+#endif
+		return read_clock();
+	}
+
+	static inline void add(const EPhase p, const uint64_t cycles) {
+		Counters& c = local();
+		c.cycles[p].store(c.cycles[p].load(std::memory_order_relaxed) + cycles, std::memory_order_relaxed);
+		c.calls[p].store(c.calls[p].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	// Select the clock. Returns false (keeping the current clock) if it is not available.
+	static bool set_clock(const ProfileClock c);
+	static ProfileClock get_clock() { return (ProfileClock)clock.load(); }
+	static const char* clock_unit();
+
+	static void reset();
+	// Cycles and calls per phase with their share of run_cycles (the whole run), or of all phases if 0
+	static void print(std::ostream& out, const uint64_t run_cycles = 0);
+
+private:
+	static std::atomic<int> clock;
+
+	static uint64_t read_clock();
+	static Counters& local();
+};
+
+// Adds the cycles from construction to destruction to phase p
+class ProfileScope {
+public:
+#if CHESS_PROFILE
+	explicit ProfileScope(const EPhase p) : phase(p), start(Profile::now()) {}
+	~ProfileScope() { Profile::add(phase, Profile::now() - start); }
+
+private:
+	EPhase phase;
+	uint64_t start;
+#else
+	explicit ProfileScope(const EPhase) {}
+#endif
+};
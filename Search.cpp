@@ -0,0 +1,580 @@
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#ifdef _MSC_VER
+#include <xmmintrin.h>
+#endif
+#include "Search.h"
+#include "Chess.h"
+#include "Evaluate.h"
+#include "Syzygy.h"
+#include "EndgameTable.h"
+#include "Stats.h"
+#include "Trace.h"
+
+using namespace std;
+
+namespace {
+
+enum TTBound : uint8_t { bound_none = 0, bound_upper = 1, bound_lower = 2, bound_exact = 3 };
+
+// Zobrist keys, from a fixed seed so keys are the same in every run
+struct ZobristKeys {
+	uint64_t pieces[16][64];
+	uint64_t side;
+	uint64_t castling[16];
+	uint64_t en_passant[8];
+
+	ZobristKeys() {
+		uint64_t seed = 0x9E3779B97F4A7C15ULL;
+		auto next = [&seed]() {  // splitmix64
+			uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+			return z ^ (z >> 31);
+		};
+		for (auto& piece : pieces) {
+			for (uint64_t& k : piece) {
+				k = next();
+			}
+		}
+		side = next();
+		for (uint64_t& k : castling) {
+			k = next();
+		}
+		for (uint64_t& k : en_passant) {
+			k = next();
+		}
+	}
+} const Zobrist;
+
+const int MVV_LVA_VALUE[6] = { 1, 3, 3, 5, 9, 20 };
+
+}  // namespace
+
+uint64_t position_key(const Board& b) {
+	uint64_t key = 0;
+	for (int sq = 0; sq < 64; sq++) {
+		if (b.square_list[sq] != EPieceCode::epc_empty)
+			key ^= Zobrist.pieces[(int)b.square_list[sq]][sq];
+	}
+	if (b.side_to_move == EPieceColor::clr_black)
+		key ^= Zobrist.side;
+	key ^= Zobrist.castling[b.castling_rights & cr_all];
+	if (b.en_passant_square != -1)
+		key ^= Zobrist.en_passant[b.en_passant_square % 8];
+	return key;
+}
+
+uint64_t position_key_after(const Board& b, uint64_t key, const Move& mv) {
+	const EPieceCode piece = b.square_list[mv.from];
+	const bool white = b.side_to_move == EPieceColor::clr_white;
+	key ^= Zobrist.side;
+	key ^= Zobrist.pieces[(int)piece][mv.from];
+	key ^= Zobrist.pieces[(int)(mv.promotion != EPieceCode::epc_empty ? mv.promotion : piece)][mv.to];
+	if (mv.capture != EPieceCode::epc_empty)
+		key ^= Zobrist.pieces[(int)mv.capture][mv.en_passant ? mv.to + (white ? -8 : 8) : mv.to];
+
+	if (get_ept(piece) == EPieceType::ept_king && abs(mv.to - mv.from) == 2) {
+		const int rook_from = mv.to > mv.from ? mv.from + 3 : mv.from - 4;
+		const int rook_to = (mv.from + mv.to) / 2;
+		key ^= Zobrist.pieces[(int)b.square_list[rook_from]][rook_from] ^ Zobrist.pieces[(int)b.square_list[rook_from]][rook_to];
+	}
+
+	key ^= Zobrist.castling[b.castling_rights & cr_all] ^ Zobrist.castling[(b.castling_rights ^ mv.lost_castle_rights) & cr_all];
+	if (b.en_passant_square != -1)
+		key ^= Zobrist.en_passant[b.en_passant_square % 8];
+	if ((piece == EPieceCode::epc_wpawn || piece == EPieceCode::epc_bpawn) && abs(mv.to - mv.from) == 16)
+		key ^= Zobrist.en_passant[mv.to % 8];
+	return key;
+}
+
+
+Search::Search(const size_t hash_mb) {
+	set_hash(hash_mb);
+}
+
+void Search::set_hash(const size_t hash_mb) {
+	// Largest power of two number of entries that fits
+	size_t entries = 1;
+	while (entries * 2 * sizeof(TTEntry) <= max<size_t>(hash_mb, 1) * 1024 * 1024) {
+		entries *= 2;
+	}
+	// Free the old table first: two tables of gigabytes may not fit
+	tt.clear();
+	tt.shrink_to_fit();
+	tt.assign(entries, TTEntry());
+}
+
+void Search::clear() {
+	fill(tt.begin(), tt.end(), TTEntry());
+	for (auto& k : killers) {
+		k[0] = k[1] = Move{ -1, -1 };
+	}
+}
+
+void Search::set_tablebases(Syzygy* syzygy_tb, EndgameTablebase* endgame_tb) {
+	syzygy = syzygy_tb;
+	endgame_tables = endgame_tb;
+}
+
+int Search::hashfull() const {
+	size_t sample = min<size_t>(1000, tt.size());
+	size_t used = 0;
+	for (size_t i = 0; i < sample; i++) {
+		used += (tt[i].bound != bound_none);
+	}
+	return (int)(used * 1000 / sample);
+}
+
+SearchInfo Search::go(const Chess& root, const SearchLimits& search_limits) {
+	Chess c = root;
+	chess = &c;
+	limits = search_limits;
+	start_time = chrono::steady_clock::now();
+	clock_start = start_time;
+	ponder_search = pondering;
+	aborted = false;
+	use_clock = !limits.movetime && limits.time_left > 0;
+	if (use_clock) {
+		time_manager.init(limits.time_left, limits.increment, limits.moves_to_go, limits.move_overhead);
+		time_limit = time_manager.get_hard_limit();
+	}
+	else
+		time_limit = limits.movetime > 0 ? max<int64_t>(1, limits.movetime - limits.move_overhead) : 0;
+	nodes = 0;
+	tbhits = 0;
+	for (auto& k : killers) {
+		k[0] = k[1] = Move{ -1, -1 };
+	}
+
+	// Keys of all earlier positions in the game, oldest first
+	key_history.clear();
+	Chess replay = root;
+	for (size_t i = 0; i < root.get_move_history().size(); i++) {
+		replay.undo_last_moves(1, false);
+		key_history.push_back(position_key(replay.get_board()));
+	}
+	reverse(key_history.begin(), key_history.end());
+	key_history.push_back(position_key(root.get_board()));
+
+	SearchInfo best;
+	// The root iterates its own list: after undo_last_moves(1, false) the pseudolegal moves of chess are stale
+	root_moves.clear();
+	for (const Move& mv : c.legal_moves()) {
+		if (is_root_move(mv))
+			root_moves.push_back(mv);
+	}
+	if (root_moves.empty())
+		return best;
+
+	int max_depth = limits.depth > 0 ? min(limits.depth, MAX_PLY - 1) : MAX_PLY - 1;
+	const size_t n_lines = min<size_t>(max(limits.multipv, 1), root_moves.size());
+	vector<SearchInfo> lines(n_lines);
+	for (int depth = 1; depth <= max_depth; depth++) {
+		// Lines are searched best first; with several lines, each search moves its best move to the front of the
+		// remaining root moves, so the next search excludes it
+		size_t completed = 0;
+		for (pv_index = 0; pv_index < n_lines; pv_index++) {
+			seldepth = 0;
+			int score = alpha_beta(depth, -INFINITE_SCORE, INFINITE_SCORE, 0);
+			if (aborted && (completed > 0 || !best.pv.empty() || pv_length[0] == 0))
+				break;
+
+			SearchInfo& line = lines[pv_index];
+			line.depth = depth;
+			line.seldepth = max(seldepth, depth);
+			line.score = score;
+			line.pv.assign(pv_table[0], pv_table[0] + pv_length[0]);
+			if (n_lines > 1) {
+				auto found = find_if(root_moves.begin() + pv_index, root_moves.end(), [&line](const Move& mv) {
+					return encode_move(mv) == encode_move(line.pv.front()); });
+				rotate(root_moves.begin() + pv_index, found, found + 1);
+			}
+			completed++;
+			if (aborted)
+				break;
+		}
+
+		// An aborted iteration is only used if it completed the best line, or found a move and nothing else is known
+		if (completed == 0)
+			break;
+
+		// A later line can score higher than an earlier one (a transposition table cutoff of a deeper search)
+		stable_sort(lines.begin(), lines.begin() + completed, [](const SearchInfo& lhs, const SearchInfo& rhs) {
+			return lhs.score > rhs.score; });
+		int64_t time = elapsed(start_time);
+		for (size_t i = 0; i < n_lines; i++) {
+			lines[i].multipv = (int)i + 1;
+			lines[i].nodes = nodes;
+			lines[i].tbhits = tbhits;
+			lines[i].time = time;
+			if (n_lines > 1 && i < completed)
+				root_moves[i] = lines[i].pv.front();
+		}
+		best = lines[0];
+
+		if (aborted)
+			break;
+		if (info_callback) {
+			for (const SearchInfo& line : lines) {
+				info_callback(line);
+			}
+		}
+
+		// With a fixed move time, the next iteration is unlikely to finish once half the time is used. The clock
+		// leaves it to the time manager, which also follows the stability of the search while pondering.
+		if (use_clock) {
+			bool enough = time_manager.stop_after_iteration(elapsed(clock_start), encode_move(best.pv.front()), best.score,
+				root_moves.size());
+			if (!limits.infinite && enough && !is_pondering())
+				break;
+		}
+		else if (!limits.infinite && time_limit > 0 && !is_pondering() && elapsed(clock_start) * 2 > time_limit)
+			break;
+		if (!limits.infinite && n_lines == 1 && is_mate_score(best.score) && depth >= 2 * mate_in(abs(best.score)) + 2)
+			break;
+	}
+
+	if (best.pv.empty())
+		best.pv.push_back(root_moves.front());
+
+	wait_for_stop(limits);
+	return best;
+}
+
+// Infinite and pondering searches only report a best move after stop (or ponderhit)
+void Search::wait_for_stop(const SearchLimits& search_limits) const {
+	while ((search_limits.infinite || pondering.load()) && !stop_flag) {
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+}
+
+int Search::alpha_beta(int depth, int alpha, int beta, const int ply) {
+	pv_length[ply] = ply;
+	if (check_limits())
+		return 0;
+	Stats::add(st_nodes);
+	if (trace)
+		trace_enter(ply, depth, alpha, beta, false);
+
+	const Board& b = chess->get_board();
+	if (ply > 0) {
+		if (b.half_move_count >= 100 || is_repetition() || chess->insufficient_material())
+			return trace_exit(ply, depth, 0, nt_draw, 0, false);
+
+		// Mate distance pruning: no line from here beats a shorter mate already found
+		alpha = max(alpha, -MATE_SCORE + ply);
+		beta = min(beta, MATE_SCORE - ply - 1);
+		if (alpha >= beta)
+			return trace_exit(ply, depth, alpha, nt_mate, 0, false);
+	}
+	if (ply >= MAX_PLY - 1)
+		return trace_exit(ply, depth, evaluate(b), nt_leaf, 0, false);
+
+	bool in_check = chess->in_check();
+	if (in_check)
+		depth++;
+	if (depth <= 0)
+		return trace_exit(ply, depth, quiescence(alpha, beta, ply), nt_leaf, 0, false);
+
+	uint64_t key = key_history.back();
+	uint16_t tt_move = 0;
+	TTEntry* entry = tt_probe(key);
+	Stats::add(st_tt_probes);
+	if (entry) {
+		Stats::add(st_tt_hits);
+		tt_move = entry->move;
+		int tt_score = entry->score;
+		if (is_mate_score(tt_score))
+			tt_score += tt_score > 0 ? -ply : ply;
+
+		if (ply > 0 && entry->depth >= depth && (entry->bound == bound_exact ||
+			(entry->bound == bound_lower && tt_score >= beta) || (entry->bound == bound_upper && tt_score <= alpha)))
+			return trace_exit(ply, depth, tt_score, nt_tt, tt_move, false);
+	}
+
+	int tb_score;
+	if (ply > 0 && probe_tablebases(ply, tb_score)) {
+		tbhits++;
+		return trace_exit(ply, depth, tb_score, nt_tb, 0, false);
+	}
+
+	vector<Move> moves = ply == 0 ? vector<Move>(root_moves.begin() + pv_index, root_moves.end())
+		: chess->get_pseudolegal_moves();
+	order_moves(moves, tt_move, ply);
+
+	int best_score = -INFINITE_SCORE;
+	int old_alpha = alpha;
+	int legal = 0;
+	Move best_move{ -1, -1 };
+
+	for (const Move& mv : moves) {
+		// The child's table entry is fetched from memory while the move is made
+		uint64_t child_key = position_key_after(chess->get_board(), key, mv);
+		tt_prefetch(child_key);
+		if (!chess->do_move(mv))
+			continue;
+		legal++;
+		nodes++;
+		key_history.push_back(child_key);
+
+		int score = -alpha_beta(depth - 1, -beta, -alpha, ply + 1);
+
+		key_history.pop_back();
+		chess->undo_last_moves(1, false);
+		if (aborted)
+			return trace_exit(ply, depth, 0, nt_abort, 0, false);
+
+		if (score > best_score) {
+			best_score = score;
+			best_move = mv;
+
+			if (score > alpha) {
+				alpha = score;
+				pv_table[ply][ply] = mv;
+				for (int i = ply + 1; i < pv_length[ply + 1]; i++) {
+					pv_table[ply][i] = pv_table[ply + 1][i];
+				}
+				pv_length[ply] = max(pv_length[ply + 1], ply + 1);
+
+				if (alpha >= beta) {
+					Stats::add(st_beta_cutoffs);
+					if (legal == 1)
+						Stats::add(st_first_move_cutoffs);
+					if (mv.capture == EPieceCode::epc_empty && encode_move(mv) != encode_move(killers[ply][0])) {
+						killers[ply][1] = killers[ply][0];
+						killers[ply][0] = mv;
+					}
+					break;
+				}
+			}
+		}
+	}
+
+	if (!legal)
+		return trace_exit(ply, depth, in_check ? -MATE_SCORE + ply : 0, nt_mate, 0, false);
+
+	int bound = best_score >= beta ? bound_lower : best_score > old_alpha ? bound_exact : bound_upper;
+	tt_store(key, best_score, depth, bound, &best_move, ply);
+	return trace_exit(ply, depth, best_score, bound == bound_lower ? nt_cut : bound == bound_exact ? nt_pv : nt_all,
+		encode_move(best_move), false);
+}
+
+// Only captures and promotions, standing pat on the static evaluation
+int Search::quiescence(int alpha, int beta, const int ply) {
+	pv_length[ply] = ply;
+	if (check_limits())
+		return 0;
+	Stats::add(st_qnodes);
+	seldepth = max(seldepth, ply);
+	if (trace)
+		trace_enter(ply, 0, alpha, beta, true);
+
+	int best_score = evaluate(chess->get_board());
+	if (ply >= MAX_PLY - 1 || best_score >= beta)
+		return trace_exit(ply, 0, best_score, nt_leaf, 0, true);
+	int old_alpha = alpha;
+	alpha = max(alpha, best_score);
+	Move best_move{ -1, -1 };
+
+	vector<Move> moves;
+	for (const Move& mv : chess->get_pseudolegal_moves()) {
+		if (mv.capture != EPieceCode::epc_empty || mv.promotion != EPieceCode::epc_empty)
+			moves.push_back(mv);
+	}
+	order_moves(moves, 0, ply);
+
+	for (const Move& mv : moves) {
+		if (!chess->do_move(mv))
+			continue;
+		nodes++;
+
+		int score = -quiescence(-beta, -alpha, ply + 1);
+
+		chess->undo_last_moves(1, false);
+		if (aborted)
+			return trace_exit(ply, 0, 0, nt_abort, 0, true);
+
+		if (score > best_score) {
+			best_score = score;
+			best_move = mv;
+			if (score > alpha) {
+				alpha = score;
+				if (alpha >= beta)
+					break;
+			}
+		}
+	}
+
+	ENodeType type = best_score >= beta ? nt_cut : best_score > old_alpha ? nt_pv : nt_all;
+	return trace_exit(ply, 0, best_score, best_move.from >= 0 ? type : nt_leaf, encode_move(best_move), true);
+}
+
+// Exact scores from tablebases: own tables give the distance to mate, Syzygy only the result (probed right after
+// a capture or pawn move, when the fifty move counter is zero)
+bool Search::probe_tablebases(const int ply, int& score) {
+	const Board& b = chess->get_board();
+
+	if (endgame_tables) {
+		int plies;
+		switch (endgame_tables->probe(b, plies)) {
+		case egt_win:	score = MATE_SCORE - ply - plies; return true;
+		case egt_loss:	score = -MATE_SCORE + ply + plies; return true;
+		case egt_draw:	score = 0; return true;
+		default:		break;
+		}
+	}
+
+	if (syzygy && b.half_move_count == 0 && syzygy->can_probe(b)) {
+		ProbeState state;
+		WDLScore wdl = syzygy->probe_wdl(*chess, &state);
+		if (state != ps_fail) {
+			score = wdl == wdl_win ? TB_WIN_SCORE - ply : wdl == wdl_loss ? -TB_WIN_SCORE + ply : 0;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Returns true (and sets aborted) once a limit is reached
+bool Search::check_limits() {
+	if (aborted)
+		return true;
+
+	if (stop_flag.load(memory_order_relaxed) || (limits.nodes && nodes >= limits.nodes))
+		aborted = true;
+	else if (time_limit > 0 && !limits.infinite && (nodes & 1023) == 0 && !is_pondering())
+		aborted = elapsed(clock_start) >= time_limit;
+	return aborted;
+}
+
+// The clock starts when the search thread first sees the ponderhit
+bool Search::is_pondering() {
+	if (ponder_search && !pondering.load(memory_order_relaxed)) {
+		ponder_search = false;
+		clock_start = chrono::steady_clock::now();
+	}
+	return ponder_search;
+}
+
+// Milliseconds since a time point
+int64_t Search::elapsed(const chrono::steady_clock::time_point since) const {
+	return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - since).count();
+}
+
+// Position repeated since the last irreversible move (a single repetition is scored as a draw)
+bool Search::is_repetition() const {
+	int last = (int)key_history.size() - 1;
+	int first = max(0, last - (int)chess->get_board().half_move_count);
+	for (int i = last - 2; i >= first; i -= 2) {
+		if (key_history[i] == key_history[last])
+			return true;
+	}
+	return false;
+}
+
+// Order: transposition table move, captures by most valuable victim / least valuable attacker, promotions, killers
+void Search::order_moves(vector<Move>& moves, const uint16_t tt_move, const int ply) const {
+	const Board& b = chess->get_board();
+	vector<pair<int, Move>> scored;
+	scored.reserve(moves.size());
+
+	for (const Move& mv : moves) {
+		int score = 0;
+		uint16_t code = encode_move(mv);
+		if (tt_move && code == tt_move)
+			score = 1000000;
+		else if (mv.capture != EPieceCode::epc_empty)
+			score = 100000 + 100 * MVV_LVA_VALUE[eval_piece_index(mv.capture)] - MVV_LVA_VALUE[eval_piece_index(b.square_list[mv.from])];
+		else if (mv.promotion != EPieceCode::epc_empty)
+			score = 90000 + MVV_LVA_VALUE[eval_piece_index(mv.promotion)];
+		else if (code == encode_move(killers[ply][0]))
+			score = 80000;
+		else if (code == encode_move(killers[ply][1]))
+			score = 79000;
+		scored.emplace_back(score, mv);
+	}
+
+	stable_sort(scored.begin(), scored.end(), [](const pair<int, Move>& lhs, const pair<int, Move>& rhs) {
+		return lhs.first > rhs.first; });
+	for (size_t i = 0; i < moves.size(); i++) {
+		moves[i] = scored[i].second;
+	}
+}
+
+Search::TTEntry* Search::tt_probe(const uint64_t key) {
+	TTEntry& e = tt[key & (tt.size() - 1)];
+	return (e.bound != bound_none && e.key == key) ? &e : nullptr;
+}
+
+void Search::tt_prefetch(const uint64_t key) const {
+#if defined(__GNUC__)
+	__builtin_prefetch(&tt[key & (tt.size() - 1)]);
+#elif defined(_MSC_VER)
+	_mm_prefetch(reinterpret_cast<const char*>(&tt[key & (tt.size() - 1)]), _MM_HINT_T0);
+#endif
+}
+
+void Search::tt_store(const uint64_t key, int score, const int depth, const int bound, const Move* best, const int ply) {
+	TTEntry& e = tt[key & (tt.size() - 1)];
+
+	// Keep deeper entries of the same position
+	if (e.key == key && e.depth > depth && bound != bound_exact)
+		return;
+
+	// Mate scores are stored relative to this node
+	if (is_mate_score(score))
+		score += score > 0 ? ply : -ply;
+
+	e.key = key;
+	e.score = (int16_t)score;
+	e.depth = (uint8_t)depth;
+	e.bound = (uint8_t)bound;
+	e.move = (best && best->from >= 0) ? encode_move(*best) : 0;
+}
+
+// 6 bits from, 6 bits to, 4 bits promotion piece
+uint16_t Search::encode_move(const Move& mv) {
+	if (mv.from < 0)
+		return 0;
+	return (uint16_t)(mv.from | (mv.to << 6) | (((int)mv.promotion & 0xF) << 12));
+}
+
+bool Search::is_root_move(const Move& mv) const {
+	if (limits.root_moves.empty())
+		return true;
+	for (const Move& m : limits.root_moves) {
+		if (encode_move(m) == encode_move(mv))
+			return true;
+	}
+	return false;
+}
+
+void Search::trace_enter(const int ply, const int depth, const int alpha, const int beta, const bool qsearch) {
+	TraceEvent e{};
+	e.key = qsearch ? position_key(chess->get_board()) : key_history.back();		// Quiescence keeps no key history
+	e.alpha = (int16_t)alpha;
+	e.beta = (int16_t)beta;
+	e.move = ply > 0 ? encode_move(chess->get_move_history().back()) : 0;
+	e.ply = (uint8_t)ply;
+	e.depth = (int8_t)depth;
+	e.kind = qsearch ? tk_qenter : tk_enter;
+	trace->record(e);
+}
+
+int Search::trace_exit(const int ply, const int depth, const int score, const uint8_t type, const uint16_t best,
+	const bool qsearch) {
+	if (trace) {
+		TraceEvent e{};
+		e.key = qsearch ? position_key(chess->get_board()) : key_history.back();
+		e.score = (int16_t)score;
+		e.move = best;
+		e.ply = (uint8_t)ply;
+		e.depth = (int8_t)depth;
+		e.kind = qsearch ? tk_qexit : tk_exit;
+		e.type = type;
+		trace->record(e);
+	}
+	return score;
+}
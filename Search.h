@@ -0,0 +1,157 @@
+/*
+ * Search.h
+ *
+ *  Iterative deepening alpha-beta search with quiescence search, transposition table and MVV-LVA/killer move
+ *  ordering. Limits are a depth, a node count, a fixed time per move and/or a clock (see TimeManager); stop() ends
+ *  the search from another thread. Each Search object is independent, so several games can be searched in parallel.
+ *  With MultiPV, every iteration searches the root once per line, each time without the best moves of the lines
+ *  before it, so all lines share the transposition table, killers and root move order of one search.
+ *  A pondering search ignores its time limit until ponderhit(), which starts the clock without interrupting it.
+ */
+
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include <cstdlib>
+#include "EnumList.h"
+#include "TimeManager.h"
+#include "LargePages.h"
+
+class Chess;
+class Syzygy;
+class EndgameTablebase;
+class TraceBuffer;
+
+// Zobrist key of a position (piece placement, side to move, castling rights and en passant square)
+uint64_t position_key(const Board& b);
+// position_key of b after the (pseudo)legal move mv, from key = position_key(b), without visiting every square
+uint64_t position_key_after(const Board& b, const uint64_t key, const Move& mv);
+
+struct SearchLimits {
+	int depth = 0;				// Maximum depth (0 for no limit)
+	uint64_t nodes = 0;			// Maximum number of nodes (0 for no limit)
+	int64_t movetime = 0;		// Maximum time in milliseconds (0 for no limit)
+	int64_t time_left = 0;		// Clock of the side to move in milliseconds, used without movetime (0 for no clock)
+	int64_t increment = 0;		// Increment per move in milliseconds
+	int moves_to_go = 0;		// Moves until the next time control (0 for the rest of the game)
+	int64_t move_overhead = 0;	// Milliseconds per move lost outside the search, subtracted from the time limits
+	bool infinite = false;		// Only stop on stop()
+	std::vector<Move> root_moves;	// Only search these moves at the root (all legal moves if empty)
+	int multipv = 1;			// Number of best lines to search
+};
+
+struct SearchInfo {
+	int depth = 0;
+	int seldepth = 0;
+	int score = 0;				// Centipawns from the side to move point of view, or mate score (see is_mate_score)
+	uint64_t nodes = 0;
+	uint64_t tbhits = 0;		// Positions resolved by tablebases
+	int64_t time = 0;			// Milliseconds
+	std::vector<Move> pv;		// Principal variation, pv[0] is the best move
+	int multipv = 1;			// Rank of this line (1 is the best)
+};
+
+class Search {
+public:
+	static const int MAX_PLY = 128;
+	static const int INFINITE_SCORE = 32001;
+	static const int MATE_SCORE = 32000;				// Mate in n plies scores MATE_SCORE - n
+	static const int TB_WIN_SCORE = MATE_SCORE - 2 * MAX_PLY;	// Tablebase win (without mate distance)
+
+	static bool is_mate_score(const int score) { return abs(score) >= MATE_SCORE - MAX_PLY; }
+	// Moves (not plies) to mate for a mate score, negative when getting mated
+	static int mate_in(const int score) { return score > 0 ? (MATE_SCORE - score + 1) / 2 : -(MATE_SCORE + score) / 2; }
+
+	explicit Search(const size_t hash_mb = 16);
+
+	// Resize (and clear) the transposition table
+	void set_hash(const size_t hash_mb);
+	void clear();
+
+	// Optional tablebases probed inside the search
+	void set_tablebases(Syzygy* syzygy, EndgameTablebase* endgame_tables);
+
+	// Called after every completed iteration, once per line in order of score
+	void set_info_callback(const std::function<void(const SearchInfo&)>& callback) { info_callback = callback; }
+
+	// Search the position in chess (which is left unchanged). Returns info of the best line of the last completed
+	// iteration; the pv is empty if there are no legal moves.
+	SearchInfo go(const Chess& chess, const SearchLimits& limits);
+	void stop() { stop_flag = true; }
+	// Block until an infinite or pondering search may report its result: after stop(), or ponderhit() when pondering.
+	// go() ends with this; a search thread that finds its move without go() must call it before answering.
+	void wait_for_stop(const SearchLimits& limits) const;
+
+	// Set before go() to ponder: the search runs without time limit and only returns after ponderhit() or stop().
+	// ponderhit() turns it into a normal search with the time limit counted from then on. Also clears the stop() of
+	// an earlier search, so a stop() that arrives before go() starts in another thread is not lost.
+	void set_pondering(const bool on) { pondering = on; stop_flag = false; }
+	void ponderhit() { pondering = false; }
+
+	// Record every node in trace (nullptr to stop tracing). The buffer is not owned and must outlive the searches.
+	void set_trace(TraceBuffer* trace_buffer) { trace = trace_buffer; }
+
+	uint64_t get_nodes() const { return nodes; }
+	// Permille of the transposition table in use (sampled)
+	int hashfull() const;
+
+private:
+	struct TTEntry {
+		uint64_t key;
+		int16_t score;
+		uint8_t depth;
+		uint8_t bound;
+		uint16_t move;
+	};
+
+	std::vector<TTEntry, LargePageAllocator<TTEntry>> tt;
+	Syzygy* syzygy = nullptr;
+	EndgameTablebase* endgame_tables = nullptr;
+	std::function<void(const SearchInfo&)> info_callback;
+	TraceBuffer* trace = nullptr;
+
+	// State of the running search
+	Chess* chess = nullptr;
+	SearchLimits limits;
+	std::chrono::steady_clock::time_point start_time;
+	std::chrono::steady_clock::time_point clock_start;		// Start of the time limit (go, or ponderhit)
+	int64_t time_limit = 0;						// Hard time limit in milliseconds (0 for none)
+	bool use_clock = false;						// Time limit by time_manager
+	TimeManager time_manager;
+	std::atomic<bool> stop_flag{ false };
+	std::atomic<bool> pondering{ false };
+	bool ponder_search = false;					// Still pondering, as seen by the search thread
+	bool aborted = false;
+	uint64_t nodes = 0;
+	uint64_t tbhits = 0;
+	int seldepth = 0;
+	std::vector<Move> root_moves;				// Legal moves at the root (within limits.root_moves), best first
+	size_t pv_index = 0;						// Line being searched: root_moves before it are excluded
+	std::vector<uint64_t> key_history;			// Keys of the game and the current line, for repetitions
+	Move pv_table[MAX_PLY][MAX_PLY];
+	int pv_length[MAX_PLY];
+	Move killers[MAX_PLY][2];
+
+	int alpha_beta(int depth, int alpha, int beta, const int ply);
+	int quiescence(int alpha, int beta, const int ply);
+	bool probe_tablebases(const int ply, int& score);
+	bool check_limits();
+	bool is_pondering();
+	int64_t elapsed(const std::chrono::steady_clock::time_point since) const;
+	bool is_repetition() const;
+	void order_moves(std::vector<Move>& moves, const uint16_t tt_move, const int ply) const;
+
+	TTEntry* tt_probe(const uint64_t key);
+	void tt_prefetch(const uint64_t key) const;
+	void tt_store(const uint64_t key, const int score, const int depth, const int bound, const Move* best, const int ply);
+	static uint16_t encode_move(const Move& mv);
+	bool is_root_move(const Move& mv) const;
+
+	void trace_enter(const int ply, const int depth, const int alpha, const int beta, const bool qsearch);
+	// Records the exit of a node when tracing, returns score
+	int trace_exit(const int ply, const int depth, const int score, const uint8_t type, const uint16_t best, const bool qsearch);
+};
@@ -0,0 +1,82 @@
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <iomanip>
+#include "Stats.h"
+
+using namespace std;
+
+namespace {
+
+// Counters of running threads, and the sums of finished threads
+mutex registry_mutex;
+vector<Stats::Counters*> registry;
+uint64_t retired[st_count];
+
+// Registers the thread's counters on first use and folds them into retired when the thread ends
+struct ThreadCounters {
+	Stats::Counters counters{};
+
+	ThreadCounters() {
+		lock_guard<mutex> lock(registry_mutex);
+		registry.push_back(&counters);
+	}
+
+	~ThreadCounters() {
+		lock_guard<mutex> lock(registry_mutex);
+		for (int s = 0; s < st_count; s++) {
+			retired[s] += counters.values[s].load(memory_order_relaxed);
+		}
+		registry.erase(find(registry.begin(), registry.end(), &counters));
+	}
+};
+
+const char* const STAT_NAMES[st_count] = {
+	"nodes", "qnodes", "tt probes", "tt hits", "beta cutoffs", "first move cutoffs", "illegal moves",
+	"moves generated", "move generations", "perft leaves"
+};
+
+}  // namespace
+
+Stats::Counters& Stats::local() {
+	thread_local ThreadCounters thread_counters;
+	return thread_counters.counters;
+}
+
+uint64_t Stats::total(const EStat s) {
+	lock_guard<mutex> lock(registry_mutex);
+	uint64_t sum = retired[s];
+	for (Counters* c : registry) {
+		sum += c->values[s].load(memory_order_relaxed);
+	}
+	return sum;
+}
+
+void Stats::reset() {
+	lock_guard<mutex> lock(registry_mutex);
+	fill(begin(retired), end(retired), 0);
+	for (Counters* c : registry) {
+		for (auto& v : c->values) {
+			v.store(0, memory_order_relaxed);
+		}
+	}
+}
+
+void Stats::print(std::ostream& out) {
+	if (!enabled()) {
+		out << "info string Statistics are compiled out (build with -DCHESS_STATS=1)" << endl;
+		return;
+	}
+
+	uint64_t t[st_count];
+	for (int s = 0; s < st_count; s++) {
+		t[s] = total((EStat)s);
+		out << "info string " << left << setw(20) << STAT_NAMES[s] << right << t[s] << endl;
+	}
+
+	auto ratio = [](const uint64_t a, const uint64_t b) { return b ? (double)a / b : 0.0; };
+	out << "info string tt hit rate         " << ratio(t[st_tt_hits], t[st_tt_probes]) << endl;
+	out << "info string first move cut rate  " << ratio(t[st_first_move_cutoffs], t[st_beta_cutoffs]) << endl;
+	out << "info string moves per node      " << ratio(t[st_moves_generated], t[st_move_generations]) << endl;
+	out << "info string illegal move rate   " << ratio(t[st_illegal_moves], t[st_move_generations]) << endl;
+}
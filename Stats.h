@@ -0,0 +1,64 @@
+/*
+ * Stats.h
+ *
+ *  Instrumentation counters for move generation and search. Every thread increments its own cache line aligned
+ *  block of counters (no sharing, no locked instructions); Stats::total sums them over all threads. The counters
+ *  are compiled out unless CHESS_STATS is set, which is the default for builds without NDEBUG.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+
+// Build with -DCHESS_STATS=1 to count in release builds (or -DCHESS_STATS=0 to never count)
+#ifndef CHESS_STATS
+#ifdef NDEBUG
+#define CHESS_STATS 0
+#else
+#define CHESS_STATS 1
+#endif
+#endif
+
+enum EStat : int {
+	st_nodes = 0,				// Search nodes (alpha-beta)
+	st_qnodes,					// Quiescence nodes
+	st_tt_probes,
+	st_tt_hits,
+	st_beta_cutoffs,
+	st_first_move_cutoffs,		// Beta cutoffs by the first legal move
+	st_illegal_moves,			// Pseudolegal moves rejected by do_move
+	st_moves_generated,			// Pseudolegal moves generated by do_move
+	st_move_generations,		// Move lists generated by do_move
+	st_perft_leaves,
+	st_count
+};
+
+class Stats {
+public:
+	struct alignas(64) Counters {
+		std::atomic<uint64_t> values[st_count];
+	};
+
+	// Counters of the calling thread. Only this thread writes them, so a relaxed load and store suffice.
+	static inline void add(const EStat s, const uint64_t n = 1) {
+#if CHESS_STATS
+		std::atomic<uint64_t>& v = local().values[s];
+		v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+#else
+		(void)s;
+		(void)n;
+#endif
+	}
+
+	static constexpr bool enabled() { return CHESS_STATS != 0; }
+
+	// Sum over all threads (including finished ones)
+	static uint64_t total(const EStat s);
+	static void reset();
+	static void print(std::ostream& out);
+
+private:
+	static Counters& local();
+};
@@ -0,0 +1,1044 @@
+/*
+ * Syzygy.cpp
+ *
+ *  Tablebase layout and decompression follow the Syzygy format by Ronald de Man: every table file holds one
+ *  (pawnless) or four (one per leading pawn file a-d) tables per side to move. A position is encoded into an
+ *  index (symmetry reduction, then groups of like pieces as binomial combinations) and the value at that index is
+ *  decompressed from canonical Huffman coded, recursively paired symbols.
+ *
+ *  The index tables, encoding, decompression and the probe/search logic are ported from tbprobe.cpp of Stockfish
+ *  (Copyright (C) The Stockfish developers, GNU General Public License version 3 or later), which in turn
+ *  is based on the original probing code by Ronald de Man. This file is therefore GPL-3.0-or-later; see README.md.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include "Syzygy.h"
+#include "Chess.h"
+
+using namespace std;
+
+namespace {
+
+const int TB_WDL = 0;
+const int TB_DTZ = 1;
+const int TB_PIECES = 7;
+
+// Flags of a TBPairsData record
+enum TBFlag { tbf_stm = 1, tbf_mapped = 2, tbf_win_plies = 4, tbf_loss_plies = 8, tbf_wide = 16, tbf_single_value = 128 };
+
+const char PIECE_CHARS[] = " PNBRQK";
+
+// Index tables, initialized once
+int MapPawns[64];
+int MapB1H1H7[64];
+int MapA1D1D4[64];
+int MapKK[10][64];					// [MapA1D1D4][square]
+uint64_t Binomial[TB_PIECES][64];	// [k][n] k elements from a set of n elements
+uint64_t LeadPawnIdx[6][64];		// [lead pawn count][square]
+uint64_t LeadPawnsSize[6][4];		// [lead pawn count][file a-d]
+
+int rank_of(int sq) { return sq / 8; }
+int file_of(int sq) { return sq % 8; }
+int off_A1H8(int sq) { return rank_of(sq) - file_of(sq); }
+bool pawns_comp(int i, int j) { return MapPawns[i] < MapPawns[j]; }
+
+uint16_t read_le16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+uint32_t read_le32(const uint8_t* p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+uint32_t read_be32(const uint8_t* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3]; }
+uint64_t read_be64(const uint8_t* p) { return ((uint64_t)read_be32(p) << 32) | read_be32(p + 4); }
+
+// Symbol pair tree entry: 12 bits left symbol, 12 bits right symbol (0xFFF for a leaf, left is then the value)
+uint16_t btree_left(const uint8_t* btree, uint16_t sym) { const uint8_t* e = btree + 3 * sym; return (uint16_t)(((e[1] & 0xF) << 8) | e[0]); }
+uint16_t btree_right(const uint8_t* btree, uint16_t sym) { const uint8_t* e = btree + 3 * sym; return (uint16_t)((e[2] << 4) | (e[1] >> 4)); }
+
+// TB piece code: pawn 1 ... king 6, +8 for black
+int tb_piece(const EPieceCode epc) {
+	int type;
+	switch (get_ept(epc)) {
+	case EPieceType::ept_wpawn:
+	case EPieceType::ept_bpawn:		type = 1; break;
+	case EPieceType::ept_knight:	type = 2; break;
+	case EPieceType::ept_bishop:	type = 3; break;
+	case EPieceType::ept_rook:		type = 4; break;
+	case EPieceType::ept_queen:		type = 5; break;
+	case EPieceType::ept_king:		type = 6; break;
+	default:						return 0;
+	}
+	return type + (get_clr(epc) == EPieceColor::clr_black ? 8 : 0);
+}
+
+// Material of one color, strongest pieces first (e.g. KRP)
+string material(const Board& b, const EPieceColor clr) {
+	int count[7] = {};
+	for (EPieceCode epc : b.square_list) {
+		if (get_clr(epc) == clr)
+			count[tb_piece(epc) % 8]++;
+	}
+
+	string res;
+	for (int type = 6; type >= 1; type--) {
+		res += string(count[type], PIECE_CHARS[type]);
+	}
+	return res;
+}
+
+int piece_total(const Board& b) {
+	int n = 0;
+	for (EPieceCode epc : b.square_list) {
+		if (epc != EPieceCode::epc_empty)
+			n++;
+	}
+	return n;
+}
+
+WDLScore negate_wdl(WDLScore wdl) { return (WDLScore)(-(int)wdl); }
+
+// DTZ of the move before a zeroing move, given the WDL after it
+int dtz_before_zeroing(WDLScore wdl) {
+	return wdl == wdl_win ? 1 :
+		wdl == wdl_cursed_win ? 101 :
+		wdl == wdl_blessed_loss ? -101 :
+		wdl == wdl_loss ? -1 : 0;
+}
+
+int sign_of(int val) { return (0 < val) - (val < 0); }
+
+void init_index_tables() {
+	// MapB1H1H7[] encodes a square below a1-h8 diagonal to 0..27
+	int code = 0;
+	for (int s = 0; s < 64; s++) {
+		if (off_A1H8(s) < 0)
+			MapB1H1H7[s] = code++;
+	}
+
+	// MapA1D1D4[] encodes a square in the a1-d1-d4 triangle to 0..9, diagonal squares last
+	vector<int> diagonal;
+	code = 0;
+	for (int s : { 0, 1, 2, 3, 9, 10, 11, 18, 19, 27 }) {
+		if (off_A1H8(s) < 0)
+			MapA1D1D4[s] = code++;
+		else if (!off_A1H8(s))
+			diagonal.push_back(s);
+	}
+	for (int s : diagonal) {
+		MapA1D1D4[s] = code++;
+	}
+
+	// MapKK[] encodes the 462 legal placements of two kings with the first in the a1-d1-d4 triangle. If the first
+	// king is on the a1-d4 diagonal, the other one may not be above the a1-h8 diagonal.
+	vector<pair<int, int>> both_on_diagonal;
+	code = 0;
+	for (int idx = 0; idx < 10; idx++) {
+		for (int s1 = 0; s1 <= 27; s1++) {
+			if (MapA1D1D4[s1] != idx || (idx == 0 && s1 != 1))  // Only b1 is mapped to 0, other squares default to 0
+				continue;
+
+			for (int s2 = 0; s2 < 64; s2++) {
+				if (abs(rank_of(s1) - rank_of(s2)) <= 1 && abs(file_of(s1) - file_of(s2)) <= 1)
+					continue;  // Kings adjacent or on the same square
+				else if (!off_A1H8(s1) && off_A1H8(s2) > 0)
+					continue;  // First on diagonal, second above
+				else if (!off_A1H8(s1) && !off_A1H8(s2))
+					both_on_diagonal.emplace_back(idx, s2);
+				else
+					MapKK[idx][s2] = code++;
+			}
+		}
+	}
+	for (auto& p : both_on_diagonal) {
+		MapKK[p.first][p.second] = code++;
+	}
+
+	// Binomial coefficients using Pascal's rule
+	Binomial[0][0] = 1;
+	for (int n = 1; n < 64; n++) {
+		for (int k = 0; k < TB_PIECES && k <= n; k++) {
+			Binomial[k][n] = (k > 0 ? Binomial[k - 1][n - 1] : 0) + (k < n ? Binomial[k][n - 1] : 0);
+		}
+	}
+
+	// MapPawns[s] encodes squares a2-h7 to 0..47: the number of squares available to the other pawns when the
+	// leading pawn is on s. The leading pawn is the one with the highest value: nearest to the edge, lowest rank.
+	int available_squares = 47;
+	for (int lead_pawns = 1; lead_pawns <= 5; lead_pawns++) {
+		for (int f = 0; f < 4; f++) {
+			uint64_t idx = 0;
+			for (int r = 1; r <= 6; r++) {
+				int sq = r * 8 + f;
+				if (lead_pawns == 1) {
+					MapPawns[sq] = available_squares--;
+					MapPawns[sq ^ 7] = available_squares--;
+				}
+				LeadPawnIdx[lead_pawns][sq] = idx;
+				idx += Binomial[lead_pawns - 1][MapPawns[sq]];
+			}
+			LeadPawnsSize[lead_pawns][f] = idx;
+		}
+	}
+}
+
+}  // namespace
+
+// Low level indexing information of one table (per side to move and leading pawn file) in a file
+struct TBPairsData {
+	uint8_t flags = 0;						// See TBFlag
+	uint8_t max_sym_len = 0;				// Maximum length in bits of the Huffman symbols
+	uint8_t min_sym_len = 0;				// Minimum length in bits of the Huffman symbols (or the value of single value tables)
+	uint32_t num_blocks = 0;				// Number of blocks of compressed data
+	size_t block_size = 0;					// Block size in bytes
+	size_t span = 0;						// About every span values there is a sparse index entry
+	const uint8_t* lowest_sym = nullptr;	// lowest_sym[l] is the symbol of length l with the lowest value (16 bit LE)
+	const uint8_t* btree = nullptr;			// btree[sym] holds the left and right symbols that expand sym (3 bytes each)
+	const uint8_t* block_length = nullptr;	// Number of values (minus one) per block (16 bit LE)
+	uint32_t block_length_size = 0;			// Size of block_length table, padded to be larger than num_blocks
+	const uint8_t* sparse_index = nullptr;	// Entries of 4 byte block number and 2 byte offset in the block (LE)
+	size_t sparse_index_size = 0;
+	const uint8_t* data = nullptr;			// Start of the Huffman coded data
+	vector<uint64_t> base64;				// base64[l - min_sym_len] is the 64 bit padded lowest symbol of length l
+	vector<uint8_t> symlen;					// Number of values (minus one) represented by a symbol
+	uint8_t pieces[TB_PIECES] = {};			// TB piece codes, in the order of the encoding
+	uint64_t group_idx[TB_PIECES + 1] = {};	// Start index for the encoding of each group of pieces
+	int group_len[TB_PIECES + 1] = {};		// Number of pieces per group, zero terminated
+	uint16_t map_idx[4] = {};				// Offsets into the DTZ value map per WDL score (DTZ only)
+};
+
+
+// One material combination, with its WDL and DTZ file
+struct SyzygyTable {
+	string name;
+	int piece_count = 0;
+	bool has_pawns = false;
+	bool has_unique_pieces = false;
+	bool symmetric = false;				// Same material for both sides, WDL only stores white to move
+	uint8_t pawn_count[2] = {};			// [leading color / other color]
+
+	mutex map_mutex;
+	atomic<bool> ready[2];				// [WDL / DTZ] mapping attempted
+	bool ok[2] = { false, false };		// [WDL / DTZ] mapping succeeded
+	MappedFile file[2];
+	const uint8_t* dtz_map = nullptr;
+	TBPairsData items[2][2][4];			// [WDL / DTZ][side to move][leading pawn file]
+
+	SyzygyTable() { ready[0] = false; ready[1] = false; }
+
+	TBPairsData* get(const int type, const int stm, const int f) {
+		return &items[type][type == TB_WDL ? stm % 2 : 0][has_pawns ? f : 0];
+	}
+};
+
+
+Syzygy::Syzygy() {
+	static once_flag tables_initialized;
+	call_once(tables_initialized, init_index_tables);
+}
+
+Syzygy::~Syzygy() = default;
+
+void Syzygy::init(const std::string& path_list) {
+	tables.clear();
+	paths.clear();
+	max_pieces = 0;
+
+	if (path_list.empty() || path_list == "<empty>")
+		return;
+
+#ifdef _WIN32
+	const char sep = ';';
+#else
+	const char sep = ':';
+#endif
+	stringstream ss(path_list);
+	string dir;
+	while (getline(ss, dir, sep)) {
+		if (!dir.empty())
+			paths.push_back(dir);
+	}
+
+	// Register all material combinations with up to 6 pieces for which a WDL file exists
+	for (int p1 = 1; p1 <= 5; p1++) {
+		string s1(1, PIECE_CHARS[p1]);
+		add("K" + s1 + "vK");
+
+		for (int p2 = 1; p2 <= p1; p2++) {
+			string s2(1, PIECE_CHARS[p2]);
+			add("K" + s1 + "vK" + s2);
+			add("K" + s1 + s2 + "vK");
+
+			for (int p3 = 1; p3 <= 5; p3++) {
+				add("K" + s1 + s2 + "vK" + PIECE_CHARS[p3]);
+			}
+
+			for (int p3 = 1; p3 <= p2; p3++) {
+				string s3(1, PIECE_CHARS[p3]);
+				add("K" + s1 + s2 + s3 + "vK");
+
+				for (int p4 = 1; p4 <= p3; p4++) {
+					add("K" + s1 + s2 + s3 + PIECE_CHARS[p4] + "vK");
+				}
+				for (int p4 = 1; p4 <= 5; p4++) {
+					add("K" + s1 + s2 + s3 + "vK" + PIECE_CHARS[p4]);
+				}
+			}
+
+			for (int p3 = 1; p3 <= p1; p3++) {
+				for (int p4 = 1; p4 <= (p1 == p3 ? p2 : p3); p4++) {
+					add("K" + s1 + s2 + "vK" + PIECE_CHARS[p3] + PIECE_CHARS[p4]);
+				}
+			}
+		}
+	}
+}
+
+// Register table name if its WDL file exists in one of the paths
+void Syzygy::add(const std::string& name) {
+	bool found = false;
+	for (const string& dir : paths) {
+		if (ifstream(dir + "/" + name + ".rtbw")) {
+			found = true;
+			break;
+		}
+	}
+	if (!found)
+		return;
+
+	unique_ptr<SyzygyTable> t(new SyzygyTable());
+	t->name = name;
+
+	size_t v = name.find('v');
+	string white = name.substr(0, v);
+	string black = name.substr(v + 1);
+
+	t->piece_count = (int)(white.size() + black.size());
+	t->has_pawns = name.find('P') != string::npos;
+	t->symmetric = (white == black);
+
+	for (const string& side : { white, black }) {
+		for (char c : string("PNBRQ")) {
+			if (count(side.begin(), side.end(), c) == 1)
+				t->has_unique_pieces = true;
+		}
+	}
+
+	// The leading color is the side with less pawns (if both sides have pawns), for better compression
+	int white_pawns = (int)count(white.begin(), white.end(), 'P');
+	int black_pawns = (int)count(black.begin(), black.end(), 'P');
+	bool white_leads = !black_pawns || (white_pawns && black_pawns >= white_pawns);
+	t->pawn_count[0] = (uint8_t)(white_leads ? white_pawns : black_pawns);
+	t->pawn_count[1] = (uint8_t)(white_leads ? black_pawns : white_pawns);
+
+	max_pieces = max(max_pieces, t->piece_count);
+	tables[name] = std::move(t);
+}
+
+bool Syzygy::can_probe(const Board& b) const {
+	return max_pieces > 0 && b.castling_rights == cr_none && piece_total(b) <= max_pieces;
+}
+
+SyzygyTable* Syzygy::find_table(const Board& b, bool& black_stronger) {
+	string white = material(b, EPieceColor::clr_white);
+	string black = material(b, EPieceColor::clr_black);
+
+	auto it = tables.find(white + "v" + black);
+	if (it != tables.end()) {
+		black_stronger = false;
+		return it->second.get();
+	}
+
+	it = tables.find(black + "v" + white);
+	if (it != tables.end()) {
+		black_stronger = true;
+		return it->second.get();
+	}
+
+	return nullptr;
+}
+
+
+// Table initialization ------------------------------------------------------------------------
+
+namespace {
+
+/* Group together pieces that are encoded together: pieces of the same type and color, except the leading group
+which holds the first 3 pieces (pawnless with a unique piece), the two kings (other pawnless tables) or the leading
+pawns. E.g. KRvKN -> KRK + N, KNNvK -> KK + NN, KPPvKP -> P + PP + K + K.
+The groups are not necessarily encoded in this order: order[0] gives the position of the leading group and
+order[1] that of the remaining pawns (if both sides have pawns). The index is then
+	g1 * N(g2) * N(g3) + g2 * N(g3) + g3
+for groups g1, g2, g3 (in encoding order), with N(g) the number of placements of group g. */
+void set_groups(const SyzygyTable& t, TBPairsData* d, const int order[2], const int f) {
+	int n = 0;
+	int first_len = t.has_pawns ? 0 : t.has_unique_pieces ? 3 : 2;
+	d->group_len[n] = 1;
+
+	for (int i = 1; i < t.piece_count; i++) {
+		if (--first_len > 0 || d->pieces[i] == d->pieces[i - 1])
+			d->group_len[n]++;
+		else
+			d->group_len[++n] = 1;
+	}
+	d->group_len[++n] = 0;  // Zero terminated
+
+	bool pp = t.has_pawns && t.pawn_count[1];  // Pawns on both sides
+	int next = pp ? 2 : 1;
+	int free_squares = 64 - d->group_len[0] - (pp ? d->group_len[1] : 0);
+	uint64_t idx = 1;
+
+	for (int k = 0; next < n || k == order[0] || k == order[1]; k++) {
+		if (k == order[0]) {  // Leading pawns or pieces
+			d->group_idx[0] = idx;
+			idx *= t.has_pawns ? LeadPawnsSize[d->group_len[0]][f] : t.has_unique_pieces ? 31332 : 462;
+		}
+		else if (k == order[1]) {  // Remaining pawns
+			d->group_idx[1] = idx;
+			idx *= Binomial[d->group_len[1]][48 - d->group_len[0]];
+		}
+		else {  // Remaining pieces
+			d->group_idx[next] = idx;
+			idx *= Binomial[d->group_len[next]][free_squares];
+			free_squares -= d->group_len[next++];
+		}
+	}
+
+	d->group_idx[n] = idx;
+}
+
+// Number of values (minus one) represented by symbol s: pairs are expanded recursively
+uint8_t set_symlen(TBPairsData* d, const uint16_t s, vector<bool>& visited) {
+	visited[s] = true;  // Set now, the tree is acyclic
+	uint16_t sr = btree_right(d->btree, s);
+	if (sr == 0xFFF)
+		return 0;
+
+	uint16_t sl = btree_left(d->btree, s);
+	if (sl >= d->symlen.size() || sr >= d->symlen.size())
+		return 0;  // Corrupt table, keep going without recursing out of range
+
+	if (!visited[sl])
+		d->symlen[sl] = set_symlen(d, sl, visited);
+	if (!visited[sr])
+		d->symlen[sr] = set_symlen(d, sr, visited);
+
+	return (uint8_t)(d->symlen[sl] + d->symlen[sr] + 1);
+}
+
+// Read the Huffman code description of one table. Returns pointer past it.
+const uint8_t* set_sizes(TBPairsData* d, const uint8_t* data) {
+	d->flags = *data++;
+
+	if (d->flags & tbf_single_value) {
+		d->num_blocks = d->block_length_size = 0;
+		d->span = d->sparse_index_size = 0;
+		d->min_sym_len = *data++;  // The single value
+		return data;
+	}
+
+	// The last group_idx entry (at the zero terminator of group_len) is the table size
+	uint64_t tb_size = d->group_idx[find(d->group_len, d->group_len + TB_PIECES, 0) - d->group_len];
+
+	d->block_size = (size_t)1 << *data++;
+	d->span = (size_t)1 << *data++;
+	d->sparse_index_size = (size_t)((tb_size + d->span - 1) / d->span);
+	uint8_t padding = *data++;
+	d->num_blocks = read_le32(data);
+	data += 4;
+	d->block_length_size = d->num_blocks + padding;  // Padded so the sparse index never points out of range
+	d->max_sym_len = *data++;
+	d->min_sym_len = *data++;
+	d->lowest_sym = data;
+
+	if (d->max_sym_len < d->min_sym_len || d->max_sym_len > 32) {
+		d->base64.clear();
+		return nullptr;
+	}
+	d->base64.resize(d->max_sym_len - d->min_sym_len + 1);
+
+	// Longer symbols have lower numeric values in the canonical code, so lowest_sym[i] >= lowest_sym[i+1]. From this
+	// the base64 table is built, such that a symbol of length l, padded to 64 bits, lies between base64[l-1] and base64[l].
+	d->base64.back() = 0;
+	for (int i = (int)d->base64.size() - 2; i >= 0; i--) {
+		d->base64[i] = (d->base64[i + 1] + read_le16(d->lowest_sym + 2 * i) - read_le16(d->lowest_sym + 2 * (i + 1))) / 2;
+	}
+	for (size_t i = 0; i < d->base64.size(); i++) {
+		d->base64[i] <<= 64 - i - d->min_sym_len;  // Right-padding to 64 bits
+	}
+
+	data += d->base64.size() * 2;
+	d->symlen.assign(read_le16(data), 0);
+	data += 2;
+	d->btree = data;
+
+	vector<bool> visited(d->symlen.size());
+	for (uint16_t sym = 0; sym < d->symlen.size(); sym++) {
+		if (!visited[sym])
+			d->symlen[sym] = set_symlen(d, sym, visited);
+	}
+
+	return data + d->symlen.size() * 3 + (d->symlen.size() & 1);
+}
+
+// DTZ values are remapped per WDL score (sorted by frequency); read the maps. Returns pointer past them.
+const uint8_t* set_dtz_map(SyzygyTable& t, const uint8_t* data, const uint8_t* base, const int max_file) {
+	t.dtz_map = data;
+
+	for (int f = 0; f <= max_file; f++) {
+		TBPairsData* d = t.get(TB_DTZ, 0, f);
+		if (!(d->flags & tbf_mapped))
+			continue;
+
+		if (d->flags & tbf_wide) {
+			data += (data - base) & 1;  // Word alignment, we may have a mixed table
+			for (int i = 0; i < 4; i++) {
+				d->map_idx[i] = (uint16_t)((data - t.dtz_map) / 2 + 1);
+				data += 2 * read_le16(data) + 2;
+			}
+		}
+		else {
+			for (int i = 0; i < 4; i++) {
+				d->map_idx[i] = (uint16_t)(data - t.dtz_map + 1);
+				data += *data + 1;
+			}
+		}
+	}
+
+	return data + ((data - base) & 1);  // Word alignment
+}
+
+}  // namespace
+
+// Memory map the WDL or DTZ file of table t and read its layout. Called on first probe, thread safe.
+bool Syzygy::map_table(SyzygyTable& t, const int type) {
+	if (t.ready[type].load(memory_order_acquire))
+		return t.ok[type];
+
+	lock_guard<mutex> lock(t.map_mutex);
+	if (t.ready[type].load(memory_order_relaxed))
+		return t.ok[type];
+
+	static const uint8_t MAGIC[2][4] = { { 0x71, 0xE8, 0x23, 0x5D }, { 0xD7, 0x66, 0x0C, 0xA5 } };
+	const string ext = (type == TB_WDL) ? ".rtbw" : ".rtbz";
+
+	bool opened = false;
+	for (const string& dir : paths) {
+		if (t.file[type].open(dir + "/" + t.name + ext)) {
+			opened = true;
+			break;
+		}
+	}
+
+	t.ok[type] = false;
+	if (opened && t.file[type].get_size() > 5 && !memcmp(t.file[type].get_data(), MAGIC[type], 4)) {
+		const uint8_t* base = t.file[type].get_data();
+		const uint8_t* end = base + t.file[type].get_size();
+		const uint8_t* data = base + 4;
+
+		const int split = 1, has_pawns = 2;
+		bool layout_ok = (bool)(*data & has_pawns) == t.has_pawns && (type == TB_DTZ || (bool)(*data & split) == !t.symmetric);
+		data++;
+
+		const int sides = (type == TB_WDL && !t.symmetric) ? 2 : 1;
+		const int max_file = t.has_pawns ? 3 : 0;
+		bool pp = t.has_pawns && t.pawn_count[1];
+
+		for (int f = 0; f <= max_file && layout_ok; f++) {
+			for (int i = 0; i < sides; i++) {
+				*t.get(type, i, f) = TBPairsData();
+			}
+
+			int order[2][2] = { { data[0] & 0xF, pp ? data[1] & 0xF : 0xF },
+								{ data[0] >> 4, pp ? data[1] >> 4 : 0xF } };
+			data += 1 + pp;
+
+			for (int k = 0; k < t.piece_count; k++, data++) {
+				for (int i = 0; i < sides; i++) {
+					t.get(type, i, f)->pieces[k] = (uint8_t)(i ? *data >> 4 : *data & 0xF);
+				}
+			}
+
+			for (int i = 0; i < sides; i++) {
+				set_groups(t, t.get(type, i, f), order[i], f);
+			}
+		}
+
+		data += (data - base) & 1;  // Word alignment
+
+		for (int f = 0; f <= max_file && layout_ok; f++) {
+			for (int i = 0; i < sides && layout_ok; i++) {
+				data = set_sizes(t.get(type, i, f), data);
+				layout_ok = data != nullptr && data <= end;
+			}
+		}
+
+		if (layout_ok && type == TB_DTZ)
+			data = set_dtz_map(t, data, base, max_file);
+
+		for (int f = 0; f <= max_file && layout_ok; f++) {
+			for (int i = 0; i < sides; i++) {
+				TBPairsData* d = t.get(type, i, f);
+				d->sparse_index = data;
+				data += d->sparse_index_size * 6;
+			}
+		}
+
+		for (int f = 0; f <= max_file && layout_ok; f++) {
+			for (int i = 0; i < sides; i++) {
+				TBPairsData* d = t.get(type, i, f);
+				d->block_length = data;
+				data += d->block_length_size * 2;
+			}
+		}
+
+		for (int f = 0; f <= max_file && layout_ok; f++) {
+			for (int i = 0; i < sides; i++) {
+				TBPairsData* d = t.get(type, i, f);
+				if (!d->num_blocks)
+					continue;  // Single value table
+				data = base + (((data - base) + 0x3F) & ~0x3F);  // 64 byte alignment
+				d->data = data;
+				data += d->num_blocks * d->block_size;
+			}
+		}
+
+		t.ok[type] = layout_ok && data <= end;
+	}
+
+	if (!t.ok[type]) {
+		if (opened)
+			cerr << "info string Corrupted tablebase file " << t.name << ext << endl;
+		t.file[type].close();
+	}
+
+	t.ready[type].store(true, memory_order_release);
+	return t.ok[type];
+}
+
+
+// Probing -------------------------------------------------------------------------------------
+
+namespace {
+
+// Value at index idx of a table: find the block through the sparse index, then walk the Huffman symbols in the
+// block and expand the symbol pair that contains the value.
+int decompress_pairs(const TBPairsData* d, const uint64_t idx) {
+	if (d->flags & tbf_single_value)
+		return d->min_sym_len;
+
+	// sparse_index[k] points to the block and offset of value k * span + span / 2
+	uint32_t k = (uint32_t)(idx / d->span);
+	const uint8_t* entry = d->sparse_index + 6 * (size_t)k;
+	uint32_t block = read_le32(entry);
+	int offset = read_le16(entry + 4);
+
+	offset += (int)(idx % d->span) - (int)(d->span / 2);
+
+	// Move to previous/next block, until offset lies in the block
+	while (offset < 0) {
+		offset += read_le16(d->block_length + 2 * (size_t)(--block)) + 1;
+	}
+	while (offset > read_le16(d->block_length + 2 * (size_t)block)) {
+		offset -= read_le16(d->block_length + 2 * (size_t)(block++)) + 1;
+	}
+
+	const uint8_t* ptr = d->data + (uint64_t)block * d->block_size;
+
+	// First 64 bits of the block: the first symbol starts at the beginning
+	uint64_t buf64 = read_be64(ptr);
+	ptr += 8;
+	int buf64_size = 64;
+	uint16_t sym;
+
+	while (true) {
+		int len = 0;  // Symbol length - min_sym_len
+
+		while (buf64 < d->base64[len]) {
+			len++;
+		}
+
+		// All symbols of a given length are consecutive, so the offset from base64 gives the symbol
+		sym = (uint16_t)((buf64 - d->base64[len]) >> (64 - len - d->min_sym_len));
+		sym = (uint16_t)(sym + read_le16(d->lowest_sym + 2 * len));
+
+		if (offset < d->symlen[sym] + 1)
+			break;
+
+		offset -= d->symlen[sym] + 1;
+		len += d->min_sym_len;
+		buf64 <<= len;  // Consume the symbol
+		buf64_size -= len;
+
+		if (buf64_size <= 32) {  // Refill the buffer
+			buf64_size += 32;
+			buf64 |= (uint64_t)read_be32(ptr) << (64 - buf64_size);
+			ptr += 4;
+		}
+	}
+
+	// Expand the symbol pairs until reaching the leaf holding our value
+	while (d->symlen[sym]) {
+		uint16_t left = btree_left(d->btree, sym);
+		if (offset < d->symlen[left] + 1)
+			sym = left;
+		else {
+			offset -= d->symlen[left] + 1;
+			sym = btree_right(d->btree, sym);
+		}
+	}
+
+	return btree_left(d->btree, sym);
+}
+
+}  // namespace
+
+// Encode board b into an index for table type and decompress the value. For DTZ, wdl is the known WDL result.
+int Syzygy::probe_table(const Board& b, const int type, const WDLScore wdl, ProbeState* result) {
+	if (piece_total(b) == 2)  // KvK
+		return type == TB_WDL ? (int)wdl_draw : 0;
+
+	bool black_stronger = false;
+	SyzygyTable* t = find_table(b, black_stronger);
+	if (!t || !map_table(*t, type)) {
+		*result = ps_fail;
+		return 0;
+	}
+
+	int squares[TB_PIECES];
+	int pieces[TB_PIECES];
+	int size = 0, lead_pawns_cnt = 0;
+	uint64_t lead_pawns = 0;
+	int tb_file = 0;
+	uint64_t idx;
+
+	// Tables are stored with the stronger side as white. For symmetric material only white to move is stored (WDL).
+	// In both cases the colors are swapped and the board flipped vertically.
+	int side = (b.side_to_move == EPieceColor::clr_black) ? 1 : 0;
+	bool flip = (t->symmetric && side == 1) || black_stronger;
+	int flip_color = flip ? 8 : 0;
+	int flip_squares = flip ? 56 : 0;
+	int stm = (flip ? 1 : 0) ^ side;
+
+	// With pawns the tables are split by the file of the leading pawn (a-d after mirroring)
+	if (t->has_pawns) {
+		int pc = t->get(type, 0, 0)->pieces[0] ^ flip_color;
+		for (int s = 0; s < 64; s++) {
+			if (tb_piece(b.square_list[s]) == pc) {
+				squares[size++] = s ^ flip_squares;
+				lead_pawns |= 1ULL << s;
+			}
+		}
+		lead_pawns_cnt = size;
+
+		swap(squares[0], *max_element(squares, squares + lead_pawns_cnt, pawns_comp));
+		tb_file = min(file_of(squares[0]), 7 - file_of(squares[0]));
+	}
+
+	// DTZ tables only store one side to move
+	if (type == TB_DTZ) {
+		int flags = t->get(type, stm, tb_file)->flags;
+		if ((flags & tbf_stm) != stm && !(t->symmetric && !t->has_pawns)) {
+			*result = ps_change_stm;
+			return 0;
+		}
+	}
+
+	// All other pieces, mapped to the table's colors and squares
+	for (int s = 0; s < 64; s++) {
+		if (b.square_list[s] == EPieceCode::epc_empty || (lead_pawns & (1ULL << s)))
+			continue;
+		squares[size] = s ^ flip_squares;
+		pieces[size++] = tb_piece(b.square_list[s]) ^ flip_color;
+	}
+
+	TBPairsData* d = t->get(type, stm, tb_file);
+
+	// Reorder the pieces to the sequence of the table
+	for (int i = lead_pawns_cnt; i < size - 1; i++) {
+		for (int j = i + 1; j < size; j++) {
+			if (d->pieces[i] == pieces[j]) {
+				swap(pieces[i], pieces[j]);
+				swap(squares[i], squares[j]);
+				break;
+			}
+		}
+	}
+
+	// Mirror horizontally so the leading piece is on files a-d
+	if (file_of(squares[0]) > 3) {
+		for (int i = 0; i < size; i++) {
+			squares[i] ^= 7;
+		}
+	}
+
+	if (t->has_pawns) {
+		// Encode leading pawns in ascending MapPawns order
+		idx = LeadPawnIdx[lead_pawns_cnt][squares[0]];
+		stable_sort(squares + 1, squares + lead_pawns_cnt, pawns_comp);
+		for (int i = 1; i < lead_pawns_cnt; i++) {
+			idx += Binomial[i][MapPawns[squares[i]]];
+		}
+	}
+	else {
+		// Mirror vertically so the leading piece is on ranks 1-4
+		if (rank_of(squares[0]) > 3) {
+			for (int i = 0; i < size; i++) {
+				squares[i] ^= 56;
+			}
+		}
+
+		// First piece of the leading group off the a1-h8 diagonal must be below it, otherwise mirror in the diagonal
+		for (int i = 0; i < d->group_len[0]; i++) {
+			if (!off_A1H8(squares[i]))
+				continue;
+			if (off_A1H8(squares[i]) > 0) {
+				for (int j = i; j < size; j++) {
+					squares[j] = ((squares[j] >> 3) | (squares[j] << 3)) & 63;
+				}
+			}
+			break;
+		}
+
+		if (t->has_unique_pieces) {
+			// The leading group is 3 pieces: first in the a1-d1-d4 triangle, the others on the remaining squares
+			int adjust1 = squares[1] > squares[0];
+			int adjust2 = (squares[2] > squares[0]) + (squares[2] > squares[1]);
+
+			if (off_A1H8(squares[0]))
+				idx = ((uint64_t)MapA1D1D4[squares[0]] * 63 + (squares[1] - adjust1)) * 62 + squares[2] - adjust2;
+			else if (off_A1H8(squares[1]))
+				idx = ((uint64_t)6 * 63 + rank_of(squares[0]) * 28 + MapB1H1H7[squares[1]]) * 62 + squares[2] - adjust2;
+			else if (off_A1H8(squares[2]))
+				idx = 6 * 63 * 62 + 4 * 28 * 62 + rank_of(squares[0]) * 7 * 28 + (rank_of(squares[1]) - adjust1) * 28
+					+ MapB1H1H7[squares[2]];
+			else
+				idx = 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28 + rank_of(squares[0]) * 7 * 6 + (rank_of(squares[1]) - adjust1) * 6
+					+ (rank_of(squares[2]) - adjust2);
+		}
+		else {
+			// Only the kings form the leading group
+			idx = MapKK[MapA1D1D4[squares[0]]][squares[1]];
+		}
+	}
+
+	// Encode the remaining groups, each sorted by square
+	idx *= d->group_idx[0];
+	int* group_sq = squares + d->group_len[0];
+	bool remaining_pawns = t->has_pawns && t->pawn_count[1];
+
+	for (int next = 1; d->group_len[next]; next++) {
+		stable_sort(group_sq, group_sq + d->group_len[next]);
+		uint64_t n = 0;
+
+		// Map a square down for every piece of a previous group on a lower square
+		for (int i = 0; i < d->group_len[next]; i++) {
+			int adjust = (int)count_if(squares, group_sq, [&](int s) { return group_sq[i] > s; });
+			n += Binomial[i + 1][group_sq[i] - adjust - 8 * remaining_pawns];
+		}
+
+		remaining_pawns = false;
+		idx += n * d->group_idx[next];
+		group_sq += d->group_len[next];
+	}
+
+	int value = decompress_pairs(d, idx);
+
+	if (type == TB_WDL)
+		return value - 2;
+
+	// DTZ: undo the frequency remapping and convert moves to plies where needed
+	const int WDL_MAP[] = { 1, 3, 0, 2, 0 };
+	TBPairsData* d0 = t->get(TB_DTZ, 0, tb_file);
+	if (d0->flags & tbf_mapped) {
+		int map_offset = d0->map_idx[WDL_MAP[wdl + 2]] + value;
+		if (d0->flags & tbf_wide)
+			value = read_le16(t->dtz_map + 2 * map_offset);
+		else
+			value = t->dtz_map[map_offset];
+	}
+
+	if ((wdl == wdl_win && !(d0->flags & tbf_win_plies)) || (wdl == wdl_loss && !(d0->flags & tbf_loss_plies)) ||
+		wdl == wdl_cursed_win || wdl == wdl_blessed_loss)
+		value *= 2;
+
+	return value + 1;
+}
+
+/* Winning captures (and pawn moves for DTZ) are "don't care" positions in the tables: the generator stores whatever
+compresses best. So the captures (and pawn moves) are searched, and the best of those and the stored value is the
+result. Positions with en passant rights are not stored at all, this is handled by the same search. */
+WDLScore Syzygy::search(Chess& chess, ProbeState* result, const bool check_zeroing_moves) {
+	WDLScore value, best_value = wdl_loss;
+
+	vector<Move> moves = chess.legal_moves();
+	size_t move_count = 0;
+
+	for (const Move& mv : moves) {
+		bool pawn_move = get_ept(chess.get_board().square_list[mv.from]) == EPieceType::ept_wpawn ||
+						 get_ept(chess.get_board().square_list[mv.from]) == EPieceType::ept_bpawn;
+		if (mv.capture == EPieceCode::epc_empty && (!check_zeroing_moves || !pawn_move))
+			continue;
+
+		move_count++;
+
+		chess.do_move(mv);
+		value = negate_wdl(search(chess, result, false));
+		chess.undo_last_moves(1);
+
+		if (*result == ps_fail)
+			return wdl_draw;
+
+		if (value > best_value) {
+			best_value = value;
+			if (value >= wdl_win) {
+				*result = ps_zeroing_best_move;  // Winning DTZ-zeroing move
+				return value;
+			}
+		}
+	}
+
+	// If all legal moves were searched the stored value may be wrong (e.g. en passant), so don't probe
+	bool no_more_moves = (move_count && move_count == moves.size());
+
+	if (no_more_moves)
+		value = best_value;
+	else {
+		value = (WDLScore)probe_table(chess.get_board(), TB_WDL, wdl_draw, result);
+		if (*result == ps_fail)
+			return wdl_draw;
+	}
+
+	if (best_value >= value) {
+		*result = (best_value > wdl_draw || no_more_moves) ? ps_zeroing_best_move : ps_ok;
+		return best_value;
+	}
+
+	*result = ps_ok;
+	return value;
+}
+
+WDLScore Syzygy::probe_wdl(Chess& chess, ProbeState* result) {
+	if (!can_probe(chess.get_board())) {
+		*result = ps_fail;
+		return wdl_draw;
+	}
+
+	*result = ps_ok;
+	return search(chess, result, false);
+}
+
+int Syzygy::probe_dtz(Chess& chess, ProbeState* result) {
+	if (!can_probe(chess.get_board())) {
+		*result = ps_fail;
+		return 0;
+	}
+
+	*result = ps_ok;
+	WDLScore wdl = search(chess, result, true);
+
+	if (*result == ps_fail || wdl == wdl_draw)  // DTZ tables don't store draws
+		return 0;
+
+	// DTZ stores a "don't care" value if the best move is zeroing
+	if (*result == ps_zeroing_best_move)
+		return dtz_before_zeroing(wdl);
+
+	int dtz = probe_table(chess.get_board(), TB_DTZ, wdl, result);
+
+	if (*result == ps_fail)
+		return 0;
+
+	if (*result != ps_change_stm)
+		return (dtz + 100 * (wdl == wdl_blessed_loss || wdl == wdl_cursed_win)) * sign_of(wdl);
+
+	// DTZ is stored for the other side to move: do a 1-ply search for the move that minimizes DTZ
+	int min_dtz = 0xFFFF;
+
+	for (const Move& mv : chess.legal_moves()) {
+		EPieceType ept = get_ept(chess.get_board().square_list[mv.from]);
+		bool zeroing = mv.capture != EPieceCode::epc_empty || ept == EPieceType::ept_wpawn || ept == EPieceType::ept_bpawn;
+
+		chess.do_move(mv);
+
+		// For zeroing moves use the DTZ before the move, with the sign from the WDL after it
+		dtz = zeroing ? -dtz_before_zeroing(search(chess, result, false)) : -probe_dtz(chess, result);
+
+		// A mating move has DTZ 1
+		if (dtz == 1 && chess.in_check() && !chess.has_legal_move())
+			min_dtz = 1;
+
+		if (!zeroing)
+			dtz += sign_of(dtz);
+
+		if (dtz < min_dtz && sign_of(dtz) == sign_of(wdl))
+			min_dtz = dtz;
+
+		chess.undo_last_moves(1);
+
+		if (*result == ps_fail)
+			return 0;
+	}
+
+	// No legal moves: mated
+	return min_dtz == 0xFFFF ? -1 : min_dtz;
+}
+
+// Rank the root moves by DTZ (taking the fifty move counter into account) and keep the best ranked ones, sorted
+// so that wins are converted as fast as possible and losses are delayed as long as possible.
+bool Syzygy::root_probe(Chess& chess, std::vector<Move>& moves) {
+	if (!can_probe(chess.get_board()))
+		return false;
+
+	ProbeState result = ps_ok;
+	int cnt50 = chess.get_board().half_move_count;
+
+	struct RankedMove {
+		Move mv;
+		int rank;
+		int dtz;
+	};
+	vector<RankedMove> ranked;
+
+	for (const Move& mv : moves) {
+		int dtz;
+		chess.do_move(mv);
+
+		if (chess.get_board().half_move_count == 0) {
+			// Zeroing move: dtz is one of -101/-1/0/1/101
+			WDLScore wdl = negate_wdl(probe_wdl(chess, &result));
+			dtz = dtz_before_zeroing(wdl);
+		}
+		else {
+			// Otherwise take dtz of the new position and correct by 1 ply
+			dtz = -probe_dtz(chess, &result);
+			dtz = dtz > 0 ? dtz + 1 : dtz < 0 ? dtz - 1 : dtz;
+		}
+
+		// A mating move has DTZ 1
+		if (dtz == 2 && chess.in_check() && !chess.has_legal_move())
+			dtz = 1;
+
+		chess.undo_last_moves(1);
+
+		if (result == ps_fail)
+			return false;
+
+		// Wins within the fifty move rule are ranked equally, losses too unless a fifty move draw is in sight
+		int rank = dtz > 0 ? (dtz + cnt50 <= 99 ? 1000 : 1000 - (dtz + cnt50))
+				 : dtz < 0 ? (-dtz * 2 + cnt50 < 100 ? -1000 : -1000 + (-dtz + cnt50))
+				 : 0;
+		ranked.push_back({ mv, rank, dtz });
+	}
+
+	int best_rank = ranked.empty() ? 0 : max_element(ranked.begin(), ranked.end(),
+		[](const RankedMove& lhs, const RankedMove& rhs) { return lhs.rank < rhs.rank; })->rank;
+
+	ranked.erase(remove_if(ranked.begin(), ranked.end(), [best_rank](const RankedMove& rm) { return rm.rank < best_rank; }), ranked.end());
+	stable_sort(ranked.begin(), ranked.end(), [](const RankedMove& lhs, const RankedMove& rhs) { return lhs.dtz < rhs.dtz; });
+
+	moves.clear();
+	for (const RankedMove& rm : ranked) {
+		moves.push_back(rm.mv);
+	}
+	return true;
+}
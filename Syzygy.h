@@ -0,0 +1,77 @@
+/*
+ * Syzygy.h
+ *
+ *  Probing of Syzygy endgame tablebases (.rtbw for win/draw/loss, .rtbz for distance to zeroing move).
+ *  Files are found in the directories of the SyzygyPath option, memory mapped on first access and
+ *  decompressed on demand, one value per probe. Ported from Stockfish (GPL-3.0-or-later), see Syzygy.cpp.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include "EnumList.h"
+#include "MappedFile.h"
+
+class Chess;
+struct SyzygyTable;
+
+// Win/draw/loss from the point of view of the side to move. Cursed wins and blessed losses are wins and
+// losses that are drawn by the fifty move rule.
+enum WDLScore {
+	wdl_loss = -2,
+	wdl_blessed_loss = -1,
+	wdl_draw = 0,
+	wdl_cursed_win = 1,
+	wdl_win = 2,
+};
+
+enum ProbeState {
+	ps_fail = 0,				// Probe failed (missing table, castling rights, too many pieces)
+	ps_ok = 1,					// Probe successful
+	ps_change_stm = -1,			// DTZ table stores the other side to move
+	ps_zeroing_best_move = 2,	// Best move zeroes the fifty move counter
+};
+
+class Syzygy {
+public:
+	Syzygy();
+	~Syzygy();
+
+	// Scan directories in paths (separated by ':' or ';' on Windows) for tables. Files are only mapped on first probe.
+	void init(const std::string& paths);
+
+	// Largest number of pieces (incl kings) for which a table was found
+	int get_max_pieces() const { return max_pieces; }
+	int get_table_count() const { return (int)tables.size(); }
+
+	// Can the position be probed at all (piece count within range and no castling rights)
+	bool can_probe(const Board& b) const;
+
+	// Probe WDL of position in chess (from side to move point of view). chess is restored afterwards.
+	WDLScore probe_wdl(Chess& chess, ProbeState* result);
+
+	// Probe DTZ (plies to next zeroing move, signed by result) of position in chess. chess is restored afterwards.
+	int probe_dtz(Chess& chess, ProbeState* result);
+
+	// Keep only the moves that preserve the tablebase result (best first). Returns false if probing failed,
+	// in which case moves is left untouched.
+	bool root_probe(Chess& chess, std::vector<Move>& moves);
+
+private:
+	std::vector<std::string> paths;
+	std::map<std::string, std::unique_ptr<SyzygyTable>> tables;  // Keyed by material, strongest side first (e.g. KRvK)
+	int max_pieces = 0;
+
+	void add(const std::string& name);
+	bool map_table(SyzygyTable& t, const int type);
+	SyzygyTable* find_table(const Board& b, bool& black_stronger);
+
+	int probe_table(const Board& b, const int type, const WDLScore wdl, ProbeState* result);
+	WDLScore search(Chess& chess, ProbeState* result, const bool check_zeroing_moves);
+};
@@ -0,0 +1,794 @@
+/*
+ * SyzygyWriter.cpp
+ *
+ *  A table file holds a header (magic, flags, piece order of every table), then per table the compression
+ *  parameters, the sparse index, the block lengths and the 64 byte aligned compressed blocks. Values are Huffman
+ *  coded symbols, where a symbol is a value or a pair of symbols (built greedily from the most frequent neighbours).
+ */
+
+#include <fstream>
+#include <vector>
+#include <map>
+#include <array>
+#include <queue>
+#include <algorithm>
+#include <cstdlib>
+#include "SyzygyWriter.h"
+#include "Chess.h"
+
+using namespace std;
+
+namespace {
+
+// Piece codes of the table format (white; black adds 8)
+const int TB_PAWN = 1;
+const int TB_WKING = 6;
+const int TB_BKING = 14;
+
+const int POSITIONS = 2 * 64 * 64 * 64;
+const int8_t ILLEGAL = 127;
+const int8_t UNKNOWN = 100;
+
+// Position of the white king, the white piece and the black king with stm to move
+inline int position_index(const int stm, const int wk, const int x, const int bk) {
+	return ((stm * 64 + wk) * 64 + x) * 64 + bk;
+}
+
+inline int rank_of(const int sq) { return sq >> 3; }
+inline int file_of(const int sq) { return sq & 7; }
+inline int off_diagonal(const int sq) { return rank_of(sq) - file_of(sq); }
+
+int table_code(const char piece) {
+	return (int)string(" PNBRQK").find(piece);
+}
+
+EPieceCode piece_code(const char piece) {
+	switch (piece) {
+	case 'Q': return EPieceCode::epc_wqueen;
+	case 'R': return EPieceCode::epc_wrook;
+	case 'B': return EPieceCode::epc_wbishop;
+	case 'N': return EPieceCode::epc_wknight;
+	case 'P': return EPieceCode::epc_wpawn;
+	}
+	return EPieceCode::epc_empty;
+}
+
+// Index of the position on b (kings and one white piece)
+int board_index(const Board& b, const int stm) {
+	int wk = -1, x = -1, bk = -1;
+	for (int sq = 0; sq < 64; sq++) {
+		if (b.square_list[sq] == EPieceCode::epc_wking)
+			wk = sq;
+		else if (b.square_list[sq] == EPieceCode::epc_bking)
+			bk = sq;
+		else if (b.square_list[sq] != EPieceCode::epc_empty)
+			x = sq;
+	}
+	return position_index(stm, wk, x, bk);
+}
+
+
+// Solving --------------------------------------------------------------------------------------------------------------
+
+// WDL (-2 loss, 0 draw, 2 win for the side to move, ILLEGAL) and DTZ (plies to the zeroing move, negative when
+// losing, 0 for draws) of every position of a table
+struct Values {
+	vector<int8_t> wdl;
+	vector<int16_t> dtz;
+};
+
+// solved holds the tables reached by promotions, so KPvK comes last
+bool solve(const char piece, const map<char, Values>& solved, Values& v) {
+	v.wdl.assign(POSITIONS, ILLEGAL);
+	v.dtz.assign(POSITIONS, 0);
+
+	struct Node {
+		vector<int> children;	// Positions after the moves that stay in the table (-1 - index for pawn pushes)
+		int zero_best = -3;		// Best result of the captures and promotions
+		int moves = 0;
+		bool in_check = false;
+	};
+	vector<Node> nodes(POSITIONS);
+
+	Chess c;
+	for (int p = 0; p < POSITIONS; p++) {
+		const int stm = p / (64 * 64 * 64), wk = p / (64 * 64) % 64, x = p / 64 % 64, bk = p % 64;
+		if (wk == x || wk == bk || x == bk || (piece == 'P' && (x < 8 || x >= 56)))
+			continue;
+		Board b;
+		b.square_list[wk] = EPieceCode::epc_wking;
+		b.square_list[x] = piece_code(piece);
+		b.square_list[bk] = EPieceCode::epc_bking;
+		b.side_to_move = stm ? EPieceColor::clr_black : EPieceColor::clr_white;
+		b.castling_rights = cr_none;
+		b.en_passant_square = -1;
+		if (!Chess::is_legal_position(b))
+			continue;
+
+		v.wdl[p] = UNKNOWN;
+		c.set_position(b);
+		Node& n = nodes[p];
+		n.in_check = c.in_check();
+		vector<Move> moves = c.legal_moves();
+		n.moves = (int)moves.size();
+		for (const Move& mv : moves) {
+			EPieceType ept = get_ept(b.square_list[mv.from]);
+			bool pawn = ept == EPieceType::ept_wpawn || ept == EPieceType::ept_bpawn;
+			if (mv.capture != EPieceCode::epc_empty) {
+				// Only the kings are left
+				n.zero_best = max(n.zero_best, 0);
+				continue;
+			}
+			c.do_move(mv);
+			int child = board_index(c.get_board(), 1 - stm);
+			c.undo_last_moves(1, false);
+			if (pawn && mv.promotion != EPieceCode::epc_empty) {
+				char promoted = " PPNBRQK"[(int)get_ept(mv.promotion)];
+				n.zero_best = max(n.zero_best, -(int)solved.at(promoted).wdl[child]);
+			}
+			else
+				n.children.push_back(pawn ? -1 - child : child);
+		}
+	}
+
+	// WDL: iterate to the fixpoint, what is still unknown then is a draw
+	for (int p = 0; p < POSITIONS; p++) {
+		if (v.wdl[p] != ILLEGAL && nodes[p].moves == 0)
+			v.wdl[p] = nodes[p].in_check ? -2 : 0;
+	}
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int p = 0; p < POSITIONS; p++) {
+			if (v.wdl[p] != UNKNOWN)
+				continue;
+			const Node& n = nodes[p];
+			bool win = n.zero_best == 2, all_lose = n.zero_best <= -2, unknown = false;
+			for (int ch : n.children) {
+				int w = v.wdl[ch < 0 ? -1 - ch : ch];
+				if (w == UNKNOWN) {
+					unknown = true;
+					continue;
+				}
+				if (w == -2)
+					win = true;
+				if (w != 2)
+					all_lose = false;
+			}
+			if (win) {
+				v.wdl[p] = 2;
+				changed = true;
+			}
+			else if (all_lose && !unknown) {
+				v.wdl[p] = -2;
+				changed = true;
+			}
+		}
+	}
+	for (int p = 0; p < POSITIONS; p++) {
+		if (v.wdl[p] == UNKNOWN)
+			v.wdl[p] = 0;
+	}
+
+	// DTZ by levels. Zeroing moves (captures, promotions, pawn pushes) and mates are one ply.
+	for (int p = 0; p < POSITIONS; p++) {
+		if (v.wdl[p] == ILLEGAL || v.wdl[p] == 0)
+			continue;
+		const Node& n = nodes[p];
+		if (n.moves == 0)
+			v.dtz[p] = -1;
+		else if (v.wdl[p] == 2) {
+			bool one = n.zero_best == 2;
+			for (int ch : n.children) {
+				if ((ch < 0 && v.wdl[-1 - ch] == -2) || (ch >= 0 && v.wdl[ch] == -2 && nodes[ch].moves == 0))
+					one = true;
+			}
+			if (one)
+				v.dtz[p] = 1;
+		}
+		else if (all_of(n.children.begin(), n.children.end(), [](int ch) { return ch < 0; }))
+			v.dtz[p] = -1;
+	}
+	for (int level = 2; level < 200; level++) {
+		vector<pair<int, int>> assign;
+		for (int p = 0; p < POSITIONS; p++) {
+			if (v.wdl[p] == ILLEGAL || v.wdl[p] == 0 || v.dtz[p] != 0)
+				continue;
+			const Node& n = nodes[p];
+			if (v.wdl[p] == 2) {
+				for (int ch : n.children) {
+					if (ch >= 0 && v.wdl[ch] == -2 && v.dtz[ch] == -(level - 1)) {
+						assign.push_back({ p, level });
+						break;
+					}
+				}
+			}
+			else {
+				// The longest resistance among the moves that do not zero
+				int longest = 1;
+				bool known = true;
+				for (int ch : n.children) {
+					if (ch < 0)
+						continue;
+					if (v.dtz[ch] == 0) {
+						known = false;
+						break;
+					}
+					longest = max(longest, (int)v.dtz[ch]);
+				}
+				if (known && longest + 1 == level)
+					assign.push_back({ p, -level });
+			}
+		}
+		for (const auto& a : assign) {
+			v.dtz[a.first] = (int16_t)a.second;
+		}
+	}
+	for (int p = 0; p < POSITIONS; p++) {
+		if (v.wdl[p] != ILLEGAL && v.wdl[p] != 0 && v.dtz[p] == 0)
+			return false;
+	}
+	return true;
+}
+
+
+// Index encoding -------------------------------------------------------------------------------------------------------
+
+int MapB1H1H7[64];		// Squares below the a1-h8 diagonal
+int MapA1D1D4[64];		// Squares of the a1-d1-d4 triangle, the diagonal last
+
+struct IndexInit {
+	IndexInit() {
+		int code = 0;
+		for (int sq = 0; sq < 64; sq++) {
+			if (off_diagonal(sq) < 0)
+				MapB1H1H7[sq] = code++;
+		}
+		const int triangle[10] = { 0, 1, 2, 3, 9, 10, 11, 18, 19, 27 };
+		code = 0;
+		for (int sq : triangle) {
+			if (off_diagonal(sq) < 0)
+				MapA1D1D4[sq] = code++;
+		}
+		for (int sq : triangle) {
+			if (off_diagonal(sq) == 0)
+				MapA1D1D4[sq] = code++;
+		}
+	}
+} index_init;
+
+// Piece order of a table and the factors of its groups
+struct TableLayout {
+	int pieces[3];			// Table piece codes in encoding order
+	int order;				// Position of the leading (pawn) group in the encoding
+	uint64_t factor[3];
+	uint64_t size;
+};
+
+// Three unique pieces form the leading group
+TableLayout layout_pawnless(const int p0, const int p1, const int p2) {
+	return { { p0, p1, p2 }, 0, { 1, 0, 0 }, 31332 };
+}
+
+// Groups [P], [p1], [p2] with the pawn group at position order
+TableLayout layout_pawn(const int p1, const int p2, const int order) {
+	TableLayout l{ { TB_PAWN, p1, p2 }, order, {}, 0 };
+	const uint64_t group_size[3] = { 6, 63, 62 };
+	uint64_t idx = 1;
+	for (int k = 0, next = 1; k < 3; k++) {
+		int g = k == order ? 0 : next++;
+		l.factor[g] = idx;
+		idx *= group_size[g];
+	}
+	l.size = idx;
+	return l;
+}
+
+// Index of a position (white is the strong side) in table l, square_of[code] is the square of table piece code
+uint64_t encode(const TableLayout& l, const bool pawns, const int square_of[16]) {
+	int sq[3];
+	for (int i = 0; i < 3; i++) {
+		sq[i] = square_of[l.pieces[i]];
+	}
+	if (file_of(sq[0]) > 3) {
+		for (int& s : sq) s ^= 7;
+	}
+	if (pawns) {
+		uint64_t idx = (rank_of(sq[0]) - 1) * l.factor[0];
+		for (int g = 1; g < 3; g++) {
+			int lower = 0;
+			for (int j = 0; j < g; j++) {
+				lower += sq[j] < sq[g];
+			}
+			idx += (uint64_t)(sq[g] - lower) * l.factor[g];
+		}
+		return idx;
+	}
+	if (rank_of(sq[0]) > 3) {
+		for (int& s : sq) s ^= 56;
+	}
+	for (int i = 0; i < 3; i++) {
+		if (off_diagonal(sq[i]) == 0)
+			continue;
+		if (off_diagonal(sq[i]) > 0) {
+			for (int j = i; j < 3; j++) {
+				sq[j] = ((sq[j] >> 3) | (sq[j] << 3)) & 63;
+			}
+		}
+		break;
+	}
+	int a1 = sq[1] > sq[0];
+	int a2 = (sq[2] > sq[0]) + (sq[2] > sq[1]);
+	if (off_diagonal(sq[0]))
+		return ((uint64_t)MapA1D1D4[sq[0]] * 63 + (sq[1] - a1)) * 62 + sq[2] - a2;
+	if (off_diagonal(sq[1]))
+		return ((uint64_t)6 * 63 + rank_of(sq[0]) * 28 + MapB1H1H7[sq[1]]) * 62 + sq[2] - a2;
+	if (off_diagonal(sq[2]))
+		return 6 * 63 * 62 + 4 * 28 * 62 + rank_of(sq[0]) * 7 * 28 + (rank_of(sq[1]) - a1) * 28 + MapB1H1H7[sq[2]];
+	return 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28 + rank_of(sq[0]) * 7 * 6 + (rank_of(sq[1]) - a1) * 6 + (rank_of(sq[2]) - a2);
+}
+
+
+// Compression ----------------------------------------------------------------------------------------------------------
+
+struct Packed {
+	bool single = false;				// All values are single_value
+	int single_value = 0;
+	int block_log = 6, span_log = 7;
+	int min_len = 0, max_len = 0;		// Code lengths
+	vector<uint16_t> lowest_sym;		// Per code length
+	vector<array<uint16_t, 2>> btree;	// Pair symbols (left, right); a value is (value, 0xFFF)
+	vector<uint32_t> sparse_block;
+	vector<uint16_t> sparse_offset;
+	vector<uint16_t> block_length;		// Values in the block - 1
+	vector<uint8_t> data;
+};
+
+Packed compress(const vector<int>& values, const int block_log, const int span_log, const int pair_rounds) {
+	Packed pk;
+	pk.block_log = block_log;
+	pk.span_log = span_log;
+	const int first = values[0];
+	if (all_of(values.begin(), values.end(), [first](int x) { return x == first; })) {
+		pk.single = true;
+		pk.single_value = first;
+		return pk;
+	}
+
+	// Symbols: every value present, then pairs of the most frequent neighbours
+	struct Symbol { int left, right, length; };		// right is -1 for a value (left)
+	vector<Symbol> symbols;
+	map<int, int> symbol_of;
+	vector<int> stream;
+	for (int x : values) {
+		if (!symbol_of.count(x)) {
+			symbol_of[x] = (int)symbols.size();
+			symbols.push_back({ x, -1, 1 });
+		}
+		stream.push_back(symbol_of[x]);
+	}
+	for (int round = 0; round < pair_rounds; round++) {
+		map<pair<int, int>, int> freq;
+		for (size_t i = 0; i + 1 < stream.size(); i++) {
+			if (symbols[stream[i]].length + symbols[stream[i + 1]].length > 256)
+				continue;
+			freq[{ stream[i], stream[i + 1] }]++;
+			if (stream[i] == stream[i + 1] && i + 2 < stream.size() && stream[i + 2] == stream[i])
+				i++;
+		}
+		pair<int, int> best{ -1, -1 };
+		int best_freq = 3;
+		for (const auto& f : freq) {
+			if (f.second > best_freq) {
+				best_freq = f.second;
+				best = f.first;
+			}
+		}
+		if (best.first < 0)
+			break;
+		const int pair_symbol = (int)symbols.size();
+		symbols.push_back({ best.first, best.second, symbols[best.first].length + symbols[best.second].length });
+		vector<int> paired;
+		for (size_t i = 0; i < stream.size(); i++) {
+			if (i + 1 < stream.size() && stream[i] == best.first && stream[i + 1] == best.second) {
+				paired.push_back(pair_symbol);
+				i++;
+			}
+			else
+				paired.push_back(stream[i]);
+		}
+		stream.swap(paired);
+	}
+
+	// Huffman code lengths
+	vector<uint64_t> freq(symbols.size());
+	for (int s : stream) {
+		freq[s]++;
+	}
+	vector<int> len(symbols.size(), 0);
+	{
+		typedef pair<uint64_t, int> Item;
+		priority_queue<Item, vector<Item>, greater<Item>> q;
+		vector<int> parent, leaf_symbol;
+		int tree_nodes = 0;
+		for (size_t s = 0; s < symbols.size(); s++) {
+			if (freq[s]) {
+				q.push({ freq[s], tree_nodes++ });
+				leaf_symbol.push_back((int)s);
+				parent.push_back(-1);
+			}
+		}
+		while (q.size() > 1) {
+			Item a = q.top(); q.pop();
+			Item b = q.top(); q.pop();
+			parent.push_back(-1);
+			parent[a.second] = tree_nodes;
+			parent[b.second] = tree_nodes;
+			q.push({ a.first + b.first, tree_nodes++ });
+		}
+		for (size_t i = 0; i < leaf_symbol.size(); i++) {
+			int depth = 0;
+			for (int n = (int)i; parent[n] >= 0; n = parent[n]) {
+				depth++;
+			}
+			len[leaf_symbol[i]] = leaf_symbol.size() > 1 ? depth : 1;
+		}
+	}
+	int max_len = 0, min_len = 64;
+	for (size_t s = 0; s < symbols.size(); s++) {
+		if (len[s]) {
+			max_len = max(max_len, len[s]);
+			min_len = min(min_len, len[s]);
+		}
+	}
+
+	// Canonical code: symbols renumbered with the longest codes first, unused symbols last
+	vector<int> ordered;
+	for (int l = max_len; l >= min_len; l--) {
+		for (size_t s = 0; s < symbols.size(); s++) {
+			if (len[s] == l)
+				ordered.push_back((int)s);
+		}
+	}
+	for (size_t s = 0; s < symbols.size(); s++) {
+		if (!len[s])
+			ordered.push_back((int)s);
+	}
+	vector<int> renumbered(symbols.size());
+	for (size_t i = 0; i < ordered.size(); i++) {
+		renumbered[ordered[i]] = (int)i;
+	}
+
+	pk.min_len = min_len;
+	pk.max_len = max_len;
+	const int lengths = max_len - min_len + 1;
+	vector<int> count(65, 0);
+	for (size_t s = 0; s < symbols.size(); s++) {
+		if (len[s])
+			count[len[s]]++;
+	}
+	pk.lowest_sym.assign(lengths, 0);
+	for (int i = lengths - 2; i >= 0; i--) {
+		pk.lowest_sym[i] = pk.lowest_sym[i + 1] + count[min_len + i + 1];
+	}
+	vector<uint64_t> base(65, 0);
+	for (int l = max_len - 1; l >= min_len; l--) {
+		base[l] = (base[l + 1] + count[l + 1]) / 2;
+	}
+	pk.btree.resize(symbols.size());
+	for (size_t s = 0; s < symbols.size(); s++) {
+		if (symbols[s].right < 0)
+			pk.btree[renumbered[s]] = { (uint16_t)symbols[s].left, 0xFFF };
+		else
+			pk.btree[renumbered[s]] = { (uint16_t)renumbered[symbols[s].left], (uint16_t)renumbered[symbols[s].right] };
+	}
+
+	// Blocks of at most block_size bytes (the reader may look 64 bits ahead) and 65536 values
+	const size_t block_size = (size_t)1 << block_log;
+	const size_t max_bits = block_size * 8 - 64;
+	vector<uint64_t> block_start{ 0 };		// Index of the first value of every block
+	vector<uint8_t> block(block_size, 0);
+	size_t bits = 0, block_values = 0;
+	uint64_t value_pos = 0;
+	auto flush = [&]() {
+		pk.data.insert(pk.data.end(), block.begin(), block.end());
+		pk.block_length.push_back((uint16_t)(block_values - 1));
+		fill(block.begin(), block.end(), 0);
+		bits = 0;
+		block_values = 0;
+		block_start.push_back(value_pos);
+	};
+	for (int s : stream) {
+		const int l = len[s];
+		const uint64_t code = base[l] + (renumbered[s] - pk.lowest_sym[l - min_len]);
+		if (bits + l > max_bits || block_values + symbols[s].length > 65536)
+			flush();
+		for (int b = l - 1; b >= 0; b--, bits++) {
+			if ((code >> b) & 1)
+				block[bits >> 3] |= (uint8_t)(0x80 >> (bits & 7));
+		}
+		block_values += symbols[s].length;
+		value_pos += symbols[s].length;
+	}
+	flush();
+	block_start.pop_back();
+
+	// Sparse index: block and offset of value k * span + span / 2
+	const uint64_t span = (uint64_t)1 << span_log;
+	const uint64_t entries = (values.size() + span - 1) / span;
+	for (uint64_t k = 0; k < entries; k++) {
+		uint64_t p = k * span + span / 2;
+		size_t b = upper_bound(block_start.begin(), block_start.end(), min<uint64_t>(p, values.size() - 1)) - block_start.begin() - 1;
+		pk.sparse_block.push_back((uint32_t)b);
+		pk.sparse_offset.push_back((uint16_t)(p - block_start[b]));
+	}
+	return pk;
+}
+
+
+// File writer ----------------------------------------------------------------------------------------------------------
+
+struct FileData {
+	vector<uint8_t> bytes;
+	void u8(const int x) { bytes.push_back((uint8_t)x); }
+	void le16(const int x) { u8(x & 0xFF); u8((x >> 8) & 0xFF); }
+	void le32(const uint32_t x) { for (int i = 0; i < 4; i++) u8((x >> (8 * i)) & 0xFF); }
+	void align(const size_t a) { while (bytes.size() % a) u8(0); }
+};
+
+void write_sizes(FileData& f, const Packed& pk, const int flags) {
+	if (pk.single) {
+		f.u8(flags | 128);
+		f.u8(pk.single_value);
+		return;
+	}
+	f.u8(flags);
+	f.u8(pk.block_log);
+	f.u8(pk.span_log);
+	f.u8(0);		// Padding of the block lengths
+	f.le32((uint32_t)pk.block_length.size());
+	f.u8(pk.max_len);
+	f.u8(pk.min_len);
+	for (uint16_t s : pk.lowest_sym) {
+		f.le16(s);
+	}
+	f.le16((int)pk.btree.size());
+	for (const auto& e : pk.btree) {
+		f.u8(e[0] & 0xFF);
+		f.u8(((e[0] >> 8) & 0xF) | ((e[1] & 0xF) << 4));
+		f.u8(e[1] >> 4);
+	}
+	if (pk.btree.size() & 1)
+		f.u8(0);
+}
+
+void write_tail(FileData& f, const vector<Packed>& tables) {
+	for (const Packed& pk : tables) {
+		for (size_t i = 0; i < pk.sparse_block.size(); i++) {
+			f.le32(pk.sparse_block[i]);
+			f.le16(pk.sparse_offset[i]);
+		}
+	}
+	for (const Packed& pk : tables) {
+		for (uint16_t l : pk.block_length) {
+			f.le16(l);
+		}
+	}
+	for (const Packed& pk : tables) {
+		if (pk.single)
+			continue;
+		f.align(64);
+		f.bytes.insert(f.bytes.end(), pk.data.begin(), pk.data.end());
+	}
+	for (int i = 0; i < 64; i++) {
+		f.u8(0);
+	}
+}
+
+bool save(const string& path, const FileData& f) {
+	ofstream file(path, ios::binary | ios::trunc);
+	file.write(reinterpret_cast<const char*>(f.bytes.data()), f.bytes.size());
+	return (bool)file;
+}
+
+// DTZ values of the wins and the losses (in plies - 1), most frequent first
+struct DtzMap {
+	vector<int> maps[4];
+};
+
+// Values of table l for side stm (and pawn file for pawn tables), as WDL + 2 or as index into the DTZ map
+vector<int> fill_table(const Values& v, const TableLayout& l, const bool pawns, const int x_code, const int stm, const int file,
+	const bool dtz, DtzMap* dtz_map, bool& ok) {
+	const int NONE = -1000, DONT_CARE = -1, WIN = 1000, LOSS = 2000;
+	vector<int> raw(l.size, NONE);
+	for (int wk = 0; wk < 64; wk++) {
+		for (int x = 0; x < 64; x++) {
+			for (int bk = 0; bk < 64; bk++) {
+				const int p = position_index(stm, wk, x, bk);
+				if (v.wdl[p] == ILLEGAL || (pawns && min(file_of(x), 7 - file_of(x)) != file))
+					continue;
+				int square_of[16] = {};
+				square_of[TB_WKING] = wk;
+				square_of[TB_BKING] = bk;
+				square_of[x_code] = x;
+				const uint64_t idx = encode(l, pawns, square_of);
+				int val;
+				if (!dtz)
+					val = v.wdl[p] + 2;
+				else
+					val = v.wdl[p] == 0 ? DONT_CARE : (v.wdl[p] > 0 ? WIN : LOSS) + abs((int)v.dtz[p]) - 1;
+
+				// Symmetric positions share an index; only the DTZ of draws may differ
+				if (raw[idx] != NONE && raw[idx] != val) {
+					if (!dtz || (raw[idx] != DONT_CARE && val != DONT_CARE))
+						ok = false;
+					if (raw[idx] == DONT_CARE)
+						raw[idx] = val;
+					continue;
+				}
+				raw[idx] = val;
+			}
+		}
+	}
+
+	vector<int> out(l.size);
+	if (!dtz) {
+		// Broken positions take the most frequent value
+		map<int, int> freq;
+		for (int x : raw) {
+			if (x != NONE)
+				freq[x]++;
+		}
+		int common = max_element(freq.begin(), freq.end(), [](const pair<const int, int>& a, const pair<const int, int>& b) {
+			return a.second < b.second; })->first;
+		for (size_t i = 0; i < raw.size(); i++) {
+			out[i] = raw[i] == NONE ? common : raw[i];
+		}
+		return out;
+	}
+
+	map<int, int> win_freq, loss_freq;
+	for (int x : raw) {
+		if (x >= LOSS)
+			loss_freq[x - LOSS]++;
+		else if (x >= WIN)
+			win_freq[x - WIN]++;
+	}
+	auto ranked = [](const map<int, int>& freq) {
+		vector<pair<int, int>> r;
+		for (const auto& e : freq) {
+			r.push_back({ -e.second, e.first });
+		}
+		sort(r.begin(), r.end());
+		vector<int> res;
+		for (const auto& e : r) {
+			res.push_back(e.second);
+		}
+		return res;
+	};
+	dtz_map->maps[0] = ranked(win_freq);
+	dtz_map->maps[1] = ranked(loss_freq);
+	for (size_t i = 0; i < raw.size(); i++) {
+		const int x = raw[i];
+		const vector<int>& m = dtz_map->maps[x >= LOSS ? 1 : 0];
+		if (x >= WIN)
+			out[i] = (int)(find(m.begin(), m.end(), x - (x >= LOSS ? LOSS : WIN)) - m.begin());
+		else
+			out[i] = 0;
+	}
+	return out;
+}
+
+}
+
+
+bool write_syzygy_test_tables(const string& dir, ostream& out) {
+	const string prefix = dir.empty() ? "" : dir + "/";
+
+	// Promotions lead to the pawnless tables
+	map<char, Values> solved;
+	for (char piece : string("QRBNP")) {
+		if (!solve(piece, solved, solved[piece])) {
+			out << "info string Could not solve K" << piece << "vK" << endl;
+			return false;
+		}
+	}
+
+	for (char piece : string("QRBNP")) {
+		const Values& v = solved[piece];
+		const bool pawns = piece == 'P';
+		const int x_code = table_code(piece);
+		const string name = string("K") + piece + "vK";
+		int results[3] = {};
+		for (int p = 0; p < POSITIONS; p++) {
+			if (v.wdl[p] != ILLEGAL)
+				results[v.wdl[p] / 2 + 1]++;
+		}
+
+		// Different piece orders per side (and per pawn file) exercise the reader
+		const int files = pawns ? 4 : 1;
+		TableLayout wdl_layout[2][4];
+		TableLayout dtz_layout[4];
+		for (int f = 0; f < files; f++) {
+			if (pawns) {
+				wdl_layout[0][f] = layout_pawn(TB_WKING, TB_BKING, f % 3);
+				wdl_layout[1][f] = layout_pawn(TB_BKING, TB_WKING, (f + 1) % 3);
+				dtz_layout[f] = layout_pawn(f % 2 ? TB_WKING : TB_BKING, f % 2 ? TB_BKING : TB_WKING, (f + 2) % 3);
+			}
+			else {
+				wdl_layout[0][f] = layout_pawnless(TB_WKING, x_code, TB_BKING);
+				wdl_layout[1][f] = layout_pawnless(x_code, TB_BKING, TB_WKING);
+				dtz_layout[f] = layout_pawnless(TB_BKING, TB_WKING, x_code);
+			}
+		}
+		// The KPvK DTZ table stores black to move, the others white to move
+		const int dtz_stm = pawns ? 1 : 0;
+		bool ok = true;
+
+		FileData wdl;
+		wdl.u8(0x71); wdl.u8(0xE8); wdl.u8(0x23); wdl.u8(0x5D);
+		wdl.u8(1 | (pawns ? 2 : 0));
+		for (int f = 0; f < files; f++) {
+			wdl.u8(wdl_layout[0][f].order | (wdl_layout[1][f].order << 4));
+			for (int k = 0; k < 3; k++) {
+				wdl.u8(wdl_layout[0][f].pieces[k] | (wdl_layout[1][f].pieces[k] << 4));
+			}
+		}
+		wdl.align(2);
+		vector<Packed> wdl_tables;
+		for (int f = 0; f < files; f++) {
+			for (int s = 0; s < 2; s++) {
+				vector<int> values = fill_table(v, wdl_layout[s][f], pawns, x_code, s, f, false, nullptr, ok);
+				wdl_tables.push_back(compress(values, 6 + (f + s) % 2, 6 + f % 3, 60));
+			}
+		}
+		for (const Packed& pk : wdl_tables) {
+			write_sizes(wdl, pk, 0);
+		}
+		write_tail(wdl, wdl_tables);
+
+		FileData dtz;
+		dtz.u8(0xD7); dtz.u8(0x66); dtz.u8(0x0C); dtz.u8(0xA5);
+		dtz.u8(pawns ? 2 : 0);
+		for (int f = 0; f < files; f++) {
+			dtz.u8(dtz_layout[f].order);
+			for (int k = 0; k < 3; k++) {
+				dtz.u8(dtz_layout[f].pieces[k]);
+			}
+		}
+		dtz.align(2);
+		vector<Packed> dtz_tables;
+		vector<DtzMap> maps(files);
+		for (int f = 0; f < files; f++) {
+			vector<int> values = fill_table(v, dtz_layout[f], pawns, x_code, dtz_stm, f, true, &maps[f], ok);
+			dtz_tables.push_back(compress(values, 6 + f % 2, 6, 60));
+		}
+		for (const Packed& pk : dtz_tables) {
+			// Side to move, value map, wins and losses in plies
+			write_sizes(dtz, pk, pk.single ? dtz_stm : dtz_stm | 2 | 4 | 8);
+		}
+		for (int f = 0; f < files; f++) {
+			if (dtz_tables[f].single)
+				continue;
+			for (const vector<int>& m : maps[f].maps) {
+				dtz.u8((int)m.size());
+				for (int x : m) {
+					dtz.u8(x);
+				}
+			}
+		}
+		dtz.align(2);
+		write_tail(dtz, dtz_tables);
+
+		if (!ok) {
+			out << "info string Index conflict in " << name << endl;
+			return false;
+		}
+		if (!save(prefix + name + ".rtbw", wdl) || !save(prefix + name + ".rtbz", dtz)) {
+			out << "info string Could not write " << prefix + name << ".rtbw/.rtbz" << endl;
+			return false;
+		}
+		out << name << ": " << results[2] << " wins, " << results[1] << " draws, " << results[0] << " losses for the side to move" << endl;
+	}
+	return true;
+}
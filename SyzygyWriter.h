@@ -0,0 +1,16 @@
+/*
+ * SyzygyWriter.h
+ *
+ *  Writer of the 3-piece test tables in syzygy_test (KQvK, KRvK, KBvK, KNvK, KPvK, .rtbw and .rtbz). The values are
+ *  solved by retrograde analysis with the Chess move generator. Index encoding and compression are written from the
+ *  file format, independently of the reader in Syzygy.cpp, and vary piece orders, symbol pairing and DTZ value maps
+ *  between the tables so that they cover more of the reader.
+ */
+
+#pragma once
+
+#include <string>
+#include <ostream>
+
+// Solve the five tables and write them to dir (which must exist). Returns false if a table could not be written.
+bool write_syzygy_test_tables(const std::string& dir, std::ostream& out);
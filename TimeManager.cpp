@@ -0,0 +1,42 @@
+#include <algorithm>
+#include "TimeManager.h"
+
+using namespace std;
+
+void TimeManager::init(const int64_t time_left, const int64_t increment, const int moves_to_go, const int64_t move_overhead) {
+	iterations = 0;
+	last_best_move = 0;
+	last_score = 0;
+	best_move_changes = 0;
+
+	// Without moves to go, plan for 40 more moves; the increment makes up for the moves after that
+	int64_t available = max<int64_t>(1, time_left - move_overhead);
+	int moves = moves_to_go > 0 ? min(moves_to_go, 50) : 40;
+
+	// The last move before the time control can use almost everything, other moves at most a share of the clock
+	int64_t cap = moves == 1 ? available * 9 / 10 : available * 2 / 5;
+	soft_limit = max<int64_t>(1, min(available / moves + increment * 3 / 4, cap));
+	hard_limit = max<int64_t>(1, min(soft_limit * 5, cap));
+}
+
+bool TimeManager::stop_after_iteration(const int64_t elapsed, const uint16_t best_move, const int score, const size_t root_moves) {
+	if (root_moves == 1)
+		return true;
+
+	// Unstable best move: up to about twice the time while it keeps changing
+	best_move_changes /= 2;
+	if (iterations > 0 && best_move != last_best_move)
+		best_move_changes += 1;
+	double scale = 1.0 + best_move_changes;
+
+	// Falling score: up to 50% more time, for a drop of a pawn or more
+	if (iterations > 0 && score < last_score)
+		scale *= 1.0 + min(last_score - score, 100) / 200.0;
+
+	iterations++;
+	last_best_move = best_move;
+	last_score = score;
+
+	// The next iteration takes longer than all completed ones together, so it is only started with enough time left
+	return elapsed > soft_limit * scale * 0.6;
+}
@@ -0,0 +1,35 @@
+/*
+ * TimeManager.h
+ *
+ *  Thinking time per move from the clock. The remaining time (less the move overhead), increment and moves to go
+ *  give a soft limit, the time a move should take on average, and a hard limit that the search never exceeds. After
+ *  every iteration the soft limit is scaled up while the best move changes or the score drops, and the search stops
+ *  at once when there is only one legal move.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+class TimeManager {
+public:
+	/* Limits for a move with time_left and increment milliseconds on the clock and moves_to_go moves until the next
+	time control (0 for the rest of the game). move_overhead is subtracted per move for communication delays. */
+	void init(const int64_t time_left, const int64_t increment, const int moves_to_go, const int64_t move_overhead);
+
+	int64_t get_soft_limit() const { return soft_limit; }
+	int64_t get_hard_limit() const { return hard_limit; }
+
+	/* Called after every completed iteration with the elapsed milliseconds, the best move (encoded) and score of
+	the iteration and the number of legal root moves. Returns true if the next iteration should not be started. */
+	bool stop_after_iteration(const int64_t elapsed, const uint16_t best_move, const int score, const size_t root_moves);
+
+private:
+	int64_t soft_limit = 0;
+	int64_t hard_limit = 0;
+
+	int iterations = 0;
+	uint16_t last_best_move = 0;
+	int last_score = 0;
+	double best_move_changes = 0;	// Decaying count of best move changes between iterations
+};
@@ -0,0 +1,270 @@
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <array>
+#include <algorithm>
+#include "Trace.h"
+#include "EnumList.h"
+
+using namespace std;
+
+namespace {
+
+const char TRACE_MAGIC[4] = { 'C', 'T', 'R', 'C' };
+const uint32_t TRACE_VERSION = 1;
+
+// Encoded move (6 bits from, 6 bits to, promotion piece code) from UCI notation, without the promotion color bit
+uint16_t parse_move(const string& uci) {
+	if (uci.size() < 4)
+		return 0;
+	int from = (uci[0] - 'a') + 8 * (uci[1] - '1');
+	int to = (uci[2] - 'a') + 8 * (uci[3] - '1');
+	int promotion = 0;
+	if (uci.size() > 4) {
+		switch (uci[4]) {
+		case 'n': promotion = (int)EPieceType::ept_knight; break;
+		case 'b': promotion = (int)EPieceType::ept_bishop; break;
+		case 'r': promotion = (int)EPieceType::ept_rook; break;
+		case 'q': promotion = (int)EPieceType::ept_queen; break;
+		default: break;
+		}
+	}
+	return (uint16_t)(from | (to << 6) | (promotion << 12));
+}
+
+bool is_enter(const TraceEvent& e) { return e.kind == tk_enter || e.kind == tk_qenter; }
+
+}  // namespace
+
+
+TraceBuffer::TraceBuffer(const size_t capacity_events) {
+	size_t capacity = 1;
+	while (capacity * 2 <= max<size_t>(capacity_events, 1)) {
+		capacity *= 2;
+	}
+	events.resize(capacity);
+	mask = capacity - 1;
+}
+
+bool TraceBuffer::dump(const std::string& path) const {
+	ofstream out(path, ios::binary);
+	if (!out)
+		return false;
+
+	uint32_t fen_length = (uint32_t)root_fen.size();
+	uint64_t count = min<uint64_t>(head, events.size());
+	out.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+	out.write((const char*)&TRACE_VERSION, sizeof(TRACE_VERSION));
+	out.write((const char*)&fen_length, sizeof(fen_length));
+	out.write(root_fen.data(), fen_length);
+	out.write((const char*)&count, sizeof(count));
+
+	// Oldest first: after wrapping, the oldest event is the one head points to
+	uint64_t first = head - count;
+	size_t begin = (size_t)(first & mask);
+	size_t part = min<size_t>((size_t)count, events.size() - begin);
+	out.write((const char*)&events[begin], part * sizeof(TraceEvent));
+	out.write((const char*)&events[0], (count - part) * sizeof(TraceEvent));
+	return (bool)out;
+}
+
+
+bool TraceFile::open(const std::string& path) {
+	ifstream in(path, ios::binary);
+	char magic[4];
+	uint32_t version, fen_length;
+	uint64_t count;
+	if (!in.read(magic, sizeof(magic)) || !equal(magic, magic + 4, TRACE_MAGIC))
+		return false;
+	if (!in.read((char*)&version, sizeof(version)) || version != TRACE_VERSION)
+		return false;
+	if (!in.read((char*)&fen_length, sizeof(fen_length)) || fen_length > 256)
+		return false;
+	root_fen.resize(fen_length);
+	in.read(&root_fen[0], fen_length);
+	if (!in.read((char*)&count, sizeof(count)))
+		return false;
+	events.resize((size_t)count);
+	in.read((char*)events.data(), count * sizeof(TraceEvent));
+	return (bool)in;
+}
+
+std::string TraceFile::move_name(const uint16_t move) {
+	if (move == 0)
+		return "root";
+	int from = move & 63, to = (move >> 6) & 63;
+	string name = { (char)('a' + from % 8), (char)('1' + from / 8), (char)('a' + to % 8), (char)('1' + to / 8) };
+	switch ((move >> 12) & 7) {
+	case (int)EPieceType::ept_knight:	name += 'n'; break;
+	case (int)EPieceType::ept_bishop:	name += 'b'; break;
+	case (int)EPieceType::ept_rook:		name += 'r'; break;
+	case (int)EPieceType::ept_queen:	name += 'q'; break;
+	default: break;
+	}
+	return name;
+}
+
+const char* TraceFile::type_name(const uint8_t type) {
+	static const char* names[] = { "pv", "cut", "all", "tt", "tb", "draw", "mate", "leaf", "abort" };
+	return type < sizeof(names) / sizeof(names[0]) ? names[type] : "?";
+}
+
+/* Every node records an enter and an exit event and children are searched in between, so the tree is rebuilt with
+a stack. A leaf of the main search opens its quiescence node at the same ply, as a child. Events before the first
+root node are only counted: their ancestors are not in the buffer. */
+
+void TraceFile::summary(std::ostream& out) const {
+	const int n_types = nt_abort + 1;
+	map<int, array<uint64_t, n_types + 2>> per_ply;		// Main search exits per type, quiescence exits, enters
+	uint64_t cut_nodes = 0, first_move_cuts = 0, children = 0, interior = 0;
+
+	// Children searched per open node, to find the cutoffs by the first move
+	vector<uint32_t> stack;
+	bool aligned = false;
+	for (const TraceEvent& e : events) {
+		if (is_enter(e)) {
+			per_ply[e.ply][n_types + 1]++;
+			if (e.ply == 0 && e.kind == tk_enter) {
+				aligned = true;
+				stack.clear();
+			}
+			if (aligned) {
+				if (!stack.empty())
+					stack.back()++;
+				stack.push_back(0);
+			}
+			continue;
+		}
+
+		if (e.kind == tk_qexit)
+			per_ply[e.ply][n_types]++;
+		else if (e.type < n_types)
+			per_ply[e.ply][e.type]++;
+
+		if (aligned && !stack.empty()) {
+			uint32_t searched = stack.back();
+			stack.pop_back();
+			if (searched > 0) {
+				interior++;
+				children += searched;
+			}
+			if (e.kind == tk_exit && e.type == nt_cut) {
+				cut_nodes++;
+				first_move_cuts += (searched == 1);
+			}
+		}
+	}
+
+	out << "Root      : " << root_fen << endl;
+	out << "Events    : " << events.size() << endl;
+	if (!events.empty() && events.front().sequence != 0)
+		out << "The buffer wrapped, the oldest events are lost" << endl;
+
+	out << "ply";
+	for (int t = 0; t < n_types; t++) {
+		out << "\t" << type_name((uint8_t)t);
+	}
+	out << "\tqnodes\tenters" << endl;
+	for (const auto& p : per_ply) {
+		out << p.first;
+		for (uint64_t count : p.second) {
+			out << "\t" << count;
+		}
+		out << endl;
+	}
+
+	out << fixed << setprecision(1);
+	if (cut_nodes)
+		out << "First move cutoffs : " << 100.0 * first_move_cuts / cut_nodes << "% of " << cut_nodes << " cut nodes" << endl;
+	if (interior)
+		out << "Children per node  : " << (double)children / interior << endl;
+	out << defaultfloat;
+}
+
+void TraceFile::tree(const std::vector<std::string>& path, const int depth, const size_t max_lines, std::ostream& out) const {
+	vector<uint16_t> target;
+	for (const string& mv : path) {
+		target.push_back(parse_move(mv));
+	}
+
+	// Last main search node at the end of path: the open main search nodes above it played the moves of path
+	vector<const TraceEvent*> stack;
+	size_t found = events.size();
+	bool aligned = false;
+	for (size_t i = 0; i < events.size(); i++) {
+		const TraceEvent& e = events[i];
+		if (!is_enter(e)) {
+			if (!stack.empty())
+				stack.pop_back();
+			continue;
+		}
+		if (e.ply == 0 && e.kind == tk_enter) {
+			aligned = true;
+			stack.clear();
+		}
+		if (!aligned)
+			continue;
+		stack.push_back(&e);
+
+		if (e.kind != tk_enter || e.ply != target.size() || stack.size() != target.size() + 1)
+			continue;
+		bool match = true;
+		for (size_t p = 1; p < stack.size() && match; p++) {
+			match = (stack[p]->move & 0x7FFF) == target[p - 1];
+		}
+		if (match)
+			found = i;
+	}
+	if (found == events.size()) {
+		out << "No node found for this line" << endl;
+		return;
+	}
+
+	// Subtree in preorder: nodes are listed at their enter event and completed at their exit event
+	struct Node {
+		const TraceEvent* enter;
+		const TraceEvent* exit;
+		size_t level;
+	};
+	vector<Node> nodes;
+	vector<size_t> open;		// Index in nodes, or SIZE_MAX for nodes deeper than depth
+	for (size_t i = found; i < events.size(); i++) {
+		const TraceEvent& e = events[i];
+		if (is_enter(e)) {
+			if ((int)open.size() <= depth) {
+				open.push_back(nodes.size());
+				nodes.push_back({ &e, nullptr, open.size() - 1 });
+			}
+			else
+				open.push_back(SIZE_MAX);
+		}
+		else {
+			if (open.back() != SIZE_MAX)
+				nodes[open.back()].exit = &e;
+			open.pop_back();
+			if (open.empty())
+				break;
+		}
+	}
+
+	size_t lines = 0;
+	for (const Node& n : nodes) {
+		if (lines++ == max_lines) {
+			out << "... (" << nodes.size() - max_lines << " more nodes)" << endl;
+			break;
+		}
+		out << string(2 * n.level, ' ') << move_name(n.enter->move);
+		out << (n.enter->kind == tk_qenter ? " q" : " d" + to_string(n.enter->depth));
+		out << " [" << n.enter->alpha << "," << n.enter->beta << "]";
+		if (n.exit) {
+			out << " = " << n.exit->score << " " << type_name(n.exit->type);
+			if (n.exit->depth > n.enter->depth)
+				out << " ext";
+			if (n.exit->move)
+				out << " best " << move_name(n.exit->move);
+		}
+		else
+			out << " (not finished)";
+		out << endl;
+	}
+}
@@ -0,0 +1,99 @@
+/*
+ * Trace.h
+ *
+ *  Search tree tracing. When a Search has a TraceBuffer, every node records an enter event (ply, move, window,
+ *  depth) and an exit event (score, node type, best move) into a fixed size ring buffer, so only the most recent
+ *  events are kept and recording costs two 24 byte stores per node; without a buffer the search only tests a
+ *  pointer. The buffer is dumped to a binary file on demand, and TraceFile reads it back and rebuilds the tree for
+ *  offline queries.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+
+enum ETraceKind : uint8_t {
+	tk_enter = 0,
+	tk_exit = 1,
+	tk_qenter = 2,		// Quiescence node
+	tk_qexit = 3,
+};
+
+enum ENodeType : uint8_t {
+	nt_pv = 0,			// Score inside the window
+	nt_cut = 1,			// Fail high
+	nt_all = 2,			// Fail low
+	nt_tt = 3,			// Transposition table cutoff
+	nt_tb = 4,			// Tablebase hit
+	nt_draw = 5,		// Fifty moves, repetition or insufficient material
+	nt_mate = 6,		// Checkmate, stalemate or mate distance pruning
+	nt_leaf = 7,		// Static evaluation (maximum ply, quiescence stand pat)
+	nt_abort = 8,		// Search stopped
+};
+
+struct TraceEvent {
+	uint64_t key;			// Position key
+	int16_t alpha;
+	int16_t beta;
+	int16_t score;			// Exit events
+	uint16_t move;			// Enter: move leading to the node, exit: best move (Search::encode_move format)
+	uint8_t ply;
+	int8_t depth;			// Enter: remaining depth, exit: depth after extensions
+	uint8_t kind;			// ETraceKind
+	uint8_t type;			// ENodeType (exit events)
+	uint32_t sequence;		// Low bits of the event number, to detect where the ring buffer wrapped
+};
+
+static_assert(sizeof(TraceEvent) == 24, "TraceEvent should be 24 bytes");
+
+class TraceBuffer {
+public:
+	// Capacity is rounded down to a power of two
+	explicit TraceBuffer(const size_t capacity_events);
+
+	inline void record(TraceEvent e) {
+		e.sequence = (uint32_t)head;
+		events[head++ & mask] = e;
+	}
+
+	void clear() { head = 0; }
+	void set_root(const std::string& fen) { root_fen = fen; }
+	uint64_t get_recorded() const { return head; }
+	size_t get_capacity() const { return events.size(); }
+
+	// Write the stored events (oldest first) with the root position. Returns succes flag.
+	bool dump(const std::string& path) const;
+
+private:
+	std::vector<TraceEvent> events;
+	uint64_t mask;
+	uint64_t head = 0;		// Number of events recorded
+	std::string root_fen;
+};
+
+// Dumped trace, with queries over the rebuilt tree
+class TraceFile {
+public:
+	bool open(const std::string& path);
+
+	const std::string& get_root() const { return root_fen; }
+	size_t size() const { return events.size(); }
+
+	// Event counts per ply and node type, and the average number of children of interior nodes
+	void summary(std::ostream& out) const;
+
+	/* Print the nodes below path (moves in UCI notation from the root) up to depth levels deeper, as an indented
+	tree with window, score and node type. Only the last search of the node at path is shown (from the last
+	iteration that visited it). At most max_lines nodes are printed. */
+	void tree(const std::vector<std::string>& path, const int depth, const size_t max_lines, std::ostream& out) const;
+
+	static std::string move_name(const uint16_t move);
+	static const char* type_name(const uint8_t type);
+
+private:
+	std::string root_fen;
+	std::vector<TraceEvent> events;
+};
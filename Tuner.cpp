@@ -0,0 +1,297 @@
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <cmath>
+#include <chrono>
+#include <iomanip>
+#include "Tuner.h"
+#include "Evaluate.h"
+#include "EvalParams.h"
+#include "DataGen.h"
+#include "Numa.h"
+
+using namespace std;
+
+Tuner::Tuner() : weights(N_WEIGHTS) {
+	for (int p = 0; p < 6; p++) {
+		for (int sq = 0; sq < 64; sq++) {
+			weights[PST_MG_OFFSET + p * 64 + sq] = PST_MG[p][sq];
+			weights[PST_EG_OFFSET + p * 64 + sq] = PST_EG[p][sq];
+		}
+		weights[VALUE_MG_OFFSET + p] = PIECE_VALUE_MG[p];
+		weights[VALUE_EG_OFFSET + p] = PIECE_VALUE_EG[p];
+	}
+	offsets.push_back(0);
+}
+
+// Loading ------------------------------------------------------------------------------------------------------------
+
+size_t Tuner::load(const std::string& path, std::ostream& out) {
+	auto start = chrono::steady_clock::now();
+	size_t before = size();
+
+	if (path.size() > 4 && path.compare(path.size() - 4, 4, ".bin") == 0) {
+		PositionFile data;
+		if (!data.open(path)) {
+			out << "info string Could not open " << path << endl;
+			return 0;
+		}
+		offsets.reserve(offsets.size() + data.size());
+		results.reserve(results.size() + data.size());
+		phases.reserve(phases.size() + data.size());
+		for (const PackedPosition& p : data) {
+			add_position(p.unpack(), p.result);
+		}
+	}
+	else {
+		ifstream file(path);
+		if (!file) {
+			out << "info string Could not open " << path << endl;
+			return 0;
+		}
+
+		string line;
+		while (getline(file, line)) {
+			istringstream in(line);
+			string fields[4];
+			if (!(in >> fields[0] >> fields[1] >> fields[2] >> fields[3]))
+				continue;
+
+			// Result somewhere after the position
+			string rest;
+			getline(in, rest);
+			int result;
+			size_t bracket = rest.find('[');
+			if (rest.find("1/2-1/2") != string::npos)
+				result = 1;
+			else if (rest.find("1-0") != string::npos)
+				result = 2;
+			else if (rest.find("0-1") != string::npos)
+				result = 0;
+			else if (bracket != string::npos)
+				result = (int)lround(2 * atof(rest.c_str() + bracket + 1));
+			else
+				continue;
+
+			Board b;
+			istringstream(fields[0] + " " + fields[1] + " " + fields[2] + " " + fields[3] + " 0 1") >> b;
+			add_position(b, result);
+		}
+	}
+
+	// Read by every tuning thread
+	interleave_memory(features.data(), features.size() * sizeof(uint16_t));
+	interleave_memory(offsets.data(), offsets.size() * sizeof(uint32_t));
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	out << "Loaded " << size() - before << " positions from " << path << " in " << seconds << "s ("
+		<< (features.size() * sizeof(uint16_t) + size() * (sizeof(uint32_t) + 2)) / max<size_t>(size(), 1)
+		<< " bytes per position)" << endl;
+	return size() - before;
+}
+
+void Tuner::add_position(const Board& b, const int result) {
+	int phase = 0;
+	for (int sq = 0; sq < 64; sq++) {
+		int p = eval_piece_index(b.square_list[sq]);
+		if (p < 0)
+			continue;
+
+		bool white = get_clr(b.square_list[sq]) == EPieceColor::clr_white;
+		features.push_back((uint16_t)((p * 64 + (white ? sq : sq ^ 56)) | (white ? 0 : 0x8000)));
+		phase += PHASE_WEIGHT[p];
+	}
+
+	offsets.push_back((uint32_t)features.size());
+	phases.push_back((uint8_t)min(phase, 24));
+	results.push_back((uint8_t)result);
+}
+
+
+// Error and gradient -------------------------------------------------------------------------------------------------
+
+double Tuner::evaluate(const size_t i) const {
+	double mg = 0, eg = 0;
+	for (uint32_t j = offsets[i]; j < offsets[i + 1]; j++) {
+		int idx = features[j] & 0x7FFF;
+		double sign = (features[j] & 0x8000) ? -1.0 : 1.0;
+		mg += sign * (weights[PST_MG_OFFSET + idx] + weights[VALUE_MG_OFFSET + idx / 64]);
+		eg += sign * (weights[PST_EG_OFFSET + idx] + weights[VALUE_EG_OFFSET + idx / 64]);
+	}
+	return (mg * phases[i] + eg * (24 - phases[i])) / 24;
+}
+
+double Tuner::gradient(const size_t begin, const size_t end, const double k, std::vector<double>& grad) const {
+	double total = 0;
+	for (size_t i = begin; i < end; i++) {
+		double s = 1 / (1 + exp(-k * evaluate(i)));
+		double diff = s - results[i] / 2.0;
+		total += diff * diff;
+		if (grad.empty())
+			continue;
+
+		// d(error)/d(eval), split over the middlegame and endgame weights by phase
+		double d = 2 * diff * s * (1 - s) * k;
+		double d_mg = d * phases[i] / 24, d_eg = d * (24 - phases[i]) / 24;
+		for (uint32_t j = offsets[i]; j < offsets[i + 1]; j++) {
+			int idx = features[j] & 0x7FFF;
+			double sign = (features[j] & 0x8000) ? -1.0 : 1.0;
+			grad[PST_MG_OFFSET + idx] += sign * d_mg;
+			grad[VALUE_MG_OFFSET + idx / 64] += sign * d_mg;
+			grad[PST_EG_OFFSET + idx] += sign * d_eg;
+			grad[VALUE_EG_OFFSET + idx / 64] += sign * d_eg;
+		}
+	}
+	return total;
+}
+
+double Tuner::error(const double k, const int threads) const {
+	int n = max(1, threads);
+	vector<double> totals(n);
+	vector<thread> workers;
+	for (int t = 0; t < n; t++) {
+		workers.emplace_back([this, &totals, k, n, t]() {
+			bind_thread(t);
+			vector<double> no_gradient;
+			totals[t] = gradient(size() * t / n, size() * (t + 1) / n, k, no_gradient);
+		});
+	}
+	double total = 0;
+	for (int t = 0; t < n; t++) {
+		workers[t].join();
+		total += totals[t];
+	}
+	return total / max<size_t>(size(), 1);
+}
+
+// Scan with decreasing step sizes
+double Tuner::fit_k(const int threads) const {
+	double best_k = 0.01, best_error = error(best_k, threads);
+	for (double step = 0.001; step > 1e-6; step /= 10) {
+		double center = best_k;
+		for (int i = -9; i <= 9; i++) {
+			double k = center + i * step;
+			if (k <= 0)
+				continue;
+			double e = error(k, threads);
+			if (e < best_error) {
+				best_error = e;
+				best_k = k;
+			}
+		}
+	}
+	return best_k;
+}
+
+
+// Optimization -------------------------------------------------------------------------------------------------------
+
+void Tuner::tune(const TunerSettings& settings, std::ostream& out) {
+	if (size() == 0) {
+		out << "info string No positions to tune on" << endl;
+		return;
+	}
+
+	int n = max(1, settings.threads);
+	double k = settings.k > 0 ? settings.k : fit_k(n);
+	out << "Tuning " << N_WEIGHTS << " weights on " << size() << " positions, K = " << k << ", initial error "
+		<< error(k, n) << endl;
+
+	// Adam
+	const double beta1 = 0.9, beta2 = 0.999, epsilon = 1e-8;
+	vector<double> m(N_WEIGHTS), v(N_WEIGHTS);
+	vector<vector<double>> grads(n, vector<double>(N_WEIGHTS));
+	auto start = chrono::steady_clock::now();
+
+	for (int epoch = 1; epoch <= settings.epochs; epoch++) {
+		auto epoch_start = chrono::steady_clock::now();
+		vector<double> totals(n);
+		vector<thread> workers;
+		for (int t = 0; t < n; t++) {
+			workers.emplace_back([this, &grads, &totals, k, n, t]() {
+				bind_thread(t);
+				fill(grads[t].begin(), grads[t].end(), 0.0);
+				totals[t] = gradient(size() * t / n, size() * (t + 1) / n, k, grads[t]);
+			});
+		}
+		double total = 0;
+		for (int t = 0; t < n; t++) {
+			workers[t].join();
+			total += totals[t];
+		}
+
+		for (int w = 0; w < N_WEIGHTS; w++) {
+			// The king has no material value
+			if (w == VALUE_MG_OFFSET + 5 || w == VALUE_EG_OFFSET + 5)
+				continue;
+
+			double g = 0;
+			for (int t = 0; t < n; t++) {
+				g += grads[t][w];
+			}
+			g /= size();
+
+			m[w] = beta1 * m[w] + (1 - beta1) * g;
+			v[w] = beta2 * v[w] + (1 - beta2) * g * g;
+			double m_hat = m[w] / (1 - pow(beta1, epoch));
+			double v_hat = v[w] / (1 - pow(beta2, epoch));
+			weights[w] -= settings.learning_rate * m_hat / (sqrt(v_hat) + epsilon);
+		}
+
+		if (epoch == 1 || epoch % 10 == 0 || epoch == settings.epochs) {
+			double epoch_time = chrono::duration<double>(chrono::steady_clock::now() - epoch_start).count();
+			out << "Epoch " << epoch << ": error " << total / size() << " (" << epoch_time << "s)" << endl;
+		}
+	}
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	out << "Final error " << error(k, n) << " after " << settings.epochs << " epochs in " << seconds << "s" << endl;
+}
+
+bool Tuner::save(const std::string& path) const {
+	ofstream file(path);
+	const char* names[6] = { "Pawn", "Knight", "Bishop", "Rook", "Queen", "King" };
+
+	auto values = [&file, this](const char* name, const int offset) {
+		file << "const int " << name << "[6] = { ";
+		for (int p = 0; p < 6; p++) {
+			file << lround(weights[offset + p]) << (p < 5 ? ", " : " };\n");
+		}
+	};
+	auto table = [&file, &names, this](const char* name, const int offset) {
+		file << "const int " << name << "[6][64] = {\n";
+		for (int p = 0; p < 6; p++) {
+			file << "\t{\t// " << names[p] << "\n";
+			for (int r = 0; r < 8; r++) {
+				file << "\t\t";
+				for (int f = 0; f < 8; f++) {
+					file << setw(4) << lround(weights[offset + p * 64 + r * 8 + f]) << (f < 7 ? ", " : ",\n");
+				}
+			}
+			file << "\t},\n";
+		}
+		file << "};\n";
+	};
+
+	file << "/*\n";
+	file << " * EvalParams.h\n";
+	file << " *\n";
+	file << " *  Evaluation weights: material and piece-square tables for the middlegame (mg) and endgame (eg), blended by game\n";
+	file << " *  phase. Tables are from white's point of view with a1 first; black uses the square mirrored vertically.\n";
+	file << " *  This file can be regenerated by the tuner.\n";
+	file << " */\n\n";
+	file << "#pragma once\n\n";
+	file << "// Piece order: pawn, knight, bishop, rook, queen, king\n";
+	values("PIECE_VALUE_MG", VALUE_MG_OFFSET);
+	values("PIECE_VALUE_EG", VALUE_EG_OFFSET);
+	file << "\n// Game phase contribution per piece (24 = all pieces on the board)\n";
+	file << "const int PHASE_WEIGHT[6] = { ";
+	for (int p = 0; p < 6; p++) {
+		file << PHASE_WEIGHT[p] << (p < 5 ? ", " : " };\n");
+	}
+	file << "\n";
+	table("PST_MG", PST_MG_OFFSET);
+	file << "\n";
+	table("PST_EG", PST_EG_OFFSET);
+	return (bool)file;
+}
@@ -0,0 +1,67 @@
+/*
+ * Tuner.h
+ *
+ *  Texel tuning of the evaluation weights (EvalParams.h). The evaluation is linear in its weights, so every position
+ *  is stored once as a short list of (piece, square, color) features plus its phase and result. Each epoch computes
+ *  the error of sigmoid(K * eval) against the results and its gradient in parallel, and Adam updates the weights.
+ *  The tuned weights are written in the format of EvalParams.h, to a separate file that replaces it after review.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include "EnumList.h"
+
+struct TunerSettings {
+	int epochs = 200;
+	int threads = 1;
+	double learning_rate = 1.0;		// Adam step size, in centipawns
+	double k = 0.0;					// Sigmoid scale, fitted to the data if 0
+};
+
+class Tuner {
+public:
+	// Weight layout: PST_MG, PST_EG (6 * 64 each), PIECE_VALUE_MG, PIECE_VALUE_EG (6 each)
+	static const int PST_MG_OFFSET = 0;
+	static const int PST_EG_OFFSET = 384;
+	static const int VALUE_MG_OFFSET = 768;
+	static const int VALUE_EG_OFFSET = 774;
+	static const int N_WEIGHTS = 780;
+
+	Tuner();
+
+	// Positions with results: EPD/FEN lines with a result ("1-0", "1/2-1/2", "0-1", [1.0], [0.5] or [0.0]), or
+	// datagen files (*.bin). Returns the number of positions read. Result is 0 (white lost), 1 (draw) or 2 (white won).
+	size_t load(const std::string& path, std::ostream& out);
+	void add_position(const Board& b, const int result);
+	size_t size() const { return results.size(); }
+
+	// Mean squared error of the current weights with sigmoid scale k
+	double error(const double k, const int threads) const;
+	// Sigmoid scale with the lowest error of the current weights
+	double fit_k(const int threads) const;
+
+	void tune(const TunerSettings& settings, std::ostream& out);
+
+	// Write the weights in the format of EvalParams.h
+	bool save(const std::string& path) const;
+
+private:
+	/* Positions as a flat list of features. A feature is a piece on a square: index p * 64 + sq (white's point of
+	view, black pieces mirrored) with bit 15 set for black. Position i uses features[offsets[i]] to
+	features[offsets[i + 1]]. */
+	std::vector<uint32_t> offsets;
+	std::vector<uint16_t> features;
+	std::vector<uint8_t> phases;		// 0 to 24
+	std::vector<uint8_t> results;		// White's point of view: 0 loss, 1 draw, 2 win
+
+	std::vector<double> weights;
+
+	// Evaluation of position i from white's point of view
+	double evaluate(const size_t i) const;
+	// Error and gradient over positions [begin, end)
+	double gradient(const size_t begin, const size_t end, const double k, std::vector<double>& grad) const;
+};
@@ -0,0 +1,186 @@
+/*
+ * UCIProcess.cpp
+ */
+
+#include <chrono>
+#include "UCIProcess.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <thread>
+#endif
+
+using namespace std;
+
+#ifndef _WIN32
+namespace {
+
+// Pipe whose ends are closed on exec, so an engine started by another thread does not inherit them (it would keep
+// our engine's stdin open after stop). pipe2 sets the flag atomically, the fcntl fallback leaves a short window.
+bool open_pipe(int fds[2]) {
+#ifdef __linux__
+	return pipe2(fds, O_CLOEXEC) == 0;
+#else
+	if (pipe(fds) != 0)
+		return false;
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	return true;
+#endif
+}
+
+}  // namespace
+#endif
+
+UCIProcess::~UCIProcess() {
+	stop();
+}
+
+#ifdef _WIN32
+
+bool UCIProcess::start(const std::string&) { return false; }
+void UCIProcess::stop() {}
+bool UCIProcess::write_line(const std::string&) { return false; }
+bool UCIProcess::read_line(std::string&, const int) { return false; }
+
+#else
+
+bool UCIProcess::start(const std::string& command) {
+	stop();
+
+	int in_pipe[2], out_pipe[2];
+	if (!open_pipe(in_pipe))
+		return false;
+	if (!open_pipe(out_pipe)) {
+		::close(in_pipe[0]);
+		::close(in_pipe[1]);
+		return false;
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		for (int fd : { in_pipe[0], in_pipe[1], out_pipe[0], out_pipe[1] }) {
+			::close(fd);
+		}
+		return false;
+	}
+
+	if (pid == 0) {
+		// Child: stdin from in_pipe, stdout to out_pipe (dup2 clears close-on-exec on the copies)
+		dup2(in_pipe[0], STDIN_FILENO);
+		dup2(out_pipe[1], STDOUT_FILENO);
+		for (int fd : { in_pipe[0], in_pipe[1], out_pipe[0], out_pipe[1] }) {
+			::close(fd);
+		}
+		execl("/bin/sh", "sh", "-c", command.c_str(), (char*)nullptr);
+		_exit(127);
+	}
+
+	::close(in_pipe[0]);
+	::close(out_pipe[1]);
+	to_child = in_pipe[1];
+	from_child = out_pipe[0];
+	buffer.clear();
+	signal(SIGPIPE, SIG_IGN);  // A crashed child shows up as a failed write instead of killing us
+
+	string line;
+	name = command;
+	if (!write_line("uci"))
+		return false;
+	while (read_line(line, 10000)) {
+		if (line.compare(0, 8, "id name ") == 0)
+			name = line.substr(8);
+		else if (line == "uciok")
+			return write_line("isready") && wait_for("readyok", line, 10000);
+	}
+
+	stop();
+	return false;
+}
+
+void UCIProcess::stop() {
+	if (pid <= 0)
+		return;
+
+	write_line("quit");
+	::close(to_child);
+	to_child = -1;
+
+	// Give the child a second to exit by itself
+	int status;
+	bool exited = false;
+	for (int i = 0; i < 100 && !exited; i++) {
+		exited = waitpid(pid, &status, WNOHANG) == pid;
+		if (!exited)
+			this_thread::sleep_for(chrono::milliseconds(10));
+	}
+	if (!exited) {
+		kill(pid, SIGKILL);
+		waitpid(pid, &status, 0);
+	}
+
+	::close(from_child);
+	from_child = -1;
+	pid = -1;
+}
+
+bool UCIProcess::write_line(const std::string& line) {
+	if (to_child < 0)
+		return false;
+
+	string data = line + "\n";
+	size_t written = 0;
+	while (written < data.size()) {
+		ssize_t n = ::write(to_child, data.data() + written, data.size() - written);
+		if (n <= 0)
+			return false;
+		written += (size_t)n;
+	}
+	return true;
+}
+
+bool UCIProcess::read_line(std::string& line, const int timeout_ms) {
+	auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+
+	while (true) {
+		size_t eol = buffer.find('\n');
+		if (eol != string::npos) {
+			line = buffer.substr(0, eol);
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+			buffer.erase(0, eol + 1);
+			return true;
+		}
+
+		auto remaining = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+		if (from_child < 0 || remaining <= 0)
+			return false;
+
+		pollfd pfd{ from_child, POLLIN, 0 };
+		if (poll(&pfd, 1, (int)remaining) <= 0)
+			return false;
+
+		char chunk[4096];
+		ssize_t n = ::read(from_child, chunk, sizeof(chunk));
+		if (n <= 0)
+			return false;
+		buffer.append(chunk, (size_t)n);
+	}
+}
+
+#endif
+
+bool UCIProcess::wait_for(const std::string& prefix, std::string& line, const int timeout_ms) {
+	auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+	while (true) {
+		auto remaining = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+		if (remaining <= 0 || !read_line(line, (int)remaining))
+			return false;
+		if (line.compare(0, prefix.size(), prefix) == 0)
+			return true;
+	}
+}
@@ -0,0 +1,40 @@
+/*
+ * UCIProcess.h
+ *
+ *  Child process speaking UCI over pipes (stdin/stdout of the child), used by the match runner to play against
+ *  other engine binaries. Only available on POSIX systems.
+ */
+
+#pragma once
+
+#include <string>
+
+class UCIProcess {
+public:
+	UCIProcess() = default;
+	~UCIProcess();
+
+	UCIProcess(const UCIProcess&) = delete;
+	UCIProcess& operator=(const UCIProcess&) = delete;
+
+	// Start command (run by /bin/sh) and do the uci/isready handshake. Returns succes flag.
+	bool start(const std::string& command);
+	// Send quit and wait for the process to exit (killed if it does not)
+	void stop();
+	bool is_running() const { return pid > 0; }
+
+	bool write_line(const std::string& line);
+	// Read one line, waiting at most timeout_ms milliseconds. Returns false on timeout or end of file.
+	bool read_line(std::string& line, const int timeout_ms);
+	// Read lines until one starts with prefix (e.g. "bestmove"). Returns false on timeout or end of file.
+	bool wait_for(const std::string& prefix, std::string& line, const int timeout_ms);
+
+	const std::string& get_name() const { return name; }
+
+private:
+	int pid = -1;
+	int to_child = -1;
+	int from_child = -1;
+	std::string buffer;
+	std::string name;			// From "id name"
+};
@@ -2,100 +2,1416 @@
 #include <string>
 #include <sstream>
 #include <future>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <iomanip>
+#include <fstream>
+#include <mutex>
+#include <map>
+#include <array>
+#include <atomic>
+#include <random>
 #include "UCIReader.h"
 #include "Chess.h"
+#include "Match.h"
+#include "DataGen.h"
+#include "Tuner.h"
+#include "PGNReader.h"
+#include "Stats.h"
+#include "Profile.h"
+#include "DistPerft.h"
+#include "PerftCache.h"
+#include "Batch.h"
+#include "AttackBatch.h"
+#include "Numa.h"
+#include "SyzygyWriter.h"
 
 using namespace std;
 
 const std::string UCIReader::ENGINENAME = "BasEngine v1";
 const std::string UCIReader::ENGINEAUTHOR = "Bas Dirkse";
 
+Chess UCIReader::game;
+PolyglotBook UCIReader::book;
+Syzygy UCIReader::tablebases;
+EndgameTablebase UCIReader::endgame_tables;
+Search UCIReader::search;
+MateSolver UCIReader::mate_solver;
+std::thread UCIReader::search_thread;
+std::unique_ptr<TraceBuffer> UCIReader::trace_buffer;
+bool UCIReader::command_failed = false;
+
+bool UCIReader::own_book = false;
+bool UCIReader::book_best_move = false;
+std::string UCIReader::book_file = "";
+std::string UCIReader::syzygy_path = "";
+std::string UCIReader::egtb_path = "";
+int UCIReader::hash_mb = 16;
+int UCIReader::multipv = 1;
+int UCIReader::move_overhead = 10;
+bool UCIReader::debug_mode = false;
+
 
 void UCIReader::uciCommunication() {
-	while (true) {
-		std::string inputLine;
-		std::getline(std::cin, inputLine);
+	search.set_tablebases(&tablebases, &endgame_tables);
+
+	std::string inputLine;
+	while (std::getline(std::cin, inputLine)) {
+		if (!executeCommand(inputLine))
+			return;
+	}
+	stopSearch();
+}
+
+bool UCIReader::executeCommand(const std::string& inputLine) {
+	command_failed = false;
+
+	std::string firstWord;
+	std::string remainder;
 
-		std::string firstWord;
-		std::string remainder;
+	size_t sep = inputLine.find(' ');
+	
+	if (sep == std::string::npos) {
+		firstWord = inputLine;
+		remainder = "";
+	}
+	else {
+		firstWord = inputLine.substr(0, sep);
+		remainder = inputLine.substr(sep+1);
+	}
+
+	if (firstWord == "uci") {
+		std::cout << "id name " << ENGINENAME << std::endl;
+		std::cout << "id author " << ENGINEAUTHOR << std::endl;
+		std::cout << "option name Hash type spin default 16 min 1 max 65536" << std::endl;
+		std::cout << "option name Large Pages type check default true" << std::endl;
+		std::cout << "option name Thread Binding type combo default auto var auto var off var node var core" << std::endl;
+		std::cout << "option name NUMA Interleave type check default true" << std::endl;
+		std::cout << "option name MultiPV type spin default 1 min 1 max 256" << std::endl;
+		std::cout << "option name Ponder type check default false" << std::endl;
+		std::cout << "option name Move Overhead type spin default 10 min 0 max 5000" << std::endl;
+		std::cout << "option name OwnBook type check default false" << std::endl;
+		std::cout << "option name BookFile type string default <empty>" << std::endl;
+		std::cout << "option name BookBestMove type check default false" << std::endl;
+		std::cout << "option name SyzygyPath type string default <empty>" << std::endl;
+		std::cout << "option name EGTBPath type string default <empty>" << std::endl;
+		std::cout << "uciok" << std::endl;
+	}
+	else if (firstWord == "debug") {
+		// In debug mode the search statistics are sent after every search
+		if (remainder == "on") {
+			debug_mode = true;
+			if (!Stats::enabled())
+				std::cout << "info string Statistics are compiled out (build with -DCHESS_STATS=1)" << std::endl;
+		}
+		else if (remainder == "off") {
+			debug_mode = false;
+		}
+
+	}
+	else if (firstWord == "isready") {
+		// set up engine
+		std::cout << "readyok" << std::endl;
+	}
+	else if (firstWord == "setoption") {
+		stopSearch();
+		setOption(remainder);
+	}
+	else if (firstWord == "register") {
 
-		size_t sep = inputLine.find(' ');
-		
-		if (sep == std::string::npos) {
-			firstWord = inputLine;
-			remainder = "";
+	}
+	else if (firstWord == "ucinewgame") {
+		stopSearch();
+		game = Chess();
+		search.clear();
+		mate_solver.clear();
+	}
+	else if (firstWord == "position") {
+		setPosition(remainder);
+	}
+	else if (firstWord == "go") {
+		go(remainder);
+	}
+	else if (firstWord == "stop") {
+		stopSearch();
+	}
+	else if (firstWord == "ponderhit") {
+		// The opponent played the expected move: the running search continues on the clock
+		search.ponderhit();
+	}
+	else if (firstWord == "quit") {
+		stopSearch();
+		return false;
+	}
+	// Non UCI commands next
+	else if (firstWord == "print" || firstWord == "d") {
+		game.print_board();
+	}
+	else if (firstWord == "myperft") {
+		if (remainder == "auto deep")
+			myPerft(true, true);
+		else if (remainder == "auto")
+			myPerft(true);
+		else if (remainder == "compare deep")
+			myPerft(false, true, true);
+		else if (remainder == "compare")
+			myPerft(false, false, true);
+		else 
+			myPerft();
+	}
+	else if (firstWord == "perft") {
+		perftDivide(remainder);
+	}
+	else if (firstWord == "perftserve") {
+		perftServe(remainder);
+	}
+	else if (firstWord == "perftworker") {
+		// perftworker <address> [threads]
+		std::istringstream in(remainder);
+		std::string address;
+		int threads = 1;
+		if (in >> address && (in >> threads || true))
+			command_failed = !perft_worker(address, threads, std::cout);
+		else {
+			std::cout << "Usage: perftworker <host:port | unix:path> [threads]" << std::endl;
+			command_failed = true;
 		}
+	}
+	else if (firstWord == "tbcheck") {
+		tablebaseCheck(remainder);
+	}
+	else if (firstWord == "tbwrite") {
+		// tbwrite <dir>: the 3-piece Syzygy test tables of syzygy_test
+		std::istringstream in(remainder);
+		std::string dir;
+		if (in >> std::quoted(dir))
+			command_failed = !write_syzygy_test_tables(dir, std::cout);
 		else {
-			firstWord = inputLine.substr(0, sep);
-			remainder = inputLine.substr(sep+1);
+			std::cout << "Usage: tbwrite <dir>" << std::endl;
+			command_failed = true;
+		}
+	}
+	else if (firstWord == "gentb") {
+		generateTables(remainder);
+	}
+	else if (firstWord == "match") {
+		runMatch(remainder);
+	}
+	else if (firstWord == "batch") {
+		batch(remainder);
+	}
+	else if (firstWord == "datagen") {
+		generateData(remainder);
+	}
+	else if (firstWord == "shuffle") {
+		std::istringstream in(remainder);
+		std::string input, output;
+		uint64_t seed = 1;
+		if (in >> std::quoted(input) >> std::quoted(output) && (in >> seed || true))
+			command_failed = !shuffle_data(input, output, seed, std::cout);
+		else {
+			std::cout << "Usage: shuffle <input> <output> [seed]" << std::endl;
+			command_failed = true;
+		}
+	}
+	else if (firstWord == "datainfo") {
+		dataInfo(remainder);
+	}
+	else if (firstWord == "tune") {
+		tuneEval(remainder);
+	}
+	else if (firstWord == "pgn") {
+		readPGN(remainder);
+	}
+	else if (firstWord == "attackbench") {
+		attackBench(remainder);
+	}
+	else if (firstWord == "bench") {
+		bench(remainder);
+	}
+	else if (firstWord == "stats") {
+		if (remainder == "reset")
+			Stats::reset();
+		else
+			Stats::print(std::cout);
+	}
+	else if (firstWord == "profile") {
+		profileCommand(remainder);
+	}
+	else if (firstWord == "trace") {
+		traceCommand(remainder);
+	}
+	else if (firstWord == "traceview") {
+		traceView(remainder);
+	}
+	else if (!firstWord.empty()) {
+		std::cout << "Unknown command: " << inputLine << std::endl;
+		command_failed = true;
+	}
+	return true;
+}
+
+
+// setoption name <id> [value <x>]
+void UCIReader::setOption(const std::string& args) {
+	size_t name_pos = args.find("name ");
+	if (name_pos == std::string::npos)
+		return;
+
+	std::string name, value;
+	size_t value_pos = args.find(" value ", name_pos);
+	if (value_pos == std::string::npos)
+		name = args.substr(name_pos + 5);
+	else {
+		name = args.substr(name_pos + 5, value_pos - name_pos - 5);
+		value = args.substr(value_pos + 7);
+	}
+
+	if (name == "Hash") {
+		hash_mb = std::max(1, std::atoi(value.c_str()));
+		search.set_hash(hash_mb);
+		mate_solver.set_hash(hash_mb);
+		std::cout << "info string Hash tables: " << large_pages_info() << std::endl;
+	}
+	else if (name == "Large Pages") {
+		// Only new tables, so allocate them again
+		set_large_pages(value == "true");
+		search.set_hash(hash_mb);
+		mate_solver.set_hash(hash_mb);
+		std::cout << "info string Hash tables: " << large_pages_info() << std::endl;
+	}
+	else if (name == "Thread Binding") {
+		const std::string values[4] = { "auto", "off", "node", "core" };
+		for (int i = 0; i < 4; i++) {
+			if (value == values[i])
+				set_thread_binding((ThreadBinding)i);
+		}
+		std::cout << "info string " << topology_info() << std::endl;
+	}
+	else if (name == "NUMA Interleave") {
+		// Shared tables: allocate the hash tables again
+		set_numa_interleave(value == "true");
+		search.set_hash(hash_mb);
+		mate_solver.set_hash(hash_mb);
+		std::cout << "info string " << topology_info() << std::endl;
+	}
+	else if (name == "MultiPV") {
+		multipv = std::min(256, std::max(1, std::atoi(value.c_str())));
+	}
+	else if (name == "Move Overhead") {
+		move_overhead = std::min(5000, std::max(0, std::atoi(value.c_str())));
+	}
+	else if (name == "Ponder") {
+		// Only tells that the GUI may send go ponder
+	}
+	else if (name == "OwnBook") {
+		own_book = (value == "true");
+	}
+	else if (name == "BookFile") {
+		book_file = (value == "<empty>") ? "" : value;
+		loadBook();
+	}
+	else if (name == "BookBestMove") {
+		book_best_move = (value == "true");
+	}
+	else if (name == "SyzygyPath") {
+		syzygy_path = (value == "<empty>") ? "" : value;
+		tablebases.init(syzygy_path);
+		std::cout << "info string Found " << tablebases.get_table_count() << " tablebases" << std::endl;
+	}
+	else if (name == "EGTBPath") {
+		egtb_path = (value == "<empty>") ? "" : value;
+		endgame_tables.init(egtb_path);
+	}
+	else {
+		std::cout << "info string Unknown option: " << name << std::endl;
+	}
+}
+
+void UCIReader::loadBook() {
+	book.close();
+	if (book_file.empty())
+		return;
+
+	if (!book.open(book_file))
+		std::cout << "info string Could not open book " << book_file << std::endl;
+	else
+		std::cout << "info string Opened book " << book_file << std::endl;
+}
+
+// gentb <material> [threads], e.g. "gentb KQvKR 8". Tables are written to EGTBPath (or the working directory).
+void UCIReader::generateTables(const std::string& args) {
+	std::istringstream in(args);
+	std::string material;
+	int threads = (int)std::thread::hardware_concurrency();
+	in >> material >> threads;
+
+	if (material.empty()) {
+		std::cout << "Usage: gentb <material> [threads], e.g. gentb KQvKR" << std::endl;
+		command_failed = true;
+		return;
+	}
+	command_failed = !endgame_tables.generate(material, std::max(threads, 1), std::cout);
+}
+
+// position [fen <fenstring> | startpos] moves <move1> .... <movei>
+void UCIReader::setPosition(const std::string& args) {
+	std::istringstream in(args);
+	std::string token;
+	in >> token;
+
+	if (token == "startpos") {
+		game = Chess();
+		in >> token;  // "moves" (if any)
+	}
+	else if (token == "fen") {
+		std::string fen;
+		while (in >> token && token != "moves") {
+			fen += token + " ";
+		}
+		Board b;
+		std::istringstream(fen) >> b;
+		if (!Chess::is_legal_position(b)) {
+			std::cout << "info string Invalid position " << fen << std::endl;
+			return;
 		}
+		game = Chess(fen);
+	}
+	else {
+		std::cout << "info string Invalid position command" << std::endl;
+		return;
+	}
 
-		if (firstWord == "uci") {
-			std::cout << "id name " << ENGINENAME << std::endl;
-			std::cout << "id author " << ENGINEAUTHOR << std::endl;
-			// send supporting options (nothing now)
-			std::cout << "uciok" << std::endl;
+	while (in >> token) {
+		if (!game.do_move(token)) {
+			std::cout << "info string Illegal move " << token << std::endl;
+			return;
 		}
-		else if (firstWord == "debug") {
-			if (remainder == "on") {
+	}
+}
 
+// go [searchmoves <move1> .... <movei>] [wtime <x>] [btime <x>] [winc <x>] [binc <x>] [movestogo <x>] [depth <x>]
+//    [nodes <x>] [mate <x>] [movetime <x>] [infinite] [ponder]
+void UCIReader::go(const std::string& args) {
+	stopSearch();
+
+	SearchLimits limits;
+	int64_t time_left[3] = {}, increment[3] = {};
+	int moves_to_go = 0;
+	int mate = 0;
+	bool ponder = false;
+	std::vector<std::string> search_moves;
+
+	std::istringstream in(args);
+	std::string token;
+	while (in >> token) {
+		if (token == "depth")			in >> limits.depth;
+		else if (token == "nodes")		in >> limits.nodes;
+		else if (token == "mate")		in >> mate;
+		else if (token == "movetime")	in >> limits.movetime;
+		else if (token == "infinite")	limits.infinite = true;
+		else if (token == "ponder")		ponder = true;
+		else if (token == "wtime")		in >> time_left[(int)EPieceColor::clr_white];
+		else if (token == "btime")		in >> time_left[(int)EPieceColor::clr_black];
+		else if (token == "winc")		in >> increment[(int)EPieceColor::clr_white];
+		else if (token == "binc")		in >> increment[(int)EPieceColor::clr_black];
+		else if (token == "movestogo")	in >> moves_to_go;
+		else if (token.size() >= 4 && token.size() <= 5 && isdigit(token[1]) && isdigit(token[3]))
+			search_moves.push_back(token);  // After searchmoves
+	}
+
+	// The search budgets its time from the clock of the side to move
+	int stm = (int)game.get_board().side_to_move;
+	limits.time_left = time_left[stm];
+	limits.increment = increment[stm];
+	limits.moves_to_go = moves_to_go;
+	limits.move_overhead = move_overhead;
+
+	std::vector<Move> legal = game.legal_moves();
+	if (legal.empty()) {
+		std::cout << "bestmove 0000" << std::endl;
+		return;
+	}
+	if (!search_moves.empty()) {
+		legal.erase(std::remove_if(legal.begin(), legal.end(), [&search_moves](const Move& m) {
+			return std::find(search_moves.begin(), search_moves.end(), uci_move(m)) == search_moves.end(); }), legal.end());
+	}
+
+	// Book moves are played instantly (but pondering and infinite searches may not answer before ponderhit or stop)
+	if (own_book && book.is_ready() && search_moves.empty() && !ponder && !limits.infinite) {
+		std::string mv = book.pick_move(game.get_board(), book_best_move);
+		for (const Move& m : legal) {
+			if (uci_move(m) == mv) {
+				std::cout << "info string book move" << std::endl;
+				std::cout << "bestmove " << mv << std::endl;
+				return;
 			}
-			else if (remainder == "off") {
+		}
+	}
+
+	// With few pieces left, keep only the moves that preserve the tablebase result, fastest conversion first
+	if (tablebases.can_probe(game.get_board())) {
+		Chess probe_game = game;
+		if (tablebases.root_probe(probe_game, legal))
+			std::cout << "info string tablebase move" << std::endl;
+	}
 
+	// Own tables give the distance to mate, so they also pick the fastest mate among the winning moves
+	if (endgame_tables.root_probe(game, legal))
+		std::cout << "info string endgame table move" << std::endl;
+
+	// The search runs on its own copy of the game, so position commands can arrive while it thinks. When pondering,
+	// the position is the one after the expected reply and the time limit starts at ponderhit.
+	limits.root_moves = legal;
+	limits.multipv = multipv;
+	search.set_info_callback(printInfo);
+	search.set_pondering(ponder);
+	if (trace_buffer) {
+		// Only the last search is kept
+		std::ostringstream fen;
+		Board root = game.get_board();
+		fen << root;
+		trace_buffer->clear();
+		trace_buffer->set_root(fen.str());
+	}
+	search_thread = std::thread([limits, mate, position = game]() {
+		bind_thread(0);
+		if (debug_mode)
+			Stats::reset();
+
+		// Mate searches use the proof-number solver; without a proven mate the normal search picks the move in the
+		// time that is left
+		SearchLimits search_limits = limits;
+		if (mate > 0) {
+			MateResult result = mate_solver.solve(position, mate, limits);
+			if (result.moves > 0) {
+				SearchInfo info;
+				info.depth = info.seldepth = 2 * result.moves - 1;
+				info.score = Search::MATE_SCORE - info.depth;
+				info.nodes = result.nodes;
+				info.time = result.time;
+				info.pv = result.pv;
+				printInfo(info);
+				search.wait_for_stop(limits);
+				std::cout << "bestmove " << uci_move(info.pv.front()) << std::endl;
+				return;
 			}
+			std::cout << "info string " << (result.disproven ? "No mate in " + std::to_string(mate) : "Mate search stopped")
+				<< " (" << result.nodes << " nodes)" << std::endl;
+			if (search_limits.movetime > 0)
+				search_limits.movetime = std::max<int64_t>(1, search_limits.movetime - result.time);
+			else if (search_limits.time_left > 0)
+				search_limits.time_left = std::max<int64_t>(1, search_limits.time_left - result.time);
+		}
 
+		SearchInfo info = search.go(position, search_limits);
+		if (debug_mode)
+			Stats::print(std::cout);
+		std::cout << "bestmove " << (info.pv.empty() ? "0000" : uci_move(info.pv.front()));
+		if (info.pv.size() > 1)
+			std::cout << " ponder " << uci_move(info.pv[1]);
+		std::cout << std::endl;
+	});
+}
+
+void UCIReader::stopSearch() {
+	if (search_thread.joinable()) {
+		search.stop();
+		mate_solver.stop();
+		search_thread.join();
+	}
+}
+
+// info depth <x> seldepth <x> multipv <x> score cp <x> | mate <y> nodes <x> nps <x> hashfull <x> tbhits <x> time <x> pv <move1> ... <movei>
+void UCIReader::printInfo(const SearchInfo& info) {
+	std::ostringstream out;
+	out << "info depth " << info.depth << " seldepth " << info.seldepth << " multipv " << info.multipv;
+	if (Search::is_mate_score(info.score))
+		out << " score mate " << Search::mate_in(info.score);
+	else
+		out << " score cp " << info.score;
+	out << " nodes " << info.nodes << " nps " << info.nodes * 1000 / std::max<int64_t>(info.time, 1);
+	out << " hashfull " << search.hashfull() << " tbhits " << info.tbhits << " time " << info.time << " pv";
+	for (const Move& m : info.pv) {
+		out << " " << uci_move(m);
+	}
+	std::cout << out.str() << std::endl;
+}
+
+/* match [games <n>] [concurrency <n>] [depth <n>] [nodes <n>] [movetime <ms>] [hash <mb>] [openings <epd file>]
+	[pgn <file>] [engine1 <command>] [engine2 <command>] [name1 <name>] [name2 <name>] [maxplies <n>]
+	[resign <cp> <moves>] [draw <cp> <moves> <from move>] [sprt <elo0> <elo1> [<alpha> <beta>]]
+Engines without command are the internal engine; quote commands or names with spaces. */
+void UCIReader::runMatch(const std::string& args) {
+	stopSearch();
+
+	MatchSettings settings;
+	settings.concurrency = (int)std::max(1u, std::thread::hardware_concurrency());
+	settings.hash_mb = hash_mb;
+
+	std::istringstream in(args);
+	std::string token;
+	while (in >> token) {
+		if (token == "games")				in >> settings.games;
+		else if (token == "concurrency")	in >> settings.concurrency;
+		else if (token == "depth")			in >> settings.limits.depth;
+		else if (token == "nodes")			in >> settings.limits.nodes;
+		else if (token == "movetime")		in >> settings.limits.movetime;
+		else if (token == "hash")			in >> settings.hash_mb;
+		else if (token == "openings")		in >> std::quoted(settings.openings_file);
+		else if (token == "pgn")			in >> std::quoted(settings.pgn_file);
+		else if (token == "engine1")		in >> std::quoted(settings.engines[0].command);
+		else if (token == "engine2")		in >> std::quoted(settings.engines[1].command);
+		else if (token == "name1")			in >> std::quoted(settings.engines[0].name);
+		else if (token == "name2")			in >> std::quoted(settings.engines[1].name);
+		else if (token == "maxplies")		in >> settings.max_plies;
+		else if (token == "resign")			in >> settings.resign_score >> settings.resign_moves;
+		else if (token == "draw")			in >> settings.draw_score >> settings.draw_moves >> settings.draw_after_move;
+		else if (token == "sprt") {
+			settings.sprt = true;
+			in >> settings.elo0 >> settings.elo1;
+			double alpha, beta;
+			if (in >> alpha >> beta) {
+				settings.alpha = alpha;
+				settings.beta = beta;
+			}
+			in.clear();
 		}
-		else if (firstWord == "isready") {
-			// set up engine
-			std::cout << "readyok" << std::endl;
+		else {
+			std::cout << "info string Unknown match argument: " << token << std::endl;
+			command_failed = true;
+			return;
 		}
-		else if (firstWord == "setoption") {
+	}
+
+	// Without a limit a game would never end
+	if (!settings.limits.depth && !settings.limits.nodes && !settings.limits.movetime)
+		settings.limits.movetime = 100;
+
+	command_failed = !Match(settings).run(std::cout);
+}
+
+
+/* batch [perft <depth> | eval | depth <n> | nodes <n> | movetime <ms>] [threads <n>] [hash <mb>] [window <n>] [<file>]
+Analyse the positions (FEN or EPD lines) of file, or of standard input, and write one JSON line per position to
+standard output; meant for the command line ("engine batch eval < positions.epd"). The summary goes to standard error.
+A search without limits is a 100000 node search. */
+void UCIReader::batch(const std::string& args) {
+	stopSearch();
+
+	BatchSettings settings;
+	settings.threads = (int)std::max(1u, std::thread::hardware_concurrency());
+	settings.hash_mb = hash_mb;
+	std::string path = "-";
 
+	std::istringstream in(args);
+	std::string token;
+	while (in >> token) {
+		if (token == "perft") {
+			settings.mode = BatchMode::bm_perft;
+			in >> settings.perft_depth;
 		}
-		else if (firstWord == "register") {
+		else if (token == "eval")		settings.mode = BatchMode::bm_eval;
+		else if (token == "depth")		in >> settings.limits.depth;
+		else if (token == "nodes")		in >> settings.limits.nodes;
+		else if (token == "movetime")	in >> settings.limits.movetime;
+		else if (token == "threads")	in >> settings.threads;
+		else if (token == "hash")		in >> settings.hash_mb;
+		else if (token == "window")		in >> settings.window;
+		else {
+			in.seekg(-(std::streamoff)token.size(), std::ios::cur);
+			in >> std::quoted(path);
+		}
+	}
+	if (!settings.limits.depth && !settings.limits.nodes && !settings.limits.movetime)
+		settings.limits.nodes = 100000;
 
+	std::ifstream file;
+	if (path != "-") {
+		file.open(path);
+		if (!file) {
+			std::cerr << "Could not open " << path << std::endl;
+			command_failed = true;
+			return;
 		}
-		else if (firstWord == "ucinewgame") {
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	uint64_t positions = run_batch(settings, path == "-" ? std::cin : file, std::cout);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cerr << "Analysed " << positions << " positions in " << seconds << "s (" << (uint64_t)(positions / std::max(seconds, 1e-3))
+		<< " positions/s, " << settings.threads << " threads)" << std::endl;
+}
+
+// datagen [positions <n>] [threads <n>] [depth <n>] [nodes <n>] [movetime <ms>] [hash <mb>] [random <plies>]
+//    [minply <n>] [seed <n>] out <file>
+void UCIReader::generateData(const std::string& args) {
+	stopSearch();
+
+	DataGenSettings settings;
+	settings.threads = (int)std::max(1u, std::thread::hardware_concurrency());
+	settings.hash_mb = hash_mb;
 
+	std::istringstream in(args);
+	std::string token;
+	while (in >> token) {
+		if (token == "positions")		in >> settings.positions;
+		else if (token == "threads")	in >> settings.threads;
+		else if (token == "depth")		in >> settings.limits.depth;
+		else if (token == "nodes")		in >> settings.limits.nodes;
+		else if (token == "movetime")	in >> settings.limits.movetime;
+		else if (token == "hash")		in >> settings.hash_mb;
+		else if (token == "random")		in >> settings.random_plies;
+		else if (token == "minply")		in >> settings.min_ply;
+		else if (token == "seed")		in >> settings.seed;
+		else if (token == "out")		in >> std::quoted(settings.output);
+		else {
+			std::cout << "info string Unknown datagen argument: " << token << std::endl;
+			command_failed = true;
+			return;
 		}
-		else if (firstWord == "position") {
+	}
+
+	if (settings.output.empty()) {
+		std::cout << "Usage: datagen [positions <n>] [threads <n>] [depth|nodes|movetime <n>] out <file>" << std::endl;
+		command_failed = true;
+		return;
+	}
+	if (!settings.limits.depth && !settings.limits.nodes && !settings.limits.movetime)
+		settings.limits.nodes = 5000;
 
+	command_failed = !generate_data(settings, std::cout);
+}
+
+// datainfo <file> [n]: number of positions, result distribution and the first n positions
+void UCIReader::dataInfo(const std::string& args) {
+	std::istringstream in(args);
+	std::string path;
+	size_t show = 5;
+	in >> std::quoted(path) >> show;
+
+	PositionFile data;
+	if (!data.open(path)) {
+		std::cout << "info string Could not open " << path << std::endl;
+		command_failed = true;
+		return;
+	}
+
+	uint64_t results[3] = {};
+	for (const PackedPosition& p : data) {
+		results[std::min<int>(p.result, 2)]++;
+	}
+	std::cout << data.size() << " positions (" << data.size() * sizeof(PackedPosition) << " bytes), white wins "
+		<< results[2] << ", draws " << results[1] << ", black wins " << results[0] << std::endl;
+
+	for (size_t i = 0; i < std::min(show, data.size()); i++) {
+		Board b = data[i].unpack();
+		std::cout << b << " score " << data[i].score << " result " << data[i].result / 2.0 << std::endl;
+	}
+}
+
+
+// tune <file> [<file> ...] [epochs <n>] [threads <n>] [lr <x>] [k <x>] [out <header>]
+// Files are EPD with results or datagen output (*.bin); the tuned weights are written to out (EvalParams.tuned.h by
+// default, copy it over EvalParams.h to build with them)
+void UCIReader::tuneEval(const std::string& args) {
+	stopSearch();
+
+	TunerSettings settings;
+	settings.threads = (int)std::max(1u, std::thread::hardware_concurrency());
+	std::string output = "EvalParams.tuned.h";
+	std::vector<std::string> files;
+
+	std::istringstream in(args);
+	std::string token;
+	while (in >> std::quoted(token)) {
+		if (token == "epochs")			in >> settings.epochs;
+		else if (token == "threads")	in >> settings.threads;
+		else if (token == "lr")			in >> settings.learning_rate;
+		else if (token == "k")			in >> settings.k;
+		else if (token == "out")		in >> std::quoted(output);
+		else							files.push_back(token);
+	}
+
+	if (files.empty()) {
+		std::cout << "Usage: tune <file> [epochs <n>] [threads <n>] [lr <x>] [k <x>] [out <header>]" << std::endl;
+		command_failed = true;
+		return;
+	}
+
+	Tuner tuner;
+	for (const std::string& file : files) {
+		tuner.load(file, std::cout);
+	}
+	tuner.tune(settings, std::cout);
+	if (tuner.save(output))
+		std::cout << "Wrote " << output << " (replace EvalParams.h with it and rebuild to use the new weights)" << std::endl;
+	else {
+		std::cout << "info string Could not write " << output << std::endl;
+		command_failed = true;
+	}
+}
+
+
+/* pgn <file> [threads <n>] [plies <n>] [top <n>] [epd <out>]
+Read a PGN database: results, the top most played openings (first plies moves) with their scores, and optionally
+the position after plies moves of every game as EPD with its result (input for tune). */
+void UCIReader::readPGN(const std::string& args) {
+	stopSearch();
+
+	std::string path, epd_path;
+	int threads = (int)std::max(1u, std::thread::hardware_concurrency());
+	int plies = 8;
+	size_t top = 10;
+
+	std::istringstream in(args);
+	std::string token;
+	in >> std::quoted(path);
+	while (in >> token) {
+		if (token == "threads")		in >> threads;
+		else if (token == "plies")	in >> plies;
+		else if (token == "top")	in >> top;
+		else if (token == "epd")	in >> std::quoted(epd_path);
+	}
+	if (path.empty()) {
+		std::cout << "Usage: pgn <file> [threads <n>] [plies <n>] [top <n>] [epd <out>]" << std::endl;
+		command_failed = true;
+		return;
+	}
+
+	std::ofstream epd;
+	std::mutex epd_mutex;
+	if (!epd_path.empty())
+		epd.open(epd_path);
+
+	// Per thread statistics, merged at the end
+	struct Stats {
+		uint64_t errors = 0, moves = 0;
+		uint64_t results[3] = {};	// White lost, draw, white won
+		std::map<std::string, std::array<uint64_t, 3>> openings;
+	};
+	std::vector<Stats> stats(std::max(1, threads));
+
+	auto start = std::chrono::steady_clock::now();
+	uint64_t games = PGNReader::process(path, threads, [&](const int t, const PGNGame& pgn) {
+		Stats& s = stats[t];
+		const std::vector<Move>& moves = pgn.game.get_move_history();
+		s.moves += moves.size();
+		if (!pgn.error.empty()) {
+			s.errors++;
+			return;
 		}
-		else if (firstWord == "go") {
+		int result = pgn.result == "1-0" ? 2 : pgn.result == "0-1" ? 0 : pgn.result == "1/2-1/2" ? 1 : -1;
+		if (result < 0 || (int)moves.size() < plies)
+			return;
+		s.results[result]++;
 
+		// Position after plies moves, and the moves leading to it in SAN (prefixed with the FEN of a set up position)
+		Chess opening = pgn.game;
+		opening.undo_last_moves((int)moves.size() - plies);
+		std::string line = pgn.tag("FEN");
+		for (const std::string& m : opening.get_move_notation()) {
+			line += (line.empty() ? "" : " ") + m;
 		}
-		else if (firstWord == "stop") {
+		s.openings[line][result]++;
 
+		if (epd.is_open()) {
+			std::ostringstream fen;
+			Board b = opening.get_board();
+			fen << b;
+			std::string fields = fen.str();
+			for (int i = 0; i < 2; i++) {
+				fields.erase(fields.find_last_of(' '));  // EPD has no move counters
+			}
+			std::lock_guard<std::mutex> lock(epd_mutex);
+			epd << fields << " c9 \"" << pgn.result << "\";\n";
 		}
-		else if (firstWord == "ponderhit") {
+	});
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
+	Stats total;
+	for (const Stats& s : stats) {
+		total.errors += s.errors;
+		total.moves += s.moves;
+		for (int r = 0; r < 3; r++) {
+			total.results[r] += s.results[r];
 		}
-		else if (firstWord == "quit") {
+		for (const auto& o : s.openings) {
+			for (int r = 0; r < 3; r++) {
+				total.openings[o.first][r] += o.second[r];
+			}
+		}
+	}
+
+	std::cout << "Read " << games << " games (" << total.errors << " with errors, " << total.moves << " moves) in "
+		<< seconds << "s: " << (uint64_t)(games / std::max(seconds, 1e-9)) << " games/s" << std::endl;
+	std::cout << "White wins " << total.results[2] << ", draws " << total.results[1] << ", black wins "
+		<< total.results[0] << std::endl;
+
+	// Most played openings, in SAN
+	std::vector<std::pair<uint64_t, std::string>> played;
+	for (const auto& o : total.openings) {
+		played.emplace_back(o.second[0] + o.second[1] + o.second[2], o.first);
+	}
+	std::sort(played.rbegin(), played.rend());
+	for (size_t i = 0; i < std::min(top, played.size()); i++) {
+		const auto& counts = total.openings[played[i].second];
+		std::cout << played[i].first << "\t" << (counts[2] + 0.5 * counts[1]) / played[i].first << "\t" << played[i].second << std::endl;
+	}
+}
+
+
+/* bench [depth] [threads] [hash]
+Search a fixed set of positions to a fixed depth, each with a cleared hash table. The total node count only depends
+on the search (not on timing or the number of threads), so it is a signature of the engine's behaviour; the time
+and nodes per second measure its speed. Threads search different positions in parallel. */
+void UCIReader::bench(const std::string& args) {
+	stopSearch();
+
+	const std::vector<std::string> positions = {
+		"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+		"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+		"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+		"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+		"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+		"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+		"r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+		"r2q1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP2BPPP/R2Q1RK1 w - - 0 10",
+		"2r3k1/pp3ppp/4p3/3pP3/3P4/P3KP2/1P4PP/2R5 b - - 0 25",
+		"8/5pk1/6p1/7p/2R4P/6P1/r4PK1/8 w - - 0 40",
+		"8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",
+		"6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+	};
+
+	int depth = 5, threads = 1, hash = 16;
+	std::istringstream in(args);
+	in >> depth >> threads >> hash;
+	if ((in.fail() && !in.eof()) || depth <= 0 || hash <= 0) {
+		std::cout << "Usage: bench [depth] [threads] [hash]" << std::endl;
+		command_failed = true;
+		return;
+	}
+	threads = std::max(threads, 1);
+
+	std::vector<uint64_t> nodes(positions.size());
+	std::atomic<size_t> next{ 0 };
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++) {
+		workers.emplace_back([&, t]() {
+			bind_thread(t);
+			Search bench_search(hash);
+			SearchLimits limits;
+			limits.depth = depth;
+			for (size_t i = next++; i < positions.size(); i = next++) {
+				bench_search.clear();
+				bench_search.go(Chess(positions[i]), limits);
+				nodes[i] = bench_search.get_nodes();
+			}
+		});
+	}
+	for (std::thread& w : workers) {
+		w.join();
+	}
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+	uint64_t total = 0;
+	for (size_t i = 0; i < positions.size(); i++) {
+		std::cout << "Position " << i + 1 << "/" << positions.size() << ": " << nodes[i] << " nodes\t" << positions[i] << std::endl;
+		total += nodes[i];
+	}
+	std::cout << "===========================" << std::endl;
+	std::cout << "Total time (ms) : " << elapsed << std::endl;
+	std::cout << "Nodes searched  : " << total << std::endl;
+	std::cout << "Nodes/second    : " << total * 1000 / std::max<int64_t>(elapsed, 1) << std::endl;
+}
+
+
+/* attackbench [positions <n>] [file <path>] [seed <n>]
+Legal move counts and check status of many positions (from random games, or the FEN/EPD lines of file) by Chess and
+by attack_batch at every SIMD level this CPU supports: positions per second and mismatches with Chess. */
+void UCIReader::attackBench(const std::string& args) {
+	stopSearch();
+
+	size_t count = 200000;
+	std::string path;
+	uint64_t seed = 1;
+	std::istringstream in(args);
+	std::string token;
+	while (in >> token) {
+		if (token == "positions")	in >> count;
+		else if (token == "file")	in >> std::quoted(path);
+		else if (token == "seed")	in >> seed;
+	}
+
+	std::vector<Board> boards;
+	if (!path.empty()) {
+		std::ifstream file(path);
+		if (!file) {
+			std::cout << "info string Could not open " << path << std::endl;
+			command_failed = true;
 			return;
 		}
-		// Non UCI commands next
-		else if (firstWord == "print" || firstWord == "d") {
+		std::string line;
+		while (boards.size() < count && std::getline(file, line)) {
+			std::istringstream fields(line);
+			std::string f[4];
+			Board b;
+			if (fields >> f[0] >> f[1] >> f[2] >> f[3] && std::istringstream(f[0] + " " + f[1] + " " + f[2] + " " + f[3] + " 0 1") >> b
+				&& Chess::is_legal_position(b))
+				boards.push_back(b);
+		}
+	}
+	else {
+		// Positions of random games, restarted when they end
+		std::mt19937_64 rng(seed);
+		Chess c;
+		while (boards.size() < count) {
+			std::vector<Move> legal = c.legal_moves();
+			if (legal.empty() || c.get_board().half_move_count >= 100)
+				c = Chess();
+			else
+				c.do_move(legal[rng() % legal.size()]);
+			boards.push_back(c.get_board());
+		}
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<int> legal_moves(boards.size());
+	std::vector<bool> in_check(boards.size());
+	for (size_t i = 0; i < boards.size(); i++) {
+		std::ostringstream fen;
+		fen << boards[i];
+		Chess c(fen.str());
+		legal_moves[i] = (int)c.legal_moves().size();
+		in_check[i] = c.in_check();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Chess       : " << (uint64_t)(boards.size() / std::max(seconds, 1e-6)) << " positions/s" << std::endl;
 
+	std::vector<BoardAttacks> results(boards.size()), reference(boards.size());
+	for (int level = 0; level <= (int)simd_supported(); level++) {
+		start = std::chrono::steady_clock::now();
+		attack_batch(boards.data(), boards.size(), results.data(), (SimdLevel)level);
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (level == 0)
+			reference = results;
+
+		size_t mismatches = 0;
+		for (size_t i = 0; i < boards.size(); i++) {
+			const BoardAttacks& r = results[i];
+			if (r.legal_moves != legal_moves[i] || r.in_check() != in_check[i] || r.checkers != reference[i].checkers
+				|| r.attacks[0] != reference[i].attacks[0] || r.attacks[1] != reference[i].attacks[1]) {
+				if (mismatches++ < 5) {
+					std::cout << "Mismatch: " << boards[i] << " legal moves " << r.legal_moves << " instead of " << legal_moves[i]
+						<< (r.in_check() != in_check[i] ? ", check status differs" : "") << std::endl;
+				}
+			}
 		}
-		else if (firstWord == "myperft") {
-			if (remainder == "auto deep")
-				myPerft(true, true);
-			else if (remainder == "auto")
-				myPerft(true);
-			else 
-				myPerft();
+		std::cout << std::left << std::setw(12) << simd_name((SimdLevel)level) << ": "
+			<< (uint64_t)(boards.size() / std::max(seconds, 1e-6)) << " positions/s, " << mismatches << " mismatches in "
+			<< boards.size() << " positions" << std::endl;
+	}
+}
+
+
+/* perft <depth> [threads <x>] [cache <file>] [cachesize <mb>] [readonly] [fen <fen>]
+Divide of the current position (or fen). With a cache file, results of subtrees are kept in the file: a run that was
+interrupted continues where it stopped and repeated runs reuse everything counted before. readonly only uses the
+results in the file, so any number of processes can share it. */
+void UCIReader::perftDivide(const std::string& args) {
+	stopSearch();
+
+	std::ostringstream fen;
+	Board current = game.get_board();
+	fen << current;
+	std::string position = fen.str(), cache_file;
+	int depth = 0, threads = 1;
+	size_t cache_mb = 1024;
+	bool read_only = false;
+
+	std::istringstream in(args);
+	std::string token;
+	in >> depth;
+	while (in >> token) {
+		if (token == "threads")			in >> threads;
+		else if (token == "cache")		in >> std::quoted(cache_file);
+		else if (token == "cachesize")	in >> cache_mb;
+		else if (token == "readonly")	read_only = true;
+		else if (token == "fen") {
+			// A FEN may be quoted (one command line argument)
+			if ((in >> std::ws).peek() == '"')
+				in >> std::quoted(position);
+			else
+				std::getline(in, position);
+			break;
 		}
+	}
+	if (depth <= 0) {
+		std::cout << "Usage: perft <depth> [threads <x>] [cache <file>] [cachesize <mb>] [readonly] [fen <fen>]" << std::endl;
+		command_failed = true;
+		return;
+	}
+	Board b;
+	std::istringstream(position) >> b;
+	if (!Chess::is_legal_position(b)) {
+		std::cout << "Invalid position " << position << std::endl;
+		command_failed = true;
+		return;
+	}
+
+	PerftCache cache;
+	if (!cache_file.empty()) {
+		if (!cache.open(cache_file, cache_mb, read_only)) {
+			std::cout << "Could not open perft cache " << cache_file << std::endl;
+			command_failed = true;
+			return;
+		}
+		std::cout << "Perft cache " << cache_file << ": " << cache.get_capacity() << " entries" << std::endl;
+	}
+	perft_divide(position, depth, threads, cache.is_open() ? &cache : nullptr, std::cout);
+}
+
+/* perftserve [depth <x>] [split <x>] [listen <host:port | unix:path>] [workers <x>] [threads <x>] [timeout <s>]
+              [wait <s>] [fen <fen>]
+Perft of the current position (or fen) counted by worker processes ("perftworker <address> [threads]", on this or
+other machines). workers forks local worker processes with threads connections each. A job that takes longer than
+timeout seconds is handed out again, and the run fails after wait seconds without any worker (default 60, 0: forever). */
+void UCIReader::perftServe(const std::string& args) {
+	stopSearch();
+
+	DistPerftSettings settings;
+	std::ostringstream fen;
+	Board current = game.get_board();
+	fen << current;
+	settings.fen = fen.str();
+
+	std::istringstream in(args);
+	std::string token;
+	while (in >> token) {
+		if (token == "depth")			in >> settings.depth;
+		else if (token == "split")		in >> settings.split_depth;
+		else if (token == "listen")		in >> settings.address;
+		else if (token == "workers")	in >> settings.local_workers;
+		else if (token == "threads")	in >> settings.worker_threads;
+		else if (token == "timeout")	in >> settings.job_timeout;
+		else if (token == "wait")		in >> settings.worker_wait;
+		else if (token == "fen") {
+			if ((in >> std::ws).peek() == '"')
+				in >> std::quoted(settings.fen);
+			else
+				std::getline(in, settings.fen);
+			break;
+		}
+	}
+	Board b;
+	std::istringstream(settings.fen) >> b;
+	if (!Chess::is_legal_position(b)) {
+		std::cout << "Invalid position " << settings.fen << std::endl;
+		command_failed = true;
+		return;
+	}
+	command_failed = !perft_coordinator(settings, std::cout);
+}
+
+/* profile [reset | clock <tsc|perf|steady> | perft <depth> | search <depth>]
+Time spent in move generation, make (update_board), unmake (restore_board) and the legality scan of do_move. perft and
+search reset the counters, run on the current position in this thread and report every phase per call and as a share
+of the whole run; without arguments the counters collected so far are printed. Needs a build with -DCHESS_PROFILE=1. */
+void UCIReader::profileCommand(const std::string& args) {
+	std::istringstream in(args);
+	std::string token;
+	in >> token;
+
+	if (token == "reset") {
+		Profile::reset();
+		return;
+	}
+	if (token == "clock") {
+		std::string name;
+		in >> name;
+		ProfileClock c = name == "tsc" ? ProfileClock::pc_tsc : name == "perf" ? ProfileClock::pc_perf : ProfileClock::pc_steady;
+		if ((name != "tsc" && name != "perf" && name != "steady") || !Profile::set_clock(c))
+			std::cout << "info string Clock " << name << " is not available" << std::endl;
+		std::cout << "info string Profile clock: " << Profile::clock_unit() << std::endl;
+		return;
+	}
+	if (token != "perft" && token != "search") {
+		Profile::print(std::cout);
+		return;
+	}
+
+	int depth = 0;
+	in >> depth;
+	if (depth <= 0) {
+		std::cout << "Usage: profile [reset | clock <tsc|perf|steady> | perft <depth> | search <depth>]" << std::endl;
+		command_failed = true;
+		return;
+	}
+	stopSearch();
+
+	Chess position = game;
+	Search profile_search(token == "search" ? hash_mb : 1);
+	SearchLimits limits;
+	limits.depth = depth;
+	uint64_t nodes = 0;
+
+	Profile::reset();
+	auto start = std::chrono::steady_clock::now();
+	const uint64_t first = Profile::now();
+	if (token == "perft")
+		nodes = position.perft(depth);
+	else {
+		profile_search.go(position, limits);
+		nodes = profile_search.get_nodes();
+	}
+	const uint64_t run = Profile::now() - first;
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "info string " << token << " " << depth << ": " << nodes << " nodes in " << elapsed << " ms" << std::endl;
+	Profile::print(std::cout, run);
+}
+
+/* tbcheck [dir]
+Probe the Syzygy tables in dir (default SyzygyPath, else syzygy_test) for positions with known values, and print a
+digest of the values of every 3-piece table (the same for any files with the same values, see README.md). Every
+position of the 3-piece tables is also compared with the own endgame tables in EGTBPath, where those exist (gentb KRvK
+etc). */
+void UCIReader::tablebaseCheck(const std::string& args) {
+	stopSearch();
+
+	std::string dir = args.empty() ? (syzygy_path.empty() ? "syzygy_test" : syzygy_path) : args;
+	Syzygy tb;
+	tb.init(dir);
+	std::cout << "Syzygy tables in " << dir << ": " << tb.get_table_count() << std::endl;
+
+	struct Known {
+		const char* fen;
+		int wdl;
+		int dtz;
+	};
+	const Known known[] = {
+		{ "k7/8/1K6/8/8/8/8/7R w - - 0 1", 2, 1 },				// Rh8 mates
+		{ "k7/8/1K6/8/8/8/8/7R b - - 0 1", -2, -2 },			// Kb8 Rh8 mate
+		{ "k6R/8/1K6/8/8/8/8/8 b - - 0 1", -2, -1 },			// Mated
+		{ "k7/1R6/2K5/8/8/8/8/8 b - - 0 1", 0, 0 },				// Stalemate
+		{ "8/8/8/8/8/8/1k6/R6K b - - 0 1", 0, 0 },				// Kxa1
+		{ "8/8/8/8/8/1k6/8/K6r w - - 0 1", -2, -1 },			// Mated, black has the rook
+		{ "k7/8/1K6/8/8/8/7Q/8 w - - 0 1", 2, 1 },				// Qh8 mates
+		{ "8/7q/8/8/8/1k6/8/K7 b - - 0 1", 2, 1 },				// Qh1 mates
+		{ "4k3/8/8/8/8/8/1q6/K7 w - - 0 1", 0, 0 },				// Kxb2
+		{ "8/4P3/8/8/8/8/k7/4K3 w - - 0 1", 2, 1 },				// e8=Q
+		{ "8/4P3/8/8/8/8/k7/4K3 b - - 0 1", -2, -2 },			// e8=Q next
+		{ "4k3/8/8/8/8/8/K3p3/8 b - - 0 1", 2, 1 },				// e1=Q
+		{ "4k3/8/4K3/4P3/8/8/8/8 b - - 0 1", -2, -4 },			// Kd8 Kf7 Kd7 e6: the king on the sixth wins
+		{ "4k3/4P3/4K3/8/8/8/8/8 b - - 0 1", 0, 0 },			// Stalemate
+		{ "k7/8/8/8/8/8/P7/K7 w - - 0 1", 0, 0 },				// Rook pawn, king in the corner
+		{ "4k3/8/8/8/8/8/8/4KB2 w - - 0 1", 0, 0 },				// Lone bishop
+	};
+
+	int correct = 0, probed = 0;
+	for (const Known& k : known) {
+		Chess c(k.fen);
+		ProbeState wdl_state, dtz_state;
+		int wdl = tb.probe_wdl(c, &wdl_state);
+		int dtz = tb.probe_dtz(c, &dtz_state);
+		std::cout << k.fen << "\t";
+		if (wdl_state == ps_fail || dtz_state == ps_fail) {
+			std::cout << "no table" << std::endl;
+			continue;
+		}
+		probed++;
+		bool ok = wdl == k.wdl && dtz == k.dtz;
+		correct += ok;
+		std::cout << "wdl " << wdl << " dtz " << dtz;
+		if (!ok)
+			std::cout << "\tFAILED (expected wdl " << k.wdl << " dtz " << k.dtz << ")";
+		std::cout << std::endl;
+	}
+	std::cout << "Tablebase check finished with " << correct << "/" << probed << " positions correct!" << std::endl;
+	command_failed = correct < probed;
+
+	// Digest (FNV-1a) of the WDL and DTZ of every position of the 3-piece tables. It only depends on the values, not
+	// on how a file encodes them, so tables written by tbwrite and the official ones give the same digests.
+	const std::pair<const char*, EPieceCode> tables[] = {
+		{ "KQvK", EPieceCode::epc_wqueen }, { "KRvK", EPieceCode::epc_wrook }, { "KBvK", EPieceCode::epc_wbishop },
+		{ "KNvK", EPieceCode::epc_wknight }, { "KPvK", EPieceCode::epc_wpawn } };
+	for (const auto& t : tables) {
+		uint64_t digest = 14695981039346656037ULL, positions = 0;
+		Chess c;
+		bool available = true;
+		for (int i = 0; i < 2 * 64 * 64 * 64 && available; i++) {
+			const int stm = i / (64 * 64 * 64), wk = i / (64 * 64) % 64, x = i / 64 % 64, bk = i % 64;
+			if (wk == x || wk == bk || x == bk)
+				continue;
+			Board b;
+			b.square_list[wk] = EPieceCode::epc_wking;
+			b.square_list[x] = t.second;
+			b.square_list[bk] = EPieceCode::epc_bking;
+			b.side_to_move = stm ? EPieceColor::clr_black : EPieceColor::clr_white;
+			b.en_passant_square = -1;
+			if (!Chess::is_legal_position(b))
+				continue;
+			c.set_position(b);
+			ProbeState wdl_state, dtz_state;
+			const int values[3] = { i, tb.probe_wdl(c, &wdl_state), tb.probe_dtz(c, &dtz_state) };
+			available = wdl_state != ps_fail && dtz_state != ps_fail;
+			for (const int v : values) {
+				for (int byte = 0; byte < 4; byte++) {
+					digest = (digest ^ ((uint32_t)v >> (8 * byte) & 0xFF)) * 1099511628211ULL;
+				}
+			}
+			positions++;
+		}
+		if (available) {
+			std::cout << t.first << ": " << positions << " positions, values digest " << std::hex << std::setw(16)
+				<< std::setfill('0') << digest << std::dec << std::setfill(' ') << std::endl;
+		}
+	}
+
+	// Without pawns the winning side never zeroes before the mate, so DTZ is the distance to mate
+	const std::pair<const char*, EPieceCode> materials[] = {
+		{ "KQvK", EPieceCode::epc_wqueen }, { "KRvK", EPieceCode::epc_wrook }, { "KPvK", EPieceCode::epc_wpawn } };
+	for (const auto& m : materials) {
+		const bool pawn = m.second == EPieceCode::epc_wpawn;
+		uint64_t positions = 0, mismatches = 0;
+		Chess c;
+
+		// Returns false if either table is missing
+		auto compare = [&](const Board& b) {
+			int plies = 0;
+			EGTResult egt = endgame_tables.probe(b, plies);
+			if (egt == egt_fail)
+				return false;
+			c.set_position(b);
+			ProbeState wdl_state, dtz_state;
+			int wdl = tb.probe_wdl(c, &wdl_state);
+			int dtz = tb.probe_dtz(c, &dtz_state);
+			if (wdl_state == ps_fail || dtz_state == ps_fail)
+				return false;
+
+			int expected = egt == egt_win ? 2 : egt == egt_loss ? -2 : 0;
+			bool ok = wdl == expected && (dtz > 0) - (dtz < 0) == expected / 2;
+			if (!pawn)
+				ok = ok && dtz == (egt == egt_win ? plies : egt == egt_loss ? -std::max(plies, 1) : 0);
+			if (!ok && mismatches++ < 10) {
+				Board shown = b;
+				std::cout << shown << "\twdl " << wdl << " dtz " << dtz << ", endgame table " << expected << " in "
+					<< plies << " plies" << std::endl;
+			}
+			positions++;
+			return true;
+		};
+
+		bool available = true;
+		for (int i = 0; i < 2 * 64 * 64 * 64 && available; i++) {
+			const int stm = i / (64 * 64 * 64), wk = i / (64 * 64) % 64, x = i / 64 % 64, bk = i % 64;
+			if (wk == x || wk == bk || x == bk)
+				continue;
+			Board b;
+			b.square_list[wk] = EPieceCode::epc_wking;
+			b.square_list[x] = m.second;
+			b.square_list[bk] = EPieceCode::epc_bking;
+			b.side_to_move = stm ? EPieceColor::clr_black : EPieceColor::clr_white;
+			b.en_passant_square = -1;
+			if (Chess::is_legal_position(b))
+				available = compare(b);
+		}
+		if (available)
+			std::cout << m.first << ": " << positions << " positions, " << mismatches << " mismatches with the endgame table" << std::endl;
+		if (mismatches)
+			command_failed = true;
+	}
+}
+
+/* trace on [size_mb] | trace off | trace dump <file>
+While tracing is on, every node of the following searches is recorded in a ring buffer of size_mb (default 64), which
+keeps the most recent events of the last search. dump writes the buffer for traceview. */
+void UCIReader::traceCommand(const std::string& args) {
+	std::istringstream in(args);
+	std::string token;
+	in >> token;
+
+	if (token == "on") {
+		size_t size_mb = 64;
+		in >> size_mb;
+		stopSearch();
+		trace_buffer.reset(new TraceBuffer(std::max<size_t>(size_mb, 1) * 1024 * 1024 / sizeof(TraceEvent)));
+		search.set_trace(trace_buffer.get());
+		std::cout << "info string tracing " << trace_buffer->get_capacity() << " events" << std::endl;
+	}
+	else if (token == "off") {
+		stopSearch();
+		search.set_trace(nullptr);
+		trace_buffer.reset();
+	}
+	else if (token == "dump") {
+		std::string path;
+		if (!(in >> std::quoted(path)) || !trace_buffer) {
+			std::cout << "Usage: trace dump <file> (after trace on and a search)" << std::endl;
+			command_failed = true;
+			return;
+		}
+		stopSearch();
+		if (trace_buffer->dump(path))
+			std::cout << "info string " << std::min<uint64_t>(trace_buffer->get_recorded(), trace_buffer->get_capacity())
+				<< " of " << trace_buffer->get_recorded() << " events written to " << path << std::endl;
 		else {
-			std::cout << "Unknown command: " << inputLine << std::endl;
+			std::cout << "info string Could not write " << path << std::endl;
+			command_failed = true;
 		}
+	}
+	else {
+		std::cout << "Usage: trace on [size_mb] | trace off | trace dump <file>" << std::endl;
+		command_failed = true;
+	}
+}
 
+/* traceview <file> [summary] | traceview <file> tree [<move1> ... <movei>] [depth <x>] [lines <x>]
+Offline queries on a dumped trace: node counts per ply and node type, or the searched subtree below a line from the
+root (window, score, node type and best move of every node, depth levels deep, default 2). */
+void UCIReader::traceView(const std::string& args) {
+	std::istringstream in(args);
+	std::string path, query, token;
+	if (!(in >> std::quoted(path))) {
+		std::cout << "Usage: traceview <file> [summary | tree <moves> [depth <x>] [lines <x>]]" << std::endl;
+		command_failed = true;
+		return;
+	}
+	TraceFile trace;
+	if (!trace.open(path)) {
+		std::cout << "Could not read trace " << path << std::endl;
+		command_failed = true;
+		return;
+	}
 
+	in >> query;
+	if (query.empty() || query == "summary") {
+		trace.summary(std::cout);
+		return;
+	}
+	if (query != "tree") {
+		std::cout << "Unknown query: " << query << std::endl;
+		command_failed = true;
+		return;
+	}
 
+	std::vector<std::string> line;
+	int depth = 2;
+	size_t lines = 200;
+	while (in >> token) {
+		if (token == "depth")		in >> depth;
+		else if (token == "lines")	in >> lines;
+		else						line.push_back(token);
 	}
+	std::cout << "Root: " << trace.get_root() << std::endl;
+	trace.tree(line, depth, lines, std::cout);
 }
 
 
-void UCIReader::myPerft(bool runall, bool deep) {
+void UCIReader::myPerft(bool runall, bool deep, bool compare) {
 	const int fen_len = 22;
 	
 	string fen_list[fen_len];
@@ -123,24 +1439,66 @@ void UCIReader::myPerft(bool runall, bool deep) {
 	fen_list[20] = "8/k1P5/8/1K6/8/8/8/8 w - - 0 1";				//--Stalemate & Checkmate
 	fen_list[21] = "8/8/2k5/5q2/5n2/8/5K2/8 b - - 0 1";				//--Stalemate & Checkmate
 
-	if (runall) {
-		vector<int> depth;
-		vector<int> perft;
+	vector<int> depth;
+	vector<int> perft;
 
-		if (deep) {
-			depth = { 5, 4, 4, 5, 4, 4, 4, 5, 6, 6, 6, 6, 6, 4, 4, 6, 5, 6, 6, 6, 7, 4 };
-			perft = { 4865609, 1073768, 4085603, 674624, 422333, 2103487, 3894594, 1063513, 1134888, 1015133, 1440467, 661072,
-					  803711, 1274206, 1720476, 3821001, 1004658, 217342, 92683, 2217, 567584, 23527};
-		}
-		else {
-			depth = { 4, 3, 3, 4, 3, 3, 3, 4, 5, 5, 5, 5, 5, 3, 3, 5, 4, 5, 6, 6, 7, 4 };
-			perft = { 197281, 32636, 97862, 43238, 9467, 62379, 89890, 85765, 185429, 135655, 206379, 120330,
-					  141077, 27826, 50509, 266199, 31961, 38983, 92683, 2217, 567584, 23527 };
+	if (deep) {
+		depth = { 5, 4, 4, 5, 4, 4, 4, 5, 6, 6, 6, 6, 6, 4, 4, 6, 5, 6, 6, 6, 7, 4 };
+		perft = { 4865609, 1073768, 4085603, 674624, 422333, 2103487, 3894594, 1063513, 1134888, 1015133, 1440467, 661072,
+				  803711, 1274206, 1720476, 3821001, 1004658, 217342, 92683, 2217, 567584, 23527};
+	}
+	else {
+		depth = { 4, 3, 3, 4, 3, 3, 3, 4, 5, 5, 5, 5, 5, 3, 3, 5, 4, 5, 6, 6, 7, 4 };
+		perft = { 197281, 32636, 97862, 43238, 9467, 62379, 89890, 85765, 185429, 135655, 206379, 120330,
+				  141077, 27826, 50509, 266199, 31961, 38983, 92683, 2217, 567584, 23527 };
+	}
+
+	if (compare) {
+		// Run all positions sequentially (timing async jobs is meaningless) with all make/unmake and move generation strategies
+		const int n_modes = 4;
+		const string mode_names[n_modes] = { "make/unmake", "copy-make", "make/unmake+incremental", "copy-make+incremental" };
+		double total[n_modes] = {};
+		int correct = 0;
+
+		for (int i = 0; i < fen_len; i++) {
+			cout << "perft(" << depth[i] << ") from position " << i << ":";
+			for (int mode = 0; mode < n_modes; mode++) {
+				Chess c(fen_list[i]);
+				c.set_copy_make(mode & 1);
+				c.set_incremental_moves(mode & 2);
+
+				auto start = std::chrono::steady_clock::now();
+				int result = c.perft(depth[i], false, false);
+				std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+				total[mode] += elapsed.count();
+				if (result == perft[i])
+					correct++;
+				else
+					cout << " (wrong: " << result << ")";
+				cout << '\t' << elapsed.count() << "s";
+			}
+			cout << endl;
 		}
 
+		cout << endl << "Perfts finished with " << correct << "/" << n_modes*fen_len << " runs correct!" << endl;
+		command_failed = correct < n_modes*fen_len;
+		int fastest = 0;
+		for (int mode = 0; mode < n_modes; mode++) {
+			cout << "Total " << mode_names[mode] << ": " << total[mode] << "s" << endl;
+			if (total[mode] < total[fastest])
+				fastest = mode;
+		}
+		cout << mode_names[fastest] << " is fastest on this platform";
+		cout << " (build with -DCHESS_COPY_MAKE=" << (fastest & 1) << " -DCHESS_INCREMENTAL_MOVES=" << (fastest >> 1) << " to make it the default)." << endl;
+	}
+	else if (runall) {
 		std::future<int> res[fen_len];
 		for (int i = 0; i < fen_len; i++) {
-			res[i] = std::async(std::launch::async, [&fen_list, &depth, i]() { return Chess(fen_list[i]).perft(depth[i], false, false); });
+			res[i] = std::async(std::launch::async, [&fen_list, &depth, i]() {
+				bind_thread(i);
+				return Chess(fen_list[i]).perft(depth[i], false, false);
+			});
 			cout << "Computing perft(" << depth[i] << ") from position " << i << ": " << fen_list[i] << endl;
 		}
 		cout << endl;
@@ -165,6 +1523,7 @@ void UCIReader::myPerft(bool runall, bool deep) {
 		}
 
 		cout << "Perfts finished with " << correct << "/" << fen_len << " positions correct!" << endl;
+		command_failed = correct < fen_len;
 
 
 
@@ -1,15 +1,72 @@
 #pragma once
 #include <string>
+#include <thread>
+#include <memory>
+#include "Chess.h"
+#include "PolyglotBook.h"
+#include "Syzygy.h"
+#include "EndgameTable.h"
+#include "Search.h"
+#include "Trace.h"
+#include "MateSolver.h"
 
 class UCIReader {
 private:
 	static const std::string ENGINENAME; 
 	static const std::string ENGINEAUTHOR;
 
-	static void myPerft(bool runall = false, bool deep = false);
+	// Engine state
+	static Chess game;
+	static PolyglotBook book;
+	static Syzygy tablebases;
+	static EndgameTablebase endgame_tables;
+	static Search search;
+	static MateSolver mate_solver;
+	static std::thread search_thread;
+	static std::unique_ptr<TraceBuffer> trace_buffer;		// Set while tracing is on
+	static bool command_failed;								// Set by the last command if it failed (exit status)
+
+	// Options
+	static bool own_book;
+	static bool book_best_move;
+	static std::string book_file;
+	static std::string syzygy_path;
+	static std::string egtb_path;
+	static int hash_mb;
+	static int multipv;
+	static int move_overhead;
+	static bool debug_mode;
+
+	static void myPerft(bool runall = false, bool deep = false, bool compare = false);
+
+	static void setOption(const std::string& args);
+	static void setPosition(const std::string& args);
+	static void go(const std::string& args);
+	static void loadBook();
+	static void generateTables(const std::string& args);
+	static void tablebaseCheck(const std::string& args);
+	static void stopSearch();
+	static void printInfo(const SearchInfo& info);
+	static void runMatch(const std::string& args);
+	static void generateData(const std::string& args);
+	static void batch(const std::string& args);
+	static void dataInfo(const std::string& args);
+	static void tuneEval(const std::string& args);
+	static void readPGN(const std::string& args);
+	static void bench(const std::string& args);
+	static void attackBench(const std::string& args);
+	static void profileCommand(const std::string& args);
+	static void traceCommand(const std::string& args);
+	static void traceView(const std::string& args);
+	static void perftServe(const std::string& args);
+	static void perftDivide(const std::string& args);
 
 public:
 	static void uciCommunication();
+	// Execute one command line. Returns false on quit.
+	static bool executeCommand(const std::string& inputLine);
+	// Whether the last command failed: bad arguments, files that could not be read or written, wrong perft results
+	static bool lastCommandFailed() { return command_failed; }
 };
 
 
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <iomanip>
 #include <vector>
 #include <algorithm>
 #include <cstdlib>
@@ -12,9 +13,26 @@ using namespace std;
 
 int main(int argc, char* argv[]) {
 
+	// Arguments are run as a single command (e.g. "engine bench 8 1 16"), otherwise talk UCI. An argument with spaces
+	// is passed quoted, so commands read it as one file name, engine command or FEN. The exit status is non-zero if
+	// the command failed.
+	if (argc > 1) {
+		ostringstream command;
+		command << argv[1];
+		for (int i = 2; i < argc; i++) {
+			string arg = argv[i];
+			command << ' ';
+			if (arg.empty() || arg.find_first_of(" \t\"") != string::npos)
+				command << quoted(arg);
+			else
+				command << arg;
+		}
+		UCIReader::executeCommand(command.str());
+		bool failed = UCIReader::lastCommandFailed();
+		UCIReader::executeCommand("quit");
+		return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
 	UCIReader::uciCommunication();
 	return 0;
-
-	
-	
 }